@@ -0,0 +1,302 @@
+/**
+ * Neptune Scanner - Allocation Counter
+ * bench_allocs.c - Checks that a running scan never calls the allocator
+ *
+ * Usage: bench_allocs
+ *
+ * Linked with -Wl,--wrap for malloc, calloc, realloc and free, so every call the scanner makes
+ * goes through the counters below. Each phase does its setup (scanner_reserve, engine and job
+ * creation, probe databases) with counting off, then counts allocator calls while the scan
+ * runs:
+ *
+ *   syn       the SYN engine over an in-process loopback transport, results into the scanner
+ *   connect   a thread-per-port connect scan of local ports, a few of them listening
+ *   services  service detection against a local server that sends an SSH banner, each
+ *             result recorded in a service table reserved for the run
+ *
+ * Calls made inside the C library (name resolution, thread creation) are not counted; --wrap
+ * only sees the scanner's own calls. The exit status is non-zero if any phase allocated.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/scanner.h"
+#include "../include/service_detection.h"
+#include "../include/service_probes.h"
+#include "../include/service_records.h"
+
+#define SYN_HOSTS 16
+#define SYN_PORTS 4096
+#define CONNECT_BASE_PORT 31000
+#define CONNECT_PORTS 256
+#define CONNECT_LISTENERS 16
+#define SERVICE_RUNS 20
+#define SERVICE_BANNER "SSH-2.0-OpenSSH_9.6p1 Ubuntu-3ubuntu13\r\n"
+#define SERVICE_DETAILS_MAX 8192
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static atomic_bool counting;
+static atomic_long allocator_calls;
+
+void *__wrap_malloc(size_t size)
+{
+  if (atomic_load(&counting))
+    atomic_fetch_add(&allocator_calls, 1);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+  if (atomic_load(&counting))
+    atomic_fetch_add(&allocator_calls, 1);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  if (atomic_load(&counting))
+    atomic_fetch_add(&allocator_calls, 1);
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+  if (atomic_load(&counting) && ptr)
+    atomic_fetch_add(&allocator_calls, 1);
+  __real_free(ptr);
+}
+
+static void start_counting(void)
+{
+  atomic_store(&allocator_calls, 0);
+  atomic_store(&counting, true);
+}
+
+static long stop_counting(void)
+{
+  atomic_store(&counting, false);
+  return atomic_load(&allocator_calls);
+}
+
+// Loopback transport: every SYN is answered at once, SYN-ACK on every third port, else RST
+typedef struct
+{
+  transport_t base;
+  int64_t now_us;
+  transport_reply_t pending[SYN_ENGINE_MAX_SLOTS];
+  int num_pending;
+} loopback_transport_t;
+
+static int64_t loopback_now(transport_t *transport)
+{
+  return ((loopback_transport_t *)transport)->now_us;
+}
+
+static bool loopback_send_syn(transport_t *transport, uint32_t addr, uint16_t port,
+                              uint16_t local_port)
+{
+  loopback_transport_t *loopback = (loopback_transport_t *)transport;
+  if (loopback->num_pending == SYN_ENGINE_MAX_SLOTS)
+    return false;
+  transport_reply_t *reply = &loopback->pending[loopback->num_pending++];
+  memset(reply, 0, sizeof(*reply));
+  reply->addr = addr;
+  reply->port = port;
+  reply->local_port = local_port;
+  reply->tcp.responded = true;
+  reply->tcp.ttl = 64;
+  reply->tcp.flags = port % 3 == 0 ? TCP_SYN | TCP_ACK : TCP_RST | TCP_ACK;
+  return true;
+}
+
+static int loopback_poll(transport_t *transport, transport_reply_t *replies, int max,
+                         int64_t timeout_us)
+{
+  loopback_transport_t *loopback = (loopback_transport_t *)transport;
+  loopback->now_us += loopback->num_pending > 0 ? 10 : timeout_us;
+  int count = loopback->num_pending < max ? loopback->num_pending : max;
+  memcpy(replies, loopback->pending + loopback->num_pending - count,
+         (size_t)count * sizeof(transport_reply_t));
+  loopback->num_pending -= count;
+  return count;
+}
+
+static void loopback_close(transport_t *transport)
+{
+  (void)transport;
+}
+
+static const transport_ops_t LOOPBACK_OPS = {loopback_now, loopback_send_syn, loopback_poll,
+                                             loopback_close};
+
+static void record_result(void *context, uint32_t addr, uint16_t port, port_state_t state,
+                          const os_response_t *reply)
+{
+  (void)context;
+  (void)addr;
+  (void)reply;
+  if (state == PORT_STATE_OPEN)
+    add_open_port(port);
+}
+
+static long run_syn_phase(int *found)
+{
+  static loopback_transport_t loopback = {.base = {&LOOPBACK_OPS}};
+  static uint16_t ports[SYN_PORTS];
+  for (int i = 0; i < SYN_PORTS; i++)
+    ports[i] = (uint16_t)(i + 1);
+
+  init_scanner();
+  scanner_reserve(SYN_HOSTS * SYN_PORTS);
+  syn_engine_config_t config;
+  syn_engine_default_config(&config);
+  syn_engine_t *engine = syn_engine_create(&loopback.base, &config);
+  if (!engine || !syn_engine_add_job(engine, htonl(0x0A000001), SYN_HOSTS, ports, SYN_PORTS, 1,
+                                     record_result, NULL))
+  {
+    fprintf(stderr, "Error: Cannot create the SYN engine\n");
+    exit(1);
+  }
+
+  start_counting();
+  while (syn_engine_busy(engine) && syn_engine_step(engine, -1))
+    ;
+  long calls = stop_counting();
+
+  *found = get_num_open_ports();
+  syn_engine_destroy(engine);
+  return calls;
+}
+
+static long run_connect_phase(int *found)
+{
+  int listeners[CONNECT_LISTENERS];
+  for (int i = 0; i < CONNECT_LISTENERS; i++)
+  {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(CONNECT_BASE_PORT + i * (CONNECT_PORTS / CONNECT_LISTENERS));
+    int one = 1;
+    listeners[i] = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listeners[i], SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listeners[i], (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listeners[i], 64) < 0)
+    {
+      fprintf(stderr, "Error: Cannot listen on port %d\n", ntohs(addr.sin_port));
+      exit(1);
+    }
+  }
+
+  init_scanner();
+  scanner_reserve(CONNECT_PORTS);
+  start_counting();
+  scan_ports("127.0.0.1", CONNECT_BASE_PORT, CONNECT_BASE_PORT + CONNECT_PORTS - 1, SCAN_CONNECT);
+  long calls = stop_counting();
+
+  *found = get_num_open_ports();
+  for (int i = 0; i < CONNECT_LISTENERS; i++)
+    close(listeners[i]);
+  return calls;
+}
+
+// Accepts connections and greets each with an SSH banner until the listener is closed
+static void *banner_server(void *arg)
+{
+  int listener = *(int *)arg;
+  int client;
+  while ((client = accept(listener, NULL, NULL)) >= 0)
+  {
+    ssize_t sent = send(client, SERVICE_BANNER, strlen(SERVICE_BANNER), 0);
+    (void)sent;
+    usleep(20000);
+    close(client);
+  }
+  return NULL;
+}
+
+static long run_services_phase(int *detected)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 16) < 0 ||
+      getsockname(listener, (struct sockaddr *)&addr, &len) < 0)
+  {
+    fprintf(stderr, "Error: Cannot start the banner server\n");
+    exit(1);
+  }
+  pthread_t server;
+  pthread_create(&server, NULL, banner_server, &listener);
+
+  load_default_service_probes();
+  ServiceInfo *info = malloc(sizeof(ServiceInfo));
+  service_table_t services;
+  service_table_init(&services);
+  if (!info || !service_detection_reserve() ||
+      !service_table_reserve(&services, SERVICE_RUNS, SERVICE_DETAILS_MAX))
+  {
+    fprintf(stderr, "Error: Out of memory\n");
+    exit(1);
+  }
+
+  *detected = 0;
+  bool recorded = true;
+  start_counting();
+  for (int i = 0; i < SERVICE_RUNS; i++)
+  {
+    *detected += detect_service("127.0.0.1", ntohs(addr.sin_port), info);
+    recorded = service_table_add(&services, info, NULL) && recorded;
+  }
+  long calls = stop_counting();
+  if (!recorded)
+  {
+    fprintf(stderr, "Error: Could not record the services\n");
+    exit(1);
+  }
+
+  shutdown(listener, SHUT_RDWR);
+  close(listener);
+  pthread_join(server, NULL);
+  service_table_free(&services);
+  free(info);
+  return calls;
+}
+
+int main(void)
+{
+  int syn_found, connect_found, services_detected;
+  long syn_calls = run_syn_phase(&syn_found);
+  long connect_calls = run_connect_phase(&connect_found);
+  long services_calls = run_services_phase(&services_detected);
+  cleanup_scanner();
+
+  printf("%-10s %10s  %s\n", "phase", "allocs", "work");
+  printf("%-10s %10ld  %d probes, %d open\n", "syn", syn_calls, SYN_HOSTS * SYN_PORTS,
+         syn_found);
+  printf("%-10s %10ld  %d probes, %d open\n", "connect", connect_calls, CONNECT_PORTS,
+         connect_found);
+  printf("%-10s %10ld  %d detections, %d identified\n", "services", services_calls,
+         SERVICE_RUNS, services_detected);
+
+  bool ok = syn_calls == 0 && connect_calls == 0 && services_calls == 0;
+  if (!ok)
+    fprintf(stderr, "FAIL: the allocator was called while scanning\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+/**
+ * Neptune Scanner - Banner Identification Benchmark
+ * bench_identify.c - Measures identify_service throughput and accuracy on a banner corpus
+ *
+ * Usage: bench_identify [corpus] [iterations]
+ *
+ * Every banner in the corpus is identified once to check the result against the expected
+ * protocol and service name, then the whole corpus is identified 'iterations' times to measure
+ * throughput. TLS entries are skipped. The exit status is non-zero if any banner is
+ * misidentified.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/service_detection.h"
+#include "corpus.h"
+
+#define DEFAULT_CORPUS "bench/corpus/banners.txt"
+#define DEFAULT_ITERATIONS 20000
+
+static corpus_entry_t corpus[MAX_CORPUS_ENTRIES];
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void identify(const corpus_entry_t *entry, ServiceInfo *info)
+{
+  memset(info, 0, sizeof(*info));
+  snprintf(info->banner, sizeof(info->banner), "%s", entry->banner);
+  identify_service(info);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = argc > 1 ? argv[1] : DEFAULT_CORPUS;
+  long iterations = argc > 2 ? atol(argv[2]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    iterations = DEFAULT_ITERATIONS;
+
+  // TLS services are identified by their handshake, not by a banner
+  int loaded = load_corpus(path, corpus, MAX_CORPUS_ENTRIES);
+  int count = 0;
+  for (int i = 0; i < loaded; i++)
+  {
+    if (!corpus_entry_is_tls(&corpus[i]))
+      corpus[count++] = corpus[i];
+  }
+  if (count <= 0)
+  {
+    fprintf(stderr, "Error: Could not read banners from %s\n", path);
+    return 1;
+  }
+
+  // Accuracy: every banner must be identified as the corpus says
+  int mismatches = 0;
+  ServiceInfo info;
+  for (int i = 0; i < count; i++)
+  {
+    identify(&corpus[i], &info);
+    if (strcmp(info.protocol, corpus[i].protocol) != 0 ||
+        strcmp(info.service_name, corpus[i].service_name) != 0)
+    {
+      fprintf(stderr, "Mismatch on entry %d: expected %s/%s, got %s/%s\n", i + 1,
+              corpus[i].protocol, corpus[i].service_name, info.protocol, info.service_name);
+      mismatches++;
+    }
+  }
+
+  // Throughput: identify the whole corpus repeatedly
+  size_t bytes = 0;
+  for (int i = 0; i < count; i++)
+    bytes += strlen(corpus[i].banner);
+
+  double start = now_seconds();
+  for (long iter = 0; iter < iterations; iter++)
+    for (int i = 0; i < count; i++)
+      identify(&corpus[i], &info);
+  double elapsed = now_seconds() - start;
+
+  double total = (double)iterations * count;
+  printf("Corpus:      %s (%d banners, %zu bytes)\n", path, count, bytes);
+  printf("Accuracy:    %d/%d identified as expected\n", count - mismatches, count);
+  printf("Iterations:  %ld\n", iterations);
+  printf("Elapsed:     %.3f s\n", elapsed);
+  printf("Throughput:  %.0f banners/s (%.1f MB/s)\n", total / elapsed,
+         (double)iterations * bytes / elapsed / 1e6);
+  printf("Latency:     %.0f ns/banner\n", elapsed * 1e9 / total);
+
+  return mismatches ? 1 : 0;
+}
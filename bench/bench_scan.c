@@ -0,0 +1,422 @@
+/**
+ * Neptune Scanner - Scan Engine Benchmark
+ * bench_scan.c - Measures scan throughput, latency, CPU and memory against a local responder
+ *
+ * Usage: bench_scan [-n open] [-c closed] [-p base_port] [-e engines] [-s samples]
+ *                   [-r responder] [-o output.json] [-b baseline.json] [-t tolerance]
+ *
+ * Starts bench/responder with 'open' listeners from base_port, then runs each engine (a
+ * comma-separated list of "connect" and "syn") over the open ports plus 'closed' ports above
+ * them. Every engine runs in its own child process so that its CPU time and peak RSS are its
+ * own. The whole range is scanned once for throughput and accuracy; then 'samples' ports spread
+ * over the range are probed one at a time for per-port latency percentiles.
+ *
+ * Results are written as JSON to stdout (and to -o). With -b, each engine's throughput is
+ * compared with the same engine in a previous run's JSON, and the exit status is non-zero if it
+ * dropped by more than 'tolerance' percent. The exit status is also non-zero if an engine
+ * misreports an open port. The syn engine needs raw sockets and is skipped without them.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/advanced_scan.h"
+#include "../include/scanner.h"
+
+#define DEFAULT_OPEN 1000
+#define DEFAULT_BASE_PORT 20000
+#define DEFAULT_SAMPLES 200
+#define DEFAULT_TOLERANCE 20.0
+#define DEFAULT_RESPONDER "bench/responder"
+#define BENCH_TARGET "127.0.0.1"
+#define MAX_ENGINES 4
+
+// Scan engines that can be benchmarked
+static const struct
+{
+  const char *name;
+  scan_type_t scan_type;
+} ENGINES[] = {{"connect", SCAN_CONNECT}, {"syn", SCAN_SYN}};
+
+// Measurements sent back from an engine's child process
+typedef struct
+{
+  int open_found;   // Open ports reported by the scan
+  int false_open;   // Reported open ports outside the responder's range
+  double seconds;   // Wall time of the full scan
+  double p50_us;    // Median single-port latency
+  double p99_us;    // 99th percentile single-port latency
+  int samples;      // Latency samples taken
+} engine_result_t;
+
+// One engine's complete result as reported
+typedef struct
+{
+  const char *name;
+  bool skipped;
+  engine_result_t result;
+  double cpu_seconds;
+  long max_rss_kb;
+} engine_report_t;
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Start the responder and wait for its "ready" line; its stdin is a pipe we hold open
+static pid_t start_responder(const char *path, int open_ports, int base_port, int *control_fd)
+{
+  int to_child[2], from_child[2];
+  if (pipe(to_child) < 0 || pipe(from_child) < 0)
+    return -1;
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    dup2(to_child[0], STDIN_FILENO);
+    dup2(from_child[1], STDOUT_FILENO);
+    close(to_child[1]);
+    close(from_child[0]);
+    char listeners[16], port[16];
+    snprintf(listeners, sizeof(listeners), "%d", open_ports);
+    snprintf(port, sizeof(port), "%d", base_port);
+    execl(path, path, "-n", listeners, "-p", port, (char *)NULL);
+    _exit(127);
+  }
+  close(to_child[0]);
+  close(from_child[1]);
+  if (pid < 0)
+    return -1;
+
+  char line[32] = "";
+  FILE *out = fdopen(from_child[0], "r");
+  if (!out || !fgets(line, sizeof(line), out) || strncmp(line, "ready", 5) != 0)
+  {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  fclose(out);
+
+  *control_fd = to_child[1];
+  return pid;
+}
+
+// Child side: scan the range, sample latencies and report through the pipe
+static void run_engine(scan_type_t scan_type, int base_port, int open_ports, int closed_ports,
+                       int samples, int result_fd)
+{
+  engine_result_t result;
+  memset(&result, 0, sizeof(result));
+  int last_port = base_port + open_ports + closed_ports - 1;
+
+  init_scanner();
+  scanner_reserve(open_ports + closed_ports);
+  double start = now_seconds();
+  scan_ports(BENCH_TARGET, base_port, last_port, scan_type);
+  result.seconds = now_seconds() - start;
+
+  int found = get_num_open_ports();
+  const int *ports = get_open_ports();
+  for (int i = 0; ports && i < found; i++)
+  {
+    if (ports[i] < base_port + open_ports)
+      result.open_found++;
+    else
+      result.false_open++;
+  }
+
+  double *latencies = malloc((size_t)(samples > 0 ? samples : 1) * sizeof(double));
+  int range = open_ports + closed_ports;
+  for (int i = 0; latencies && i < samples; i++)
+  {
+    int port = base_port + (int)((long)i * range / samples);
+    double t = now_seconds();
+    is_port_open(BENCH_TARGET, port, scan_type);
+    latencies[result.samples++] = (now_seconds() - t) * 1e6;
+  }
+  if (result.samples > 0)
+  {
+    qsort(latencies, (size_t)result.samples, sizeof(double), compare_doubles);
+    result.p50_us = latencies[result.samples / 2];
+    result.p99_us = latencies[(result.samples * 99) / 100];
+  }
+  free(latencies);
+
+  ssize_t written = write(result_fd, &result, sizeof(result));
+  _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+}
+
+// Run one engine in a child process and collect its measurements and resource usage
+static bool measure_engine(scan_type_t scan_type, int base_port, int open_ports, int closed_ports,
+                           int samples, engine_report_t *report)
+{
+  int fds[2];
+  if (pipe(fds) < 0)
+    return false;
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    close(fds[0]);
+    run_engine(scan_type, base_port, open_ports, closed_ports, samples, fds[1]);
+  }
+  close(fds[1]);
+  if (pid < 0)
+  {
+    close(fds[0]);
+    return false;
+  }
+
+  ssize_t got = read(fds[0], &report->result, sizeof(report->result));
+  close(fds[0]);
+
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0 || got != (ssize_t)sizeof(report->result))
+    return false;
+
+  report->cpu_seconds = (double)usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                        (double)usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  report->max_rss_kb = usage.ru_maxrss;
+  return true;
+}
+
+// Find an engine's ports_per_sec in a previous run's JSON; returns a negative value if absent
+static double baseline_throughput(const char *json, const char *engine)
+{
+  char key[64];
+  snprintf(key, sizeof(key), "\"name\": \"%s\"", engine);
+  const char *entry = strstr(json, key);
+  if (!entry)
+    return -1;
+  const char *field = strstr(entry, "\"ports_per_sec\":");
+  if (!field)
+    return -1;
+  return strtod(field + 16, NULL);
+}
+
+static char *read_file(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return NULL;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *buffer = size >= 0 ? malloc((size_t)size + 1) : NULL;
+  if (buffer)
+    buffer[fread(buffer, 1, (size_t)size, file)] = '\0';
+  fclose(file);
+  return buffer;
+}
+
+static void write_json(FILE *out, int open_ports, int closed_ports, const engine_report_t *reports,
+                       int count)
+{
+  fprintf(out, "{\n  \"target\": \"%s\",\n  \"open_ports\": %d,\n  \"closed_ports\": %d,\n",
+          BENCH_TARGET, open_ports, closed_ports);
+  fprintf(out, "  \"engines\": [\n");
+  for (int i = 0; i < count; i++)
+  {
+    const engine_report_t *r = &reports[i];
+    fprintf(out, "    {\n      \"name\": \"%s\",\n", r->name);
+    if (r->skipped)
+    {
+      fprintf(out, "      \"skipped\": true\n    }%s\n", i + 1 < count ? "," : "");
+      continue;
+    }
+    int scanned = open_ports + closed_ports;
+    fprintf(out, "      \"seconds\": %.3f,\n", r->result.seconds);
+    fprintf(out, "      \"ports_per_sec\": %.1f,\n",
+            r->result.seconds > 0 ? scanned / r->result.seconds : 0.0);
+    fprintf(out, "      \"open_found\": %d,\n      \"false_open\": %d,\n", r->result.open_found,
+            r->result.false_open);
+    fprintf(out, "      \"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"samples\": %d},\n",
+            r->result.p50_us, r->result.p99_us, r->result.samples);
+    fprintf(out, "      \"cpu_seconds\": %.3f,\n      \"max_rss_kb\": %ld\n", r->cpu_seconds,
+            r->max_rss_kb);
+    fprintf(out, "    }%s\n", i + 1 < count ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int open_ports = DEFAULT_OPEN;
+  int closed_ports = -1;
+  int base_port = DEFAULT_BASE_PORT;
+  int samples = DEFAULT_SAMPLES;
+  double tolerance = DEFAULT_TOLERANCE;
+  char engines[64] = "connect,syn";
+  const char *responder = DEFAULT_RESPONDER;
+  const char *output = NULL;
+  const char *baseline = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:c:p:e:s:r:o:b:t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      open_ports = atoi(optarg);
+      break;
+    case 'c':
+      closed_ports = atoi(optarg);
+      break;
+    case 'p':
+      base_port = atoi(optarg);
+      break;
+    case 'e':
+      snprintf(engines, sizeof(engines), "%s", optarg);
+      break;
+    case 's':
+      samples = atoi(optarg);
+      break;
+    case 'r':
+      responder = optarg;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'b':
+      baseline = optarg;
+      break;
+    case 't':
+      tolerance = atof(optarg);
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-n open] [-c closed] [-p base_port] [-e engines] [-s samples]\n"
+              "       [-r responder] [-o output.json] [-b baseline.json] [-t tolerance]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (closed_ports < 0)
+    closed_ports = open_ports;
+  if (open_ports < 1 || samples < 0 || base_port < 1 ||
+      base_port + open_ports + closed_ports > 65536)
+  {
+    fprintf(stderr, "Error: The port range must fit below port 65536\n");
+    return 1;
+  }
+
+  // The scanner opens a socket per port in flight
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  int control_fd;
+  pid_t responder_pid = start_responder(responder, open_ports, base_port, &control_fd);
+  if (responder_pid < 0)
+  {
+    fprintf(stderr, "Error: Could not start %s\n", responder);
+    return 1;
+  }
+
+  engine_report_t reports[MAX_ENGINES];
+  int count = 0;
+  int status = 0;
+  for (char *name = strtok(engines, ","); name && count < MAX_ENGINES; name = strtok(NULL, ","))
+  {
+    size_t e = 0;
+    while (e < sizeof(ENGINES) / sizeof(ENGINES[0]) && strcmp(ENGINES[e].name, name) != 0)
+      e++;
+    if (e == sizeof(ENGINES) / sizeof(ENGINES[0]))
+    {
+      fprintf(stderr, "Warning: Unknown engine %s\n", name);
+      continue;
+    }
+
+    engine_report_t *report = &reports[count++];
+    memset(report, 0, sizeof(*report));
+    report->name = ENGINES[e].name;
+    if (ENGINES[e].scan_type == SCAN_SYN && !raw_sockets_available())
+    {
+      fprintf(stderr, "Skipping %s: raw sockets need root privileges\n", name);
+      report->skipped = true;
+      continue;
+    }
+
+    fprintf(stderr, "Running %s engine over %d ports...\n", name, open_ports + closed_ports);
+    if (!measure_engine(ENGINES[e].scan_type, base_port, open_ports, closed_ports, samples,
+                        report))
+    {
+      fprintf(stderr, "Error: The %s engine did not report results\n", name);
+      report->skipped = true;
+      status = 1;
+      continue;
+    }
+    if (report->result.open_found != open_ports || report->result.false_open != 0)
+    {
+      fprintf(stderr, "Accuracy: %s found %d of %d open ports (%d false positives)\n", name,
+              report->result.open_found, open_ports, report->result.false_open);
+      status = 1;
+    }
+  }
+
+  close(control_fd);
+  kill(responder_pid, SIGTERM);
+  waitpid(responder_pid, NULL, 0);
+
+  write_json(stdout, open_ports, closed_ports, reports, count);
+  if (output)
+  {
+    FILE *file = fopen(output, "w");
+    if (file)
+    {
+      write_json(file, open_ports, closed_ports, reports, count);
+      fclose(file);
+    }
+    else
+    {
+      fprintf(stderr, "Error: Could not write %s\n", output);
+      status = 1;
+    }
+  }
+
+  // Compare throughput with the baseline run
+  char *previous = baseline ? read_file(baseline) : NULL;
+  if (baseline && !previous)
+    fprintf(stderr, "Warning: Could not read baseline %s\n", baseline);
+  for (int i = 0; previous && i < count; i++)
+  {
+    double before = baseline_throughput(previous, reports[i].name);
+    if (reports[i].skipped || before <= 0)
+      continue;
+    double after = (open_ports + closed_ports) / reports[i].result.seconds;
+    double change = (after - before) * 100.0 / before;
+    fprintf(stderr, "%-8s %10.1f ports/s (baseline %.1f, %+.1f%%)\n", reports[i].name, after,
+            before, change);
+    if (change < -tolerance)
+    {
+      fprintf(stderr, "Regression: %s is more than %.0f%% slower than the baseline\n",
+              reports[i].name, tolerance);
+      status = 1;
+    }
+  }
+  free(previous);
+
+  return status;
+}
@@ -0,0 +1,300 @@
+/**
+ * Neptune Scanner - Service Detection Benchmark
+ * bench_services.c - Measures service detection throughput and accuracy against the service zoo
+ *
+ * Usage: bench_services [-c corpus] [-z zoo] [-p base_port] [-m mode] [-i iterations]
+ *                       [-j workers] [-d delay_ms] [-f fragment] [-g gap_ms]
+ *
+ * Starts bench/service_zoo on the corpus (passing on -d, -f and -g), so that every corpus entry
+ * is a live service on its own port. Each service is detected once to check the result against
+ * the corpus, then the whole zoo is detected 'iterations' times by 'workers' threads to measure
+ * identifications per second and per-service latency.
+ *
+ * Mode "service" (the default) runs detect_service and expects the protocol and service name
+ * the corpus gives for it (see corpus.h). Mode "protocol" runs the detector for the entry's protocol (detect_ssh,
+ * detect_ftp, detect_http, detect_telnet or detect_tls; detect_service for the rest) and expects
+ * it to succeed. The exit status is non-zero if any service is misidentified.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/config.h"
+#include "../include/http_probe.h"
+#include "../include/service_detection.h"
+#include "../include/service_probes.h"
+#include "../include/services.h"
+#include "corpus.h"
+
+#define DEFAULT_CORPUS "bench/corpus/banners.txt"
+#define DEFAULT_ZOO "bench/service_zoo"
+#define DEFAULT_BASE_PORT 31000
+#define MAX_WORKERS 64
+#define ZOO_TARGET "127.0.0.1"
+
+typedef bool (*detect_fn)(const char *target, int port, ServiceInfo *service_info);
+
+typedef struct
+{
+  const char *mode;        // "service" or "protocol"
+  int base_port;
+  int count;               // Corpus entries
+  long total;              // Detections to run in the throughput pass
+  long next;               // Next detection to hand out
+  double *latencies;       // Per-detection latency in microseconds, indexed by detection
+  pthread_mutex_t lock;
+} run_t;
+
+static corpus_entry_t corpus[MAX_CORPUS_ENTRIES];
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Start the zoo and wait for its "ready" line; its stdin is a pipe we hold open
+static pid_t start_zoo(char *const argv[], int *control_fd)
+{
+  int to_child[2], from_child[2];
+  if (pipe(to_child) < 0 || pipe(from_child) < 0)
+    return -1;
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    dup2(to_child[0], STDIN_FILENO);
+    dup2(from_child[1], STDOUT_FILENO);
+    close(to_child[1]);
+    close(from_child[0]);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+  close(to_child[0]);
+  close(from_child[1]);
+  if (pid < 0)
+    return -1;
+
+  char line[32] = "";
+  FILE *out = fdopen(from_child[0], "r");
+  if (!out || !fgets(line, sizeof(line), out) || strncmp(line, "ready", 5) != 0)
+  {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  fclose(out);
+
+  *control_fd = to_child[1];
+  return pid;
+}
+
+// Detector for an entry's protocol in "protocol" mode
+static detect_fn protocol_detector(const corpus_entry_t *entry)
+{
+  if (corpus_entry_is_tls(entry))
+    return detect_tls;
+  if (strcmp(entry->protocol, "SSH") == 0)
+    return detect_ssh;
+  if (strcmp(entry->protocol, "FTP") == 0)
+    return detect_ftp;
+  if (strcmp(entry->protocol, "HTTP") == 0)
+    return detect_http;
+  if (strcmp(entry->protocol, "Telnet") == 0)
+    return detect_telnet;
+  return detect_service;
+}
+
+// Detect one zoo service; returns whether the result is what the corpus expects
+static bool detect(const run_t *run, int index, ServiceInfo *info)
+{
+  const corpus_entry_t *entry = &corpus[index];
+  int port = run->base_port + index;
+
+  memset(info, 0, sizeof(*info));
+  info->port = port;
+  if (strcmp(run->mode, "protocol") == 0)
+    return protocol_detector(entry)(ZOO_TARGET, port, info);
+
+  detect_service(ZOO_TARGET, port, info);
+  return strcmp(info->protocol, entry->detected_protocol) == 0 &&
+         strcmp(info->service_name, entry->detected_service_name) == 0;
+}
+
+static void *worker(void *arg)
+{
+  run_t *run = arg;
+  ServiceInfo info;
+  for (;;)
+  {
+    pthread_mutex_lock(&run->lock);
+    long n = run->next < run->total ? run->next++ : -1;
+    pthread_mutex_unlock(&run->lock);
+    if (n < 0)
+      break;
+
+    double start = now_seconds();
+    detect(run, (int)(n % run->count), &info);
+    run->latencies[n] = (now_seconds() - start) * 1e6;
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = DEFAULT_CORPUS;
+  const char *zoo = DEFAULT_ZOO;
+  const char *mode = "service";
+  const char *delay = "0";
+  const char *fragment = "0";
+  const char *gap = "0";
+  int base_port = DEFAULT_BASE_PORT;
+  long iterations = 1;
+  int workers = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:z:p:m:i:j:d:f:g:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      path = optarg;
+      break;
+    case 'z':
+      zoo = optarg;
+      break;
+    case 'p':
+      base_port = atoi(optarg);
+      break;
+    case 'm':
+      mode = optarg;
+      break;
+    case 'i':
+      iterations = atol(optarg);
+      break;
+    case 'j':
+      workers = atoi(optarg);
+      break;
+    case 'd':
+      delay = optarg;
+      break;
+    case 'f':
+      fragment = optarg;
+      break;
+    case 'g':
+      gap = optarg;
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-c corpus] [-z zoo] [-p base_port] [-m service|protocol] "
+              "[-i iterations] [-j workers] [-d delay_ms] [-f fragment] [-g gap_ms]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if ((strcmp(mode, "service") != 0 && strcmp(mode, "protocol") != 0) || iterations < 1 ||
+      workers < 1 || workers > MAX_WORKERS)
+  {
+    fprintf(stderr, "Error: mode must be service or protocol, iterations at least 1 and "
+                    "workers 1-%d\n", MAX_WORKERS);
+    return 1;
+  }
+
+  int count = load_corpus(path, corpus, MAX_CORPUS_ENTRIES);
+  if (count <= 0)
+  {
+    fprintf(stderr, "Error: Could not read banners from %s\n", path);
+    return 1;
+  }
+
+  char port[16];
+  snprintf(port, sizeof(port), "%d", base_port);
+  char *zoo_argv[] = {(char *)zoo, "-c", (char *)path, "-p", port, "-d", (char *)delay,
+                      "-f", (char *)fragment, "-g", (char *)gap, NULL};
+  int control_fd;
+  pid_t zoo_pid = start_zoo(zoo_argv, &control_fd);
+  if (zoo_pid < 0)
+  {
+    fprintf(stderr, "Error: Could not start %s\n", zoo);
+    return 1;
+  }
+
+  // The scanner's databases, loaded as main does and before any thread starts
+  load_services_db(SERVICES_DB_FILE);
+  if (!load_service_probes(SERVICE_PROBES_FILE))
+    load_default_service_probes();
+  if (!load_http_requests(HTTP_REQUESTS_FILE))
+    load_default_http_requests();
+
+  run_t run;
+  memset(&run, 0, sizeof(run));
+  run.mode = mode;
+  run.base_port = base_port;
+  run.count = count;
+  run.total = iterations * count;
+  run.latencies = malloc((size_t)run.total * sizeof(double));
+  pthread_mutex_init(&run.lock, NULL);
+  if (!run.latencies)
+  {
+    close(control_fd);
+    waitpid(zoo_pid, NULL, 0);
+    return 1;
+  }
+
+  // Accuracy: every service must be identified as the corpus says
+  int mismatches = 0;
+  ServiceInfo info;
+  for (int i = 0; i < count; i++)
+  {
+    if (!detect(&run, i, &info))
+    {
+      fprintf(stderr, "Mismatch on entry %d (port %d): expected %s/%s, got %s/%s\n", i + 1,
+              base_port + i, corpus[i].detected_protocol, corpus[i].detected_service_name,
+              info.protocol, info.service_name);
+      mismatches++;
+    }
+  }
+
+  // Throughput: detect the whole zoo repeatedly
+  pthread_t threads[MAX_WORKERS];
+  double start = now_seconds();
+  for (int i = 0; i < workers; i++)
+    pthread_create(&threads[i], NULL, worker, &run);
+  for (int i = 0; i < workers; i++)
+    pthread_join(threads[i], NULL);
+  double elapsed = now_seconds() - start;
+
+  close(control_fd);
+  waitpid(zoo_pid, NULL, 0);
+
+  qsort(run.latencies, (size_t)run.total, sizeof(double), compare_doubles);
+  printf("Corpus:      %s (%d services on ports %d-%d)\n", path, count, base_port,
+         base_port + count - 1);
+  printf("Mode:        %s, delay %s ms, fragments of %s bytes every %s ms\n", mode, delay,
+         fragment, gap);
+  printf("Accuracy:    %d/%d identified as expected\n", count - mismatches, count);
+  printf("Detections:  %ld (%ld iterations, %d workers)\n", run.total, iterations, workers);
+  printf("Elapsed:     %.3f s\n", elapsed);
+  printf("Throughput:  %.1f identifications/s\n", (double)run.total / elapsed);
+  printf("Latency:     p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+         run.latencies[run.total / 2] / 1e3, run.latencies[(run.total * 99) / 100] / 1e3,
+         run.latencies[run.total - 1] / 1e3);
+
+  free(run.latencies);
+  unload_services_db();
+  pthread_mutex_destroy(&run.lock);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/**
+ * Neptune Scanner - Simulated Network Benchmark
+ * bench_sim.c - Runs the SYN engine against simulated networks and checks it against ground truth
+ *
+ * Usage: bench_sim [scenario]
+ *
+ * Each scenario describes a simulated network and the engine settings to scan it with. The
+ * engine runs on the simulator's virtual clock, so a scan of a million hosts finishes in seconds
+ * and every run is identical. For each scenario the virtual scan time, probe counts, the
+ * simulator's view of what happened, and accuracy against the simulator's ground truth are
+ * printed, along with the wall time the run took. The exit status is non-zero if any scenario
+ * reports a closed port as open or misses more open ports than it allows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "../include/net_sim.h"
+#include "../include/syn_engine.h"
+
+typedef struct
+{
+  const char *name;
+  const char *description;
+  net_sim_config_t network;
+  uint16_t ports[8];      // Ports to scan; none means all 65536
+  int num_ports;
+  int rate;               // Engine rate limit in probes/s, 0 for none
+  int max_outstanding;
+  int retries;
+  int timeout_ms;
+  double max_missed_open; // Fraction of open ports that may be missed (loss causes some misses)
+} scenario_t;
+
+static const uint16_t WEB_PORTS[] = {22, 80, 443};
+
+// Network fields left out are zero: no loss, no firewalls, no RST limit
+static const scenario_t SCENARIOS[] = {
+    {.name = "internet",
+     .description = "2^20 hosts, 5% up, 30% of ports open, 40% firewalled, 1% loss, 20-220 ms RTT",
+     .network = {.num_hosts = 1u << 20, .host_up = 0.05, .port_open_rate = 0.3, .firewalled = 0.4,
+                 .rtt_us = 20000, .rtt_spread_us = 200000, .rtt_jitter_us = 5000, .loss = 0.01,
+                 .seed = 1},
+     .ports = {80, 443},
+     .num_ports = 2,
+     .max_outstanding = 16384,
+     .retries = 1,
+     .timeout_ms = 1000,
+     .max_missed_open = 0.002},
+    {.name = "lossy",
+     .description = "4096 hosts, all up, 3 of 8 ports open, 10% loss each way",
+     .network = {.num_hosts = 4096, .host_up = 1.0, .open_ports = WEB_PORTS, .num_open_ports = 3,
+                 .rtt_us = 5000, .rtt_spread_us = 5000, .rtt_jitter_us = 1000, .loss = 0.10,
+                 .seed = 2},
+     .ports = {21, 22, 23, 25, 80, 110, 143, 443},
+     .num_ports = 8,
+     .max_outstanding = 4096,
+     .retries = 3,
+     .timeout_ms = 200,
+     .max_missed_open = 0.005},
+    {.name = "rst-limited",
+     .description = "one host, all 65536 ports, RSTs limited to 200/s, engine unpaced",
+     .network = {.num_hosts = 1, .host_up = 1.0, .open_ports = WEB_PORTS, .num_open_ports = 3,
+                 .rtt_us = 1000, .rtt_jitter_us = 200, .rst_per_sec = 200, .seed = 3},
+     .max_outstanding = 4096,
+     .retries = 1,
+     .timeout_ms = 500},
+    {.name = "rst-paced",
+     .description = "the same host, engine paced to the RST limit",
+     .network = {.num_hosts = 1, .host_up = 1.0, .open_ports = WEB_PORTS, .num_open_ports = 3,
+                 .rtt_us = 1000, .rtt_jitter_us = 200, .rst_per_sec = 200, .seed = 3},
+     .rate = 200,
+     .max_outstanding = 4096,
+     .retries = 1,
+     .timeout_ms = 500},
+};
+
+typedef struct
+{
+  const transport_t *network;
+  uint64_t true_open;  // Reported open and really open
+  uint64_t false_open; // Reported open but closed
+  uint64_t closed;
+  uint64_t filtered;
+} tally_t;
+
+static void tally_result(void *context, uint32_t addr, uint16_t port, port_state_t state,
+                         const os_response_t *reply)
+{
+  tally_t *tally = context;
+  (void)reply;
+  if (state == PORT_STATE_OPEN)
+  {
+    if (net_sim_port_open(tally->network, addr, port))
+      tally->true_open++;
+    else
+      tally->false_open++;
+  }
+  else if (state == PORT_STATE_CLOSED)
+  {
+    tally->closed++;
+  }
+  else
+  {
+    tally->filtered++;
+  }
+}
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Run one scenario; returns false if its accuracy is out of bounds
+static bool run_scenario(const scenario_t *scenario)
+{
+  net_sim_config_t network = scenario->network;
+  network.first_addr = inet_addr("10.0.0.0");
+
+  // A scenario without a port list scans every port
+  uint16_t *ports = NULL;
+  int num_ports = scenario->num_ports;
+  if (num_ports == 0)
+  {
+    num_ports = 65536;
+    ports = malloc((size_t)num_ports * sizeof(uint16_t));
+    if (!ports)
+      return false;
+    for (int i = 0; i < num_ports; i++)
+      ports[i] = (uint16_t)i;
+  }
+  const uint16_t *scan_ports = ports ? ports : scenario->ports;
+
+  transport_t *transport = net_sim_open(&network);
+  if (!transport)
+  {
+    free(ports);
+    return false;
+  }
+
+  // Ground truth over everything the scan will cover
+  uint64_t expected_open = 0;
+  for (uint32_t h = 0; h < network.num_hosts; h++)
+  {
+    uint32_t addr = htonl(ntohl(network.first_addr) + h);
+    for (int p = 0; p < num_ports; p++)
+      expected_open += net_sim_port_open(transport, addr, scan_ports[p]);
+  }
+
+  syn_engine_config_t config;
+  syn_engine_default_config(&config);
+  config.rate = scenario->rate;
+  config.max_outstanding = scenario->max_outstanding;
+  config.retries = scenario->retries;
+  config.timeout_us = (int64_t)scenario->timeout_ms * 1000;
+
+  tally_t tally = {transport, 0, 0, 0, 0};
+  syn_engine_stats_t stats;
+  double start = now_seconds();
+  bool ran = syn_engine_run(transport, &config, network.first_addr, network.num_hosts, scan_ports,
+                            num_ports, tally_result, &tally, &stats);
+  double wall = now_seconds() - start;
+
+  net_sim_stats_t sim;
+  net_sim_get_stats(transport, &sim);
+  transport->ops->close(transport);
+  free(ports);
+
+  uint64_t missed = expected_open - tally.true_open;
+  double missed_fraction = expected_open ? (double)missed / (double)expected_open : 0.0;
+  bool ok = ran && tally.false_open == 0 && missed_fraction <= scenario->max_missed_open;
+
+  printf("%s: %s\n", scenario->name, scenario->description);
+  printf("  targets:     %llu (%u hosts x %d ports)\n",
+         (unsigned long long)network.num_hosts * (unsigned long long)num_ports, network.num_hosts,
+         num_ports);
+  printf("  virtual:     %.3f s, %.0f probes/s\n", stats.elapsed_us / 1e6,
+         stats.elapsed_us > 0 ? stats.sent * 1e6 / (double)stats.elapsed_us : 0.0);
+  printf("  wall:        %.3f s, %.0f probes/s\n", wall, wall > 0 ? stats.sent / wall : 0.0);
+  printf("  engine:      %llu sent, %llu retransmitted, %llu unmatched replies\n",
+         (unsigned long long)stats.sent, (unsigned long long)stats.retransmits,
+         (unsigned long long)stats.unmatched);
+  printf("  results:     %llu open, %llu closed, %llu filtered\n", (unsigned long long)stats.open,
+         (unsigned long long)stats.closed, (unsigned long long)stats.filtered);
+  printf("  network:     %llu lost, %llu RSTs rate limited, %llu unanswered\n",
+         (unsigned long long)sim.lost, (unsigned long long)sim.rst_limited,
+         (unsigned long long)sim.unanswered);
+  printf("  accuracy:    %llu/%llu open found (%.3f%% missed, %.3f%% allowed), %llu false open"
+         "%s\n\n",
+         (unsigned long long)tally.true_open, (unsigned long long)expected_open,
+         missed_fraction * 100, scenario->max_missed_open * 100,
+         (unsigned long long)tally.false_open, ok ? "" : "  FAILED");
+  return ok;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *only = argc > 1 ? argv[1] : NULL;
+  int failures = 0;
+  int run = 0;
+
+  for (size_t i = 0; i < sizeof(SCENARIOS) / sizeof(SCENARIOS[0]); i++)
+  {
+    if (only && strcmp(only, SCENARIOS[i].name) != 0)
+      continue;
+    run++;
+    if (!run_scenario(&SCENARIOS[i]))
+      failures++;
+  }
+
+  if (run == 0)
+  {
+    fprintf(stderr, "Error: Unknown scenario %s\n", only);
+    return 1;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * Neptune Scanner - Banner Corpus
+ * corpus.c - Reader for bench/corpus/banners.txt
+ */
+
+#include "corpus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decode the C escapes used by the corpus (\r, \n, \t, \\, \xHH) in place; returns the length
+static size_t unescape(char *text)
+{
+  char *out = text;
+  for (const char *in = text; *in; in++)
+  {
+    if (*in != '\\' || !in[1])
+    {
+      *out++ = *in;
+      continue;
+    }
+
+    in++;
+    switch (*in)
+    {
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'x':
+    {
+      char hex[3] = {0};
+      if (in[1] && in[2])
+      {
+        hex[0] = in[1];
+        hex[1] = in[2];
+        in += 2;
+      }
+      *out++ = (char)strtol(hex, NULL, 16);
+      break;
+    }
+    default:
+      *out++ = *in;
+      break;
+    }
+  }
+  *out = '\0';
+  return (size_t)(out - text);
+}
+
+int load_corpus(const char *path, corpus_entry_t *entries, int max_entries)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return -1;
+
+  char line[4096];
+  int count = 0;
+  while (count < max_entries && fgets(line, sizeof(line), file))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+
+    // What detect_service reports for the previous entry
+    if (strncmp(line, "#=", 2) == 0 && count > 0)
+    {
+      corpus_entry_t *entry = &entries[count - 1];
+      char *protocol = line + 2 + strspn(line + 2, " ");
+      char *name = strchr(protocol, '\t');
+      if (!name)
+        continue;
+      *name++ = '\0';
+      snprintf(entry->detected_protocol, sizeof(entry->detected_protocol), "%.*s",
+               (int)sizeof(entry->detected_protocol) - 1, protocol);
+      snprintf(entry->detected_service_name, sizeof(entry->detected_service_name), "%.*s",
+               (int)sizeof(entry->detected_service_name) - 1, name);
+      continue;
+    }
+    if (line[0] == '#' || line[0] == '\0')
+      continue;
+
+    char *protocol = line;
+    char *name = strchr(protocol, '\t');
+    char *banner = name ? strchr(name + 1, '\t') : NULL;
+    if (!banner)
+      continue;
+    *name++ = '\0';
+    *banner++ = '\0';
+
+    corpus_entry_t *entry = &entries[count++];
+    size_t len = unescape(banner);
+    if (len > sizeof(entry->banner) - 1)
+      len = sizeof(entry->banner) - 1;
+    snprintf(entry->protocol, sizeof(entry->protocol), "%.*s", (int)sizeof(entry->protocol) - 1,
+             protocol);
+    snprintf(entry->service_name, sizeof(entry->service_name), "%.*s",
+             (int)sizeof(entry->service_name) - 1, name);
+    memcpy(entry->banner, banner, len);
+    entry->banner[len] = '\0';
+    entry->banner_len = len;
+    memcpy(entry->detected_protocol, entry->protocol, sizeof(entry->protocol));
+    memcpy(entry->detected_service_name, entry->service_name, sizeof(entry->service_name));
+  }
+
+  fclose(file);
+  return count;
+}
+
+bool corpus_entry_is_tls(const corpus_entry_t *entry)
+{
+  return strncmp(entry->protocol, "TLS", 3) == 0;
+}
@@ -0,0 +1,47 @@
+/**
+ * Neptune Scanner - Banner Corpus
+ * corpus.h - Reader for bench/corpus/banners.txt, shared by the service benchmarks
+ *
+ * One banner per line: <protocol> TAB <service name> TAB <banner>, with C escapes (\r, \n, \t,
+ * \\, \xHH) in the banner. Lines starting with '#' are comments, except that a line
+ * "#= <protocol> TAB <service name>" right after an entry gives what detect_service reports for
+ * it when that differs from what identify_service reports from the banner alone.
+ */
+
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAX_CORPUS_ENTRIES 1024
+
+typedef struct
+{
+  char protocol[32];              // Protocol expected from identify_service
+  char service_name[64];          // Service name expected from identify_service
+  char banner[1024];              // Banner bytes (NUL-terminated)
+  size_t banner_len;              // Banner length; escapes may put NUL bytes inside the banner
+  char detected_protocol[32];     // Protocol expected from detect_service
+  char detected_service_name[64]; // Service name expected from detect_service
+} corpus_entry_t;
+
+/**
+ * Reads a corpus file
+ *
+ * @param path Corpus file
+ * @param entries Array that receives the entries
+ * @param max_entries Capacity of entries
+ * @return Number of entries read, or -1 if the file cannot be opened
+ */
+int load_corpus(const char *path, corpus_entry_t *entries, int max_entries);
+
+/**
+ * Whether an entry describes a TLS service
+ *
+ * TLS entries are answered with a handshake rather than a banner: the banner column holds the
+ * certificate's common name and the protocol column the TLS version ("TLSv1.2").
+ */
+bool corpus_entry_is_tls(const corpus_entry_t *entry);
+
+#endif /* BENCH_CORPUS_H */
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Neptune Scanner - Benchmark network conditions
+# netem.sh - Runs a command in a private network namespace with tc netem on its loopback
+#
+# Usage: bench/netem.sh "<netem parameters>" <command> [args...]
+#
+# Example: bench/netem.sh "delay 5ms 1ms loss 1%" bench/bench_scan -n 500
+#
+# The responder and the scanner both talk over the namespace's loopback interface, so the
+# netem parameters apply to every packet in both directions (SYNs, SYN-ACKs and RSTs alike).
+# Needs root and iproute2.
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 \"<netem parameters>\" <command> [args...]" >&2
+  exit 1
+fi
+
+NETEM="$1"
+shift
+NS="neptune-bench-$$"
+
+ip netns add "$NS"
+trap 'ip netns del "$NS"' EXIT INT TERM
+ip -n "$NS" link set lo up
+# shellcheck disable=SC2086 # the parameters are deliberately split into words
+tc -n "$NS" qdisc add dev lo root netem $NETEM
+
+ip netns exec "$NS" "$@"
@@ -0,0 +1,160 @@
+/**
+ * Neptune Scanner - Benchmark Responder
+ * responder.c - Fake scan target with many listening ports
+ *
+ * Usage: responder [-n listeners] [-p base_port] [-b banner]
+ *
+ * Opens 'listeners' TCP listeners on 127.0.0.1, starting at base_port, and prints "ready" on
+ * stdout once all of them accept connections. Every accepted connection is sent the banner (if
+ * any) and closed. The process runs until it is killed or stdin reaches end of file, so a parent
+ * holding the other end of a pipe never leaves it behind. Network conditions (dropped or delayed
+ * SYNs) are not simulated here; bench/netem.sh runs the whole benchmark in a network namespace
+ * with tc netem on its loopback interface.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define DEFAULT_LISTENERS 1000
+#define DEFAULT_BASE_PORT 20000
+#define MAX_LISTENERS 30000
+#define LISTEN_BACKLOG 512
+
+// Make room for one descriptor per listener plus the accepted connections
+static void raise_fd_limit(int needed)
+{
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)needed)
+  {
+    limit.rlim_cur = limit.rlim_max < (rlim_t)needed ? limit.rlim_max : (rlim_t)needed;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static int open_listener(int port)
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    return -1;
+
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((unsigned short)port);
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, LISTEN_BACKLOG) < 0)
+  {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+int main(int argc, char *argv[])
+{
+  int listeners = DEFAULT_LISTENERS;
+  int base_port = DEFAULT_BASE_PORT;
+  const char *banner = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:p:b:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      listeners = atoi(optarg);
+      break;
+    case 'p':
+      base_port = atoi(optarg);
+      break;
+    case 'b':
+      banner = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-n listeners] [-p base_port] [-b banner]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (listeners < 1 || listeners > MAX_LISTENERS || base_port < 1 ||
+      base_port + listeners - 1 > 65535)
+  {
+    fprintf(stderr, "Error: listeners must be 1-%d and fit below port 65536\n", MAX_LISTENERS);
+    return 1;
+  }
+
+  raise_fd_limit(listeners + 64);
+
+  // Slot 0 watches stdin; the listeners follow
+  struct pollfd *fds = calloc((size_t)listeners + 1, sizeof(struct pollfd));
+  if (!fds)
+    return 1;
+  fds[0].fd = STDIN_FILENO;
+  fds[0].events = POLLIN;
+  for (int i = 0; i < listeners; i++)
+  {
+    fds[i + 1].fd = open_listener(base_port + i);
+    fds[i + 1].events = POLLIN;
+    if (fds[i + 1].fd < 0)
+    {
+      fprintf(stderr, "Error: Could not listen on port %d: %s\n", base_port + i,
+              strerror(errno));
+      return 1;
+    }
+  }
+
+  printf("ready\n");
+  fflush(stdout);
+
+  size_t banner_len = banner ? strlen(banner) : 0;
+  for (;;)
+  {
+    if (poll(fds, (nfds_t)listeners + 1, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (fds[0].revents)
+    {
+      char discard[256];
+      if (read(STDIN_FILENO, discard, sizeof(discard)) <= 0)
+        break;
+    }
+
+    for (int i = 1; i <= listeners; i++)
+    {
+      if (!(fds[i].revents & POLLIN))
+        continue;
+
+      int client;
+      while ((client = accept(fds[i].fd, NULL, NULL)) >= 0)
+      {
+        if (banner_len > 0)
+        {
+          ssize_t sent = send(client, banner, banner_len, MSG_NOSIGNAL);
+          (void)sent;
+        }
+        close(client);
+      }
+    }
+  }
+
+  for (int i = 1; i <= listeners; i++)
+    close(fds[i].fd);
+  free(fds);
+  return 0;
+}
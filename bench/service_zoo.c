@@ -0,0 +1,509 @@
+/**
+ * Neptune Scanner - Service Zoo
+ * service_zoo.c - Fake services that replay the banner corpus for service detection benchmarks
+ *
+ * Usage: service_zoo [-c corpus] [-p base_port] [-d delay_ms] [-f fragment] [-g gap_ms]
+ *
+ * Opens one listener on 127.0.0.1 per corpus entry, entry i on base_port + i, and prints
+ * "ready <entries>" on stdout once all of them accept connections. Each listener behaves like the
+ * daemon its entry describes:
+ *
+ *   - HTTP entries wait for a request and answer every request on the connection with the
+ *     banner, followed by a body when the banner has a Content-Length. The connection is closed
+ *     after a response that says "Connection: close" or has no length.
+ *   - TLS entries answer a ClientHello with ServerHello, Certificate and ServerHelloDone. The
+ *     certificate is generated for the common name in the banner column. Anything other than a
+ *     handshake record is met with a silent close, as most TLS servers do.
+ *   - All other entries (SSH, FTP, SMTP, POP3, IMAP, Telnet, ...) send the banner as soon as the
+ *     connection is accepted and then ignore what the client sends until it hangs up.
+ *
+ * Every reply is sent after delay_ms, in pieces of at most 'fragment' bytes (0 = in one piece)
+ * with gap_ms between pieces, to exercise the scanner's read loops. Each connection is served by
+ * its own thread. The process runs until it is killed or stdin reaches end of file.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "corpus.h"
+
+#define DEFAULT_CORPUS "bench/corpus/banners.txt"
+#define DEFAULT_BASE_PORT 31000 // Unassigned in data/neptune-services, so TLS reports ssl/unknown
+#define LISTEN_BACKLOG 128
+#define IDLE_TIMEOUT 10         // Seconds a silent client is kept before the zoo hangs up
+#define MAX_HTTP_BODY 65536
+#define MAX_TLS_FLIGHT 4096
+#define ZOO_ISSUER "Neptune Service Zoo CA"
+
+static corpus_entry_t corpus[MAX_CORPUS_ENTRIES];
+static int reply_delay_ms = 0;
+static int fragment_size = 0;
+static int fragment_gap_ms = 0;
+
+typedef struct
+{
+  int sock;
+  const corpus_entry_t *entry;
+} connection_t;
+
+static void sleep_ms(int ms)
+{
+  if (ms <= 0)
+    return;
+  struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+    ;
+}
+
+// Send a reply after the configured delay, fragmented as configured
+static bool send_reply(int sock, const void *data, size_t len)
+{
+  const char *bytes = data;
+  sleep_ms(reply_delay_ms);
+  while (len > 0)
+  {
+    size_t piece = fragment_size > 0 && (size_t)fragment_size < len ? (size_t)fragment_size : len;
+    ssize_t sent = send(sock, bytes, piece, MSG_NOSIGNAL);
+    if (sent <= 0)
+      return false;
+    bytes += sent;
+    len -= (size_t)sent;
+    if (len > 0)
+      sleep_ms(fragment_gap_ms);
+  }
+  return true;
+}
+
+// Discard whatever the client sends until it hangs up or goes quiet
+static void drain(int sock)
+{
+  char discard[1024];
+  while (recv(sock, discard, sizeof(discard), 0) > 0)
+    ;
+}
+
+static void serve_greeting(const connection_t *connection)
+{
+  if (send_reply(connection->sock, connection->entry->banner, connection->entry->banner_len))
+    drain(connection->sock);
+}
+
+// Content-Length of a response header block, or -1 if it has none
+static long content_length(const char *headers)
+{
+  for (const char *line = headers; line; line = strstr(line, "\r\n"))
+  {
+    if (line != headers)
+      line += 2;
+    if (strncasecmp(line, "Content-Length:", 15) == 0)
+      return strtol(line + 15, NULL, 10);
+  }
+  return -1;
+}
+
+static void serve_http(const connection_t *connection)
+{
+  const corpus_entry_t *entry = connection->entry;
+  long body_len = content_length(entry->banner);
+  bool keep_alive = body_len >= 0 && strncmp(entry->banner, "HTTP/1.1", 8) == 0 &&
+                    strstr(entry->banner, "Connection: close") == NULL;
+  if (body_len > MAX_HTTP_BODY)
+    body_len = MAX_HTTP_BODY;
+
+  size_t response_len = entry->banner_len + (size_t)(body_len > 0 ? body_len : 0);
+  char *response = malloc(response_len);
+  if (!response)
+    return;
+  memcpy(response, entry->banner, entry->banner_len);
+  memset(response + entry->banner_len, 'x', response_len - entry->banner_len);
+
+  char request[8192];
+  size_t used = 0;
+  bool open = true;
+  while (open)
+  {
+    ssize_t received = recv(connection->sock, request + used, sizeof(request) - 1 - used, 0);
+    if (received <= 0)
+      break;
+    used += (size_t)received;
+    request[used] = '\0';
+
+    // Answer every complete request; HEAD responses have no body
+    char *end;
+    while (open && (end = strstr(request, "\r\n\r\n")) != NULL)
+    {
+      bool head = strncmp(request, "HEAD ", 5) == 0;
+      open = send_reply(connection->sock, response, head ? entry->banner_len : response_len) &&
+             keep_alive;
+      size_t consumed = (size_t)(end + 4 - request);
+      used -= consumed;
+      memmove(request, request + consumed, used + 1);
+    }
+
+    if (used == sizeof(request) - 1)
+      break; // Request headers too large
+  }
+  free(response);
+}
+
+// Write a DER TLV; returns the end of what was written
+static unsigned char *put_tlv(unsigned char *out, unsigned char tag, const void *content,
+                              size_t len)
+{
+  *out++ = tag;
+  if (len < 0x80)
+  {
+    *out++ = (unsigned char)len;
+  }
+  else if (len < 0x100)
+  {
+    *out++ = 0x81;
+    *out++ = (unsigned char)len;
+  }
+  else
+  {
+    *out++ = 0x82;
+    *out++ = (unsigned char)(len >> 8);
+    *out++ = (unsigned char)len;
+  }
+  memmove(out, content, len);
+  return out + len;
+}
+
+static unsigned char *put_bytes(unsigned char *out, const void *bytes, size_t len)
+{
+  memcpy(out, bytes, len);
+  return out + len;
+}
+
+// Name with a single common name attribute
+static size_t build_name(const char *common_name, unsigned char *out)
+{
+  static const unsigned char CN_OID[] = {0x55, 0x04, 0x03};
+  unsigned char attribute[160];
+  unsigned char set[160];
+  unsigned char *p = put_tlv(attribute, 0x06, CN_OID, sizeof(CN_OID));
+  p = put_tlv(p, 0x0C, common_name, strlen(common_name));
+  p = put_tlv(set, 0x30, attribute, (size_t)(p - attribute));
+  p = put_tlv(attribute, 0x31, set, (size_t)(p - set));
+  return (size_t)(put_tlv(out, 0x30, attribute, (size_t)(p - attribute)) - out);
+}
+
+/**
+ * Builds a certificate for a common name
+ *
+ * Only the structure is real: the key and the signature are placeholders, which is enough for a
+ * client that reads the certificate without verifying it.
+ */
+static size_t build_certificate(const char *common_name, unsigned char *out)
+{
+  static const unsigned char VERSION[] = {0x02, 0x01, 0x02};
+  static const unsigned char SERIAL[] = {0x01};
+  static const unsigned char SHA256_RSA[] = {0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7,
+                                             0x0D, 0x01, 0x01, 0x0B, 0x05, 0x00};
+  static const unsigned char RSA_KEY[] = {0x30, 0x11, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86,
+                                          0x48, 0x86, 0xF7, 0x0D, 0x01, 0x01, 0x01, 0x05,
+                                          0x00, 0x03, 0x00};
+  static const unsigned char SAN_OID[] = {0x55, 0x1D, 0x11};
+  static const unsigned char SIGNATURE[] = {0x00, 0x5A, 0x4F, 0x4F};
+
+  char cn[100];
+  snprintf(cn, sizeof(cn), "%.*s", (int)sizeof(cn) - 1, common_name);
+
+  unsigned char subject[160];
+  unsigned char issuer[160];
+  size_t subject_len = build_name(cn, subject);
+  size_t issuer_len = build_name(ZOO_ISSUER, issuer);
+
+  unsigned char validity[40];
+  unsigned char *v = put_tlv(validity, 0x17, "240101000000Z", 13);
+  v = put_tlv(v, 0x17, "340101000000Z", 13);
+
+  // subjectAltName with the common name as its only dNSName
+  unsigned char san[128];
+  unsigned char extension[160];
+  unsigned char extensions[192];
+  unsigned char *s = put_tlv(extension, 0x82, cn, strlen(cn));
+  s = put_tlv(san, 0x30, extension, (size_t)(s - extension));
+  unsigned char *e = put_tlv(extension, 0x06, SAN_OID, sizeof(SAN_OID));
+  e = put_tlv(e, 0x04, san, (size_t)(s - san));
+  s = put_tlv(san, 0x30, extension, (size_t)(e - extension));
+  e = put_tlv(extensions, 0x30, san, (size_t)(s - san));
+
+  unsigned char tbs[1024];
+  unsigned char *p = put_tlv(tbs, 0xA0, VERSION, sizeof(VERSION));
+  p = put_tlv(p, 0x02, SERIAL, sizeof(SERIAL));
+  p = put_bytes(p, SHA256_RSA, sizeof(SHA256_RSA));
+  p = put_bytes(p, issuer, issuer_len);
+  p = put_tlv(p, 0x30, validity, (size_t)(v - validity));
+  p = put_bytes(p, subject, subject_len);
+  p = put_bytes(p, RSA_KEY, sizeof(RSA_KEY));
+  p = put_tlv(p, 0xA3, extensions, (size_t)(e - extensions));
+
+  unsigned char body[1200];
+  unsigned char *b = put_tlv(body, 0x30, tbs, (size_t)(p - tbs));
+  b = put_bytes(b, SHA256_RSA, sizeof(SHA256_RSA));
+  b = put_tlv(b, 0x03, SIGNATURE, sizeof(SIGNATURE));
+  return (size_t)(put_tlv(out, 0x30, body, (size_t)(b - body)) - out);
+}
+
+static unsigned char *put_u16(unsigned char *out, unsigned value)
+{
+  *out++ = (unsigned char)(value >> 8);
+  *out++ = (unsigned char)value;
+  return out;
+}
+
+static unsigned char *put_u24(unsigned char *out, size_t value)
+{
+  *out++ = (unsigned char)(value >> 16);
+  return put_u16(out, (unsigned)value);
+}
+
+// Protocol version named by a TLS entry's protocol column
+static unsigned tls_version(const char *protocol)
+{
+  if (strcmp(protocol, "TLSv1.0") == 0)
+    return 0x0301;
+  if (strcmp(protocol, "TLSv1.1") == 0)
+    return 0x0302;
+  return 0x0303;
+}
+
+// ServerHello, Certificate and ServerHelloDone in one handshake record
+static size_t build_tls_flight(const corpus_entry_t *entry, unsigned char *out)
+{
+  unsigned version = tls_version(entry->protocol);
+  unsigned char certificate[1400];
+  size_t certificate_len = build_certificate(entry->banner, certificate);
+
+  unsigned char *p = out + 5;
+  *p++ = 2; // ServerHello
+  p = put_u24(p, 2 + 32 + 1 + 2 + 1);
+  p = put_u16(p, version);
+  for (int i = 0; i < 32; i++)
+    *p++ = (unsigned char)(0xA5 ^ i);
+  *p++ = 0;              // Empty session id
+  p = put_u16(p, 0xC02F); // TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256
+  *p++ = 0;              // No compression
+
+  *p++ = 11; // Certificate
+  p = put_u24(p, 3 + 3 + certificate_len);
+  p = put_u24(p, 3 + certificate_len);
+  p = put_u24(p, certificate_len);
+  p = put_bytes(p, certificate, certificate_len);
+
+  *p++ = 14; // ServerHelloDone
+  p = put_u24(p, 0);
+
+  size_t body_len = (size_t)(p - out) - 5;
+  out[0] = 0x16;
+  put_u16(out + 1, version);
+  put_u16(out + 3, (unsigned)body_len);
+  return body_len + 5;
+}
+
+static void serve_tls(const connection_t *connection)
+{
+  // Read the ClientHello record; the contents do not change the answer
+  unsigned char header[5];
+  size_t got = 0;
+  while (got < sizeof(header))
+  {
+    ssize_t received = recv(connection->sock, header + got, sizeof(header) - got, 0);
+    if (received <= 0)
+      return;
+    got += (size_t)received;
+  }
+  if (header[0] != 0x16 || header[1] != 0x03)
+    return;
+
+  size_t remaining = (size_t)header[3] << 8 | header[4];
+  unsigned char discard[1024];
+  while (remaining > 0)
+  {
+    ssize_t received = recv(connection->sock, discard,
+                            remaining < sizeof(discard) ? remaining : sizeof(discard), 0);
+    if (received <= 0)
+      return;
+    remaining -= (size_t)received;
+  }
+
+  unsigned char flight[MAX_TLS_FLIGHT];
+  size_t flight_len = build_tls_flight(connection->entry, flight);
+  if (send_reply(connection->sock, flight, flight_len))
+    drain(connection->sock);
+}
+
+static void *serve_connection(void *arg)
+{
+  connection_t *connection = arg;
+  const corpus_entry_t *entry = connection->entry;
+
+  struct timeval timeout = {IDLE_TIMEOUT, 0};
+  setsockopt(connection->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  int one = 1;
+  setsockopt(connection->sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  if (corpus_entry_is_tls(entry))
+    serve_tls(connection);
+  else if (strcmp(entry->protocol, "HTTP") == 0)
+    serve_http(connection);
+  else
+    serve_greeting(connection);
+
+  close(connection->sock);
+  free(connection);
+  return NULL;
+}
+
+static int open_listener(int port)
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    return -1;
+
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((unsigned short)port);
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, LISTEN_BACKLOG) < 0)
+  {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = DEFAULT_CORPUS;
+  int base_port = DEFAULT_BASE_PORT;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:p:d:f:g:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      path = optarg;
+      break;
+    case 'p':
+      base_port = atoi(optarg);
+      break;
+    case 'd':
+      reply_delay_ms = atoi(optarg);
+      break;
+    case 'f':
+      fragment_size = atoi(optarg);
+      break;
+    case 'g':
+      fragment_gap_ms = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-c corpus] [-p base_port] [-d delay_ms] [-f fragment] [-g gap_ms]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  int count = load_corpus(path, corpus, MAX_CORPUS_ENTRIES);
+  if (count <= 0)
+  {
+    fprintf(stderr, "Error: Could not read banners from %s\n", path);
+    return 1;
+  }
+  if (base_port < 1 || base_port + count - 1 > 65535)
+  {
+    fprintf(stderr, "Error: %d listeners do not fit below port 65536\n", count);
+    return 1;
+  }
+
+  // Slot 0 watches stdin; the listeners follow
+  struct pollfd *fds = calloc((size_t)count + 1, sizeof(struct pollfd));
+  if (!fds)
+    return 1;
+  fds[0].fd = STDIN_FILENO;
+  fds[0].events = POLLIN;
+  for (int i = 0; i < count; i++)
+  {
+    fds[i + 1].fd = open_listener(base_port + i);
+    fds[i + 1].events = POLLIN;
+    if (fds[i + 1].fd < 0)
+    {
+      fprintf(stderr, "Error: Could not listen on port %d: %s\n", base_port + i,
+              strerror(errno));
+      return 1;
+    }
+  }
+
+  printf("ready %d\n", count);
+  fflush(stdout);
+
+  for (;;)
+  {
+    if (poll(fds, (nfds_t)count + 1, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (fds[0].revents)
+    {
+      char discard[256];
+      if (read(STDIN_FILENO, discard, sizeof(discard)) <= 0)
+        break;
+    }
+
+    for (int i = 1; i <= count; i++)
+    {
+      if (!(fds[i].revents & POLLIN))
+        continue;
+
+      int client;
+      while ((client = accept(fds[i].fd, NULL, NULL)) >= 0)
+      {
+        connection_t *connection = malloc(sizeof(connection_t));
+        pthread_t thread;
+        if (!connection)
+        {
+          close(client);
+          continue;
+        }
+        connection->sock = client;
+        connection->entry = &corpus[i - 1];
+        if (pthread_create(&thread, NULL, serve_connection, connection) != 0)
+        {
+          close(client);
+          free(connection);
+          continue;
+        }
+        pthread_detach(thread);
+      }
+    }
+  }
+
+  for (int i = 1; i <= count; i++)
+    close(fds[i].fd);
+  free(fds);
+  return 0;
+}
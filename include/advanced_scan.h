@@ -2,6 +2,7 @@
 #define ADVANCED_SCAN_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 // TCP flags
@@ -63,8 +64,10 @@ typedef struct
 } tcp_header_t;
 
 // Function declarations
+bool raw_sockets_available(void);
 bool tcp_syn_scan(const char *target, int port, int timeout);
 bool tcp_custom_scan(const char *target, int port, uint8_t flags, int timeout);
-bool detect_os(const char *target, char *os_info, size_t os_info_size);
+unsigned short tcp_checksum(unsigned short *ptr, int nbytes);
+unsigned short ip_checksum(unsigned short *ptr, int nbytes);
 
 #endif /* ADVANCED_SCAN_H */
\ No newline at end of file
@@ -9,18 +9,40 @@
 #include <stdbool.h>
 #include "config.h"
 #include "advanced_scan.h"
+#include "port_spec.h"
 
 // Configuration structure to hold all scan options
 typedef struct
 {
-  char target[256];       // Target host or IP
-  int port_range[2];      // [start_port, end_port]
-  int *port_list;         // List of specific ports to scan
+  char target[256];       // Target host, address, CIDR block or octet ranges
+  char target_list[256];  // File of targets to scan (-iL, empty = none)
+  char exclude[1024];     // Addresses and ranges never to probe, comma-separated (--exclude)
+  char exclude_file[256]; // File of addresses and ranges never to probe (--excludefile)
+  port_spec_t *port_spec; // Ports given with -p (NULL = none)
+  int *port_list;         // Ordered list of ports to scan (--top-ports, --shard)
   int port_list_size;     // Number of ports in the list
-  bool use_port_list;     // Whether to use port_list instead of port_range
+  bool use_port_list;     // Whether to use port_list instead of port_spec
   scan_type_t scan_type;  // Type of scan to perform
   bool detect_os;         // Enable OS detection
   bool detect_services;   // Enable service detection
+  int version_intensity;  // Service probe intensity (0-9)
+  char service_probes_file[256]; // Service probe database path
+  char http_requests_file[256]; // HTTP fingerprint request sets path
+  int top_ports;          // Scan the N most frequently open ports (0 = off)
+  char services_db_file[256]; // Services database path
+  char os_db_file[256];   // OS signature database path
+  int stats_interval_ms;  // Live statistics report interval (0 = off)
+  char stats_json[256];   // Live statistics JSON sink: file, tcp:HOST:PORT or unix:PATH
+  char trace_file[256];   // Chrome trace output file (empty = no tracing)
+  int metrics_port;       // Serve Prometheus metrics on 127.0.0.1:<port> (0 = off)
+  int rate;               // SYN probes per second (0 = no limit)
+  char daemon_socket[256]; // Serve scan jobs on this Unix socket (empty = scan normally)
+  char submit_socket[256]; // Send the scan to the daemon on this Unix socket
+  int weight;             // Job weight when submitting to a daemon
+  int shard_index;        // This scanner's shard (1-based, 0 = not sharded)
+  int shard_count;        // Number of shards the scan is split into
+  char output_file[256];  // Sorted results file (empty = none)
+  char binary_file[256];  // Binary results file with a banner table (empty = none)
   bool verbose;           // Verbose output
 } Args;
 
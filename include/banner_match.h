@@ -0,0 +1,67 @@
+/**
+ * Neptune Scanner - Multi-pattern Banner Matching
+ * banner_match.h - Aho-Corasick automaton for finding many signatures in one pass
+ *
+ * Patterns are added once, compiled into a deterministic automaton, and then every scan
+ * reports the first offset of each pattern in a single pass over the text.
+ */
+
+#ifndef BANNER_MATCH_H
+#define BANNER_MATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AC_MAX_PATTERNS 256 // Maximum number of patterns in one automaton
+#define AC_MAX_STATES 4096  // Maximum number of automaton states (sum of pattern lengths + 1)
+
+typedef struct ac_automaton ac_automaton_t;
+
+/**
+ * Creates an empty automaton
+ *
+ * @return New automaton, or NULL if memory allocation failed
+ */
+ac_automaton_t *ac_create(void);
+
+/**
+ * Adds a pattern; must be called before ac_compile
+ *
+ * @param ac Automaton
+ * @param pattern Pattern bytes
+ * @param len Number of pattern bytes (must be > 0)
+ * @return Pattern ID (0-based, in insertion order), or -1 on error
+ */
+int ac_add_pattern(ac_automaton_t *ac, const char *pattern, size_t len);
+
+/**
+ * Builds failure links and the full transition table
+ *
+ * @param ac Automaton
+ * @return true on success
+ */
+bool ac_compile(ac_automaton_t *ac);
+
+/**
+ * Returns the number of patterns added to the automaton
+ */
+int ac_pattern_count(const ac_automaton_t *ac);
+
+/**
+ * Scans text once and records where each pattern first occurs
+ *
+ * @param ac Compiled automaton
+ * @param text Text to scan
+ * @param len Number of bytes in text
+ * @param first_pos Array of ac_pattern_count() entries; receives the offset of the first
+ *                  occurrence of each pattern or -1 if the pattern does not occur
+ * @return Number of distinct patterns found
+ */
+int ac_scan(const ac_automaton_t *ac, const char *text, size_t len, int *first_pos);
+
+/**
+ * Releases an automaton
+ */
+void ac_free(ac_automaton_t *ac);
+
+#endif /* BANNER_MATCH_H */
@@ -20,11 +20,8 @@
 #define MAX_OPEN_PORTS 1000   // Maximum number of open ports to track
 #define MAX_BANNER_SIZE 1024  // Maximum size of service banner
 #define MAX_VERSION_SIZE 32   // Maximum size of version string
-#define MAX_COMMON_PORTS 1024 // Maximum number of common ports to scan
 
-// Common ports to scan
-#define COMMON_PORTS_COUNT 16
-extern const int COMMON_PORTS[COMMON_PORTS_COUNT];
+// The common ports scanned by default are the entries of include/services.def
 
 // Service detection timeouts
 #define HTTP_TIMEOUT 2000   // HTTP service detection timeout
@@ -33,11 +30,47 @@ extern const int COMMON_PORTS[COMMON_PORTS_COUNT];
 #define SSH_TIMEOUT 2000    // SSH service detection timeout
 #define TELNET_TIMEOUT 2000 // Telnet service detection timeout
 
-// OS detection parameters
+// Banner grabbing timing (all values in milliseconds)
+// Waits are derived from the RTT measured during the TCP handshake and clamped to these bounds
+#define BANNER_CONNECT_TIMEOUT 3000 // Maximum time to wait for the TCP handshake
+#define BANNER_RTT_MULTIPLIER 4     // Initial banner wait = RTT * multiplier
+#define BANNER_MIN_WAIT 100         // Lower bound for the initial banner wait
+#define BANNER_MAX_WAIT 2000        // Upper bound for the initial banner wait
+#define BANNER_PROBE_MAX_WAIT 3000  // Upper bound for the wait after sending a probe
+#define BANNER_MIN_IDLE_GAP 30      // Lower bound for the idle gap that ends a read
+#define BANNER_MAX_IDLE_GAP 500     // Upper bound for the idle gap that ends a read
+
+// Service probe database used by version detection (-sV)
+#define SERVICE_PROBES_FILE "data/neptune-service-probes"
+#define DEFAULT_VERSION_INTENSITY 7 // Same scale as nmap: 0 = lightest, 9 = all probes
+#define MAX_VERSION_INTENSITY 9
+
+// HTTP request sets pipelined to web services during version detection (-sV)
+#define HTTP_REQUESTS_FILE "data/neptune-http-requests"
+#define HTTP_MAX_SKIP_BODY 16384 // Bodies larger than this end the connection instead of being read
+
+// Services database (built from data/neptune-services by tools/mkservicesdb)
+#define SERVICES_DB_FILE "data/neptune-services.db"
+
+// SYN scan engine (-sS)
+#define SYN_ENGINE_MAX_OUTSTANDING 4096 // Probes in flight at once
+#define SYN_ENGINE_RETRIES 1            // Retransmissions before a port counts as filtered
+#define SYN_ENGINE_TIMEOUT 1000         // Milliseconds to wait for a reply to each send
+#define SYN_ENGINE_BASE_PORT 40000      // First local port; one port per probe in flight
+
+// Live scan statistics (--stats-every, --stats-json)
+#define DEFAULT_STATS_INTERVAL 1000 // Milliseconds between reports when only --stats-json is given
+
+// OS detection parameters (-O)
+#define OS_DB_FILE "data/neptune-os-db"
 #define OS_DETECTION_TIMEOUT 3000 // OS detection timeout
 #define OS_DETECTION_TRIES 3      // Number of OS detection attempts
+#define OS_MATCH_THRESHOLD 85     // Scores at or above this are reported as a match
+#define PASSIVE_OS_MARGIN 15      // Lead over other OS classes a passive guess needs to stand
 
 // Global configuration variables
 extern bool use_common_ports; // Flag to indicate if common ports should be scanned
+extern int version_intensity; // Number of service probes to try (0-9), see --version-intensity
+extern int scan_rate;         // SYN probes per second, 0 for no limit, see --rate
 
 #endif /* CONFIG_H */ // End of include guard
\ No newline at end of file
@@ -0,0 +1,64 @@
+/**
+ * Neptune Scanner - Scan Job Daemon
+ * daemon.h - Long-running scan server sharing one warm SYN engine between jobs (--daemon)
+ *
+ * The daemon opens the raw transport, loads the databases and creates the SYN engine once, then
+ * takes scan jobs from clients over a Unix domain socket. Every job runs on that one engine, which
+ * shares the probe slots and the --rate budget between jobs in proportion to their weights, so a
+ * large sweep cannot starve a small interactive scan. Results stream back to each client as they
+ * are found. The engine runs on its own thread; each connection has a thread that streams its
+ * job's results and runs service detection, so a slow client never holds up the engine.
+ *
+ * Every message is a frame: a 4-byte big-endian payload length, then one line of text without a
+ * newline. A client sends
+ *
+ *   SCAN target=<host> ports=<spec> [weight=<1-DAEMON_MAX_WEIGHT>] [services=1]
+ *
+ * where spec is a -p port spec ("22,80,8000-8100,[81]"; see port_spec.h). The daemon answers
+ *
+ *   JOB <id> <ports>                               the job was accepted
+ *   OPEN <port>                                    an open port, as soon as it is found
+ *   SERVICE <port>\t<name>\t<protocol>\t<version>  after the scan, with services=1
+ *   DONE open=<n> closed=<n> filtered=<n> sent=<n> elapsed_ms=<n>
+ *
+ * or ERROR <message>. A connection may run jobs one after another; closing it cancels its job.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdbool.h>
+#include "exclude_list.h"
+
+#define DAEMON_MAX_FRAME 65536   // Largest payload accepted in either direction
+#define DAEMON_MAX_CLIENTS 64    // Connections served at once
+#define DAEMON_MAX_WEIGHT 1000   // Largest job weight
+#define DAEMON_STEP_WAIT 50      // Milliseconds the engine waits for replies before taking new jobs
+
+/**
+ * Serves scan jobs until SIGINT or SIGTERM
+ *
+ * The socket is created mode 0600 and removed on exit. The service probe and HTTP request
+ * databases must already be loaded.
+ *
+ * @param socket_path Path of the Unix domain socket to listen on
+ * @param exclude Built list of addresses jobs may not target, or NULL for none
+ * @return false if raw sockets are unavailable or the socket cannot be created
+ */
+bool daemon_run(const char *socket_path, const exclude_list_t *exclude);
+
+/**
+ * Submits a job to a daemon and prints its replies to stdout as they arrive
+ *
+ * @param socket_path Daemon's socket
+ * @param target Host to scan
+ * @param ports Ports to scan
+ * @param num_ports Number of entries in ports
+ * @param weight Job weight (1 to DAEMON_MAX_WEIGHT)
+ * @param services Whether the daemon should run service detection on open ports
+ * @return true if the job ran to completion
+ */
+bool daemon_submit(const char *socket_path, const char *target, const int *ports, int num_ports,
+                   int weight, bool services);
+
+#endif /* DAEMON_H */
@@ -0,0 +1,150 @@
+/**
+ * Neptune Scanner - HTTP Fingerprinting
+ * http_parser.h - Incremental HTTP/1.x response parser
+ *
+ * The parser works in place on the caller's receive buffer: each call examines only the bytes
+ * appended since the previous call and records the fields of interest as spans into the buffer,
+ * so nothing is copied or scanned twice. It reports HTTP_PARSE_DONE as soon as the status line,
+ * the headers and (for HTML responses) the page title are known, letting the caller hang up
+ * without reading the rest of the body. On a keep-alive connection, http_parser_skip_body then
+ * consumes the rest of the message so that the next pipelined response can be parsed.
+ */
+
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_MAX_RESPONSE 8192     // Response bytes buffered: the headers and the start of the body
+#define HTTP_TITLE_SCAN_LIMIT 1024 // Body bytes searched for <title> before giving up
+#define HTTP_MAX_PIPELINE 8        // Responses recorded per service
+
+// A field of the response: offset and length in the receive buffer
+typedef struct
+{
+  size_t offset;
+  size_t len;
+} http_span_t;
+
+// The outcome of one request
+typedef struct
+{
+  char request[128];  // "METHOD path"
+  int status_code;    // Status code
+  long long body_len; // Body length, or -1 if the body was not read
+  uint32_t body_hash; // FNV-1a hash of the body, if body_len >= 0
+} http_response_t;
+
+// What a service's responses revealed, copied out of the receive buffer
+typedef struct
+{
+  int status_code;                              // Status of the first response, 0 if none
+  char server[96];                              // Server header
+  char powered_by[64];                          // X-Powered-By header
+  char title[128];                              // Page title
+  http_response_t responses[HTTP_MAX_PIPELINE]; // Every response, in request order
+  int num_responses;                            // Number of entries in responses
+} http_info_t;
+
+// Result of feeding bytes to the parser
+typedef enum
+{
+  HTTP_PARSE_MORE,  // Need more bytes
+  HTTP_PARSE_DONE,  // Everything of interest has been seen; stop reading
+  HTTP_PARSE_ERROR  // Not an HTTP/1.x response
+} http_parse_status_t;
+
+// Where the parser is in the response
+typedef enum
+{
+  HTTP_STATE_STATUS,  // Reading the status line
+  HTTP_STATE_HEADERS, // Reading header lines
+  HTTP_STATE_BODY,       // Searching the body for the title
+  HTTP_STATE_DONE,       // Fields of interest known
+  HTTP_STATE_SKIP_BODY,  // Skipping a Content-Length body
+  HTTP_STATE_CHUNK_SIZE, // Reading a chunk size line
+  HTTP_STATE_CHUNK_DATA, // Skipping chunk data
+  HTTP_STATE_CHUNK_END,  // Reading the line break after chunk data
+  HTTP_STATE_TRAILERS,   // Reading trailer lines after the last chunk
+  HTTP_STATE_COMPLETE    // The whole message has been consumed
+} http_state_t;
+
+// Incremental parser state; initialize with http_parser_init
+typedef struct
+{
+  http_state_t state;        // Current state
+  size_t pos;                // Next byte to examine
+  int version;               // Protocol version times ten (e.g., 11 for HTTP/1.1)
+  int status_code;           // Status code (e.g., 200)
+  http_span_t reason;        // Reason phrase
+  http_span_t server;        // Server header value
+  http_span_t powered_by;    // X-Powered-By header value
+  http_span_t content_type;  // Content-Type header value
+  http_span_t title;         // Contents of <title>, whitespace trimmed
+  long long content_length;  // Content-Length, or -1 if absent
+  size_t body_start;         // Offset of the first body byte
+  size_t title_limit;        // Offset where the title search stops, 0 until known
+  bool head_request;         // Set before feeding if the request was HEAD (no body follows)
+  bool chunked;              // Transfer-Encoding: chunked
+  bool keep_alive;           // The connection stays open after this response
+  long long body_remaining;  // Bytes left in the body or current chunk while skipping
+  long long body_len;        // Body bytes skipped so far, -1 if the body runs to connection close
+  uint32_t body_hash;        // FNV-1a hash of the body bytes skipped so far
+} http_parser_t;
+
+/**
+ * Resets a parser before the first response byte
+ *
+ * @param parser Parser state
+ */
+void http_parser_init(http_parser_t *parser);
+
+/**
+ * Parses the bytes appended to the receive buffer since the last call
+ *
+ * @param parser Parser state
+ * @param data Receive buffer holding the whole response so far; must not move between calls
+ * @param len Number of bytes in data
+ * @return HTTP_PARSE_MORE until the parser has everything it needs or fails
+ */
+http_parse_status_t http_parser_feed(http_parser_t *parser, const char *data, size_t len);
+
+/**
+ * Copies the status, headers and title found by the parser into an http_info_t
+ *
+ * Runs of whitespace and control characters are collapsed to single spaces.
+ *
+ * @param parser Parser that has seen at least the status line
+ * @param data The receive buffer passed to http_parser_feed
+ * @param info Filled with the status code, headers and title
+ */
+void http_parser_get_info(const http_parser_t *parser, const char *data, http_info_t *info);
+
+/**
+ * Consumes the rest of the message after http_parser_feed returned HTTP_PARSE_DONE
+ *
+ * Content-Length and chunked bodies are skipped up to the end of the message, hashing the body
+ * bytes on the way. A body delimited by the connection closing cannot be skipped; the parser then
+ * reports completion with keep_alive cleared. Between calls the caller may drop consumed bytes
+ * with http_parser_discard; spans are invalid once skipping has started.
+ *
+ * @param parser Parser state
+ * @param data Receive buffer
+ * @param len Number of bytes in data
+ * @return HTTP_PARSE_DONE once the message has been consumed (parser->pos is then the start of the
+ *         next response), HTTP_PARSE_MORE if more bytes are needed, HTTP_PARSE_ERROR on bad framing
+ */
+http_parse_status_t http_parser_skip_body(http_parser_t *parser, const char *data, size_t len);
+
+/**
+ * Marks the bytes consumed so far as discarded
+ *
+ * @param parser Parser state
+ * @return Number of bytes at the start of the receive buffer the caller may now drop; the parser
+ *         continues at offset 0 of the shifted buffer
+ */
+size_t http_parser_discard(http_parser_t *parser);
+
+#endif /* HTTP_PARSER_H */
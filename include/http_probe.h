@@ -0,0 +1,75 @@
+/**
+ * Neptune Scanner - HTTP Fingerprinting
+ * http_probe.h - Request sets pipelined to HTTP services
+ *
+ * Each HTTP service gets one set of requests, chosen by port from data/neptune-http-requests. The
+ * whole set is written to a single keep-alive connection at once and the responses are parsed in
+ * order, so fingerprinting a web port costs one TCP connection however many requests it takes.
+ */
+
+#ifndef HTTP_PROBE_H
+#define HTTP_PROBE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "http_parser.h"
+#include "service_probes.h"
+
+#define MAX_HTTP_REQUESTS HTTP_MAX_PIPELINE // Maximum number of requests in a set
+#define MAX_HTTP_REQUEST_SETS 16            // Maximum number of sets in the request file
+#define MAX_HTTP_METHOD 16                  // Maximum length of a request method
+#define MAX_HTTP_PATH 96                    // Maximum length of a request path
+
+// One request of a set
+typedef struct
+{
+  char method[MAX_HTTP_METHOD]; // Method, sent as is (invalid methods probe error handling)
+  char path[MAX_HTTP_PATH];     // Request target
+} http_request_t;
+
+// Requests sent to the HTTP services on a group of ports
+typedef struct
+{
+  probe_port_range_t ports[MAX_PROBE_PORT_RANGES]; // Ports the set applies to
+  int num_port_ranges;                             // Number of entries in ports (0 = default set)
+  http_request_t requests[MAX_HTTP_REQUESTS];      // Requests, sent in order
+  int num_requests;                                // Number of entries in requests
+} http_request_set_t;
+
+/**
+ * Loads request sets from a file, replacing any previously loaded sets
+ *
+ * @param path Path to a file in the neptune-http-requests format
+ * @return true if the file was read and contained at least one request
+ */
+bool load_http_requests(const char *path);
+
+/**
+ * Loads the built-in request set used when no request file is available
+ */
+void load_default_http_requests(void);
+
+/**
+ * Selects the request set for a port
+ *
+ * @param port Target port
+ * @return The first set listing the port, else the default set; never NULL
+ */
+const http_request_set_t *select_http_requests(int port);
+
+/**
+ * Writes the requests of a set from index first onwards as one pipelined buffer
+ *
+ * Every request but the last asks for the connection to be kept alive.
+ *
+ * @param set Request set
+ * @param first Index of the first request to write
+ * @param host Value of the Host header
+ * @param buffer Output buffer
+ * @param buffer_size Size of buffer
+ * @return Number of bytes written, or 0 if they do not fit
+ */
+size_t build_http_requests(const http_request_set_t *set, int first, const char *host,
+                           char *buffer, size_t buffer_size);
+
+#endif /* HTTP_PROBE_H */
@@ -0,0 +1,43 @@
+/**
+ * Neptune Scanner - Metrics Endpoint
+ * metrics.h - Prometheus text exposition of the live scan statistics (--metrics-port)
+ *
+ * A low-priority thread serves GET /metrics on 127.0.0.1. Each scrape reads a scan_stats
+ * snapshot, which only loads the per-thread counters, so scraping never takes a lock the probe
+ * paths hold and cannot stall transmission. One client is served at a time with short socket
+ * timeouts; a stuck client costs the endpoint, never the scan.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "scan_stats.h"
+
+#define METRICS_IO_TIMEOUT 2000 // Milliseconds a client gets to send its request and read the reply
+
+/**
+ * Renders a snapshot in the Prometheus text format (version 0.0.4)
+ *
+ * @param snapshot Statistics to render
+ * @param buffer Output buffer
+ * @param size Size of the buffer
+ * @return Length of the text, or 0 if the buffer is too small
+ */
+size_t metrics_render(const scan_stats_snapshot_t *snapshot, char *buffer, size_t size);
+
+/**
+ * Starts serving /metrics on 127.0.0.1
+ *
+ * @param port TCP port to listen on
+ * @return false if the port cannot be bound or the thread cannot be started
+ */
+bool metrics_start(int port);
+
+/**
+ * Stops the endpoint, if it was started
+ */
+void metrics_stop(void);
+
+#endif /* METRICS_H */
@@ -0,0 +1,226 @@
+/**
+ * Neptune Scanner - Library API
+ * neptunescan.h - Embedding the scanner: one context per scan (libneptunescan)
+ *
+ * A scan context holds everything one scan needs: its options, targets and ports, its worker
+ * threads, its SYN engine and local port range, and its counters, so a process can run many
+ * scans at once. neptune_scan_start returns immediately; results arrive through the callback
+ * on the scan's own threads while the caller does other work, and neptune_scan_cancel stops a
+ * scan early.
+ *
+ *   neptune_scan_options_t options;
+ *   neptune_scan_options_init(&options);
+ *   neptune_scan_ctx *scan = neptune_scan_create(&options, on_result, state);
+ *   neptune_scan_add_target(scan, "192.0.2.10");
+ *   neptune_scan_add_ports(scan, "1-1024,8080");
+ *   neptune_scan_start(scan);
+ *   ...
+ *   neptune_scan_wait(scan);
+ *   neptune_scan_destroy(scan);
+ *
+ * Some state is process-wide and shared by every context: the service probe and HTTP request
+ * databases, which neptune_init loads, the probe intensity (the default of -sV) and the live
+ * statistics of scan_stats.h (and --metrics-port in a host program), which count every scan
+ * together. Call neptune_init before starting scans and neptune_cleanup once they have all
+ * finished; while a scan with service detection runs, both leave the databases as they are.
+ *
+ * Only this header is part of the API; libneptunescan.so exports nothing else.
+ */
+
+#ifndef NEPTUNESCAN_H
+#define NEPTUNESCAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(NEPTUNE_BUILD_SHARED)
+#define NEPTUNE_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define NEPTUNE_API __attribute__((visibility("default")))
+#else
+#define NEPTUNE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct neptune_scan_ctx neptune_scan_ctx;
+
+typedef enum
+{
+  NEPTUNE_SCAN_CONNECT, // Full TCP connections (no privileges needed)
+  NEPTUNE_SCAN_SYN      // Half-open SYN probes (needs root or CAP_NET_RAW, not on Windows)
+} neptune_scan_type_t;
+
+typedef enum
+{
+  NEPTUNE_PORT_OPEN,
+  NEPTUNE_PORT_CLOSED,
+  NEPTUNE_PORT_FILTERED // No answer within the timeout
+} neptune_port_state_t;
+
+typedef enum
+{
+  NEPTUNE_EVENT_PORT,    // A port was scanned
+  NEPTUNE_EVENT_SERVICE, // Service detection identified an open port (detect_services)
+  NEPTUNE_EVENT_DONE     // The scan finished or was cancelled; the last event of a scan
+} neptune_event_t;
+
+// Scan options
+typedef struct
+{
+  neptune_scan_type_t scan_type;
+  int timeout_ms;        // Time to wait for an answer to each probe
+  int retries;           // SYN scan: retransmissions of an unanswered probe
+  int rate;              // SYN scan: probes per second, 0 for no limit
+  int concurrency;       // Connect scan: connections in flight at once (1 to 1024)
+  bool report_closed;    // Report closed and filtered ports too, not only open ones
+  bool detect_services;  // Run service detection on open ports once the port scan is done
+} neptune_scan_options_t;
+
+// One result; the strings are only valid during the callback
+typedef struct
+{
+  neptune_event_t event;
+  const char *target;          // Target as passed to neptune_scan_add_target
+  uint32_t addr;               // Its IPv4 address, network byte order
+  uint16_t port;
+  neptune_port_state_t state;  // NEPTUNE_EVENT_PORT
+  const char *service;         // NEPTUNE_EVENT_SERVICE: name, protocol and version, or ""
+  const char *protocol;
+  const char *version;
+} neptune_result_t;
+
+// Counters of one scan
+typedef struct
+{
+  uint64_t probed;    // Ports with a result
+  uint64_t open;
+  uint64_t closed;
+  uint64_t filtered;
+  bool cancelled;     // neptune_scan_cancel stopped the scan before it finished
+} neptune_scan_stats_t;
+
+/**
+ * Called for every result of a scan, from one of the scan's threads
+ *
+ * Calls for one scan never overlap. The scan waits while the callback runs, so it should hand
+ * results off rather than do slow work itself.
+ *
+ * @param user Pointer given to neptune_scan_create
+ * @param result The result
+ */
+typedef void (*neptune_result_fn)(void *user, const neptune_result_t *result);
+
+/**
+ * Loads the service probe and HTTP request databases used by service detection
+ *
+ * Call once before scans with detect_services; without it the first such scan loads the
+ * built-in probes. The databases are shared by all scans, so they cannot be replaced while a
+ * scan with service detection is running.
+ *
+ * @param service_probes_file Probe database, or NULL for the built-in probes
+ * @param http_requests_file HTTP request sets, or NULL for the built-in requests
+ * @return false if a file could not be loaded (the built-ins are used instead), or if a scan
+ *         with service detection is running (nothing is loaded)
+ */
+NEPTUNE_API bool neptune_init(const char *service_probes_file, const char *http_requests_file);
+
+/**
+ * Frees the databases loaded by neptune_init once every scan has finished; while a scan with
+ * service detection is running it does nothing
+ */
+NEPTUNE_API void neptune_cleanup(void);
+
+/**
+ * Fills options with the defaults (connect scan, the scanner's usual timeouts)
+ *
+ * @param options Options to fill
+ */
+NEPTUNE_API void neptune_scan_options_init(neptune_scan_options_t *options);
+
+/**
+ * Creates a scan with no targets
+ *
+ * @param options Scan options (copied)
+ * @param on_result Result callback
+ * @param user Passed to on_result
+ * @return The scan, or NULL if an option is out of range or memory runs out
+ */
+NEPTUNE_API neptune_scan_ctx *neptune_scan_create(const neptune_scan_options_t *options,
+                                                  neptune_result_fn on_result, void *user);
+
+/**
+ * Adds a target host, resolving it now; only before neptune_scan_start
+ *
+ * @param scan Scan
+ * @param host Hostname or IPv4 address
+ * @return false if the host does not resolve, the scan was started or memory runs out
+ */
+NEPTUNE_API bool neptune_scan_add_target(neptune_scan_ctx *scan, const char *host);
+
+/**
+ * Adds ports to scan on every target; only before neptune_scan_start
+ *
+ * @param scan Scan
+ * @param spec Ports in the -p syntax, e.g. "22,80,8000-", "-,[25]" or "T:1-1024"; ports
+ *             already added are skipped
+ * @return false if the spec is invalid, selects UDP ports or the scan was started
+ */
+NEPTUNE_API bool neptune_scan_add_ports(neptune_scan_ctx *scan, const char *spec);
+
+/**
+ * Starts the scan in the background and returns at once
+ *
+ * @param scan Scan with at least one target and port
+ * @return false if there is nothing to scan, it was already started, raw sockets are unavailable
+ *         for a SYN scan or its threads cannot be created
+ */
+NEPTUNE_API bool neptune_scan_start(neptune_scan_ctx *scan);
+
+/**
+ * Asks a running scan to stop; returns at once
+ *
+ * Probes in flight are abandoned unreported and service detection stops after the current
+ * port. NEPTUNE_EVENT_DONE still follows.
+ *
+ * @param scan Scan
+ */
+NEPTUNE_API void neptune_scan_cancel(neptune_scan_ctx *scan);
+
+/**
+ * Whether a started scan has not delivered NEPTUNE_EVENT_DONE yet
+ *
+ * @param scan Scan
+ * @return true while the scan runs
+ */
+NEPTUNE_API bool neptune_scan_running(const neptune_scan_ctx *scan);
+
+/**
+ * Waits until a started scan is done
+ *
+ * @param scan Scan
+ */
+NEPTUNE_API void neptune_scan_wait(neptune_scan_ctx *scan);
+
+/**
+ * Reads the counters of a scan; may be called while it runs
+ *
+ * @param scan Scan
+ * @param stats Filled with the counters
+ */
+NEPTUNE_API void neptune_scan_get_stats(const neptune_scan_ctx *scan, neptune_scan_stats_t *stats);
+
+/**
+ * Cancels a scan if it runs, waits for it and frees it; not from inside its callback
+ *
+ * @param scan Scan, or NULL
+ */
+NEPTUNE_API void neptune_scan_destroy(neptune_scan_ctx *scan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NEPTUNESCAN_H */
@@ -0,0 +1,75 @@
+/**
+ * Neptune Scanner - Network Simulator
+ * net_sim.h - In-process transport that simulates a network of hosts on a virtual clock
+ *
+ * Hosts occupy a contiguous address block. Whether a host is up, which of its ports are open,
+ * whether it is firewalled and its base round-trip time are all derived from a hash of the seed
+ * and address, so a simulated /8 costs no memory until it is probed. Replies are queued as timed
+ * events; the clock only moves when the engine waits, and jumps straight to the next reply, so a
+ * scan that would take hours on a real network runs in the time it takes to process its packets.
+ * Given the same seed and the same sequence of calls, every run is identical.
+ */
+
+#ifndef NET_SIM_H
+#define NET_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "transport.h"
+
+// Simulated network
+typedef struct
+{
+  uint32_t first_addr;       // First simulated address, network byte order
+  uint32_t num_hosts;        // Number of consecutive simulated addresses
+  double host_up;            // Fraction of addresses with a live host (0-1)
+  const uint16_t *open_ports; // Ports open on every live host
+  int num_open_ports;        // Number of entries in open_ports
+  double port_open_rate;     // Probability that any other port of a live host is open
+  double firewalled;         // Fraction of live hosts that drop probes to closed ports (no RST)
+  int64_t rtt_us;            // Smallest round-trip time
+  int64_t rtt_spread_us;     // Per-host extra round-trip time, uniform in [0, spread)
+  int64_t rtt_jitter_us;     // Per-packet extra delay, uniform in [0, jitter)
+  double loss;               // Probability that a packet is lost, in each direction
+  int rst_per_sec;           // RSTs a host sends per second, 0 for no limit
+  uint64_t seed;             // Seed for host properties and packet fates
+} net_sim_config_t;
+
+// What happened inside the simulator
+typedef struct
+{
+  uint64_t probes;      // Probes sent by the engine
+  uint64_t syn_acks;    // SYN-ACKs delivered
+  uint64_t rsts;        // RSTs delivered
+  uint64_t lost;        // Probes or replies lost in transit
+  uint64_t rst_limited; // RSTs suppressed by rate limiting
+  uint64_t unanswered;  // Probes to absent hosts or firewalled ports
+} net_sim_stats_t;
+
+/**
+ * Creates a simulated network
+ *
+ * @param config Network description (open_ports is copied)
+ * @return The transport, or NULL on allocation failure
+ */
+transport_t *net_sim_open(const net_sim_config_t *config);
+
+/**
+ * Tells whether a simulated port is open (ground truth for checking engine results)
+ *
+ * @param transport Transport returned by net_sim_open
+ * @param addr Host address, network byte order
+ * @param port Port
+ * @return true if the host is up and the port is open
+ */
+bool net_sim_port_open(const transport_t *transport, uint32_t addr, uint16_t port);
+
+/**
+ * Reads the simulator's counters
+ *
+ * @param transport Transport returned by net_sim_open
+ * @param stats Filled with the counters
+ */
+void net_sim_get_stats(const transport_t *transport, net_sim_stats_t *stats);
+
+#endif /* NET_SIM_H */
@@ -0,0 +1,176 @@
+/**
+ * Neptune Scanner - OS Detection
+ * os_detect.h - Active TCP/IP stack fingerprinting against a signature database
+ *
+ * Each host is sent a fixed probe sequence: two SYNs to an open port (with and without TCP
+ * options), an ACK to the open port, a SYN to a closed port and an ICMP echo request. The
+ * responses (TTL, DF, window, TCP option layout, MSS, window scale and flags) form a fingerprint
+ * that is scored against the signatures in data/neptune-os-db. Probes for a whole batch of hosts
+ * are sent back to back over shared raw sockets and the replies are matched as they arrive.
+ *
+ * Signatures are indexed by the two most discriminating fields of the SYN response, the initial
+ * TTL and the option layout, so a fingerprint is only scored against the few signatures that
+ * can plausibly match.
+ */
+
+#ifndef OS_DETECT_H
+#define OS_DETECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OS_MAX_BATCH 256       // Maximum number of hosts probed together
+#define OS_MAX_ALTERNATIVES 8  // Maximum number of alternative values for one signature field
+#define OS_MAX_OPTIONS_LEN 16  // Maximum length of an option layout string
+#define OS_MAX_SIGNATURES 8192 // Maximum number of signatures in the database
+#define OS_MAX_PROBE_LEN 40    // Longest TCP probe segment (20-byte header + 20 bytes of options)
+
+// Probes in the fingerprinting sequence
+typedef enum
+{
+  OS_PROBE_SYN,    // SYN with window scale, NOP, MSS, timestamp and SACK-permitted to an open port
+  OS_PROBE_PLAIN,  // SYN without options to an open port
+  OS_PROBE_ACK,    // ACK to an open port
+  OS_PROBE_CLOSED, // SYN to a closed port
+  OS_PROBE_ICMP,   // ICMP echo request
+  OS_PROBE_COUNT
+} os_probe_t;
+
+// What the response to one probe looked like
+typedef struct
+{
+  bool responded;                       // A response arrived
+  uint8_t ttl;                          // TTL as received
+  bool df;                              // Don't Fragment bit
+  uint16_t window;                      // TCP window
+  uint8_t flags;                        // TCP flags (TCP_SYN, TCP_ACK, ...)
+  char options[OS_MAX_OPTIONS_LEN + 1]; // Option layout: M=MSS, N=NOP, W=window scale,
+                                        // S=SACK permitted, T=timestamp, E=end of list
+  uint16_t mss;                         // MSS option value, 0 if absent
+  int wscale;                           // Window scale option value, -1 if absent
+} os_response_t;
+
+// A host's responses to the whole probe sequence
+typedef struct
+{
+  os_response_t responses[OS_PROBE_COUNT];
+} os_fingerprint_t;
+
+// A host to fingerprint
+typedef struct
+{
+  uint32_t addr;    // IPv4 address, network byte order
+  int open_port;    // An open TCP port, or 0 if none is known (open-port probes are skipped)
+  int closed_port;  // A closed TCP port
+} os_target_t;
+
+// Result of matching a fingerprint
+typedef struct
+{
+  const char *name;    // Best matching signature, or NULL if nothing scored
+  const char *os_class; // Its class line (e.g., "Linux | general purpose")
+  int score;           // Match quality of the best signature, 0-100
+  int runner_up;       // Match quality of the best signature of a different class, 0-100
+} os_match_t;
+
+/**
+ * Loads the OS signature database, replacing any database loaded before
+ *
+ * @param path Path to a file in the neptune-os-db format
+ * @return true if the file was read and contained at least one signature
+ */
+bool load_os_db(const char *path);
+
+/**
+ * Releases the OS signature database
+ */
+void free_os_db(void);
+
+/**
+ * Probes a batch of hosts concurrently
+ *
+ * Requires raw socket privileges. Unanswered probes are retransmitted up to OS_DETECTION_TRIES
+ * times within OS_DETECTION_TIMEOUT.
+ *
+ * @param targets Hosts to probe
+ * @param count Number of hosts (at most OS_MAX_BATCH)
+ * @param fingerprints Output array, one fingerprint per host
+ * @return false if the raw sockets could not be opened
+ */
+bool os_probe_hosts(const os_target_t *targets, int count, os_fingerprint_t *fingerprints);
+
+/**
+ * Scores a fingerprint against the loaded signatures
+ *
+ * @param fingerprint Responses of one host
+ * @param match Filled with the best match
+ * @return true if some signature scored above zero
+ */
+bool os_match_fingerprint(const os_fingerprint_t *fingerprint, os_match_t *match);
+
+/**
+ * Seeds a random state for probe fields, different on every call
+ *
+ * @param state Receives the state
+ */
+void os_random_seed(uint64_t *state);
+
+/**
+ * Draws random bits for probe fields (xorshift64; reentrant, each caller keeps its own state)
+ *
+ * @param state State seeded by os_random_seed
+ * @return 32 random bits
+ */
+uint32_t os_random(uint64_t *state);
+
+/**
+ * Builds a TCP probe segment with its checksum, without an IP header
+ *
+ * With options set this is the OS_PROBE_SYN probe, which the SYN scan also sends so that its
+ * SYN-ACKs can be matched against the SYN lines of the signature database.
+ *
+ * @param segment Output buffer of at least OS_MAX_PROBE_LEN bytes
+ * @param saddr Source address, network byte order
+ * @param daddr Destination address, network byte order
+ * @param sport Source port
+ * @param dport Destination port
+ * @param flags TCP flags (TCP_SYN, TCP_ACK, ...)
+ * @param options Whether to add the OS_PROBE_SYN options
+ * @param rng Random state for the sequence and acknowledgment numbers
+ * @return Segment length
+ */
+size_t os_build_tcp_probe(unsigned char *segment, uint32_t saddr, uint32_t daddr, uint16_t sport,
+                          uint16_t dport, uint8_t flags, bool options, uint64_t *rng);
+
+/**
+ * Parses a received IPv4 TCP packet into a probe response
+ *
+ * @param packet Packet starting at the IP header
+ * @param len Packet length
+ * @param response Filled with the TTL, DF, window, flags and TCP options
+ * @return false if the packet is not a complete TCP packet
+ */
+bool os_parse_tcp_response(const unsigned char *packet, size_t len, os_response_t *response);
+
+/**
+ * Finds the local address used to reach a target (POSIX only)
+ *
+ * @param target Target address, network byte order
+ * @return Local address, or 0 if there is no route
+ */
+uint32_t os_source_address(uint32_t target);
+
+/**
+ * Performs OS detection on the target host.
+ *
+ * The first open port found by the scan is used for the open-port probes.
+ *
+ * @param target The hostname or IP address to check
+ * @param os_info Buffer to store OS information
+ * @param os_info_size Size of the buffer
+ * @return true if OS detection was successful, false otherwise
+ */
+bool detect_os(const char *target, char *os_info, size_t os_info_size);
+
+#endif /* OS_DETECT_H */
@@ -0,0 +1,64 @@
+/**
+ * Neptune Scanner - Passive OS Inference
+ * passive_os.h - OS guesses from the SYN-ACKs received during a SYN scan
+ *
+ * The SYN scan sends the same SYN as the OS_PROBE_SYN probe of active OS detection, so every
+ * SYN-ACK it receives is already the first response of an OS fingerprint. The scan records the
+ * first SYN-ACK of each host here; a guess is then made from the SYN lines of the signature
+ * database at no extra probe cost, and active -O probing is only needed when that guess does
+ * not clearly single out one OS class.
+ */
+
+#ifndef PASSIVE_OS_H
+#define PASSIVE_OS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "os_detect.h"
+
+#define PASSIVE_OS_MAX_HOSTS 4096 // Hosts whose SYN-ACKs are remembered
+
+/**
+ * Records a SYN-ACK received from a host (thread-safe)
+ *
+ * The first SYN-ACK of a host is kept. Later ones are compared with it: a host whose ports
+ * answer with different stacks (e.g., port forwarding to other machines) is marked inconsistent.
+ *
+ * @param addr Host address, network byte order
+ * @param syn_ack Parsed SYN-ACK
+ */
+void passive_os_record(uint32_t addr, const os_response_t *syn_ack);
+
+/**
+ * Guesses a host's OS from its recorded SYN-ACK
+ *
+ * @param addr Host address, network byte order
+ * @param match Filled with the best match of the SYN-ACK alone
+ * @param syn_ack If not NULL, filled with the recorded SYN-ACK
+ * @return false if no SYN-ACK was recorded for the host or no signature matched
+ */
+bool passive_os_guess(uint32_t addr, os_match_t *match, os_response_t *syn_ack);
+
+/**
+ * Tells whether a passive guess is too weak to stand without active probing
+ *
+ * @param addr Host address, network byte order
+ * @param match Result of passive_os_guess
+ * @return true if the score is below OS_MATCH_THRESHOLD, another OS class scored within
+ *         PASSIVE_OS_MARGIN, or the host's SYN-ACKs disagreed
+ */
+bool passive_os_ambiguous(uint32_t addr, const os_match_t *match);
+
+/**
+ * Forgets the SYN-ACK of one host, making room for others during a long sweep
+ *
+ * @param addr Host address, network byte order
+ */
+void passive_os_forget(uint32_t addr);
+
+/**
+ * Forgets all recorded SYN-ACKs
+ */
+void passive_os_reset(void);
+
+#endif /* PASSIVE_OS_H */
@@ -0,0 +1,138 @@
+/**
+ * Neptune Scanner - Port Specifications
+ * port_spec.h - Compiling -p port specs into per-protocol port bitmaps
+ *
+ * A spec is a comma-separated list of items:
+ *
+ *   80         one port (0-65535)
+ *   8000-9000  a range; "1024-" runs to 65535, "-1024" starts at 1, "-" alone is 1-65535
+ *   T: U:      the following items are TCP (the default) or UDP ports, e.g. "22,U:53,T:80"
+ *   [ ... ]    items between brackets are excluded, e.g. "-,[25,135-139]"
+ *
+ * Exclusions apply after every inclusion, wherever they appear. A spec compiles into one
+ * 65536-bit bitmap per protocol (8 KB each), so any selection costs the same to store, and the
+ * engines walk the set ports with count-trailing-zeros rather than keeping port lists.
+ */
+
+#ifndef PORT_SPEC_H
+#define PORT_SPEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PORT_BITMAP_WORDS (65536 / 64)
+
+// A set of ports
+typedef struct
+{
+  uint64_t bits[PORT_BITMAP_WORDS];
+} port_bitmap_t;
+
+// The ports of a spec, by protocol
+typedef struct
+{
+  port_bitmap_t tcp;
+  port_bitmap_t udp;
+} port_spec_t;
+
+/**
+ * Compiles a port spec
+ *
+ * @param text Spec, e.g. "1-1024,3306,T:8000-9000,U:53,[135-139]"
+ * @param spec Receives the ports
+ * @param error Receives a message when the spec is invalid
+ * @param error_size Size of the error buffer
+ * @return false if the spec is invalid or selects no ports
+ */
+bool port_spec_parse(const char *text, port_spec_t *spec, char *error, size_t error_size);
+
+/**
+ * Empties a bitmap
+ *
+ * @param bitmap Bitmap
+ */
+void port_bitmap_clear(port_bitmap_t *bitmap);
+
+/**
+ * Adds the ports first to last
+ *
+ * @param bitmap Bitmap
+ * @param first First port (0-65535)
+ * @param last Last port, at least first
+ */
+void port_bitmap_set_range(port_bitmap_t *bitmap, int first, int last);
+
+/**
+ * Counts the ports in a bitmap
+ *
+ * @param bitmap Bitmap
+ * @return Number of ports
+ */
+int port_bitmap_count(const port_bitmap_t *bitmap);
+
+/**
+ * Writes the ports of a bitmap in ascending order
+ *
+ * @param bitmap Bitmap
+ * @param ports Output array
+ * @param max Capacity of ports
+ * @return Number of ports written
+ */
+int port_bitmap_to_list(const port_bitmap_t *bitmap, int *ports, int max);
+
+/**
+ * Formats a bitmap as a spec of ports and ranges ("22,80,8000-9000")
+ *
+ * @param bitmap Bitmap
+ * @param buffer Output buffer; a spec that does not fit is cut short and ends in "..."
+ * @param size Size of the buffer
+ */
+void port_bitmap_format(const port_bitmap_t *bitmap, char *buffer, size_t size);
+
+/**
+ * Adds a port
+ *
+ * @param bitmap Bitmap
+ * @param port Port (0-65535)
+ */
+static inline void port_bitmap_set(port_bitmap_t *bitmap, int port)
+{
+  bitmap->bits[port >> 6] |= 1ull << (port & 63);
+}
+
+/**
+ * Tests for a port
+ *
+ * @param bitmap Bitmap
+ * @param port Port (0-65535)
+ * @return true if the port is in the bitmap
+ */
+static inline bool port_bitmap_test(const port_bitmap_t *bitmap, int port)
+{
+  return (bitmap->bits[port >> 6] >> (port & 63)) & 1;
+}
+
+/**
+ * Finds the first port at or after a given one, skipping empty words 64 ports at a time
+ *
+ * @param bitmap Bitmap
+ * @param from Port to start at (0-65536)
+ * @return The port, or -1 if there is none
+ */
+static inline int port_bitmap_next(const port_bitmap_t *bitmap, int from)
+{
+  if (from > 65535)
+    return -1;
+  int word = from >> 6;
+  uint64_t bits = bitmap->bits[word] & (~0ull << (from & 63));
+  while (bits == 0)
+  {
+    if (++word == PORT_BITMAP_WORDS)
+      return -1;
+    bits = bitmap->bits[word];
+  }
+  return word * 64 + __builtin_ctzll(bits);
+}
+
+#endif /* PORT_SPEC_H */
@@ -0,0 +1,45 @@
+/**
+ * Neptune Scanner - Binary Results
+ * results_binary.h - Compact binary results (-oB) with a deduplicated banner table
+ *
+ * The text results file (-o) keeps ports, services and versions but no banners. The binary
+ * form keeps the banners too, byte for byte: it writes each distinct banner once, in a table,
+ * and each result refers to it by ID, so a fleet-wide -sV run that sees the same sshd banner
+ * on thousands of ports stores it once.
+ *
+ * All integers are little-endian. IDs index the table they refer to from 1; 0 means none.
+ *
+ *   header   "NSRB", u8 version (1), u8[3] zero, u32 IPv4 address (a << 24 | b << 16 | ...),
+ *            u16 shard index (0 = not sharded), u16 shard count
+ *   strings  u32 count, then per string: u16 length, bytes    (service and protocol names)
+ *   banners  u32 count, then per banner: u32 length, bytes
+ *   results  u32 count, then per open port, sorted by port:
+ *            u16 port, u32 service string ID, u32 protocol string ID, u32 banner ID,
+ *            u16 version length, version bytes
+ */
+
+#ifndef RESULTS_BINARY_H
+#define RESULTS_BINARY_H
+
+#include <stdbool.h>
+#include "service_records.h"
+
+#define RESULTS_BINARY_MAGIC "NSRB"
+#define RESULTS_BINARY_VERSION 1
+
+/**
+ * Writes the open ports of one host in the binary format
+ *
+ * @param path Output file
+ * @param addr Host address in dotted form
+ * @param shard_index Shard of this scan (1-based), 0 if the scan is not sharded
+ * @param shard_count Number of shards
+ * @param ports Open ports, in any order
+ * @param services Service records parallel to ports, or NULL
+ * @param count Number of open ports
+ * @return false if the file cannot be written
+ */
+bool results_binary_write(const char *path, const char *addr, int shard_index, int shard_count,
+                          const int *ports, const service_table_t *services, int count);
+
+#endif /* RESULTS_BINARY_H */
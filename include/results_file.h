@@ -0,0 +1,81 @@
+/**
+ * Neptune Scanner - Results File
+ * results_file.h - Sorted, mergeable scan results (-o), the format shard outputs are merged in
+ *
+ * A results file is text. Lines starting with '#' are comments; the first is the format line
+ * "# neptunescan results 1", and a shard of a sharded scan adds "# shard <i>/<n>". Each other
+ * line is one open port:
+ *
+ *   <IPv4 address>\t<port>\topen\t<service>\t<version>
+ *
+ * Lines are sorted by address, then port, so the files of all shards of a scan can be merged
+ * with a streaming k-way merge (tools/mergeshards) without loading any of them.
+ */
+
+#ifndef RESULTS_FILE_H
+#define RESULTS_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "service_records.h"
+
+#define RESULTS_FILE_FORMAT "# neptunescan results 1"
+#define RESULTS_FILE_MAX_LINE 1024 // Longest line, newline included
+
+// An open port and its position in the caller's arrays
+typedef struct
+{
+  int port;
+  int index;
+} result_ref_t;
+
+/**
+ * Orders the open ports of one host as the results files list them: by port, each port once
+ *
+ * @param ports Open ports, in any order
+ * @param count Number of open ports
+ * @param unique Receives the number of distinct ports
+ * @return References whose first *unique entries are the distinct ports in ascending order, the
+ *         first position of each kept (free it), or NULL if memory runs out
+ */
+result_ref_t *results_file_order(const int *ports, int count, int *unique);
+
+/**
+ * Writes the open ports of one host
+ *
+ * @param path Output file
+ * @param addr Host address in dotted form
+ * @param shard_index Shard of this scan (1-based), 0 if the scan is not sharded
+ * @param shard_count Number of shards
+ * @param ports Open ports, in any order
+ * @param services Service records parallel to ports, or NULL
+ * @param count Number of open ports
+ * @return false if the file cannot be written
+ */
+bool results_file_write(const char *path, const char *addr, int shard_index, int shard_count,
+                        const int *ports, const service_table_t *services, int count);
+
+/**
+ * Writes the open ports of a multi-host scan, without service fields
+ *
+ * @param path Output file
+ * @param shard_index Shard of this scan (1-based), 0 if the scan is not sharded
+ * @param shard_count Number of shards
+ * @param keys Open ports as results_file_key makes them, in any order; sorted in place
+ * @param count Number of open ports
+ * @return false if the file cannot be written
+ */
+bool results_file_write_keys(const char *path, int shard_index, int shard_count, uint64_t *keys,
+                             size_t count);
+
+/**
+ * Reads the sort key of a result line
+ *
+ * @param line Line from a results file
+ * @param key Receives the address (host byte order) in the high bits and the port in the low 16
+ * @return false for comments, blank lines and malformed lines
+ */
+bool results_file_key(const char *line, uint64_t *key);
+
+#endif /* RESULTS_FILE_H */
@@ -0,0 +1,173 @@
+/**
+ * Neptune Scanner - Live Scan Statistics
+ * scan_stats.h - Per-thread counters, RTT histograms and the periodic reporter
+ *
+ * Every thread that records a statistic gets a shard of its own: a block of counters and an RTT
+ * histogram on separate cache lines from every other thread's. Recording is a relaxed atomic add
+ * to the caller's shard, with no lock and no shared cache line; readers sum all shards. A shard
+ * is handed on when its thread exits, so the thread-per-port connect scan reuses a few shards
+ * instead of creating one per port. Beyond STATS_MAX_SHARDS concurrent threads, the rest share
+ * one overflow shard (still lock-free, merely contended).
+ *
+ * RTTs go into an HDR-style log-linear histogram: STATS_RTT_SUB_BUCKETS buckets per power of
+ * two, so any RTT from 1 us to hours is kept to within 1/STATS_RTT_SUB_BUCKETS of its value in a
+ * fixed amount of memory.
+ */
+
+#ifndef SCAN_STATS_H
+#define SCAN_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATS_MAX_SHARDS 64         // Threads with a shard of their own
+#define STATS_RTT_SUB_BITS 4        // log2 of the buckets per power of two
+#define STATS_RTT_SUB_BUCKETS (1 << STATS_RTT_SUB_BITS)
+#define STATS_RTT_MAX_EXPONENT 35   // RTTs of 2^36 us (19 hours) or more share the last bucket
+#define STATS_RTT_BUCKETS \
+  ((STATS_RTT_MAX_EXPONENT - STATS_RTT_SUB_BITS + 2) * STATS_RTT_SUB_BUCKETS)
+
+// Counters kept per thread
+typedef enum
+{
+  STAT_PROBES_SENT,    // Probes sent, including retransmissions
+  STAT_RESPONSES,      // Replies matched to a probe
+  STAT_RETRANSMITS,    // Probes sent again after a timeout
+  STAT_TIMEOUTS,       // Waits for a reply that ran out
+  STAT_OPEN,           // Ports found open
+  STAT_CLOSED,         // Ports found closed
+  STAT_FILTERED,       // Ports that never answered
+  STAT_BYTES_SENT,     // Bytes sent on the wire (packets) or the connection (streams)
+  STAT_BYTES_RECEIVED, // Bytes received likewise
+  STAT_COUNT
+} scan_stat_t;
+
+// Levels kept globally; every user adds and later removes its own share, so concurrent scans
+// add up instead of overwriting each other
+typedef enum
+{
+  GAUGE_IN_FLIGHT,     // Probes sent and waiting for a reply
+  GAUGE_ACTIVE_HOSTS,  // Hosts being scanned
+  GAUGE_PROBE_QUEUE,   // Ports of running scans not probed yet
+  GAUGE_SERVICE_QUEUE, // Open ports waiting for service detection
+  GAUGE_COUNT
+} scan_gauge_t;
+
+// Sum of all shards at one moment
+typedef struct
+{
+  int64_t taken_us;                   // scan_stats_now_us() when the snapshot was taken
+  double cpu_seconds;                 // Process CPU time (user + system) at that moment
+  uint64_t targets;                   // Ports announced with scan_stats_expect
+  uint64_t counters[STAT_COUNT];
+  int64_t gauges[GAUGE_COUNT];
+  uint64_t rtt_count;                 // RTTs recorded
+  uint64_t rtt_sum_us;                // Their sum
+  uint64_t rtt[STATS_RTT_BUCKETS];    // Their histogram
+} scan_stats_snapshot_t;
+
+/**
+ * Name of a counter as used in reports ("probes_sent", ...)
+ *
+ * @param stat Counter
+ * @return Static string
+ */
+const char *scan_stats_counter_name(scan_stat_t stat);
+
+/**
+ * Name of a gauge as used in reports ("in_flight", ...)
+ *
+ * @param gauge Gauge
+ * @return Static string
+ */
+const char *scan_stats_gauge_name(scan_gauge_t gauge);
+
+/**
+ * Adds to one of the calling thread's counters
+ *
+ * @param stat Counter
+ * @param amount Amount to add
+ */
+void scan_stats_add(scan_stat_t stat, uint64_t amount);
+
+/**
+ * Records a round-trip time in the calling thread's histogram
+ *
+ * @param rtt_us Time from the probe to its reply, in microseconds
+ */
+void scan_stats_record_rtt(int64_t rtt_us);
+
+/**
+ * Raises or lowers a gauge
+ *
+ * @param gauge Gauge
+ * @param delta Amount to add (negative to lower)
+ */
+void scan_stats_gauge_add(scan_gauge_t gauge, int64_t delta);
+
+/**
+ * Creates shards ahead of a scan, so that its threads find one free instead of allocating it
+ *
+ * @param threads Threads that will count concurrently (capped at STATS_MAX_SHARDS)
+ */
+void scan_stats_reserve(int threads);
+
+/**
+ * Announces ports about to be scanned, so reports can show progress
+ *
+ * @param targets Number of ports (host and port pairs) the scan will report on
+ */
+void scan_stats_expect(uint64_t targets);
+
+/**
+ * Monotonic clock for RTT measurements
+ *
+ * @return Microseconds since an arbitrary fixed point
+ */
+int64_t scan_stats_now_us(void);
+
+/**
+ * Sums all shards
+ *
+ * @param snapshot Filled with the totals so far
+ */
+void scan_stats_snapshot(scan_stats_snapshot_t *snapshot);
+
+/**
+ * Reads a percentile from a snapshot's RTT histogram
+ *
+ * @param snapshot Snapshot
+ * @param percentile Percentile, 0 to 100
+ * @return The highest RTT in the bucket holding that percentile, in microseconds; 0 if no RTT
+ *         was recorded
+ */
+int64_t scan_stats_rtt_percentile(const scan_stats_snapshot_t *snapshot, double percentile);
+
+/**
+ * Upper bound of an RTT histogram bucket
+ *
+ * @param index Bucket, 0 to STATS_RTT_BUCKETS - 1
+ * @return The highest RTT counted in that bucket, in microseconds
+ */
+int64_t scan_stats_rtt_bucket_high(int index);
+
+/**
+ * Starts a low-priority thread that reports the statistics at a fixed interval
+ *
+ * Each report prints one line on stderr with totals, rates over the interval, RTT percentiles
+ * and CPU use, and writes the same data as one line of JSON to json_sink if one is given. A
+ * final report is made by scan_stats_stop_reporter.
+ *
+ * @param interval_ms Time between reports
+ * @param json_sink NULL, a file path, "tcp:HOST:PORT" or (not on Windows) "unix:PATH"
+ * @return false if the sink cannot be opened or the thread cannot be started
+ */
+bool scan_stats_start_reporter(int interval_ms, const char *json_sink);
+
+/**
+ * Makes a final report and stops the reporter thread, if it was started
+ */
+void scan_stats_stop_reporter(void);
+
+#endif /* SCAN_STATS_H */
@@ -5,4 +5,31 @@
 
 const char *scan_type_to_string(scan_type_t scan_type);
 
+/**
+ * Keeps the ports of one shard of a scan (--shard): every shard_count-th port starting at
+ * position shard_index - 1, so shards are disjoint, differ in size by at most one port and each
+ * samples the whole list rather than one block of it
+ *
+ * @param ports Ports of the whole scan; the shard's ports are moved to the front, in order
+ * @param count Number of ports
+ * @param shard_index Shard (1 to shard_count)
+ * @param shard_count Number of shards
+ * @return Number of ports in the shard
+ */
+int shard_ports(int *ports, int count, int shard_index, int shard_count);
+
+/**
+ * Keeps the ports of one shard of a bitmap: every shard_count-th port in ascending order,
+ * starting at position (shard_index - 1 - rotation) modulo shard_count
+ *
+ * @param ports Ports of the whole scan
+ * @param rotation Shift of the slices (0 to shard_count - 1); the same rotation across all
+ *                 shards gives disjoint slices that together cover ports
+ * @param shard_index Shard (1 to shard_count)
+ * @param shard_count Number of shards
+ * @param shard Receives the shard's ports
+ */
+void shard_port_bitmap(const port_bitmap_t *ports, int rotation, int shard_index,
+                       int shard_count, port_bitmap_t *shard);
+
 #endif // SCAN_UTILS_H
\ No newline at end of file
@@ -9,7 +9,12 @@
 #define SCANNER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "advanced_scan.h"
+#include "port_spec.h"
+#include "syn_engine.h"
+#include "target_spec.h"
 
 // Default timeout in milliseconds
 #define DEFAULT_TIMEOUT 1000
@@ -21,29 +26,75 @@
 bool init_scanner(void);
 void cleanup_scanner(void);
 
+/**
+ * Sizes the scanner's memory for a scan, so that probing and recording results allocate nothing
+ *
+ * Call after init_scanner with the number of ports the scan will probe. Scans larger than the
+ * reservation still work; they grow the memory once when they start.
+ *
+ * @param max_ports Ports to be scanned
+ * @return false if memory runs out
+ */
+bool scanner_reserve(int max_ports);
+
 // Port scanning functions
 void scan_ports(const char *target, int start_port, int end_port, scan_type_t scan_type);
 void scan_port(const char *target, int port, scan_type_t scan_type);
+void scan_port_list(const char *target, const int *ports, int count, scan_type_t scan_type);
+void scan_port_bitmap(const char *target, const port_bitmap_t *ports, scan_type_t scan_type);
 void scan_common_ports(const char *target, scan_type_t scan_type);
 int is_port_open(const char *target, int port, scan_type_t scan_type);
 
-// Open ports tracking
-int *get_open_ports(void);
-int get_num_open_ports(void);
-int add_open_port(int port);
+// Addresses that share their ports in a sharded multi-host scan: aligned runs of this many
+#define SHARD_RUN_HOSTS 256
 
-// Service detection
-const char *get_service_name(int port);
-const char *get_service_description(int port);
+// Called with each open port of a multi-host scan; addr is in host byte order
+typedef void (*target_open_fn)(void *context, uint32_t addr, int port);
+
+// Called once the hosts first to last (host byte order) of a multi-host scan are finished
+typedef void (*target_done_fn)(void *context, uint32_t first, uint32_t last);
 
 /**
- * Performs OS detection on the target host.
+ * Scans the ports of a bitmap on every host of a target stream, taking blocks as it goes
+ *
+ * A SYN scan keeps SWEEP_JOBS blocks in the SYN engine at once, one job each, and tops it up
+ * from the stream as blocks finish; other scan types take the hosts one at a time. The SYN-ACKs
+ * of open ports are recorded for the passive OS guess (passive_os.h) until on_done has seen
+ * their host.
  *
- * @param target The hostname or IP address to check
- * @param os_info Buffer to store OS information
- * @param os_info_size Size of the buffer
- * @return true if OS detection was successful, false otherwise
+ * A shard scans a slice of the targets x ports space. Each aligned run of SHARD_RUN_HOSTS
+ * addresses gets every shard_count-th port, starting at a position that rotates from one run
+ * to the next, so the shards are disjoint, together cover every pair and share the work evenly
+ * whether a scan has many hosts or many ports.
+ *
+ * @param targets Target stream
+ * @param ports Ports to scan on each host
+ * @param shard_index Shard to scan (1 to shard_count), 0 for the whole scan
+ * @param shard_count Number of shards
+ * @param scan_type The type of scan to perform
+ * @param on_open Called with each open port as it is found
+ * @param on_done Called with each run of finished hosts, or NULL
+ * @param context Passed to on_open and on_done
+ * @return Number of hosts scanned
+ */
+uint64_t scan_target_stream(target_stream_t *targets, const port_bitmap_t *ports,
+                            int shard_index, int shard_count, scan_type_t scan_type,
+                            target_open_fn on_open, target_done_fn on_done, void *context);
+
+/**
+ * Probes one port with a non-blocking connect, counting it in the live statistics (reentrant)
+ *
+ * @param addr Target address, network byte order
+ * @param port Port to probe
+ * @param timeout_ms Time to wait for the connection
+ * @param state Receives the outcome
+ * @return false if no socket could be created; nothing was sent
  */
-bool detect_os(const char *target, char *os_info, size_t os_info_size);
+bool connect_probe(uint32_t addr, int port, int timeout_ms, port_state_t *state);
+
+// Open ports tracking
+const int *get_open_ports(void);
+int get_num_open_ports(void);
+int add_open_port(int port);
 
 #endif /* SCANNER_H */ // End of include guard
\ No newline at end of file
@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "http_parser.h"
+#include "tls_probe.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -21,23 +24,45 @@ typedef struct
   char service_name[64]; // Service name (e.g., "Web Server", "File Server")
   char version[32];      // Service version
   char banner[1024];     // Service banner
+  size_t banner_len;     // Bytes of the banner as received; it may hold NULs
+  http_info_t http;      // HTTP response details, if detect_http got a response
+  tls_info_t tls;        // TLS handshake details, if the service speaks TLS
 } ServiceInfo;
 
 // Function declarations
-const char *get_service_name(int port);
-const char *get_service_description(int port);
 bool grab_banner(const char *target, int port, char *banner, size_t banner_size);
 bool detect_service_version(const char *target, int port, char *version, size_t version_size);
 
 // Main service detection function
 bool detect_service(const char *host, int port, ServiceInfo *service_info);
 
+/**
+ * Identifies the service on a port of an address that is already resolved, so the probes reach
+ * the address that was scanned
+ *
+ * @param host The target as given, used for SNI and the HTTP Host header
+ * @param addr The target address, network byte order
+ * @param port The port to check
+ * @param service_info Pointer to service info structure to fill
+ * @return true if service was detected, false otherwise
+ */
+bool detect_service_at(const char *host, uint32_t addr, int port, ServiceInfo *service_info);
+
+/**
+ * Allocates the calling thread's detection buffers (TLS parser, HTTP request and response)
+ * ahead of a scan; otherwise they are allocated by the thread's first detection
+ *
+ * @return false if memory runs out
+ */
+bool service_detection_reserve(void);
+
 // Service-specific detection functions
 bool detect_http(const char *target, int port, ServiceInfo *service_info);
 bool detect_ftp(const char *target, int port, ServiceInfo *service_info);
 bool detect_smtp(const char *target, int port, ServiceInfo *service_info);
 bool detect_ssh(const char *target, int port, ServiceInfo *service_info);
 bool detect_telnet(const char *target, int port, ServiceInfo *service_info);
+bool detect_tls(const char *target, int port, ServiceInfo *service_info);
 
 // Helper function to identify service from banner
 void identify_service(ServiceInfo *service_info);
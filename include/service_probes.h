@@ -0,0 +1,142 @@
+/**
+ * Neptune Scanner - Service Probe Database
+ * service_probes.h - Probe payloads and match rules loaded from a probe file
+ *
+ * The probe file uses a subset of the nmap-service-probes format. See
+ * data/neptune-service-probes for the supported directives and pattern syntax.
+ */
+
+#ifndef SERVICE_PROBES_H
+#define SERVICE_PROBES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "service_detection.h"
+
+#define MAX_PROBE_NAME 32       // Maximum length of a probe name
+#define MAX_PROBE_PAYLOAD 512   // Maximum size of a probe payload
+#define MAX_PROBE_PORT_RANGES 32 // Maximum number of port ranges per probe
+#define MAX_MATCH_PATTERN 160   // Maximum number of tokens in a match pattern
+#define MAX_SERVICE_PROBES 64   // Maximum number of probes in the database
+
+// Token kinds in a compiled match pattern
+typedef enum
+{
+  PATTERN_LITERAL, // Match one byte
+  PATTERN_ANY,     // Match any run of bytes (shortest first)
+  PATTERN_VERSION  // Capture a version token (longest first)
+} pattern_token_kind_t;
+
+typedef struct
+{
+  unsigned char kind; // pattern_token_kind_t
+  unsigned char byte; // Byte to match for PATTERN_LITERAL
+} pattern_token_t;
+
+// A single "match" rule of a probe
+typedef struct
+{
+  char service[32];                         // Service name (e.g., "ssh")
+  char product[64];                         // Product name (e.g., "OpenSSH"), may be empty
+  pattern_token_t tokens[MAX_MATCH_PATTERN]; // Compiled pattern
+  int num_tokens;                           // Number of tokens in the pattern
+  bool anchored;                            // Pattern must match at the start of the response
+  bool nocase;                              // Case-insensitive literal comparison
+} probe_match_t;
+
+// Inclusive range of ports a probe usually matches
+typedef struct
+{
+  unsigned short low;
+  unsigned short high;
+} probe_port_range_t;
+
+// A probe: payload to send plus the rules used to interpret the reply
+typedef struct
+{
+  char name[MAX_PROBE_NAME];                          // Probe name (e.g., "GetRequest")
+  unsigned char payload[MAX_PROBE_PAYLOAD];           // Bytes to send (empty for the NULL probe)
+  size_t payload_len;                                 // Number of payload bytes
+  probe_port_range_t ports[MAX_PROBE_PORT_RANGES];    // Ports this probe usually matches
+  int num_port_ranges;                                // Number of entries in ports
+  probe_port_range_t ssl_ports[MAX_PROBE_PORT_RANGES]; // Ports where the service is wrapped in TLS
+  int num_ssl_port_ranges;                            // Number of entries in ssl_ports
+  int rarity;                                         // 1 (common) to 9 (rare)
+  probe_match_t *matches;                             // Match rules, tried in file order
+  int num_matches;                                    // Number of match rules
+} service_probe_t;
+
+/**
+ * Parses a port list such as "80,443,8000-8100"
+ *
+ * @param text Port list; parsing stops at the first character that does not belong to it
+ * @param ranges Output array
+ * @param max_ranges Capacity of ranges
+ * @return Number of ranges stored
+ */
+int parse_port_ranges(const char *text, probe_port_range_t *ranges, int max_ranges);
+
+/**
+ * Checks whether a port falls in one of the ranges
+ *
+ * @param ranges Port ranges
+ * @param num_ranges Number of entries in ranges
+ * @param port Port to look for
+ * @return true if a range contains the port
+ */
+bool ranges_have_port(const probe_port_range_t *ranges, int num_ranges, int port);
+
+/**
+ * Loads the probe database from a file, replacing any previously loaded probes
+ *
+ * @param path Path to a probe file in the neptune-service-probes format
+ * @return true if the file was read and contained at least one probe
+ */
+bool load_service_probes(const char *path);
+
+/**
+ * Loads the small built-in probe set used when no probe file is available
+ */
+void load_default_service_probes(void);
+
+/**
+ * Releases the loaded probe database
+ */
+void free_service_probes(void);
+
+/**
+ * Selects the probes to try against a port, ordered by likelihood
+ *
+ * The NULL probe (empty payload) always comes first. Probes whose port list contains the port
+ * follow, then the remaining probes with a rarity not above the intensity, least rare first.
+ *
+ * @param port Target port
+ * @param intensity Version intensity (0-9)
+ * @param selected Output array of probe pointers
+ * @param max_selected Capacity of selected
+ * @return Number of probes stored in selected
+ */
+int select_service_probes(int port, int intensity, const service_probe_t **selected,
+                          int max_selected);
+
+/**
+ * Checks whether any loaded probe lists the port in its sslports
+ *
+ * @param port Target port
+ * @return true if services on the port usually speak TLS first
+ */
+bool is_ssl_port(int port);
+
+/**
+ * Applies a probe's match rules to a response
+ *
+ * @param probe Probe that produced the response
+ * @param response Response bytes
+ * @param response_len Number of response bytes
+ * @param service_info Filled with protocol, service name and version on a match
+ * @return true if one of the probe's rules matched
+ */
+bool match_service_probe(const service_probe_t *probe, const char *response, size_t response_len,
+                         ServiceInfo *service_info);
+
+#endif /* SERVICE_PROBES_H */
@@ -0,0 +1,133 @@
+/**
+ * Neptune Scanner - Service Records
+ * service_records.h - Compact storage for the service detection results of a scan
+ *
+ * detect_service fills a ServiceInfo, which is over 3 KB of fixed buffers. A scan keeps its
+ * results as service_record_t instead: the protocol and service name are interned (the same
+ * few strings repeat across ports), and the version and the preformatted HTTP and TLS detail
+ * lines are stored once, at their real length, in the table's arena. A record is 24 bytes plus
+ * its text, so millions of open ports cost tens of bytes each.
+ *
+ * Banners are content-addressed: many hosts send byte-identical banners (the same sshd build,
+ * the same default page), so each distinct banner is stored once, found by a 64-bit hash that
+ * is verified against the stored bytes, and records refer to it by ID. Output writers emit the
+ * banner table once and the same IDs (results_binary.h).
+ */
+
+#ifndef SERVICE_RECORDS_H
+#define SERVICE_RECORDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "service_detection.h"
+
+// One open port; text fields are arena offsets, 0 for none
+typedef struct
+{
+  uint32_t protocol;    // Interned string ID
+  uint32_t service;     // Interned string ID
+  uint32_t version;
+  uint32_t banner;      // Banner ID, 0 for none
+  uint32_t details;     // Lines printed under the port (http-title, ssl-cert, ...)
+  uint16_t port;
+} service_record_t;
+
+// A distinct banner
+typedef struct
+{
+  uint64_t hash;
+  uint32_t offset;        // Arena offset of the bytes
+  uint32_t len;
+} service_banner_t;
+
+// Records of one scan with their strings
+typedef struct
+{
+  service_record_t *records;
+  size_t count;
+  size_t capacity;
+
+  char *arena;            // NUL-terminated text; offset 0 holds the empty string
+  size_t arena_used;
+  size_t arena_capacity;
+
+  uint32_t *strings;      // Arena offset of each interned string, by ID (ID 0 is "")
+  uint32_t num_strings;
+  uint32_t strings_capacity;
+  uint32_t *intern_slots; // Open-addressed hash of string IDs, 0 for an empty slot
+  uint32_t intern_mask;
+
+  service_banner_t *banners; // By ID (ID 0 is no banner)
+  uint32_t num_banners;
+  uint32_t banners_capacity;
+  uint32_t *banner_slots;    // Open-addressed hash of banner IDs, 0 for an empty slot
+  uint32_t banner_mask;
+} service_table_t;
+
+/**
+ * Initializes an empty table
+ *
+ * @param table Table
+ */
+void service_table_init(service_table_t *table);
+
+/**
+ * Frees a table's records and strings
+ *
+ * @param table Table
+ */
+void service_table_free(service_table_t *table);
+
+/**
+ * Sizes a table for more ports, so that adding them allocates nothing
+ *
+ * Room is kept for the worst case: new strings and a distinct banner on every port, and the
+ * longest text in every field. Only the arena pages that are written take memory.
+ *
+ * @param table Table
+ * @param ports Ports that will be added
+ * @param details_max Size of the details buffer passed to service_table_add
+ * @return false if memory runs out or the arena would pass 4 GB
+ */
+bool service_table_reserve(service_table_t *table, size_t ports, size_t details_max);
+
+/**
+ * Adds the result of detect_service for one port
+ *
+ * @param table Table
+ * @param info Detection result (copied; it can be reused for the next port)
+ * @param details Text printed under the port, or NULL
+ * @return false if memory runs out
+ */
+bool service_table_add(service_table_t *table, const ServiceInfo *info, const char *details);
+
+/**
+ * Bytes of a banner; valid until the next service_table_add
+ *
+ * @param table Table
+ * @param id Banner ID from a record
+ * @param len Receives the banner's length, or NULL
+ * @return The banner, NUL-terminated; "" for ID 0
+ */
+const char *service_table_banner(const service_table_t *table, uint32_t id, uint32_t *len);
+
+/**
+ * Text of an arena offset; valid until the next service_table_add
+ *
+ * @param table Table
+ * @param offset Arena offset from a record's version or details
+ * @return The text, "" for offset 0
+ */
+const char *service_table_text(const service_table_t *table, uint32_t offset);
+
+/**
+ * Text of an interned string; valid until the next service_table_add
+ *
+ * @param table Table
+ * @param id String ID from a record's protocol or service
+ * @return The string, "" for ID 0
+ */
+const char *service_table_string(const service_table_t *table, uint32_t id);
+
+#endif /* SERVICE_RECORDS_H */
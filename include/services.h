@@ -0,0 +1,143 @@
+/**
+ * Neptune Scanner - Port to Service Lookup
+ * services.h - Service names, descriptions and frequencies by port
+ *
+ * Lookups come from two sources. The services database (data/neptune-services.db, built by
+ * tools/mkservicesdb from an nmap-services style text file) covers TCP and UDP and is memory
+ * mapped at startup. The compiled-in table in include/services.def covers the common TCP ports
+ * and is used whenever the database is not loaded or does not know a port. Both are indexed
+ * densely by port, so every lookup is a single array access.
+ */
+
+#ifndef SERVICES_H
+#define SERVICES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Transport protocols in the services database (IP protocol numbers)
+typedef enum
+{
+  SERVICE_PROTO_TCP = 6,
+  SERVICE_PROTO_UDP = 17
+} service_proto_t;
+
+// One row of the services table
+typedef struct
+{
+  unsigned short port;     // Port number
+  const char *name;        // Short service name (e.g., "http")
+  const char *description; // One-line description, may be empty
+  double frequency;        // Approximate fraction of hosts with the port open
+} service_entry_t;
+
+// Row numbers in the compiled-in table (SERVICE_ID_<port>), plus the number of rows
+enum
+{
+#define SERVICE(port, name, description, frequency) SERVICE_ID_##port,
+#include "services.def"
+#undef SERVICE
+  SERVICE_COUNT
+};
+
+// The compiled-in table, sorted by descending frequency
+extern const service_entry_t SERVICES[SERVICE_COUNT];
+
+/*
+ * Services database file layout (all integers little-endian, all offsets from the file start)
+ *
+ *   services_db_header_t
+ *   services_db_record_t records[num_records]   sorted by descending frequency
+ *   uint16_t tcp_index[65536]                   record number + 1 for each TCP port, 0 if absent
+ *   uint16_t udp_index[65536]                   the same for UDP
+ *   char strings[strings_size]                  NUL-terminated names and descriptions
+ */
+#define SERVICES_DB_MAGIC "NEPSVDB"           // 8 bytes including the terminating NUL
+#define SERVICES_DB_VERSION 1                 // Format version
+#define SERVICES_DB_BYTE_ORDER 0x01020304     // Detects a file of the other byte order
+#define SERVICES_DB_MAX_RECORDS 65535         // Record numbers + 1 must fit the uint16_t index
+#define SERVICES_DB_FREQUENCY_SCALE 1000000.0 // Frequencies are stored in parts per million
+
+typedef struct
+{
+  char magic[8];           // SERVICES_DB_MAGIC
+  uint32_t version;        // SERVICES_DB_VERSION
+  uint32_t byte_order;     // SERVICES_DB_BYTE_ORDER
+  uint32_t num_records;    // Number of records
+  uint32_t records_offset; // Offset of the record array
+  uint32_t index_offset;   // Offset of tcp_index (udp_index follows it)
+  uint32_t strings_offset; // Offset of the string pool
+  uint32_t strings_size;   // Size of the string pool
+  uint32_t reserved;       // Zero
+} services_db_header_t;
+
+typedef struct
+{
+  uint16_t port;        // Port number
+  uint8_t protocol;     // service_proto_t
+  uint8_t reserved;     // Zero
+  uint32_t frequency;   // Open frequency in parts per million
+  uint32_t name;        // Offset of the name in the string pool
+  uint32_t description; // Offset of the description in the string pool (empty string if none)
+} services_db_record_t;
+
+/**
+ * Memory-maps a services database, replacing any database loaded before
+ *
+ * @param path Path to a file written by tools/mkservicesdb
+ * @return true if the file was mapped and passed validation
+ */
+bool load_services_db(const char *path);
+
+/**
+ * Unmaps the services database; lookups fall back to the compiled-in table
+ */
+void unload_services_db(void);
+
+/**
+ * Looks up a port in the services database, then in the compiled-in table
+ *
+ * @param port The port number
+ * @param protocol Transport protocol
+ * @param entry Filled with the service on success; strings stay valid until the database is
+ *              unloaded
+ * @return true if the port is known
+ */
+bool lookup_service(int port, service_proto_t protocol, service_entry_t *entry);
+
+/**
+ * Gets service information for a specific port
+ *
+ * @param port The port number
+ * @return A pointer to the service name or "Unknown" if not found
+ */
+const char *get_service_name(int port);
+
+/**
+ * Gets service description for a specific port
+ *
+ * @param port The port number
+ * @return A pointer to the service description or "Unknown service" if not found
+ */
+const char *get_service_description(int port);
+
+/**
+ * Gets how often a port is found open
+ *
+ * @param port The port number
+ * @return Approximate fraction of hosts with the port open, or 0 if not known
+ */
+double get_service_frequency(int port);
+
+/**
+ * Lists the ports most likely to be open
+ *
+ * @param protocol Transport protocol
+ * @param count Number of ports wanted
+ * @param ports Output array with room for count ports, filled most frequent first
+ * @return Number of ports stored (less than count if fewer ports are known)
+ */
+int get_top_ports(service_proto_t protocol, int count, int *ports);
+
+#endif /* SERVICES_H */
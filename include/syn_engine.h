@@ -0,0 +1,191 @@
+/**
+ * Neptune Scanner - SYN Scan Engine
+ * syn_engine.h - Single-threaded, rate-limited SYN scanning over a transport
+ *
+ * The engine keeps up to max_outstanding probes in flight. Each probe owns a slot, and the slot
+ * number is encoded in the probe's source port, so a reply finds its probe without a search.
+ * Slots are kept in send order, which is also timeout order: the oldest probe is always the next
+ * to time out, so retransmission needs no timer structure. The same engine runs on the real
+ * network (transport_raw_open) and on the simulator (net_sim_open).
+ *
+ * An engine can run several jobs at once (the daemon does). Jobs share the slots and the rate
+ * limit by weighted fair sharing: each probe advances its job's pass by 1/weight, and the job
+ * with the lowest pass sends next, so a job of weight 2 gets twice the probes of a job of
+ * weight 1 while both have ports left. syn_engine_run is the single-job case.
+ */
+
+#ifndef SYN_ENGINE_H
+#define SYN_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "port_spec.h"
+#include "transport.h"
+
+#define SYN_ENGINE_MAX_SLOTS 16384 // Upper bound on max_outstanding (one local port per slot)
+
+// Outcome for one host and port
+typedef enum
+{
+  PORT_STATE_OPEN,     // SYN-ACK received
+  PORT_STATE_CLOSED,   // RST received
+  PORT_STATE_FILTERED  // No reply after all retries
+} port_state_t;
+
+typedef struct syn_engine syn_engine_t;
+typedef struct syn_job syn_job_t;
+
+// Engine parameters
+typedef struct
+{
+  int max_outstanding;  // Probes in flight at once (1 to SYN_ENGINE_MAX_SLOTS)
+  int rate;             // Probes per second including retransmissions, 0 for no limit
+  int retries;          // Retransmissions of an unanswered probe
+  int64_t timeout_us;   // Time to wait for a reply before retransmitting or giving up
+  uint16_t base_port;   // Local ports base_port to base_port + max_outstanding - 1 are used
+} syn_engine_config_t;
+
+// Engine counters
+typedef struct
+{
+  uint64_t sent;        // Probes sent, including retransmissions
+  uint64_t retransmits; // Retransmissions
+  uint64_t open;        // Ports reported open
+  uint64_t closed;      // Ports reported closed
+  uint64_t filtered;    // Ports reported filtered
+  uint64_t unmatched;   // Replies that matched no probe in flight (late, duplicate or foreign)
+  int64_t elapsed_us;   // Transport time the scan took
+} syn_engine_stats_t;
+
+/**
+ * Called once for every host and port scanned
+ *
+ * @param context Caller's context
+ * @param addr Host address, network byte order
+ * @param port Port
+ * @param state Outcome
+ * @param reply The reply for open and closed ports, NULL for filtered ones
+ */
+typedef void (*syn_result_fn)(void *context, uint32_t addr, uint16_t port, port_state_t state,
+                              const os_response_t *reply);
+
+/**
+ * Fills a configuration with the defaults from config.h
+ *
+ * @param config Configuration to fill
+ */
+void syn_engine_default_config(syn_engine_config_t *config);
+
+/**
+ * Creates an engine with no jobs
+ *
+ * @param transport Transport to send and receive through; only the engine may use it
+ * @param config Engine parameters (copied)
+ * @return The engine, or NULL if the configuration is invalid or memory runs out
+ */
+syn_engine_t *syn_engine_create(transport_t *transport, const syn_engine_config_t *config);
+
+/**
+ * Removes all jobs and frees an engine (not the transport)
+ *
+ * @param engine Engine, or NULL
+ */
+void syn_engine_destroy(syn_engine_t *engine);
+
+/**
+ * Adds a job scanning every port of every host in an address block
+ *
+ * Probes go out port by port, each port across all hosts in turn, so consecutive probes to
+ * the same host are spread out.
+ *
+ * @param engine Engine
+ * @param first_addr First host, network byte order
+ * @param num_hosts Number of consecutive hosts
+ * @param ports Ports to scan on each host (copied)
+ * @param num_ports Number of entries in ports
+ * @param weight Share of the probes relative to other jobs (at least 1)
+ * @param on_result Result callback, called from syn_engine_step
+ * @param context Passed to on_result
+ * @return The job, or NULL if memory runs out
+ */
+syn_job_t *syn_engine_add_job(syn_engine_t *engine, uint32_t first_addr, uint32_t num_hosts,
+                              const uint16_t *ports, int num_ports, int weight,
+                              syn_result_fn on_result, void *context);
+
+/**
+ * Adds a job scanning the ports of a bitmap on every host in an address block
+ *
+ * Like syn_engine_add_job, with the ports taken in ascending order straight from the bitmap,
+ * so a job costs the same whether it scans three ports or all of them.
+ *
+ * @param engine Engine
+ * @param first_addr First host, network byte order
+ * @param num_hosts Number of consecutive hosts
+ * @param ports Ports to scan on each host (copied)
+ * @param weight Share of the probes relative to other jobs (at least 1)
+ * @param on_result Result callback, called from syn_engine_step
+ * @param context Passed to on_result
+ * @return The job, or NULL if memory runs out
+ */
+syn_job_t *syn_engine_add_bitmap_job(syn_engine_t *engine, uint32_t first_addr,
+                                     uint32_t num_hosts, const port_bitmap_t *ports, int weight,
+                                     syn_result_fn on_result, void *context);
+
+/**
+ * Whether a job has reported every host and port
+ *
+ * @param job Job
+ * @param stats If not NULL, filled with the job's counters so far
+ * @return true once the job is finished
+ */
+bool syn_engine_job_finished(const syn_job_t *job, syn_engine_stats_t *stats);
+
+/**
+ * Removes a job; probes of an unfinished job still in flight are dropped unreported
+ *
+ * @param engine Engine
+ * @param job Job to remove and free
+ */
+void syn_engine_remove_job(syn_engine_t *engine, syn_job_t *job);
+
+/**
+ * Whether any job is unfinished
+ *
+ * @param engine Engine
+ * @return true while a job has probes to send or in flight
+ */
+bool syn_engine_busy(const syn_engine_t *engine);
+
+/**
+ * Runs one round: handles timeouts, sends what the slots and rate limit allow, then waits for
+ * replies and reports them
+ *
+ * @param engine Engine
+ * @param max_wait_us Longest time to wait for replies, or -1 to wait until the next timeout
+ *                    or send
+ * @return false if the transport failed
+ */
+bool syn_engine_step(syn_engine_t *engine, int64_t max_wait_us);
+
+/**
+ * Scans every port of every host in an address block
+ *
+ * Probes go out port by port, each port across all hosts in turn, so consecutive probes to
+ * the same host are spread out.
+ *
+ * @param transport Transport to send and receive through
+ * @param config Engine parameters
+ * @param first_addr First host, network byte order
+ * @param num_hosts Number of consecutive hosts
+ * @param ports Ports to scan on each host
+ * @param num_ports Number of entries in ports
+ * @param on_result Result callback
+ * @param context Passed to on_result
+ * @param stats If not NULL, filled with the engine counters
+ * @return false if the configuration is invalid or the transport failed
+ */
+bool syn_engine_run(transport_t *transport, const syn_engine_config_t *config, uint32_t first_addr,
+                    uint32_t num_hosts, const uint16_t *ports, int num_ports,
+                    syn_result_fn on_result, void *context, syn_engine_stats_t *stats);
+
+#endif /* SYN_ENGINE_H */
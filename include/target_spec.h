@@ -0,0 +1,133 @@
+/**
+ * Neptune Scanner - Target Specifications
+ * target_spec.h - Streaming IPv4 targets from CIDR blocks, octet ranges and -iL lists
+ *
+ * A target is one of
+ *
+ *   192.0.2.10        one address
+ *   scanme.example    a host name, resolved when its turn comes
+ *   10.1.0.0/16       a CIDR block
+ *   10.0-3.*.1-254    octet ranges: each octet a number, a range or * (0-255)
+ *
+ * and -iL names a file of targets separated by whitespace or newlines ('#' starts a comment).
+ *
+ * Targets come out as blocks of consecutive addresses, at most TARGET_BLOCK_MAX_HOSTS each:
+ * a /16 is one block, 10.0-3.*.1-254 is 1024 blocks of 254 hosts. A target stream hands the
+ * blocks out from a bounded queue that a producer thread fills, walking the command-line
+ * target and then the memory-mapped list file a line at a time, so a scan starts on the first
+ * block of a list of any length and holds the same memory for ten targets or ten million.
+ * Addresses of an exclusion list are cut out of each block before it is queued.
+ */
+
+#ifndef TARGET_SPEC_H
+#define TARGET_SPEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "exclude_list.h"
+
+#define TARGET_BLOCK_MAX_HOSTS 65536 // Larger ranges are split into blocks of this many hosts
+#define TARGET_QUEUE_BLOCKS 4096     // Blocks the producer may run ahead of the scan
+
+// Consecutive addresses first to last, host byte order
+typedef struct
+{
+  uint32_t first;
+  uint32_t last;
+} target_block_t;
+
+// The addresses of a target without a host name: a range of values for each octet
+typedef struct
+{
+  uint8_t low[4];
+  uint8_t high[4];
+} target_range_t;
+
+typedef struct target_stream target_stream_t;
+
+// Called with each run of consecutive addresses (host byte order); false stops the walk
+typedef bool (*target_run_fn)(void *context, uint32_t first, uint32_t last);
+
+/**
+ * Parses an address, CIDR block or octet ranges
+ *
+ * @param text Target, e.g. "10.0.0.0/8" or "192.168.1-2.*"
+ * @param range Receives the octet ranges
+ * @return false if the text is none of these (a host name, or invalid)
+ */
+bool target_range_parse(const char *text, target_range_t *range);
+
+/**
+ * Counts the addresses of a range
+ *
+ * @param range Octet ranges
+ * @return Number of addresses (up to 2^32)
+ */
+uint64_t target_range_count(const target_range_t *range);
+
+/**
+ * Walks the runs of consecutive addresses of a range in ascending order
+ *
+ * @param range Octet ranges
+ * @param visit Called with each run
+ * @param context Passed to visit
+ * @return false if visit stopped the walk
+ */
+bool target_range_each(const target_range_t *range, target_run_fn visit, void *context);
+
+/**
+ * Starts streaming targets
+ *
+ * @param target Command-line target, or NULL or "" for none
+ * @param list_file File of targets (-iL), or NULL or "" for none
+ * @param exclude Built exclusion list, kept until the stream is closed, or NULL for none
+ * @param error Receives a message when the stream cannot start
+ * @param error_size Size of the error buffer
+ * @return The stream, or NULL if the list file cannot be mapped or memory runs out
+ */
+target_stream_t *target_stream_open(const char *target, const char *list_file,
+                                    const exclude_list_t *exclude, char *error, size_t error_size);
+
+/**
+ * Takes the next block of targets
+ *
+ * @param stream Stream
+ * @param block Receives the block
+ * @param wait Wait for the producer when no block is queued yet
+ * @return false if no block is queued (without wait) or the targets are used up
+ */
+bool target_stream_next(target_stream_t *stream, target_block_t *block, bool wait);
+
+/**
+ * Tells whether every block has been taken
+ *
+ * @param stream Stream
+ * @return true once the producer has finished and its queue is empty
+ */
+bool target_stream_done(target_stream_t *stream);
+
+/**
+ * Counts the targets skipped so far because they were invalid or did not resolve
+ *
+ * @param stream Stream
+ * @return Number of skipped targets
+ */
+uint64_t target_stream_invalid(target_stream_t *stream);
+
+/**
+ * Counts the addresses left out so far because they are excluded
+ *
+ * @param stream Stream
+ * @return Number of excluded addresses
+ */
+uint64_t target_stream_excluded(target_stream_t *stream);
+
+/**
+ * Stops the producer and frees the stream
+ *
+ * @param stream Stream, or NULL
+ */
+void target_stream_close(target_stream_t *stream);
+
+#endif /* TARGET_SPEC_H */
@@ -0,0 +1,92 @@
+/**
+ * Neptune Scanner - TLS Fingerprinting
+ * tls_probe.h - ClientHello builder and incremental ServerHello/Certificate parser
+ *
+ * The probe never completes a handshake and performs no cryptography: it sends one ClientHello,
+ * reads the server's first flight until the leaf certificate has arrived and then hangs up. The
+ * ClientHello offers TLS 1.2 at most so that the certificate is sent in the clear.
+ */
+
+#ifndef TLS_PROBE_H
+#define TLS_PROBE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TLS_MAX_CLIENT_HELLO 512  // Buffer size that always fits tls_build_client_hello output
+#define TLS_MAX_HANDSHAKE 32768   // Handshake bytes buffered while waiting for the leaf certificate
+
+// What the server revealed in its first flight
+typedef struct
+{
+  uint16_t version;     // Negotiated protocol version (e.g., 0x0303)
+  uint16_t cipher;      // Selected cipher suite
+  uint8_t alert;        // Alert description if the server refused the ClientHello
+  bool server_hello;    // ServerHello was parsed
+  bool certificate;     // Leaf certificate was parsed
+  char subject[128];    // Subject common name
+  char issuer[128];     // Issuer common name
+  char san[256];        // Subject alternative names, comma-separated
+  char not_before[24];  // Validity start, "YYYY-MM-DD HH:MM:SS"
+  char not_after[24];   // Validity end, "YYYY-MM-DD HH:MM:SS"
+} tls_info_t;
+
+// Result of feeding bytes to the parser
+typedef enum
+{
+  TLS_PARSE_MORE,  // Need more bytes
+  TLS_PARSE_DONE,  // Certificate parsed (or the server sent no certificate); stop reading
+  TLS_PARSE_ALERT, // Server answered with an alert; see tls_info_t.alert
+  TLS_PARSE_ERROR  // Not TLS, or a malformed or oversized message
+} tls_parse_status_t;
+
+// Incremental parser state; initialize with tls_parser_init
+typedef struct
+{
+  unsigned char record[5];                    // Header of the record being read
+  size_t record_header_len;                   // Bytes of the record header read so far
+  size_t record_remaining;                    // Body bytes of the current record still to come
+  unsigned char record_type;                  // Content type of the current record
+  unsigned char handshake[TLS_MAX_HANDSHAKE]; // Handshake bytes not yet consumed
+  size_t handshake_len;                       // Number of bytes in handshake
+} tls_parser_t;
+
+/**
+ * Builds a ClientHello record
+ *
+ * @param server_name Host name for the SNI extension, or NULL/empty to omit it
+ * @param buffer Output buffer of at least TLS_MAX_CLIENT_HELLO bytes
+ * @param buffer_size Size of buffer
+ * @return Number of bytes written, or 0 if the buffer is too small
+ */
+size_t tls_build_client_hello(const char *server_name, unsigned char *buffer, size_t buffer_size);
+
+/**
+ * Resets a parser before the first response byte
+ */
+void tls_parser_init(tls_parser_t *parser);
+
+/**
+ * Feeds response bytes to the parser as they arrive
+ *
+ * @param parser Parser state
+ * @param data Bytes received
+ * @param len Number of bytes received
+ * @param info Filled in as messages are parsed
+ * @return TLS_PARSE_MORE until the parser has everything it needs or fails
+ */
+tls_parse_status_t tls_parser_feed(tls_parser_t *parser, const unsigned char *data, size_t len,
+                                   tls_info_t *info);
+
+/**
+ * Returns the name of a protocol version (e.g., "TLSv1.2"), or NULL if unknown
+ */
+const char *tls_version_name(uint16_t version);
+
+/**
+ * Returns the IANA name of a cipher suite offered by the probe, or NULL if unknown
+ */
+const char *tls_cipher_name(uint16_t cipher);
+
+#endif /* TLS_PROBE_H */
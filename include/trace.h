@@ -0,0 +1,109 @@
+/**
+ * Neptune Scanner - Event Tracing
+ * trace.h - Per-thread span rings exported as a Chrome trace (--trace)
+ *
+ * Each thread that records an event writes it to a ring of its own, so recording takes no lock
+ * and touches no shared cache line. Rings are handed on when their thread exits, as scan_stats
+ * shards are; each event carries the id of the thread that recorded it. A full ring overwrites
+ * its oldest events, and threads beyond TRACE_MAX_RINGS drop theirs (both are counted).
+ *
+ * trace_write() exports every ring as Chrome trace-event JSON, which chrome://tracing and
+ * Perfetto (ui.perfetto.dev) open directly.
+ *
+ * When tracing is off, trace_begin() and trace_end() are a load and a branch; no clock is read.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "scan_stats.h"
+
+#define TRACE_RING_EVENTS (1 << 18) // Events kept per ring (a power of two; 8 MB)
+#define TRACE_MAX_RINGS 64          // Rings allocated at most
+
+// What a span or instant covers
+typedef enum
+{
+  TRACE_RESOLVE,  // Host name resolution
+  TRACE_SEND,     // Sending a probe
+  TRACE_RESPONSE, // Reply matched to a probe (instant; value = RTT in us)
+  TRACE_CONNECT,  // TCP handshake, from connect() to its outcome
+  TRACE_WAIT,     // Waiting for replies or banner bytes
+  TRACE_SERVICE,  // A service detection stage
+  TRACE_WRITE,    // Writing results
+  TRACE_EVENT_COUNT
+} trace_event_t;
+
+// Whether events are being recorded; only changed while no scan threads run
+extern bool trace_enabled;
+
+/**
+ * Allocates the first ring and starts recording
+ *
+ * @return false if tracing could not be started
+ */
+bool trace_start(void);
+
+/**
+ * Records a finished span, or an instant if duration_us is negative
+ *
+ * @param event What the span covers
+ * @param start_us Start time from scan_stats_now_us()
+ * @param duration_us Length of the span in microseconds; negative for an instant
+ * @param port Port the event concerns, or 0
+ * @param value Event-specific value (RTT for TRACE_RESPONSE), or 0
+ * @param detail Static or long-lived string shown with the event (probe name, stage), or NULL
+ */
+void trace_record(trace_event_t event, int64_t start_us, int64_t duration_us, int port,
+                  uint32_t value, const char *detail);
+
+/**
+ * Stops recording and writes every ring as Chrome trace-event JSON
+ *
+ * @param path Output file
+ * @param events Set to the number of events written (may be NULL)
+ * @param dropped Set to the number of events overwritten or dropped (may be NULL)
+ * @return false if the file cannot be written
+ */
+bool trace_write(const char *path, uint64_t *events, uint64_t *dropped);
+
+/**
+ * Start of a span
+ *
+ * @return Start time to pass to trace_end, or 0 when tracing is off
+ */
+static inline int64_t trace_begin(void)
+{
+  return trace_enabled ? scan_stats_now_us() : 0;
+}
+
+/**
+ * End of a span started with trace_begin
+ *
+ * @param event What the span covered
+ * @param start Value returned by trace_begin
+ * @param port Port the span concerns, or 0
+ * @param detail Static or long-lived string, or NULL
+ */
+static inline void trace_end(trace_event_t event, int64_t start, int port, const char *detail)
+{
+  if (trace_enabled)
+    trace_record(event, start, scan_stats_now_us() - start, port, 0, detail);
+}
+
+/**
+ * Records an instant event
+ *
+ * @param event What happened
+ * @param port Port the event concerns, or 0
+ * @param value Event-specific value, or 0
+ */
+static inline void trace_instant(trace_event_t event, int port, uint32_t value)
+{
+  if (trace_enabled)
+    trace_record(event, scan_stats_now_us(), -1, port, value, NULL);
+}
+
+#endif /* TRACE_H */
@@ -0,0 +1,78 @@
+/**
+ * Neptune Scanner - Packet Transport
+ * transport.h - Interface between the packet scan engines and the network
+ *
+ * Packet-level engines (currently the SYN engine) never touch sockets or clocks directly; they
+ * send probes, wait for replies and read the time through a transport. The raw-socket transport
+ * talks to the real network. The simulator (net_sim.h) implements the same interface over an
+ * in-process model of hosts with a virtual clock, so engine behavior against millions of hosts
+ * can be run deterministically in seconds.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "os_detect.h"
+
+// A reply to one of our probes
+typedef struct
+{
+  uint32_t addr;         // Responding host, network byte order
+  uint16_t port;         // Its port (source port of the reply)
+  uint16_t local_port;   // Our port the reply was sent to
+  os_response_t tcp;     // TTL, DF, window, flags and TCP options of the reply
+} transport_reply_t;
+
+typedef struct transport transport_t;
+
+// Transport operations
+typedef struct
+{
+  /**
+   * @return Current time in microseconds (real or virtual, monotonic)
+   */
+  int64_t (*now)(transport_t *transport);
+
+  /**
+   * Sends a SYN probe
+   *
+   * @return false if the probe could not be sent (it may still be lost in transit if true)
+   */
+  bool (*send_syn)(transport_t *transport, uint32_t addr, uint16_t port, uint16_t local_port);
+
+  /**
+   * Waits for replies
+   *
+   * Returns as soon as at least one reply is available, or when timeout_us has passed.
+   *
+   * @param replies Output array
+   * @param max Capacity of replies
+   * @param timeout_us Longest time to wait
+   * @return Number of replies stored, or -1 on error
+   */
+  int (*poll)(transport_t *transport, transport_reply_t *replies, int max, int64_t timeout_us);
+
+  /**
+   * Releases the transport
+   */
+  void (*close)(transport_t *transport);
+} transport_ops_t;
+
+// Every transport starts with its operations; backends extend this struct
+struct transport
+{
+  const transport_ops_t *ops;
+};
+
+/**
+ * Opens the raw-socket transport (POSIX, needs root or CAP_NET_RAW)
+ *
+ * Probes are the OS_PROBE_SYN segment, so replies can also feed the passive OS guess.
+ *
+ * @return The transport, or NULL if raw sockets are unavailable
+ */
+transport_t *transport_raw_open(void);
+
+#endif /* TRANSPORT_H */
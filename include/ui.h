@@ -48,7 +48,7 @@ void show_scanning_header(const char *target, int start_port, int end_port);
 void print_header(void);
 
 // Function to print scan results
-void print_results(const char *target, int *open_ports, int num_ports);
+void print_results(const char *target, const int *open_ports, int num_ports);
 
 // Function to print scan results with version information
 void print_results_with_versions(const char *target, int *open_ports, ServiceInfo *service_info, int num_ports);
@@ -10,6 +10,7 @@
 #define UTILS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * Displays a progress bar in the console
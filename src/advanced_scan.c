@@ -9,15 +9,20 @@
 #include "advanced_scan.h"
 #include "scanner.h"
 #include "scan_utils.h"
+#include "os_detect.h"
+#include "passive_os.h"
+#include "scan_stats.h"
+#include "trace.h"
+#include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+
+#ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <iphlpapi.h>
-
-#ifdef _WIN32
 #define close closesocket
 #else
 #include <sys/socket.h>
@@ -29,6 +34,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#define SOCKET_ERROR (-1)
 #endif
 
 // Function to calculate TCP checksum
@@ -87,105 +93,140 @@ unsigned short ip_checksum(unsigned short *ptr, int nbytes)
   return answer;
 }
 
-// Function to perform TCP SYN scan
-bool tcp_syn_scan(const char *target, int port, int timeout)
+// Function to check whether raw TCP sockets can be opened (root or CAP_NET_RAW)
+bool raw_sockets_available(void)
 {
 #ifdef _WIN32
-  SOCKET sock = socket(AF_INET, SOCK_RAW, IPPROTO_IP);
-  if (sock == INVALID_SOCKET)
+  return false;
+#else
+  int sock = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+  if (sock < 0)
   {
     return false;
   }
+  close(sock);
+  return true;
+#endif
+}
+
+// Function to perform TCP SYN scan
+bool tcp_syn_scan(const char *target, int port, int timeout)
+{
+#ifdef _WIN32
+  // Windows does not send TCP over raw sockets
+  (void)target;
+  (void)port;
+  (void)timeout;
+  return false;
 #else
-  int sock = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
-  if (sock < 0)
+  // getaddrinfo rather than gethostbyname: ports are scanned from several threads at once
+  struct addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(target, NULL, &hints, &result) != 0)
   {
     return false;
   }
-#endif
+  struct sockaddr_in dest;
+  memcpy(&dest, result->ai_addr, sizeof(dest));
+  freeaddrinfo(result);
 
-  // Set socket options
-  int one = 1;
-  if (setsockopt(sock, IPPROTO_IP, IP_HDRINCL, (char *)&one, sizeof(one)) < 0)
+  uint32_t daddr = dest.sin_addr.s_addr;
+  uint32_t saddr = os_source_address(daddr);
+
+  // Without IP_HDRINCL the kernel adds the IP header, and the socket also receives the replies
+  int sock = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+  if (sock < 0)
   {
-    close(sock);
     return false;
   }
 
-  // Create packet
-  char packet[sizeof(ip_header_t) + sizeof(tcp_header_t)];
-  memset(packet, 0, sizeof(packet));
-
-  // Fill IP header
-  ip_header_t *ip = (ip_header_t *)packet;
-  ip->version = 4;
-  ip->ihl = 5;
-  ip->tos = 0;
-  ip->tot_len = htons(sizeof(packet));
-  ip->id = htons(54321);
-  ip->frag_off = 0;
-  ip->ttl = 64;
-  ip->protocol = IPPROTO_TCP;
-  ip->check = 0;
-  ip->saddr = inet_addr("127.0.0.1");
-  ip->daddr = inet_addr(target);
-
-  // Fill TCP header
-  tcp_header_t *tcp = (tcp_header_t *)(packet + sizeof(ip_header_t));
-  tcp->source = htons(54321);
-  tcp->dest = htons(port);
-  tcp->seq = htonl(12345);
-  tcp->ack_seq = 0;
-  tcp->doff = 5;
-  tcp->syn = 1;
-  tcp->window = htons(5840);
-  tcp->check = 0;
-  tcp->urg_ptr = 0;
-
-  // Calculate checksums
-  tcp->check = tcp_checksum((unsigned short *)tcp, sizeof(tcp_header_t));
-  ip->check = ip_checksum((unsigned short *)ip, sizeof(ip_header_t));
-
-  // Send packet
-  struct sockaddr_in dest;
-  memset(&dest, 0, sizeof(dest));
-  dest.sin_family = AF_INET;
-  dest.sin_addr.s_addr = inet_addr(target);
-  dest.sin_port = htons(port);
+  // The SYN carries the OS_PROBE_SYN options, so each SYN-ACK doubles as a passive OS fingerprint
+  uint64_t rng;
+  os_random_seed(&rng);
+  uint16_t sport = (uint16_t)(32768 + os_random(&rng) % 28000);
+  unsigned char segment[OS_MAX_PROBE_LEN];
+  size_t len =
+      os_build_tcp_probe(segment, saddr, daddr, sport, (uint16_t)port, TCP_SYN, true, &rng);
 
-  if (sendto(sock, packet, sizeof(packet), 0, (struct sockaddr *)&dest, sizeof(dest)) == SOCKET_ERROR)
+  if (sendto(sock, (const char *)segment, len, 0, (struct sockaddr *)&dest, sizeof(dest)) ==
+      SOCKET_ERROR)
   {
     close(sock);
     return false;
   }
+  int64_t sent_at = scan_stats_now_us();
+  scan_stats_add(STAT_PROBES_SENT, 1);
+  scan_stats_add(STAT_BYTES_SENT, len + 20);
+  scan_stats_gauge_add(GAUGE_IN_FLIGHT, 1);
+
+  // Wait for the SYN-ACK or RST; the raw socket sees all TCP traffic, so filter on the ports
+  bool open = false;
+  bool answered = false;
+  long deadline = get_timestamp() + timeout;
+  long now;
+  while ((now = get_timestamp()) < deadline)
+  {
+    struct timeval tv;
+    tv.tv_sec = (deadline - now) / 1000;
+    tv.tv_usec = ((deadline - now) % 1000) * 1000;
+
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(sock, &readfds);
+    if (select(sock + 1, &readfds, NULL, NULL, &tv) <= 0)
+    {
+      break;
+    }
 
-  // Wait for response
-  struct timeval tv;
-  tv.tv_sec = timeout / 1000;
-  tv.tv_usec = (timeout % 1000) * 1000;
+    unsigned char packet[1500];
+    ssize_t bytes = recv(sock, packet, sizeof(packet), 0);
+    if (bytes < 20)
+    {
+      continue;
+    }
+    scan_stats_add(STAT_BYTES_RECEIVED, (uint64_t)bytes);
 
-  fd_set readfds;
-  FD_ZERO(&readfds);
-  FD_SET(sock, &readfds);
+    size_t ihl = (size_t)(packet[0] & 0x0F) * 4;
+    uint32_t from;
+    memcpy(&from, packet + 12, 4);
+    if ((size_t)bytes < ihl + 20 || from != daddr)
+    {
+      continue;
+    }
+    const unsigned char *tcp = packet + ihl;
+    if ((tcp[0] << 8 | tcp[1]) != port || (tcp[2] << 8 | tcp[3]) != sport)
+    {
+      continue;
+    }
 
-  if (select(sock + 1, &readfds, NULL, NULL, &tv) > 0)
-  {
-    char response[1024];
-    int bytes = recv(sock, response, sizeof(response), 0);
-    if (bytes > 0)
+    os_response_t response;
+    if (os_parse_tcp_response(packet, (size_t)bytes, &response) &&
+        (response.flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK))
     {
-      ip_header_t *resp_ip = (ip_header_t *)response;
-      tcp_header_t *resp_tcp = (tcp_header_t *)(response + (resp_ip->ihl * 4));
-      if (resp_tcp->syn && resp_tcp->ack)
-      {
-        close(sock);
-        return true;
-      }
+      passive_os_record(daddr, &response);
+      open = true;
     }
+    answered = true;
+    scan_stats_add(STAT_RESPONSES, 1);
+    scan_stats_record_rtt(scan_stats_now_us() - sent_at);
+    trace_instant(TRACE_RESPONSE, port, (uint32_t)(scan_stats_now_us() - sent_at));
+    break;
   }
 
+  scan_stats_gauge_add(GAUGE_IN_FLIGHT, -1);
+  if (answered)
+  {
+    scan_stats_add(open ? STAT_OPEN : STAT_CLOSED, 1);
+  }
+  else
+  {
+    scan_stats_add(STAT_TIMEOUTS, 1);
+    scan_stats_add(STAT_FILTERED, 1);
+  }
   close(sock);
-  return false;
+  return open;
+#endif
 }
 
 // Function to perform custom TCP scan
@@ -199,13 +240,3 @@ bool tcp_custom_scan(const char *target, int port, uint8_t flags, int timeout)
   (void)timeout;
   return false;
 }
-
-// Function to detect OS
-bool detect_os(const char *target, char *os_info, size_t os_info_size)
-{
-  // Simple OS detection based on TCP/IP stack fingerprinting
-  // For now, just return a generic response
-  (void)target;
-  snprintf(os_info, os_info_size, "Unknown OS (TCP/IP stack fingerprinting not implemented)");
-  return true;
-}
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "scanner.h"
 #include "scan_utils.h"
 #include "utils.h"
+#include "daemon.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -54,6 +55,12 @@ bool parse_args(int argc, char *argv[], Args *args)
   args->port_list = NULL;
   args->port_list_size = 0;
   args->use_port_list = false;
+  args->version_intensity = DEFAULT_VERSION_INTENSITY;
+  args->weight = 1;
+  strncpy(args->service_probes_file, SERVICE_PROBES_FILE, sizeof(args->service_probes_file) - 1);
+  strncpy(args->http_requests_file, HTTP_REQUESTS_FILE, sizeof(args->http_requests_file) - 1);
+  strncpy(args->services_db_file, SERVICES_DB_FILE, sizeof(args->services_db_file) - 1);
+  strncpy(args->os_db_file, OS_DB_FILE, sizeof(args->os_db_file) - 1);
 
   // Need at least one argument (the target)
   if (argc < 2)
@@ -83,65 +90,38 @@ bool parse_args(int argc, char *argv[], Args *args)
       }
       else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
       {
-        // Parse port range: -p <start>-<end> or -p <port> or -p <port1,port2,port3,...>
-        char *port_arg = argv[++i];
-        
-        // Check if it's a list of ports (contains comma)
-        if (strchr(port_arg, ',') != NULL)
+        // Port spec: ports, ranges, T:/U: prefixes and [exclusions], compiled to bitmaps
+        char error[128];
+        free(args->port_spec);
+        args->port_spec = malloc(sizeof(port_spec_t));
+        if (!args->port_spec)
         {
-          // It's a list of ports
-          args->use_port_list = true;
-          
-          // Count the number of ports in the list
-          int port_count = 1;  // Start with 1 for the first port
-          for (char *c = port_arg; *c; c++)
-          {
-            if (*c == ',')
-            {
-              port_count++;
-            }
-          }
-          
-          // Allocate memory for the port list
-          args->port_list = (int *)malloc(port_count * sizeof(int));
-          if (!args->port_list)
-          {
-            fprintf(stderr, "Memory allocation error\n");
-            return false;
-          }
-          
-          // Parse the ports
-          char *token = strtok(port_arg, ",");
-          int index = 0;
-          
-          while (token != NULL && index < port_count)
-          {
-            args->port_list[index++] = atoi(token);
-            token = strtok(NULL, ",");
-          }
-          
-          args->port_list_size = index;
+          fprintf(stderr, "Memory allocation error\n");
+          return false;
         }
-        else
+        if (!port_spec_parse(argv[++i], args->port_spec, error, sizeof(error)))
         {
-          // Check if it's a range (contains dash)
-          char *dash = strchr(port_arg, '-');
-          if (dash)
-          {
-            // Range of ports
-            *dash = '\0';
-            args->port_range[0] = atoi(port_arg);
-            args->port_range[1] = atoi(dash + 1);
-          }
-          else
-          {
-            // Single port
-            args->port_range[0] = atoi(port_arg);
-            args->port_range[1] = args->port_range[0];
-          }
-          args->use_port_list = false;
+          fprintf(stderr, "-p: %s\n", error);
+          return false;
         }
       }
+      else if (strcmp(argv[i], "-iL") == 0 && i + 1 < argc)
+      {
+        strncpy(args->target_list, argv[++i], sizeof(args->target_list) - 1);
+      }
+      else if (strcmp(argv[i], "--exclude") == 0 && i + 1 < argc)
+      {
+        if (strlen(argv[++i]) >= sizeof(args->exclude))
+        {
+          fprintf(stderr, "--exclude list is too long, use --excludefile\n");
+          return false;
+        }
+        strcpy(args->exclude, argv[i]);
+      }
+      else if (strcmp(argv[i], "--excludefile") == 0 && i + 1 < argc)
+      {
+        strncpy(args->exclude_file, argv[++i], sizeof(args->exclude_file) - 1);
+      }
       else if (strcmp(argv[i], "-sS") == 0)
       {
         args->scan_type = SCAN_SYN;
@@ -170,6 +150,112 @@ bool parse_args(int argc, char *argv[], Args *args)
       {
         args->detect_services = true;
       }
+      else if (strcmp(argv[i], "--version-intensity") == 0 && i + 1 < argc)
+      {
+        args->version_intensity = atoi(argv[++i]);
+        if (args->version_intensity < 0 || args->version_intensity > MAX_VERSION_INTENSITY)
+        {
+          fprintf(stderr, "Version intensity must be between 0 and %d\n", MAX_VERSION_INTENSITY);
+          return false;
+        }
+      }
+      else if (strcmp(argv[i], "--service-probes") == 0 && i + 1 < argc)
+      {
+        strncpy(args->service_probes_file, argv[++i], sizeof(args->service_probes_file) - 1);
+      }
+      else if (strcmp(argv[i], "--http-requests") == 0 && i + 1 < argc)
+      {
+        strncpy(args->http_requests_file, argv[++i], sizeof(args->http_requests_file) - 1);
+      }
+      else if (strcmp(argv[i], "--os-db") == 0 && i + 1 < argc)
+      {
+        strncpy(args->os_db_file, argv[++i], sizeof(args->os_db_file) - 1);
+      }
+      else if (strcmp(argv[i], "--top-ports") == 0 && i + 1 < argc)
+      {
+        args->top_ports = atoi(argv[++i]);
+        if (args->top_ports < 1 || args->top_ports > 65536)
+        {
+          fprintf(stderr, "--top-ports must be between 1 and 65536\n");
+          return false;
+        }
+      }
+      else if (strcmp(argv[i], "--services-db") == 0 && i + 1 < argc)
+      {
+        strncpy(args->services_db_file, argv[++i], sizeof(args->services_db_file) - 1);
+      }
+      else if (strcmp(argv[i], "--stats-every") == 0 && i + 1 < argc)
+      {
+        double seconds = atof(argv[++i]);
+        if (seconds < 0.01 || seconds > 3600)
+        {
+          fprintf(stderr, "--stats-every must be between 0.01 and 3600 seconds\n");
+          return false;
+        }
+        args->stats_interval_ms = (int)(seconds * 1000 + 0.5);
+      }
+      else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc)
+      {
+        strncpy(args->stats_json, argv[++i], sizeof(args->stats_json) - 1);
+      }
+      else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      {
+        strncpy(args->trace_file, argv[++i], sizeof(args->trace_file) - 1);
+      }
+      else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc)
+      {
+        args->metrics_port = atoi(argv[++i]);
+        if (args->metrics_port < 1 || args->metrics_port > 65535)
+        {
+          fprintf(stderr, "--metrics-port must be between 1 and 65535\n");
+          return false;
+        }
+      }
+      else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+      {
+        args->rate = atoi(argv[++i]);
+        if (args->rate < 1)
+        {
+          fprintf(stderr, "--rate must be at least 1 probe per second\n");
+          return false;
+        }
+      }
+      else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc)
+      {
+        strncpy(args->daemon_socket, argv[++i], sizeof(args->daemon_socket) - 1);
+      }
+      else if (strcmp(argv[i], "--submit") == 0 && i + 1 < argc)
+      {
+        strncpy(args->submit_socket, argv[++i], sizeof(args->submit_socket) - 1);
+      }
+      else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc)
+      {
+        char extra;
+        if (sscanf(argv[++i], "%d/%d%c", &args->shard_index, &args->shard_count, &extra) != 2 ||
+            args->shard_count < 1 || args->shard_index < 1 ||
+            args->shard_index > args->shard_count)
+        {
+          fprintf(stderr, "--shard must be i/n with 1 <= i <= n\n");
+          return false;
+        }
+      }
+      else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      {
+        strncpy(args->output_file, argv[++i], sizeof(args->output_file) - 1);
+      }
+      else if (strcmp(argv[i], "-oB") == 0 && i + 1 < argc)
+      {
+        strncpy(args->binary_file, argv[++i], sizeof(args->binary_file) - 1);
+      }
+      else if (strcmp(argv[i], "--weight") == 0 && i + 1 < argc)
+      {
+        args->weight = atoi(argv[++i]);
+        if (args->weight < 1 || args->weight > DAEMON_MAX_WEIGHT)
+        {
+          fprintf(stderr, "--weight must be between 1 and %d\n", DAEMON_MAX_WEIGHT);
+          return false;
+        }
+      }
       else
       {
         fprintf(stderr, "Unknown option: %s\n", argv[i]);
@@ -186,9 +272,30 @@ bool parse_args(int argc, char *argv[], Args *args)
     }
   }
 
-  // Must have a target
-  if (args->target[0] == '\0')
+  // Must have a target or a target list, unless serving jobs from clients
+  if (args->target[0] == '\0' && args->target_list[0] == '\0' &&
+      args->daemon_socket[0] == '\0')
+  {
+    return false;
+  }
+
+  // A daemon serves other clients' scans; it cannot also be one
+  if (args->daemon_socket[0] != '\0' && args->submit_socket[0] != '\0')
+  {
+    fprintf(stderr, "--daemon cannot be combined with --submit\n");
+    return false;
+  }
+
+  // A JSON sink alone reports at the default interval
+  if (args->stats_json[0] != '\0' && args->stats_interval_ms == 0)
+  {
+    args->stats_interval_ms = DEFAULT_STATS_INTERVAL;
+  }
+
+  // --top-ports chooses the ports itself
+  if (args->top_ports > 0 && args->port_spec)
   {
+    fprintf(stderr, "--top-ports cannot be combined with -p\n");
     return false;
   }
 
@@ -198,9 +305,13 @@ bool parse_args(int argc, char *argv[], Args *args)
 void show_help(const char *program_name)
 {
   printf("Neptune Scanner %s\n", VERSION);
-  printf("Usage: %s [Options] target\n\n", program_name);
+  printf("Usage: %s [Options] target\n", program_name);
+  printf("  target: host, address, CIDR (10.0.0.0/16) or octet ranges (10.0-3.*.1-254)\n\n");
   printf("Options:\n");
-  printf("  -p <port range>    Port range to scan (e.g., 1-1024)\n");
+  printf("  -p <ports>         Ports to scan (e.g., 1-1024,3306,U:53,- for all, [25] excluded)\n");
+  printf("  -iL <file>                 Also scan the targets listed in <file>\n");
+  printf("  --exclude <ranges>         Never probe these addresses and ranges (comma-separated)\n");
+  printf("  --excludefile <file>       Never probe the addresses and ranges listed in <file>\n");
   printf("  -sS               TCP SYN scan (stealth)\n");
   printf("  -sT               TCP Connect scan\n");
   printf("  -sU               UDP scan\n");
@@ -208,6 +319,29 @@ void show_help(const char *program_name)
   printf("  -v                Verbose output\n");
   printf("  -t <timeout>      Timeout in milliseconds (default: %d)\n", DEFAULT_TIMEOUT);
   printf("  -sV               Enable service detection\n");
+  printf("  --version-intensity <0-9>  Number of service probes to try (default: %d)\n",
+         DEFAULT_VERSION_INTENSITY);
+  printf("  --service-probes <file>    Service probe database (default: %s)\n", SERVICE_PROBES_FILE);
+  printf("  --http-requests <file>     HTTP fingerprint requests (default: %s)\n", HTTP_REQUESTS_FILE);
+  printf("  --top-ports <N>            Scan the N most frequently open ports\n");
+  printf("  --services-db <file>       Services database (default: %s)\n", SERVICES_DB_FILE);
+  printf("  -O                Enable OS detection (requires root)\n");
+  printf("  --os-db <file>             OS signature database (default: %s)\n", OS_DB_FILE);
+  printf("  --stats-every <seconds>    Print live scan statistics at this interval\n");
+  printf("  --stats-json <sink>        Also write them as JSON lines to a file, tcp:HOST:PORT\n"
+         "                             or unix:PATH (every %d ms unless --stats-every)\n",
+         DEFAULT_STATS_INTERVAL);
+  printf("  --trace <file>             Write a Chrome/Perfetto trace of the scan to <file>\n");
+  printf("  --metrics-port <port>      Serve Prometheus metrics on 127.0.0.1:<port>/metrics\n");
+  printf("  -o <file>                  Write open ports to <file>, sorted for merging\n");
+  printf("  -oB <file>                 Write results and deduplicated banners in binary form\n");
+  printf("  --shard <i/n>              Scan only slice i of n disjoint, equal slices of the\n"
+         "                             ports (of targets x ports for several hosts)\n");
+  printf("  --rate <pps>               Limit SYN scans to <pps> probes per second\n");
+  printf("  --daemon <socket>          Serve scan jobs on a Unix socket (requires root)\n");
+  printf("  --submit <socket>          Run the scan on the daemon at <socket>\n");
+  printf("  --weight <1-%d>          Share of the daemon's probe rate for --submit (default: 1)\n",
+         DAEMON_MAX_WEIGHT);
   printf("  -V                Show version information\n");
   printf("  -h                Show this help message\n\n");
   printf("Examples:\n");
@@ -215,6 +349,8 @@ void show_help(const char *program_name)
   printf("  %s -p 1-1024 example.com\n", program_name);
   printf("  %s -sS -v example.com\n", program_name);
   printf("  %s -sV example.com\n", program_name);
+  printf("  %s --top-ports 1000 example.com\n", program_name);
+  printf("  %s -sS -p 22,443 10.0.0.0/16\n", program_name);
 }
 
 void show_version(void)
@@ -229,11 +365,17 @@ void cleanup_args(Args *args)
     args->port_list = NULL;
     args->port_list_size = 0;
   }
+  free(args->port_spec);
+  args->port_spec = NULL;
 }
 
 void print_args_help(void)
 {
   printf("Neptune Scanner %s\n\n", VERSION);
+  printf("  -p <ports>         Ports to scan (e.g., 1-1024,3306,U:53,- for all, [25] excluded)\n");
+  printf("  -iL <file>                 Also scan the targets listed in <file>\n");
+  printf("  --exclude <ranges>         Never probe these addresses and ranges (comma-separated)\n");
+  printf("  --excludefile <file>       Never probe the addresses and ranges listed in <file>\n");
   printf("  -sS               TCP SYN scan (stealth)\n");
   printf("  -sT               TCP Connect scan\n");
   printf("  -sU               UDP scan\n");
@@ -241,6 +383,25 @@ void print_args_help(void)
   printf("  -v                Verbose output\n");
   printf("  -t <timeout>      Timeout in milliseconds (default: 1000)\n");
   printf("  -sV               Enable service detection\n");
+  printf("  --version-intensity <0-9>  Number of service probes to try (default: 7)\n");
+  printf("  --service-probes <file>    Service probe database\n");
+  printf("  --http-requests <file>     HTTP fingerprint requests\n");
+  printf("  --top-ports <N>            Scan the N most frequently open ports\n");
+  printf("  --services-db <file>       Services database\n");
+  printf("  -O                Enable OS detection (requires root)\n");
+  printf("  --os-db <file>             OS signature database\n");
+  printf("  --stats-every <seconds>    Print live scan statistics at this interval\n");
+  printf("  --stats-json <sink>        Also write them as JSON lines (file or tcp:HOST:PORT)\n");
+  printf("  --trace <file>             Write a Chrome/Perfetto trace of the scan to <file>\n");
+  printf("  --metrics-port <port>      Serve Prometheus metrics on 127.0.0.1:<port>/metrics\n");
+  printf("  -o <file>                  Write open ports to <file>, sorted for merging\n");
+  printf("  -oB <file>                 Write results and deduplicated banners in binary form\n");
+  printf("  --shard <i/n>              Scan only slice i of n disjoint, equal slices of the\n"
+         "                             ports (of targets x ports for several hosts)\n");
+  printf("  --rate <pps>               Limit SYN scans to <pps> probes per second\n");
+  printf("  --daemon <socket>          Serve scan jobs on a Unix socket (requires root)\n");
+  printf("  --submit <socket>          Run the scan on the daemon at <socket>\n");
+  printf("  --weight <1-1000>          Share of the daemon's probe rate for --submit\n");
   printf("  -V                Show version information\n");
   printf("  -h                Show this help message\n");
   printf("\n");
@@ -0,0 +1,326 @@
+/**
+ * Neptune Scanner - Multi-pattern Banner Matching
+ * banner_match.c - Aho-Corasick automaton implementation
+ */
+
+#include "../include/banner_match.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AC_SCAN_MIN_SPLIT_LEN 128 // Shorter texts are walked in one pass by ac_scan
+
+struct ac_automaton
+{
+  uint16_t (*next)[256];                // Trie edges by byte (freed once compiled)
+  uint16_t *fail;                       // Failure links
+  uint16_t *dict;                       // Next state on the failure chain that ends a pattern
+  int16_t *pattern;                     // Pattern ending at each state, or -1
+  uint32_t *delta;                      // Compiled DFA: (row << 1) | ends-a-pattern, indexed by
+                                        // row + class; row = state * num_classes
+  uint16_t *output;                     // First state on the chain that ends a pattern, or 0
+  uint8_t byte_class[256];              // Byte to class; class 0 = bytes in no pattern
+  int num_classes;                      // Number of byte classes including class 0
+  size_t pattern_len[AC_MAX_PATTERNS];  // Length of each pattern
+  size_t max_len;                       // Length of the longest pattern
+  int num_states;                       // Number of states in use
+  int capacity;                         // Number of states allocated
+  int num_patterns;                     // Number of patterns added
+  bool compiled;                        // Whether ac_compile has run
+};
+
+// Grow the state arrays so that at least 'needed' states fit
+static bool ac_reserve(ac_automaton_t *ac, int needed)
+{
+  if (needed <= ac->capacity)
+    return true;
+  if (needed > AC_MAX_STATES)
+    return false;
+
+  int capacity = ac->capacity ? ac->capacity : 64;
+  while (capacity < needed)
+    capacity *= 2;
+  if (capacity > AC_MAX_STATES)
+    capacity = AC_MAX_STATES;
+
+  uint16_t(*next)[256] = realloc(ac->next, (size_t)capacity * sizeof(*next));
+  if (!next)
+    return false;
+  ac->next = next;
+
+  uint16_t *fail = realloc(ac->fail, (size_t)capacity * sizeof(*fail));
+  if (!fail)
+    return false;
+  ac->fail = fail;
+
+  uint16_t *dict = realloc(ac->dict, (size_t)capacity * sizeof(*dict));
+  if (!dict)
+    return false;
+  ac->dict = dict;
+
+  int16_t *pattern = realloc(ac->pattern, (size_t)capacity * sizeof(*pattern));
+  if (!pattern)
+    return false;
+  ac->pattern = pattern;
+
+  ac->capacity = capacity;
+  return true;
+}
+
+// Append a fresh state with no edges
+static int ac_new_state(ac_automaton_t *ac)
+{
+  if (!ac_reserve(ac, ac->num_states + 1))
+    return -1;
+
+  int state = ac->num_states++;
+  memset(ac->next[state], 0, sizeof(ac->next[state]));
+  ac->fail[state] = 0;
+  ac->dict[state] = 0;
+  ac->pattern[state] = -1;
+  return state;
+}
+
+ac_automaton_t *ac_create(void)
+{
+  ac_automaton_t *ac = calloc(1, sizeof(ac_automaton_t));
+  if (!ac)
+    return NULL;
+  ac->num_classes = 1;
+
+  // State 0 is the root
+  if (ac_new_state(ac) != 0)
+  {
+    ac_free(ac);
+    return NULL;
+  }
+  return ac;
+}
+
+int ac_add_pattern(ac_automaton_t *ac, const char *pattern, size_t len)
+{
+  if (ac->compiled || len == 0 || ac->num_patterns >= AC_MAX_PATTERNS)
+    return -1;
+
+  int state = 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    unsigned char c = (unsigned char)pattern[i];
+    if (ac->byte_class[c] == 0)
+      ac->byte_class[c] = (uint8_t)ac->num_classes++;
+    if (ac->next[state][c] == 0)
+    {
+      int created = ac_new_state(ac);
+      if (created < 0)
+        return -1;
+      ac->next[state][c] = (uint16_t)created;
+    }
+    state = ac->next[state][c];
+  }
+
+  // Each pattern must be distinct so that every ID has its own final state
+  if (ac->pattern[state] >= 0)
+    return -1;
+
+  int id = ac->num_patterns++;
+  ac->pattern[state] = (int16_t)id;
+  ac->pattern_len[id] = len;
+  if (len > ac->max_len)
+    ac->max_len = len;
+  return id;
+}
+
+bool ac_compile(ac_automaton_t *ac)
+{
+  if (ac->compiled)
+    return true;
+
+  int *queue = malloc((size_t)ac->num_states * sizeof(int));
+  if (!queue)
+    return false;
+
+  int head = 0;
+  int tail = 0;
+
+  // Depth-1 states fail back to the root; missing root edges loop on the root
+  for (int c = 0; c < 256; c++)
+  {
+    int child = ac->next[0][c];
+    if (child)
+    {
+      ac->fail[child] = 0;
+      ac->dict[child] = 0;
+      queue[tail++] = child;
+    }
+  }
+
+  // Breadth-first: failure links of shallower states are final before they are used
+  while (head < tail)
+  {
+    int state = queue[head++];
+    for (int c = 0; c < 256; c++)
+    {
+      int child = ac->next[state][c];
+      int fallback = ac->next[ac->fail[state]][c];
+      if (child)
+      {
+        ac->fail[child] = (uint16_t)fallback;
+        ac->dict[child] = ac->pattern[fallback] >= 0 ? (uint16_t)fallback : ac->dict[fallback];
+        queue[tail++] = child;
+      }
+      else
+      {
+        ac->next[state][c] = (uint16_t)fallback;
+      }
+    }
+  }
+
+  free(queue);
+
+  // Collapse the 256-wide table into one column per byte class so the DFA stays cache-resident
+  int classes = ac->num_classes;
+  ac->delta = malloc((size_t)ac->num_states * classes * sizeof(uint32_t));
+  ac->output = malloc((size_t)ac->num_states * sizeof(uint16_t));
+  if (!ac->delta || !ac->output)
+  {
+    free(ac->delta);
+    free(ac->output);
+    ac->delta = NULL;
+    ac->output = NULL;
+    return false;
+  }
+
+  for (int state = 0; state < ac->num_states; state++)
+  {
+    for (int c = 0; c < 256; c++)
+    {
+      int target = ac->next[state][c];
+      bool ends_pattern = ac->pattern[target] >= 0 || ac->dict[target] != 0;
+      ac->delta[state * classes + ac->byte_class[c]] =
+          ((uint32_t)target * classes) << 1 | (ends_pattern ? 1 : 0);
+    }
+    ac->output[state] = ac->pattern[state] >= 0 ? (uint16_t)state : ac->dict[state];
+  }
+
+  free(ac->next);
+  ac->next = NULL;
+  ac->compiled = true;
+  return true;
+}
+
+int ac_pattern_count(const ac_automaton_t *ac)
+{
+  return ac->num_patterns;
+}
+
+// Record every pattern that ends at 'pos' in the state encoded by 'entry'
+static void ac_report(const ac_automaton_t *ac, uint32_t entry, size_t pos, int *first_pos,
+                      int *found)
+{
+  // Walk the state itself, then its dictionary chain
+  int out = ac->output[(entry >> 1) / ac->num_classes];
+  while (out)
+  {
+    int id = ac->pattern[out];
+    int start = (int)(pos + 1 - ac->pattern_len[id]);
+    if (first_pos[id] < 0)
+    {
+      first_pos[id] = start;
+      (*found)++;
+    }
+    else if (start < first_pos[id])
+    {
+      first_pos[id] = start;
+    }
+    out = ac->dict[out];
+  }
+}
+
+int ac_scan(const ac_automaton_t *ac, const char *text, size_t len, int *first_pos)
+{
+  const unsigned char *bytes = (const unsigned char *)text;
+  const uint32_t *delta = ac->delta;
+  const uint8_t *byte_class = ac->byte_class;
+  int found = 0;
+
+  for (int i = 0; i < ac->num_patterns; i++)
+    first_pos[i] = -1;
+
+  // Each step is a load that depends on the previous one, so a single walk is bound by load
+  // latency. Long texts are split into four slices walked in lockstep; every slice but the first
+  // is entered max_len - 1 bytes early so that matches crossing a boundary are seen, and each
+  // walk only reports matches that end inside its own slice.
+  size_t overlap = ac->max_len - 1;
+  size_t slice = len / 4;
+  size_t i = 0;
+  if (len >= AC_SCAN_MIN_SPLIT_LEN && slice > overlap)
+  {
+    const unsigned char *s1 = bytes + slice;
+    const unsigned char *s2 = bytes + 2 * slice;
+    const unsigned char *s3 = bytes + 3 * slice;
+    uint32_t e0 = 0;
+    uint32_t e1 = 0;
+    uint32_t e2 = 0;
+    uint32_t e3 = 0;
+
+    // Warm up with the overlap; patterns ending there belong to the previous slice
+    for (size_t j = overlap; j > 0; j--)
+    {
+      e1 = delta[(e1 >> 1) + byte_class[s1[-(ptrdiff_t)j]]];
+      e2 = delta[(e2 >> 1) + byte_class[s2[-(ptrdiff_t)j]]];
+      e3 = delta[(e3 >> 1) + byte_class[s3[-(ptrdiff_t)j]]];
+    }
+
+    for (; i < slice; i++)
+    {
+      e0 = delta[(e0 >> 1) + byte_class[bytes[i]]];
+      e1 = delta[(e1 >> 1) + byte_class[s1[i]]];
+      e2 = delta[(e2 >> 1) + byte_class[s2[i]]];
+      e3 = delta[(e3 >> 1) + byte_class[s3[i]]];
+
+      if ((e0 | e1 | e2 | e3) & 1)
+      {
+        if (e0 & 1)
+          ac_report(ac, e0, i, first_pos, &found);
+        if (e1 & 1)
+          ac_report(ac, e1, slice + i, first_pos, &found);
+        if (e2 & 1)
+          ac_report(ac, e2, 2 * slice + i, first_pos, &found);
+        if (e3 & 1)
+          ac_report(ac, e3, 3 * slice + i, first_pos, &found);
+      }
+    }
+
+    // The last walk also covers the remainder of the division
+    uint32_t state = e3;
+    for (i = 4 * slice; i < len; i++)
+    {
+      state = delta[(state >> 1) + byte_class[bytes[i]]];
+      if (state & 1)
+        ac_report(ac, state, i, first_pos, &found);
+    }
+    return found;
+  }
+
+  uint32_t state = 0;
+  for (i = 0; i < len; i++)
+  {
+    state = delta[(state >> 1) + byte_class[bytes[i]]];
+    if (state & 1)
+      ac_report(ac, state, i, first_pos, &found);
+  }
+  return found;
+}
+
+void ac_free(ac_automaton_t *ac)
+{
+  if (!ac)
+    return;
+  free(ac->next);
+  free(ac->fail);
+  free(ac->dict);
+  free(ac->pattern);
+  free(ac->delta);
+  free(ac->output);
+  free(ac);
+}
@@ -0,0 +1,732 @@
+/**
+ * Neptune Scanner - Scan Job Daemon
+ * daemon.c - Job server over a Unix domain socket, its engine thread and the submit client
+ */
+
+#include "../include/daemon.h"
+#include "../include/config.h"
+#include "../include/scan_stats.h"
+#include "../include/service_detection.h"
+#include "../include/syn_engine.h"
+#include "../include/transport.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WAKE_INTERVAL 200 // Milliseconds between checks for a stop request or a closed client
+
+// A job from submission until its client has sent the last reply
+typedef struct daemon_job
+{
+  // Set by the client thread before the job is submitted
+  unsigned id;
+  uint32_t addr;
+  port_bitmap_t *ports;       // The TCP ports of the request's spec
+  int num_ports;
+  int weight;
+
+  syn_job_t *engine_job;      // Engine thread only
+
+  // Under server.lock
+  uint16_t *open;             // Open ports in the order they were found
+  int num_open;
+  int open_capacity;
+  bool cancelled;             // The client went away
+  bool released;              // Out of the engine; stats are final and only the client holds it
+  bool failed;                // The engine could not run it (see error)
+  const char *error;
+  syn_engine_stats_t stats;
+  pthread_cond_t changed;     // Signalled on new open ports and on release
+  struct daemon_job *next;    // In server.pending or server.active
+} daemon_job_t;
+
+static struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t work;        // Signalled on submission, cancellation and stop
+  pthread_cond_t idle;        // Signalled when a client thread exits
+  daemon_job_t *pending;      // Submitted, not yet given to the engine
+  daemon_job_t *active;       // In the engine
+  bool stop;
+  unsigned next_id;
+  int clients[DAEMON_MAX_CLIENTS]; // Connected sockets, -1 for a free entry
+  int num_clients;
+  syn_engine_t *engine;
+  const exclude_list_t *exclude; // Addresses no job may target (NULL = none)
+} server = {.lock = PTHREAD_MUTEX_INITIALIZER,
+            .work = PTHREAD_COND_INITIALIZER,
+            .idle = PTHREAD_COND_INITIALIZER};
+
+static volatile sig_atomic_t stop_requested;
+
+static void request_stop(int signal_number)
+{
+  (void)signal_number;
+  stop_requested = 1;
+}
+
+// Write all of a buffer
+static bool send_all(int sock, const void *data, size_t len)
+{
+  const char *p = data;
+  while (len > 0)
+  {
+    ssize_t n = send(sock, p, len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+// Read exactly len bytes; false on error or end of stream
+static bool recv_all(int sock, void *data, size_t len)
+{
+  char *p = data;
+  while (len > 0)
+  {
+    ssize_t n = recv(sock, p, len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static bool send_frame(int sock, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Send one formatted frame
+static bool send_frame(int sock, const char *format, ...)
+{
+  char frame[4 + 1024];
+  va_list ap;
+  va_start(ap, format);
+  int len = vsnprintf(frame + 4, sizeof(frame) - 4, format, ap);
+  va_end(ap);
+  if (len < 0)
+    return false;
+  if ((size_t)len >= sizeof(frame) - 4)
+    len = (int)sizeof(frame) - 5;
+
+  frame[0] = (char)(len >> 24);
+  frame[1] = (char)(len >> 16);
+  frame[2] = (char)(len >> 8);
+  frame[3] = (char)len;
+  return send_all(sock, frame, 4 + (size_t)len);
+}
+
+// Send a payload that may be longer than send_frame allows
+static bool send_payload(int sock, const char *payload, size_t len)
+{
+  unsigned char head[4] = {(unsigned char)(len >> 24), (unsigned char)(len >> 16),
+                           (unsigned char)(len >> 8), (unsigned char)len};
+  return send_all(sock, head, sizeof(head)) && send_all(sock, payload, len);
+}
+
+/**
+ * Reads one frame
+ *
+ * @param sock Socket
+ * @param buffer Receives the payload, NUL-terminated
+ * @param size Size of buffer (at least DAEMON_MAX_FRAME + 1)
+ * @return Payload length, or -1 on error, end of stream or an oversized frame
+ */
+static int recv_frame(int sock, char *buffer, size_t size)
+{
+  unsigned char head[4];
+  if (!recv_all(sock, head, sizeof(head)))
+    return -1;
+  uint32_t len = (uint32_t)head[0] << 24 | (uint32_t)head[1] << 16 | (uint32_t)head[2] << 8 |
+                 head[3];
+  if (len > DAEMON_MAX_FRAME || len >= size || !recv_all(sock, buffer, len))
+    return -1;
+  buffer[len] = '\0';
+  return (int)len;
+}
+
+// Find "key=" in a request and copy its value; false if the key is absent
+static bool request_value(const char *request, const char *key, char *value, size_t size)
+{
+  size_t key_len = strlen(key);
+  for (const char *p = request; (p = strstr(p, key)) != NULL; p += key_len)
+  {
+    if ((p != request && p[-1] != ' ') || p[key_len] != '=')
+      continue;
+    const char *start = p + key_len + 1;
+    size_t len = strcspn(start, " ");
+    if (len >= size)
+      return false;
+    memcpy(value, start, len);
+    value[len] = '\0';
+    return true;
+  }
+  return false;
+}
+
+// Engine callback: keep open ports for the client thread to stream
+static void record_result(void *context, uint32_t addr, uint16_t port, port_state_t state,
+                          const os_response_t *reply)
+{
+  (void)addr;
+  (void)reply;
+  daemon_job_t *job = context;
+  if (state != PORT_STATE_OPEN)
+    return;
+
+  pthread_mutex_lock(&server.lock);
+  if (job->num_open == job->open_capacity)
+  {
+    int capacity = job->open_capacity ? job->open_capacity * 2 : 16;
+    uint16_t *open = realloc(job->open, (size_t)capacity * sizeof(uint16_t));
+    if (!open)
+    {
+      pthread_mutex_unlock(&server.lock);
+      return;
+    }
+    job->open = open;
+    job->open_capacity = capacity;
+  }
+  job->open[job->num_open++] = port;
+  pthread_cond_signal(&job->changed);
+  pthread_mutex_unlock(&server.lock);
+}
+
+// Hand a job back to its client thread; called with server.lock held
+static void release_job(daemon_job_t *job, const char *error)
+{
+  if (error)
+  {
+    job->failed = true;
+    job->error = error;
+  }
+  job->released = true;
+  pthread_cond_signal(&job->changed);
+}
+
+// Give pending jobs to the engine and take out the finished and cancelled ones; lock held
+static void update_jobs(void)
+{
+  while (server.pending)
+  {
+    daemon_job_t *job = server.pending;
+    server.pending = job->next;
+    job->engine_job = syn_engine_add_bitmap_job(server.engine, job->addr, 1, job->ports,
+                                                job->weight, record_result, job);
+    if (!job->engine_job)
+    {
+      release_job(job, "out of memory");
+      continue;
+    }
+    job->next = server.active;
+    server.active = job;
+  }
+
+  daemon_job_t **link = &server.active;
+  while (*link)
+  {
+    daemon_job_t *job = *link;
+    bool finished = syn_engine_job_finished(job->engine_job, &job->stats);
+    if (!finished && !job->cancelled)
+    {
+      link = &job->next;
+      continue;
+    }
+    *link = job->next;
+    syn_engine_remove_job(server.engine, job->engine_job);
+    job->engine_job = NULL;
+    release_job(job, NULL);
+  }
+}
+
+// The only thread that touches the engine and the transport
+static void *engine_thread(void *arg)
+{
+  (void)arg;
+  pthread_mutex_lock(&server.lock);
+  while (!server.stop)
+  {
+    update_jobs();
+    if (!syn_engine_busy(server.engine))
+    {
+      pthread_cond_wait(&server.work, &server.lock);
+      continue;
+    }
+
+    // Results are reported from inside the step, which takes the lock per open port
+    pthread_mutex_unlock(&server.lock);
+    bool ok = syn_engine_step(server.engine, (int64_t)DAEMON_STEP_WAIT * 1000);
+    pthread_mutex_lock(&server.lock);
+    if (!ok)
+    {
+      fprintf(stderr, "Transport failed, stopping the daemon\n");
+      server.stop = true;
+      stop_requested = 1;
+    }
+  }
+
+  // Nothing runs any more; fail what is left
+  for (daemon_job_t *list = server.active; list;)
+  {
+    daemon_job_t *job = list;
+    list = job->next;
+    syn_engine_remove_job(server.engine, job->engine_job);
+    release_job(job, "daemon stopped");
+  }
+  for (daemon_job_t *list = server.pending; list;)
+  {
+    daemon_job_t *job = list;
+    list = job->next;
+    release_job(job, "daemon stopped");
+  }
+  server.active = server.pending = NULL;
+  pthread_mutex_unlock(&server.lock);
+  return NULL;
+}
+
+// Whether the peer has closed the connection; data it sent meanwhile is left unread
+static bool peer_closed(int sock)
+{
+  struct pollfd pfd = {.fd = sock, .events = POLLIN};
+  if (poll(&pfd, 1, 0) <= 0)
+    return false;
+  if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+    return true;
+  char byte;
+  return recv(sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+static void add_ms(struct timespec *ts, int ms)
+{
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_nsec += (long)ms * 1000000;
+  ts->tv_sec += ts->tv_nsec / 1000000000;
+  ts->tv_nsec %= 1000000000;
+}
+
+// Run service detection on the job's open ports and send what it finds
+static bool send_services(int sock, const char *target, const daemon_job_t *job)
+{
+  scan_stats_gauge_add(GAUGE_SERVICE_QUEUE, job->num_open);
+  bool ok = true;
+  for (int i = 0; i < job->num_open; i++)
+  {
+    ServiceInfo info;
+    memset(&info, 0, sizeof(info));
+    info.port = job->open[i];
+    if (ok && detect_service_at(target, job->addr, job->open[i], &info))
+    {
+      ok = send_frame(sock, "SERVICE %d\t%s\t%s\t%s", job->open[i], info.service_name,
+                      info.protocol, info.version);
+    }
+    scan_stats_gauge_add(GAUGE_SERVICE_QUEUE, -1);
+  }
+  return ok;
+}
+
+// Submit a job and stream its results; false once the client is gone
+static bool run_job(int sock, daemon_job_t *job, const char *target, bool services)
+{
+  pthread_mutex_lock(&server.lock);
+  if (server.stop)
+  {
+    pthread_mutex_unlock(&server.lock);
+    return send_frame(sock, "ERROR daemon stopped");
+  }
+  job->id = ++server.next_id;
+  job->next = server.pending;
+  server.pending = job;
+  pthread_cond_signal(&server.work);
+  pthread_mutex_unlock(&server.lock);
+
+  bool connected = send_frame(sock, "JOB %u %d", job->id, job->num_ports);
+  int sent = 0;
+
+  pthread_mutex_lock(&server.lock);
+  while (!job->released)
+  {
+    if (connected && sent < job->num_open)
+    {
+      // Copy the new ports so the engine never waits on a socket write
+      uint16_t batch[256];
+      int n = job->num_open - sent < 256 ? job->num_open - sent : 256;
+      memcpy(batch, job->open + sent, (size_t)n * sizeof(uint16_t));
+      sent += n;
+      pthread_mutex_unlock(&server.lock);
+      for (int i = 0; i < n && connected; i++)
+        connected = send_frame(sock, "OPEN %u", batch[i]);
+      pthread_mutex_lock(&server.lock);
+      continue;
+    }
+
+    if (!connected || peer_closed(sock))
+    {
+      connected = false;
+      if (!job->cancelled)
+      {
+        job->cancelled = true;
+        pthread_cond_signal(&server.work);
+      }
+      pthread_cond_wait(&job->changed, &server.lock);
+      continue;
+    }
+
+    struct timespec deadline;
+    add_ms(&deadline, WAKE_INTERVAL);
+    pthread_cond_timedwait(&job->changed, &server.lock, &deadline);
+  }
+  pthread_mutex_unlock(&server.lock);
+
+  // Released: the open ports and stats are final and no other thread holds the job
+  for (; connected && sent < job->num_open; sent++)
+    connected = send_frame(sock, "OPEN %u", job->open[sent]);
+  if (!connected)
+    return false;
+  if (job->failed)
+    return send_frame(sock, "ERROR %s", job->error);
+  if (services && !send_services(sock, target, job))
+    return false;
+  return send_frame(sock, "DONE open=%llu closed=%llu filtered=%llu sent=%llu elapsed_ms=%lld",
+                    (unsigned long long)job->stats.open, (unsigned long long)job->stats.closed,
+                    (unsigned long long)job->stats.filtered, (unsigned long long)job->stats.sent,
+                    (long long)(job->stats.elapsed_us / 1000));
+}
+
+// Parse and run one request; false once the client is gone
+static bool handle_request(int sock, const char *request)
+{
+  char target[256], spec[DAEMON_MAX_FRAME], value[32];
+  if (strncmp(request, "SCAN ", 5) != 0)
+    return send_frame(sock, "ERROR unknown request");
+  if (!request_value(request, "target", target, sizeof(target)) ||
+      !request_value(request, "ports", spec, sizeof(spec)))
+    return send_frame(sock, "ERROR SCAN needs target= and ports=");
+
+  int weight = 1;
+  if (request_value(request, "weight", value, sizeof(value)))
+  {
+    weight = atoi(value);
+    if (weight < 1 || weight > DAEMON_MAX_WEIGHT)
+      return send_frame(sock, "ERROR weight must be between 1 and %d", DAEMON_MAX_WEIGHT);
+  }
+  bool services = request_value(request, "services", value, sizeof(value)) &&
+                  strcmp(value, "1") == 0;
+
+  struct addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(target, NULL, &hints, &result) != 0)
+    return send_frame(sock, "ERROR cannot resolve %s", target);
+  uint32_t addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(result);
+  if (server.exclude && exclude_list_contains(server.exclude, ntohl(addr)))
+    return send_frame(sock, "ERROR %s is excluded", target);
+
+  daemon_job_t job;
+  memset(&job, 0, sizeof(job));
+  job.addr = addr;
+  job.weight = weight;
+  port_spec_t *ports = malloc(sizeof(port_spec_t));
+  char error[128];
+  if (!ports)
+    return send_frame(sock, "ERROR out of memory");
+  if (!port_spec_parse(spec, ports, error, sizeof(error)))
+  {
+    free(ports);
+    return send_frame(sock, "ERROR %s", error);
+  }
+  // The engine sends TCP SYNs only; UDP items are accepted and left out
+  job.ports = &ports->tcp;
+  job.num_ports = port_bitmap_count(job.ports);
+  if (job.num_ports == 0)
+  {
+    free(ports);
+    return send_frame(sock, "ERROR port spec has no TCP ports");
+  }
+
+  pthread_cond_init(&job.changed, NULL);
+  bool connected = run_job(sock, &job, target, services);
+  pthread_cond_destroy(&job.changed);
+  free(job.open);
+  free(ports);
+  return connected;
+}
+
+static void *client_thread(void *arg)
+{
+  int sock = (int)(intptr_t)arg;
+  char *request = malloc(DAEMON_MAX_FRAME + 1);
+
+  while (request && recv_frame(sock, request, DAEMON_MAX_FRAME + 1) >= 0)
+  {
+    if (!handle_request(sock, request))
+      break;
+  }
+  free(request);
+
+  pthread_mutex_lock(&server.lock);
+  for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+  {
+    if (server.clients[i] == sock)
+      server.clients[i] = -1;
+  }
+  server.num_clients--;
+  pthread_cond_signal(&server.idle);
+  pthread_mutex_unlock(&server.lock);
+  close(sock);
+  return NULL;
+}
+
+// Start a thread for a new connection, or turn it away if there are too many
+static void accept_client(int sock)
+{
+  pthread_mutex_lock(&server.lock);
+  int slot = -1;
+  for (int i = 0; i < DAEMON_MAX_CLIENTS && slot < 0; i++)
+  {
+    if (server.clients[i] < 0)
+      slot = i;
+  }
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (slot >= 0 &&
+      pthread_create(&thread, &attr, client_thread, (void *)(intptr_t)sock) == 0)
+  {
+    server.clients[slot] = sock;
+    server.num_clients++;
+    sock = -1;
+  }
+  pthread_attr_destroy(&attr);
+  pthread_mutex_unlock(&server.lock);
+
+  if (sock >= 0)
+  {
+    send_frame(sock, "ERROR too many clients");
+    close(sock);
+  }
+}
+
+// Create the listening socket, replacing a stale one left by an earlier daemon
+static int listen_unix(const char *socket_path)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path))
+    return -1;
+  strcpy(addr.sun_path, socket_path);
+
+  struct stat st;
+  if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(socket_path);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0)
+    return -1;
+  mode_t mask = umask(0077);
+  bool bound = bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+  umask(mask);
+  if (!bound || listen(sock, 16) != 0)
+  {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+bool daemon_run(const char *socket_path, const exclude_list_t *exclude)
+{
+  server.exclude = exclude;
+  transport_t *transport = transport_raw_open();
+  if (!transport)
+  {
+    fprintf(stderr, "The daemon needs raw sockets (run as root or with CAP_NET_RAW)\n");
+    return false;
+  }
+
+  syn_engine_config_t config;
+  syn_engine_default_config(&config);
+  config.rate = scan_rate;
+  server.engine = syn_engine_create(transport, &config);
+  int sock = server.engine ? listen_unix(socket_path) : -1;
+  if (sock < 0)
+  {
+    fprintf(stderr, "Cannot listen on %s\n", socket_path);
+    syn_engine_destroy(server.engine);
+    server.engine = NULL;
+    transport->ops->close(transport);
+    return false;
+  }
+
+  for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+    server.clients[i] = -1;
+  server.stop = false;
+  stop_requested = 0;
+  signal(SIGINT, request_stop);
+  signal(SIGTERM, request_stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  pthread_t engine;
+  if (pthread_create(&engine, NULL, engine_thread, NULL) != 0)
+  {
+    close(sock);
+    unlink(socket_path);
+    syn_engine_destroy(server.engine);
+    server.engine = NULL;
+    transport->ops->close(transport);
+    return false;
+  }
+  printf("Daemon listening on %s (rate %s)\n", socket_path, scan_rate ? "limited" : "unlimited");
+  fflush(stdout);
+
+  while (!stop_requested)
+  {
+    // Wake up regularly to notice a signal
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    if (poll(&pfd, 1, WAKE_INTERVAL) <= 0)
+      continue;
+    int client = accept(sock, NULL, NULL);
+    if (client >= 0)
+      accept_client(client);
+  }
+
+  // Stop the engine, then wake the clients so they report the stop and exit
+  close(sock);
+  unlink(socket_path);
+  pthread_mutex_lock(&server.lock);
+  server.stop = true;
+  pthread_cond_broadcast(&server.work);
+  pthread_mutex_unlock(&server.lock);
+  pthread_join(engine, NULL);
+
+  pthread_mutex_lock(&server.lock);
+  for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+  {
+    if (server.clients[i] >= 0)
+      shutdown(server.clients[i], SHUT_RD);
+  }
+  while (server.num_clients > 0)
+    pthread_cond_wait(&server.idle, &server.lock);
+  pthread_mutex_unlock(&server.lock);
+
+  syn_engine_destroy(server.engine);
+  server.engine = NULL;
+  transport->ops->close(transport);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  return true;
+}
+
+bool daemon_submit(const char *socket_path, const char *target, const int *ports, int num_ports,
+                   int weight, bool services)
+{
+  // Runs of consecutive ports go out as ranges to keep the request small
+  char *request = malloc(DAEMON_MAX_FRAME);
+  if (!request)
+    return false;
+  int len = snprintf(request, DAEMON_MAX_FRAME, "SCAN target=%s weight=%d%s ports=", target,
+                     weight, services ? " services=1" : "");
+  for (int i = 0; i < num_ports && len < DAEMON_MAX_FRAME; i++)
+  {
+    int last = i;
+    while (last + 1 < num_ports && ports[last + 1] == ports[last] + 1)
+      last++;
+    len += last > i ? snprintf(request + len, DAEMON_MAX_FRAME - len, "%s%d-%d", i ? "," : "",
+                               ports[i], ports[last])
+                    : snprintf(request + len, DAEMON_MAX_FRAME - len, "%s%d", i ? "," : "",
+                               ports[i]);
+    i = last;
+  }
+  if (len >= DAEMON_MAX_FRAME)
+  {
+    fprintf(stderr, "Port list too long for a daemon request\n");
+    free(request);
+    return false;
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+  {
+    fprintf(stderr, "Cannot connect to the daemon at %s\n", socket_path);
+    if (sock >= 0)
+      close(sock);
+    free(request);
+    return false;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  bool done = false;
+  if (send_payload(sock, request, (size_t)len))
+  {
+    // The reply can reuse the request buffer; one extra byte holds the terminator
+    char *reply = realloc(request, DAEMON_MAX_FRAME + 1);
+    if (reply)
+    {
+      request = reply;
+      while (recv_frame(sock, reply, DAEMON_MAX_FRAME + 1) >= 0)
+      {
+        printf("%s\n", reply);
+        fflush(stdout);
+        if (strncmp(reply, "DONE", 4) == 0 || strncmp(reply, "ERROR", 5) == 0)
+        {
+          done = reply[0] == 'D';
+          break;
+        }
+      }
+    }
+  }
+  close(sock);
+  free(request);
+  return done;
+}
+
+#else
+
+bool daemon_run(const char *socket_path, const exclude_list_t *exclude)
+{
+  (void)socket_path;
+  (void)exclude;
+  fprintf(stderr, "The daemon is not supported on Windows\n");
+  return false;
+}
+
+bool daemon_submit(const char *socket_path, const char *target, const int *ports, int num_ports,
+                   int weight, bool services)
+{
+  (void)socket_path;
+  (void)target;
+  (void)ports;
+  (void)num_ports;
+  (void)weight;
+  (void)services;
+  fprintf(stderr, "The daemon is not supported on Windows\n");
+  return false;
+}
+
+#endif
@@ -0,0 +1,221 @@
+/**
+ * Neptune Scanner - Exclusion Lists
+ * exclude_list.c - Building and searching exclusion lists
+ */
+
+#include "../include/exclude_list.h"
+#include "../include/target_spec.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INDEX_SLOTS 65536      // One per /16
+#define ENTRY_MAX_LEN 63       // Longest entry (an address range needs 31)
+#define LINE_MAX_LEN 4096      // Longest line of an exclusion file
+
+void exclude_list_init(exclude_list_t *list)
+{
+  memset(list, 0, sizeof(*list));
+}
+
+static bool add_run(void *context, uint32_t first, uint32_t last)
+{
+  exclude_list_t *list = context;
+  if (list->num_ranges == list->capacity)
+  {
+    uint32_t capacity = list->capacity ? list->capacity * 2 : 256;
+    exclude_range_t *ranges = realloc(list->ranges, (size_t)capacity * sizeof(exclude_range_t));
+    if (!ranges)
+      return false;
+    list->ranges = ranges;
+    list->capacity = capacity;
+  }
+  list->ranges[list->num_ranges++] = (exclude_range_t){first, last};
+  return true;
+}
+
+// Add one entry; false with a message if it is invalid or memory runs out
+static bool add_entry(exclude_list_t *list, const char *entry, size_t len, char *error,
+                      size_t error_size)
+{
+  char text[ENTRY_MAX_LEN + 1];
+  target_range_t range;
+  if (len > ENTRY_MAX_LEN)
+  {
+    snprintf(error, error_size, "invalid exclusion \"%.*s...\"", 16, entry);
+    return false;
+  }
+  memcpy(text, entry, len);
+  text[len] = '\0';
+  if (!target_range_parse(text, &range))
+  {
+    snprintf(error, error_size, "invalid exclusion \"%s\" (addresses and ranges only)", text);
+    return false;
+  }
+  if (!target_range_each(&range, add_run, list))
+  {
+    snprintf(error, error_size, "out of memory");
+    return false;
+  }
+  return true;
+}
+
+// Add the entries of a line up to its comment, if any
+static bool add_line(exclude_list_t *list, const char *line, char *error, size_t error_size)
+{
+  const char *p = line;
+  while (*p && *p != '#')
+  {
+    if (*p == ',' || isspace((unsigned char)*p))
+    {
+      p++;
+      continue;
+    }
+    const char *entry = p;
+    while (*p && *p != '#' && *p != ',' && !isspace((unsigned char)*p))
+      p++;
+    if (!add_entry(list, entry, (size_t)(p - entry), error, error_size))
+      return false;
+  }
+  return true;
+}
+
+bool exclude_list_add(exclude_list_t *list, const char *text, char *error, size_t error_size)
+{
+  return add_line(list, text, error, error_size);
+}
+
+bool exclude_list_add_file(exclude_list_t *list, const char *path, char *error,
+                           size_t error_size)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+  {
+    snprintf(error, error_size, "cannot read %s", path);
+    return false;
+  }
+
+  char *line = malloc(LINE_MAX_LEN);
+  bool ok = line != NULL;
+  if (!ok)
+    snprintf(error, error_size, "out of memory");
+  for (int number = 1; ok && fgets(line, LINE_MAX_LEN, file); number++)
+  {
+    char message[160];
+    ok = add_line(list, line, message, sizeof(message));
+    if (!ok)
+      snprintf(error, error_size, "%s:%d: %s", path, number, message);
+  }
+  free(line);
+  fclose(file);
+  return ok;
+}
+
+static int compare_ranges(const void *a, const void *b)
+{
+  const exclude_range_t *x = a, *y = b;
+  return x->first < y->first ? -1 : x->first > y->first;
+}
+
+bool exclude_list_build(exclude_list_t *list)
+{
+  list->index = malloc(INDEX_SLOTS * sizeof(uint32_t));
+  if (!list->index)
+    return false;
+
+  // Sort, then merge ranges that overlap or touch
+  qsort(list->ranges, list->num_ranges, sizeof(exclude_range_t), compare_ranges);
+  uint32_t merged = 0;
+  for (uint32_t i = 0; i < list->num_ranges; i++)
+  {
+    exclude_range_t *tail = merged ? &list->ranges[merged - 1] : NULL;
+    if (tail && (tail->last == UINT32_MAX || list->ranges[i].first <= tail->last + 1))
+    {
+      if (list->ranges[i].last > tail->last)
+        tail->last = list->ranges[i].last;
+    }
+    else
+    {
+      list->ranges[merged++] = list->ranges[i];
+    }
+  }
+  list->num_ranges = merged;
+
+  // Slot s holds the first range that ends at or after the start of /16 number s
+  uint32_t range = 0;
+  for (uint32_t slot = 0; slot < INDEX_SLOTS; slot++)
+  {
+    while (range < list->num_ranges && list->ranges[range].last < slot << 16)
+      range++;
+    list->index[slot] = range;
+  }
+  list->built = true;
+  return true;
+}
+
+// Position of the first range that ends at or after addr (num_ranges if none)
+static uint32_t find_range(const exclude_list_t *list, uint32_t addr)
+{
+  uint32_t slot = addr >> 16;
+  uint32_t low = list->index[slot];
+  uint32_t high = slot + 1 < INDEX_SLOTS ? list->index[slot + 1] : list->num_ranges;
+  while (low < high)
+  {
+    uint32_t middle = low + (high - low) / 2;
+    if (list->ranges[middle].last < addr)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+bool exclude_list_contains(const exclude_list_t *list, uint32_t addr)
+{
+  if (!list->built)
+    return false;
+  uint32_t range = find_range(list, addr);
+  return range < list->num_ranges && list->ranges[range].first <= addr;
+}
+
+bool exclude_list_next_run(const exclude_list_t *list, uint32_t *first, uint32_t last,
+                           uint32_t *run_last)
+{
+  if (*first > last)
+    return false;
+  if (!list->built)
+  {
+    *run_last = last;
+    return true;
+  }
+
+  // Skip the range *first falls in; merged ranges never touch, so what follows is allowed
+  uint32_t range = find_range(list, *first);
+  if (range < list->num_ranges && list->ranges[range].first <= *first)
+  {
+    if (list->ranges[range].last >= last)
+      return false;
+    *first = list->ranges[range].last + 1;
+    range++;
+  }
+  *run_last = range < list->num_ranges && list->ranges[range].first <= last
+                  ? list->ranges[range].first - 1
+                  : last;
+  return true;
+}
+
+uint64_t exclude_list_count(const exclude_list_t *list)
+{
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < list->num_ranges; i++)
+    count += (uint64_t)(list->ranges[i].last - list->ranges[i].first) + 1;
+  return count;
+}
+
+void exclude_list_free(exclude_list_t *list)
+{
+  free(list->ranges);
+  free(list->index);
+  exclude_list_init(list);
+}
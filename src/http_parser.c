@@ -0,0 +1,417 @@
+/**
+ * Neptune Scanner - HTTP Fingerprinting
+ * http_parser.c - Incremental HTTP/1.x response parser
+ */
+
+#include "../include/http_parser.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+void http_parser_init(http_parser_t *parser)
+{
+  memset(parser, 0, sizeof(*parser));
+  parser->state = HTTP_STATE_STATUS;
+  parser->content_length = -1;
+}
+
+// Case-insensitive comparison of a span against a lowercase literal
+static bool span_equals(const char *data, size_t start, size_t end, const char *lower)
+{
+  size_t len = strlen(lower);
+  if (end - start != len)
+    return false;
+  for (size_t i = 0; i < len; i++)
+  {
+    if (tolower((unsigned char)data[start + i]) != lower[i])
+      return false;
+  }
+  return true;
+}
+
+// Find a lowercase literal in data[start, end) ignoring case; returns end if absent
+static size_t find_nocase(const char *data, size_t start, size_t end, const char *lower)
+{
+  size_t len = strlen(lower);
+  for (size_t i = start; i + len <= end; i++)
+  {
+    if (tolower((unsigned char)data[i]) == lower[0] &&
+        span_equals(data, i, i + len, lower))
+    {
+      return i;
+    }
+  }
+  return end;
+}
+
+// Store data[start, end) in a span, without surrounding whitespace
+static void set_span(http_span_t *span, const char *data, size_t start, size_t end)
+{
+  while (start < end && isspace((unsigned char)data[start]))
+    start++;
+  while (end > start && isspace((unsigned char)data[end - 1]))
+    end--;
+  span->offset = start;
+  span->len = end - start;
+}
+
+// Parse "HTTP/1.1 200 OK"; the line excludes its terminator
+static bool parse_status_line(http_parser_t *parser, const char *data, size_t start, size_t end)
+{
+  const char *line = data + start;
+  size_t len = end - start;
+  if (len < 12 || strncmp(line, "HTTP/", 5) != 0 || !isdigit((unsigned char)line[5]) ||
+      line[6] != '.' || !isdigit((unsigned char)line[7]) || line[8] != ' ' ||
+      !isdigit((unsigned char)line[9]) || !isdigit((unsigned char)line[10]) ||
+      !isdigit((unsigned char)line[11]))
+  {
+    return false;
+  }
+
+  parser->version = (line[5] - '0') * 10 + (line[7] - '0');
+  parser->status_code = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+  parser->keep_alive = parser->version >= 11; // HTTP/1.0 closes unless asked not to
+  set_span(&parser->reason, data, start + 12, end);
+  return true;
+}
+
+// Record the headers of interest; the line excludes its terminator
+static void parse_header_line(http_parser_t *parser, const char *data, size_t start, size_t end)
+{
+  const char *colon = memchr(data + start, ':', end - start);
+  if (!colon || data[start] == ' ' || data[start] == '\t') // Malformed or folded line
+    return;
+
+  size_t name_end = (size_t)(colon - data);
+  size_t value_start = name_end + 1;
+  if (span_equals(data, start, name_end, "server"))
+  {
+    set_span(&parser->server, data, value_start, end);
+  }
+  else if (span_equals(data, start, name_end, "x-powered-by"))
+  {
+    set_span(&parser->powered_by, data, value_start, end);
+  }
+  else if (span_equals(data, start, name_end, "content-type"))
+  {
+    set_span(&parser->content_type, data, value_start, end);
+  }
+  else if (span_equals(data, start, name_end, "content-length"))
+  {
+    http_span_t value;
+    set_span(&value, data, value_start, end);
+    if (value.len > 0 && value.len < 19 && isdigit((unsigned char)data[value.offset]))
+      parser->content_length = strtoll(data + value.offset, NULL, 10);
+  }
+  else if (span_equals(data, start, name_end, "transfer-encoding"))
+  {
+    parser->chunked = find_nocase(data, value_start, end, "chunked") < end;
+  }
+  else if (span_equals(data, start, name_end, "connection"))
+  {
+    if (find_nocase(data, value_start, end, "close") < end)
+      parser->keep_alive = false;
+    else if (find_nocase(data, value_start, end, "keep-alive") < end)
+      parser->keep_alive = true;
+  }
+}
+
+// Whether the response carries a body at all (RFC 9112 section 6.3)
+static bool response_has_body(const http_parser_t *parser)
+{
+  return !parser->head_request && parser->status_code >= 200 && parser->status_code != 204 &&
+         parser->status_code != 304;
+}
+
+// Decide at the end of the headers whether the body can hold a title worth waiting for
+static bool body_may_have_title(const http_parser_t *parser, const char *data)
+{
+  if (!response_has_body(parser) || parser->content_length == 0)
+    return false;
+  if (parser->content_type.len > 0 &&
+      find_nocase(data, parser->content_type.offset,
+                  parser->content_type.offset + parser->content_type.len,
+                  "html") == parser->content_type.offset + parser->content_type.len)
+  {
+    return false;
+  }
+  return true;
+}
+
+// Parse a chunk size line ("1a3;ext"); the line excludes its terminator
+static bool parse_chunk_size(const char *data, size_t start, size_t end, long long *size)
+{
+  size_t i = start;
+  *size = 0;
+  for (; i < end && isxdigit((unsigned char)data[i]) && *size < (1LL << 40); i++)
+  {
+    int digit = isdigit((unsigned char)data[i]) ? data[i] - '0'
+                                                 : tolower((unsigned char)data[i]) - 'a' + 10;
+    *size = *size * 16 + digit;
+  }
+  return i > start && (i == end || data[i] == ';' || data[i] == ' ' || data[i] == '\t');
+}
+
+// Work out where the title search must stop, without reading past the message
+static http_parse_status_t set_title_limit(http_parser_t *parser, const char *data, size_t len)
+{
+  size_t start = parser->body_start;
+  long long size = HTTP_TITLE_SCAN_LIMIT;
+
+  if (parser->chunked)
+  {
+    // Only the first chunk is searched, so pipelined data after the body is never mistaken for it
+    const char *newline = memchr(data + start, '\n', len - start);
+    if (!newline)
+      return len - start > 1024 ? HTTP_PARSE_ERROR : HTTP_PARSE_MORE;
+    size_t next = (size_t)(newline - data) + 1;
+    size_t end = next - 1;
+    if (end > start && data[end - 1] == '\r')
+      end--;
+    if (!parse_chunk_size(data, start, end, &size))
+      return HTTP_PARSE_ERROR;
+    start = next;
+  }
+  else if (parser->content_length >= 0)
+  {
+    size = parser->content_length;
+  }
+
+  parser->pos = start;
+  if (size > HTTP_TITLE_SCAN_LIMIT)
+    size = HTTP_TITLE_SCAN_LIMIT;
+  parser->title_limit = start + (size_t)size;
+  return HTTP_PARSE_DONE;
+}
+
+// Search the body received so far for <title>...</title>
+static http_parse_status_t parse_body(http_parser_t *parser, const char *data, size_t len)
+{
+  if (parser->title_limit == 0)
+  {
+    http_parse_status_t status = set_title_limit(parser, data, len);
+    if (status != HTTP_PARSE_DONE)
+      return status;
+  }
+
+  size_t limit = parser->title_limit;
+  size_t end = len < limit ? len : limit;
+
+  size_t open = find_nocase(data, parser->pos, end, "<title");
+  if (open < end)
+  {
+    const char *gt = memchr(data + open, '>', end - open);
+    const char *lt = gt ? memchr(gt, '<', (size_t)(data + end - gt)) : NULL;
+    if (lt)
+    {
+      set_span(&parser->title, data, (size_t)(gt + 1 - data), (size_t)(lt - data));
+      parser->pos = (size_t)(lt - data);
+      parser->state = HTTP_STATE_DONE;
+      return HTTP_PARSE_DONE;
+    }
+    parser->pos = open; // Wait for the rest of the element
+  }
+  else
+  {
+    // Keep enough bytes to catch a "<title" split across reads
+    parser->pos = end >= parser->pos + 5 ? end - 5 : parser->pos;
+  }
+
+  if (end == limit)
+  {
+    parser->state = HTTP_STATE_DONE;
+    return HTTP_PARSE_DONE;
+  }
+  return HTTP_PARSE_MORE;
+}
+
+http_parse_status_t http_parser_feed(http_parser_t *parser, const char *data, size_t len)
+{
+  if (parser->state >= HTTP_STATE_DONE)
+    return HTTP_PARSE_DONE;
+
+  // Reject non-HTTP responses as soon as the first bytes arrive
+  if (parser->state == HTTP_STATE_STATUS)
+  {
+    size_t check = len - parser->pos < 5 ? len - parser->pos : 5;
+    if (strncmp(data + parser->pos, "HTTP/", check) != 0)
+      return HTTP_PARSE_ERROR;
+  }
+
+  while (parser->state == HTTP_STATE_STATUS || parser->state == HTTP_STATE_HEADERS)
+  {
+    const char *newline = memchr(data + parser->pos, '\n', len - parser->pos);
+    if (!newline)
+      return HTTP_PARSE_MORE;
+
+    size_t start = parser->pos;
+    size_t end = (size_t)(newline - data);
+    parser->pos = end + 1;
+    if (end > start && data[end - 1] == '\r')
+      end--;
+
+    if (parser->state == HTTP_STATE_STATUS)
+    {
+      if (!parse_status_line(parser, data, start, end))
+        return HTTP_PARSE_ERROR;
+      parser->state = HTTP_STATE_HEADERS;
+    }
+    else if (end > start)
+    {
+      parse_header_line(parser, data, start, end);
+    }
+    else if (parser->status_code >= 100 && parser->status_code < 200 &&
+             parser->status_code != 101)
+    {
+      // Interim response; the real one follows
+      parser->state = HTTP_STATE_STATUS;
+      parser->server.len = parser->powered_by.len = parser->content_type.len = 0;
+      parser->content_length = -1;
+      parser->chunked = false;
+    }
+    else
+    {
+      parser->body_start = parser->pos;
+      if (!body_may_have_title(parser, data))
+      {
+        parser->state = HTTP_STATE_DONE;
+        return HTTP_PARSE_DONE;
+      }
+      parser->state = HTTP_STATE_BODY;
+    }
+  }
+
+  return parse_body(parser, data, len);
+}
+
+// Copy a span as printable text, collapsing whitespace runs
+static void copy_span(char *out, size_t out_size, const char *data, http_span_t span)
+{
+  size_t n = 0;
+  bool space = false;
+  for (size_t i = 0; i < span.len && n < out_size - 1; i++)
+  {
+    unsigned char c = (unsigned char)data[span.offset + i];
+    if (isspace(c) || c < 0x20 || c == 0x7F)
+    {
+      space = true;
+      continue;
+    }
+    if (space && n > 0 && n < out_size - 2)
+      out[n++] = ' ';
+    space = false;
+    out[n++] = (char)c;
+  }
+  out[n] = '\0';
+}
+
+void http_parser_get_info(const http_parser_t *parser, const char *data, http_info_t *info)
+{
+  info->status_code = parser->status_code;
+  copy_span(info->server, sizeof(info->server), data, parser->server);
+  copy_span(info->powered_by, sizeof(info->powered_by), data, parser->powered_by);
+  copy_span(info->title, sizeof(info->title), data, parser->title);
+}
+
+// Hash and consume body bytes, up to body_remaining
+static void skip_body_bytes(http_parser_t *parser, const char *data, size_t len)
+{
+  size_t available = len - parser->pos;
+  size_t n = (unsigned long long)parser->body_remaining < available ? (size_t)parser->body_remaining
+                                                                    : available;
+  uint32_t hash = parser->body_hash;
+  for (size_t i = 0; i < n; i++)
+  {
+    hash ^= (unsigned char)data[parser->pos + i];
+    hash *= 16777619u;
+  }
+  parser->body_hash = hash;
+  parser->body_len += (long long)n;
+  parser->body_remaining -= (long long)n;
+  parser->pos += n;
+}
+
+http_parse_status_t http_parser_skip_body(http_parser_t *parser, const char *data, size_t len)
+{
+  if (parser->state < HTTP_STATE_DONE)
+    return HTTP_PARSE_ERROR;
+
+  // Choose the framing on the first call, starting over from the first body byte
+  if (parser->state == HTTP_STATE_DONE)
+  {
+    parser->pos = parser->body_start;
+    parser->body_len = 0;
+    parser->body_hash = 2166136261u;
+    if (!response_has_body(parser))
+    {
+      parser->state = HTTP_STATE_COMPLETE;
+    }
+    else if (parser->chunked)
+    {
+      parser->state = HTTP_STATE_CHUNK_SIZE;
+    }
+    else if (parser->content_length >= 0)
+    {
+      parser->body_remaining = parser->content_length;
+      parser->state = HTTP_STATE_SKIP_BODY;
+    }
+    else
+    {
+      // The body runs until the server closes the connection, so its length is unknown
+      parser->keep_alive = false;
+      parser->body_len = -1;
+      parser->state = HTTP_STATE_COMPLETE;
+    }
+  }
+
+  while (parser->state != HTTP_STATE_COMPLETE)
+  {
+    if (parser->state == HTTP_STATE_SKIP_BODY || parser->state == HTTP_STATE_CHUNK_DATA)
+    {
+      skip_body_bytes(parser, data, len);
+      if (parser->body_remaining > 0)
+        return HTTP_PARSE_MORE;
+      parser->state =
+          parser->state == HTTP_STATE_SKIP_BODY ? HTTP_STATE_COMPLETE : HTTP_STATE_CHUNK_END;
+      continue;
+    }
+
+    // The remaining states read one line at a time
+    const char *newline = memchr(data + parser->pos, '\n', len - parser->pos);
+    if (!newline)
+      return len - parser->pos > 1024 ? HTTP_PARSE_ERROR : HTTP_PARSE_MORE;
+    size_t start = parser->pos;
+    size_t end = (size_t)(newline - data);
+    parser->pos = end + 1;
+    if (end > start && data[end - 1] == '\r')
+      end--;
+
+    if (parser->state == HTTP_STATE_CHUNK_END)
+    {
+      if (end != start)
+        return HTTP_PARSE_ERROR;
+      parser->state = HTTP_STATE_CHUNK_SIZE;
+    }
+    else if (parser->state == HTTP_STATE_CHUNK_SIZE)
+    {
+      // Hex size, optionally followed by ";extensions"
+      long long size;
+      if (!parse_chunk_size(data, start, end, &size))
+        return HTTP_PARSE_ERROR;
+      parser->body_remaining = size;
+      parser->state = size > 0 ? HTTP_STATE_CHUNK_DATA : HTTP_STATE_TRAILERS;
+    }
+    else if (end == start) // HTTP_STATE_TRAILERS: a blank line ends the message
+    {
+      parser->state = HTTP_STATE_COMPLETE;
+    }
+  }
+  return HTTP_PARSE_DONE;
+}
+
+size_t http_parser_discard(http_parser_t *parser)
+{
+  size_t consumed = parser->pos;
+  parser->pos = 0;
+  return consumed;
+}
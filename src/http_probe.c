@@ -0,0 +1,199 @@
+/**
+ * Neptune Scanner - HTTP Fingerprinting
+ * http_probe.c - Loading, selection and serialization of HTTP request sets
+ */
+
+#include "../include/http_probe.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Loaded request sets
+static http_request_set_t request_sets[MAX_HTTP_REQUEST_SETS];
+static int num_request_sets = 0;
+
+// Built-in requests used when no request file can be read
+static const char DEFAULT_HTTP_REQUESTS[] =
+    "requests default\n"
+    "GET /\n"
+    "GET /robots.txt\n"
+    "GET /favicon.ico\n"
+    "NEPTUNE /\n";
+
+// A method is an HTTP token; a path must not contain whitespace
+static bool valid_request(const char *method, const char *path)
+{
+  for (const char *p = method; *p; p++)
+  {
+    if (!isalnum((unsigned char)*p) && !strchr("!#$%&'*+-.^_`|~", *p))
+      return false;
+  }
+  for (const char *p = path; *p; p++)
+  {
+    if ((unsigned char)*p <= ' ' || *p == 0x7F)
+      return false;
+  }
+  return method[0] != '\0' && path[0] != '\0';
+}
+
+/**
+ * Parses request sets from a buffer
+ *
+ * @param buffer Request file contents (modified in place)
+ * @return Number of requests loaded
+ */
+static int parse_http_requests(char *buffer)
+{
+  http_request_set_t *current = NULL;
+  int loaded = 0;
+  char *line = buffer;
+
+  while (line && *line)
+  {
+    char *next = strchr(line, '\n');
+    if (next)
+      *next++ = '\0';
+
+    // Strip trailing CR and leading whitespace
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r')
+      line[len - 1] = '\0';
+    while (isspace((unsigned char)*line))
+      line++;
+
+    if (*line == '\0' || *line == '#')
+    {
+      line = next;
+      continue;
+    }
+
+    if (strncmp(line, "requests ", 9) == 0)
+    {
+      current = NULL;
+      if (num_request_sets < MAX_HTTP_REQUEST_SETS)
+      {
+        current = &request_sets[num_request_sets++];
+        memset(current, 0, sizeof(*current));
+        if (strncmp(line + 9, "default", 7) != 0)
+        {
+          current->num_port_ranges =
+              parse_port_ranges(line + 9, current->ports, MAX_PROBE_PORT_RANGES);
+          if (current->num_port_ranges == 0)
+          {
+            // A bad port list must not turn the set into a default set
+            num_request_sets--;
+            current = NULL;
+          }
+        }
+      }
+    }
+    else if (current && current->num_requests < MAX_HTTP_REQUESTS)
+    {
+      char method[MAX_HTTP_METHOD] = {0};
+      char path[MAX_HTTP_PATH] = {0};
+      if (sscanf(line, "%15s %95s", method, path) == 2 && valid_request(method, path))
+      {
+        http_request_t *request = &current->requests[current->num_requests++];
+        strcpy(request->method, method);
+        strcpy(request->path, path);
+        loaded++;
+      }
+    }
+
+    line = next;
+  }
+
+  return loaded;
+}
+
+bool load_http_requests(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size <= 0)
+  {
+    fclose(file);
+    return false;
+  }
+
+  char *buffer = malloc((size_t)size + 1);
+  if (!buffer)
+  {
+    fclose(file);
+    return false;
+  }
+
+  size_t read = fread(buffer, 1, (size_t)size, file);
+  fclose(file);
+  buffer[read] = '\0';
+
+  num_request_sets = 0;
+  int loaded = parse_http_requests(buffer);
+  free(buffer);
+
+  return loaded > 0;
+}
+
+void load_default_http_requests(void)
+{
+  char buffer[sizeof(DEFAULT_HTTP_REQUESTS)];
+  memcpy(buffer, DEFAULT_HTTP_REQUESTS, sizeof(buffer));
+
+  num_request_sets = 0;
+  parse_http_requests(buffer);
+}
+
+const http_request_set_t *select_http_requests(int port)
+{
+  if (num_request_sets == 0)
+    load_default_http_requests();
+
+  const http_request_set_t *fallback = NULL;
+  for (int i = 0; i < num_request_sets; i++)
+  {
+    const http_request_set_t *set = &request_sets[i];
+    if (set->num_requests == 0)
+      continue;
+    if (set->num_port_ranges == 0)
+    {
+      if (!fallback)
+        fallback = set;
+    }
+    else if (ranges_have_port(set->ports, set->num_port_ranges, port))
+    {
+      return set;
+    }
+  }
+
+  if (fallback)
+    return fallback;
+
+  // A file without a default set still needs one for unlisted ports
+  static const http_request_set_t ROOT_ONLY = {.requests = {{"GET", "/"}}, .num_requests = 1};
+  return &ROOT_ONLY;
+}
+
+size_t build_http_requests(const http_request_set_t *set, int first, const char *host,
+                           char *buffer, size_t buffer_size)
+{
+  size_t used = 0;
+  for (int i = first; i < set->num_requests; i++)
+  {
+    const http_request_t *request = &set->requests[i];
+    int written = snprintf(buffer + used, buffer_size - used,
+                           "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: NeptuneScanner/1.0\r\n"
+                           "Accept: */*\r\nConnection: %s\r\n\r\n",
+                           request->method, request->path, host,
+                           i + 1 < set->num_requests ? "keep-alive" : "close");
+    if (written < 0 || (size_t)written >= buffer_size - used)
+      return 0;
+    used += (size_t)written;
+  }
+  return used;
+}
@@ -32,6 +32,22 @@ void WSACleanup(void) {}
 #include "../include/advanced_scan.h"
 #include "../include/utils.h" /* For get_timestamp */
 #include "../include/service_detection.h" /* For service detection functions */
+#include "../include/service_probes.h"    /* For the service probe database */
+#include "../include/services.h"          /* For port to service lookups */
+#include "../include/http_probe.h"        /* For the HTTP fingerprint request sets */
+#include "../include/os_detect.h"         /* For OS fingerprinting */
+#include "../include/passive_os.h"        /* For OS guesses from SYN scan replies */
+#include "../include/scan_stats.h"        /* For live scan statistics */
+#include "../include/trace.h"             /* For --trace */
+#include "../include/metrics.h"           /* For --metrics-port */
+#include "../include/daemon.h"            /* For --daemon and --submit */
+#include "../include/results_file.h"      /* For -o */
+#include "../include/scan_utils.h"        /* For --shard */
+#include "../include/service_records.h"   /* For the compact -sV results */
+#include "../include/results_binary.h"    /* For -oB */
+#include "../include/target_spec.h"       /* For CIDR, octet range and -iL targets */
+#include "../include/exclude_list.h"      /* For --exclude and --excludefile */
+#include <stdarg.h>                        /* For format_service_details */
 
 // Color codes for terminal output
 #define COLOR_RED "\x1b[31m"
@@ -42,6 +58,342 @@ void WSACleanup(void) {}
 #define COLOR_CYAN "\x1b[36m"
 #define COLOR_RESET "\x1b[0m"
 
+#define SERVICE_DETAILS_MAX 8192 // Longest HTTP and TLS detail text kept for a port
+
+// Append to a details buffer, dropping what does not fit
+static void append_details(char *buffer, size_t size, size_t *len, const char *format, ...)
+{
+  if (*len >= size - 1)
+    return;
+  va_list ap;
+  va_start(ap, format);
+  int written = vsnprintf(buffer + *len, size - *len, format, ap);
+  va_end(ap);
+  *len = written < 0 ? size - 1 : *len + (size_t)written;
+  if (*len > size - 1)
+    *len = size - 1;
+}
+
+/**
+ * Formats what the HTTP and TLS probes saw, as printed under the port in the results
+ *
+ * @param info Detection result
+ * @param buffer Output buffer
+ * @param size Size of the buffer
+ */
+static void format_service_details(const ServiceInfo *info, char *buffer, size_t size)
+{
+  size_t len = 0;
+  buffer[0] = '\0';
+
+  const http_info_t *http = &info->http;
+  if (http->status_code) {
+    if (http->server[0])
+      append_details(buffer, size, &len, "| http-server-header: %s\n", http->server);
+    if (http->powered_by[0])
+      append_details(buffer, size, &len, "| http-powered-by: %s\n", http->powered_by);
+    if (http->num_responses > 1) {
+      append_details(buffer, size, &len, "| http-responses:\n");
+      for (int r = 0; r < http->num_responses; r++) {
+        const http_response_t *response = &http->responses[r];
+        if (response->body_len >= 0)
+          append_details(buffer, size, &len, "|   %s: %d, %lld bytes, hash %08x\n",
+                         response->request, response->status_code, response->body_len,
+                         response->body_hash);
+        else
+          append_details(buffer, size, &len, "|   %s: %d\n", response->request,
+                         response->status_code);
+      }
+    }
+    append_details(buffer, size, &len, "|_http-title: %s\n",
+                   http->title[0] ? http->title : "(no title)");
+  }
+
+  const tls_info_t *tls = &info->tls;
+  if (tls->certificate) {
+    const char *cipher = tls_cipher_name(tls->cipher);
+    append_details(buffer, size, &len, "| ssl-cert: Subject: %s\n",
+                   tls->subject[0] ? tls->subject : "(none)");
+    append_details(buffer, size, &len, "|   Issuer: %s\n", tls->issuer[0] ? tls->issuer : "(none)");
+    if (tls->san[0])
+      append_details(buffer, size, &len, "|   Subject Alternative Name: %s\n", tls->san);
+    append_details(buffer, size, &len, "|   Not valid before: %s\n", tls->not_before);
+    append_details(buffer, size, &len, "|   Not valid after:  %s\n", tls->not_after);
+    if (cipher)
+      append_details(buffer, size, &len, "|_  Cipher: %s\n", cipher);
+    else
+      append_details(buffer, size, &len, "|_  Cipher: 0x%04X\n", tls->cipher);
+  }
+}
+
+/**
+ * Lists the ports of a scan given by -p or defaulting to the common ports, for the consumers
+ * that need an explicit list (shards, daemon jobs)
+ *
+ * @param args Parsed arguments
+ * @param count Receives the number of ports
+ * @return The list (to be freed), or NULL if memory runs out
+ */
+static int *explicit_port_list(const Args *args, int *count)
+{
+  *count = args->port_spec ? port_bitmap_count(&args->port_spec->tcp) : SERVICE_COUNT;
+  int *ports = malloc((size_t)(*count > 0 ? *count : 1) * sizeof(int));
+  if (!ports)
+  {
+    return NULL;
+  }
+  if (args->port_spec)
+  {
+    port_bitmap_to_list(&args->port_spec->tcp, ports, *count);
+  }
+  for (int i = 0; !args->port_spec && i < *count; i++)
+  {
+    ports[i] = SERVICES[i].port;
+  }
+  return ports;
+}
+
+/**
+ * Tells whether a scan covers more than one host: a target list, or a CIDR block or octet
+ * ranges with more than one address
+ *
+ * @param args Parsed arguments
+ * @return true for a multi-host scan
+ */
+static bool multi_host_targets(const Args *args)
+{
+  target_range_t range;
+  return args->target_list[0] ||
+         (target_range_parse(args->target, &range) && target_range_count(&range) > 1);
+}
+
+// Open ports of a multi-host scan: counted, and kept for the results file when there is one
+typedef struct
+{
+  uint64_t found;
+  bool keep;
+  uint64_t *keys;       // Address << 16 | port, as results_file_key reads them back
+  size_t num_keys;
+  size_t keys_capacity;
+  bool keys_lost;       // Memory ran out, so the results file would miss ports
+  bool os_guesses;      // Print the passive OS guess of each host from its SYN-ACKs
+} sweep_results_t;
+
+// Print an open port of a multi-host scan as soon as it is found
+static void print_sweep_result(void *context, uint32_t addr, int port)
+{
+  sweep_results_t *results = context;
+  char text[INET_ADDRSTRLEN];
+  struct in_addr in;
+  in.s_addr = htonl(addr);
+  inet_ntop(AF_INET, &in, text, sizeof(text));
+  printf("Discovered open port %d/tcp on %s\n", port, text);
+  results->found++;
+
+  if (!results->keep || results->keys_lost)
+  {
+    return;
+  }
+  if (results->num_keys == results->keys_capacity)
+  {
+    size_t capacity = results->keys_capacity ? results->keys_capacity * 2 : 1024;
+    uint64_t *keys = realloc(results->keys, capacity * sizeof(uint64_t));
+    if (!keys)
+    {
+      results->keys_lost = true;
+      return;
+    }
+    results->keys = keys;
+    results->keys_capacity = capacity;
+  }
+  results->keys[results->num_keys++] = (uint64_t)addr << 16 | (uint64_t)port;
+}
+
+// Print the passive OS guesses of finished hosts and forget their SYN-ACKs
+static void print_sweep_hosts(void *context, uint32_t first, uint32_t last)
+{
+  const sweep_results_t *results = context;
+  if (!results->os_guesses)
+  {
+    return;
+  }
+  uint32_t addr = first;
+  do
+  {
+    os_match_t match;
+    if (passive_os_guess(htonl(addr), &match, NULL))
+    {
+      char text[INET_ADDRSTRLEN];
+      struct in_addr in;
+      in.s_addr = htonl(addr);
+      inet_ntop(AF_INET, &in, text, sizeof(text));
+      printf("Passive OS guess for %s: %s (%d%% match%s)\n", text, match.name, match.score,
+             passive_os_ambiguous(htonl(addr), &match) ? ", ambiguous" : "");
+    }
+    passive_os_forget(htonl(addr));
+  } while (addr++ != last);
+}
+
+/**
+ * Scans many hosts: targets stream in block by block from the command line and -iL, and each
+ * open port is printed when it is found, so memory does not grow with the number of targets.
+ * -o keeps 8 bytes per open port and writes them sorted at the end, and a SYN scan prints the
+ * passive OS guess of each host once it is finished; service detection, active OS detection
+ * and -oB remain single-host features.
+ *
+ * @param args Parsed arguments
+ * @param exclude Addresses to leave out, or NULL
+ * @return Exit status
+ */
+static int run_sweep(Args *args, const exclude_list_t *exclude)
+{
+  if (args->detect_services || args->detect_os || args->binary_file[0])
+  {
+    print_warning("-sV, -O and -oB apply to single-host scans, skipping them");
+  }
+
+  // Every host gets the same ports
+  port_bitmap_t *ports = malloc(sizeof(port_bitmap_t));
+  if (!ports)
+  {
+    print_error("Failed to allocate port list");
+    return 1;
+  }
+  port_bitmap_clear(ports);
+  if (args->use_port_list)
+  {
+    for (int i = 0; i < args->port_list_size; i++)
+    {
+      port_bitmap_set(ports, args->port_list[i]);
+    }
+  }
+  else if (args->port_spec)
+  {
+    *ports = args->port_spec->tcp;
+  }
+  else
+  {
+    for (int i = 0; i < SERVICE_COUNT; i++)
+    {
+      port_bitmap_set(ports, SERVICES[i].port);
+    }
+  }
+
+  char error[256];
+  target_stream_t *targets = target_stream_open(args->target, args->target_list, exclude,
+                                                error, sizeof(error));
+  if (!targets)
+  {
+    char message[300];
+    snprintf(message, sizeof(message), "Cannot start the scan: %s", error);
+    print_error(message);
+    free(ports);
+    return 1;
+  }
+
+  char spec[256];
+  port_bitmap_format(ports, spec, sizeof(spec));
+  printf("Targets: %s%s%s\n", args->target, args->target[0] && args->target_list[0] ? ", " : "",
+         args->target_list[0] ? args->target_list : "");
+  printf("Ports to scan: %s\n", spec);
+  if (args->shard_count > 1)
+  {
+    printf("Shard %d/%d of the targets x ports\n", args->shard_index, args->shard_count);
+  }
+  if (!init_scanner() || !scanner_reserve(port_bitmap_count(ports)))
+  {
+    print_error("Failed to initialize scanner");
+    target_stream_close(targets);
+    free(ports);
+    return 1;
+  }
+  print_header();
+
+  if (args->scan_type == SCAN_SYN && !raw_sockets_available())
+  {
+    print_warning("SYN scan requires root privileges, falling back to TCP connect scan");
+    args->scan_type = SCAN_CONNECT;
+  }
+  const char *stats_sink = args->stats_json[0] ? args->stats_json : NULL;
+  if (args->stats_interval_ms > 0 &&
+      !scan_stats_start_reporter(args->stats_interval_ms, stats_sink))
+  {
+    print_warning("Could not start the statistics reporter (check --stats-json)");
+  }
+  if (args->trace_file[0] && !trace_start())
+  {
+    print_warning("Could not start tracing");
+  }
+  if (args->metrics_port > 0 && !metrics_start(args->metrics_port))
+  {
+    print_warning("Could not start the metrics endpoint (is the port in use?)");
+  }
+
+  sweep_results_t results = {.keep = args->output_file[0] != '\0'};
+  results.os_guesses = args->scan_type == SCAN_SYN && load_os_db(args->os_db_file);
+
+  printf("Performing %s scan...\n\n", scan_type_to_string(args->scan_type));
+  long start_time = get_timestamp();
+  uint64_t hosts =
+      scan_target_stream(targets, ports, args->shard_index, args->shard_count, args->scan_type,
+                         print_sweep_result, print_sweep_hosts, &results);
+  char duration[32];
+  format_duration(get_timestamp() - start_time, duration, sizeof(duration));
+  scan_stats_stop_reporter();
+
+  uint64_t excluded = target_stream_excluded(targets);
+  if (excluded > 0)
+  {
+    printf("\nLeft out %llu excluded addresses\n", (unsigned long long)excluded);
+  }
+  uint64_t invalid = target_stream_invalid(targets);
+  if (invalid > 0)
+  {
+    char message[96];
+    snprintf(message, sizeof(message), "Skipped %llu targets that were invalid or did not resolve",
+             (unsigned long long)invalid);
+    print_warning(message);
+  }
+  printf("\nNeptune Scan completed in %s: %llu hosts, %llu open ports found.\n", duration,
+         (unsigned long long)hosts, (unsigned long long)results.found);
+
+  // Results file, sorted so that the files of several shards merge into one
+  if (args->output_file[0])
+  {
+    int64_t write_start = trace_begin();
+    if (results.keys_lost)
+    {
+      print_warning("Out of memory keeping open ports, not writing the results file");
+    }
+    else if (!results_file_write_keys(args->output_file, args->shard_index, args->shard_count,
+                                      results.keys, results.num_keys))
+    {
+      print_warning("Could not write the results file");
+    }
+    trace_end(TRACE_WRITE, write_start, 0, "results");
+  }
+  if (trace_enabled)
+  {
+    uint64_t events = 0, dropped = 0;
+    if (trace_write(args->trace_file, &events, &dropped))
+    {
+      printf("Trace written to %s (%llu events, %llu overwritten or dropped)\n", args->trace_file,
+             (unsigned long long)events, (unsigned long long)dropped);
+    }
+    else
+    {
+      print_warning("Could not write the trace file");
+    }
+  }
+
+  free(results.keys);
+  free_os_db();
+  target_stream_close(targets);
+  free(ports);
+  metrics_stop();
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
   // Initialize Winsock on Windows
@@ -62,9 +414,166 @@ int main(int argc, char *argv[])
     return 1;
   }
 
+  // Map the services database; without it lookups use the compiled-in table
+  if (!load_services_db(args.services_db_file) && args.verbose)
+  {
+    print_warning("Could not load services database, using built-in services table");
+  }
+
+  // Addresses that are never probed, whatever the targets
+  exclude_list_t exclude;
+  exclude_list_init(&exclude);
+  const exclude_list_t *excluded = NULL;
+  if (args.exclude[0] || args.exclude_file[0])
+  {
+    char error[512];
+    if ((args.exclude[0] && !exclude_list_add(&exclude, args.exclude, error, sizeof(error))) ||
+        (args.exclude_file[0] &&
+         !exclude_list_add_file(&exclude, args.exclude_file, error, sizeof(error))))
+    {
+      print_error(error);
+      return 1;
+    }
+    if (!exclude_list_build(&exclude))
+    {
+      print_error("Failed to allocate the exclusion list");
+      return 1;
+    }
+    excluded = &exclude;
+    if (args.verbose)
+    {
+      printf("Excluding %llu addresses in %u ranges\n",
+             (unsigned long long)exclude_list_count(&exclude), exclude.num_ranges);
+    }
+  }
+
+  // The daemon loads the databases once and serves scans until it is stopped
+  scan_rate = args.rate;
+  if (args.daemon_socket[0])
+  {
+    version_intensity = args.version_intensity;
+    if (!load_service_probes(args.service_probes_file))
+    {
+      print_warning("Could not load service probe database, using built-in probes");
+      load_default_service_probes();
+    }
+    if (!load_http_requests(args.http_requests_file))
+    {
+      print_warning("Could not load HTTP request sets, using built-in requests");
+      load_default_http_requests();
+    }
+    if (args.metrics_port > 0 && !metrics_start(args.metrics_port))
+    {
+      print_warning("Could not start the metrics endpoint (is the port in use?)");
+    }
+
+    bool served = daemon_run(args.daemon_socket, excluded);
+    metrics_stop();
+    exclude_list_free(&exclude);
+    free_service_probes();
+    unload_services_db();
+    cleanup_args(&args);
+    return served ? 0 : 1;
+  }
+
+  // Resolve --top-ports into an explicit list, most frequently open first
+  if (args.top_ports > 0)
+  {
+    args.port_list = malloc(args.top_ports * sizeof(int));
+    if (!args.port_list)
+    {
+      print_error("Failed to allocate port list");
+      return 1;
+    }
+    args.port_list_size = get_top_ports(SERVICE_PROTO_TCP, args.top_ports, args.port_list);
+    args.use_port_list = true;
+    if (args.port_list_size < args.top_ports)
+    {
+      print_warning("Services database knows fewer ports than --top-ports requested");
+    }
+  }
+
+  // UDP ports can be given, but there is no UDP engine to scan them
+  if (args.port_spec && port_bitmap_count(&args.port_spec->udp) > 0)
+  {
+    print_warning("UDP scanning is not supported, ignoring the U: ports of -p");
+    if (port_bitmap_count(&args.port_spec->tcp) == 0)
+    {
+      print_error("No TCP ports to scan");
+      return 1;
+    }
+  }
+
+  // A shard of a single-host scan takes every n-th port of the full list, so shards need no
+  // coordination; a multi-host scan slices targets x ports as it goes (scan_target_stream)
+  bool sweep = multi_host_targets(&args);
+  if (args.shard_count > 1 && !sweep)
+  {
+    if (!args.use_port_list)
+    {
+      args.port_list = explicit_port_list(&args, &args.port_list_size);
+      if (!args.port_list)
+      {
+        print_error("Failed to allocate port list");
+        return 1;
+      }
+      args.use_port_list = true;
+    }
+    args.port_list_size = shard_ports(args.port_list, args.port_list_size, args.shard_index,
+                                      args.shard_count);
+    printf("Shard %d/%d: %d ports\n", args.shard_index, args.shard_count, args.port_list_size);
+  }
+
+  // Hand the scan to a daemon and print what it streams back
+  if (args.submit_socket[0] && sweep)
+  {
+    print_error("--submit scans a single host");
+    return 1;
+  }
+
+  // A single host that is excluded is refused outright
+  char target_addr[INET_ADDRSTRLEN];
+  if (excluded && !sweep && resolve_hostname(args.target, target_addr, sizeof(target_addr)) &&
+      exclude_list_contains(excluded, ntohl(inet_addr(target_addr))))
+  {
+    char message[320];
+    snprintf(message, sizeof(message), "%s (%s) is excluded, not scanning it", args.target,
+             target_addr);
+    print_error(message);
+    return 1;
+  }
+  if (args.submit_socket[0])
+  {
+    int count = args.port_list_size;
+    int *ports = args.use_port_list ? args.port_list : explicit_port_list(&args, &count);
+    bool done = ports && daemon_submit(args.submit_socket, args.target, ports, count,
+                                       args.weight, args.detect_services);
+    if (!args.use_port_list)
+    {
+      free(ports);
+    }
+    unload_services_db();
+    exclude_list_free(&exclude);
+    cleanup_args(&args);
+    return done ? 0 : 1;
+  }
+
+  // CIDR blocks, octet ranges and target lists stream through their own scan loop
+  if (sweep)
+  {
+    int status = run_sweep(&args, excluded);
+    exclude_list_free(&exclude);
+    unload_services_db();
+    cleanup_scanner();
+    cleanup_args(&args);
+    return status;
+  }
+
   // Print debug info
   printf("Target: %s\n", args.target);
-  if (args.use_port_list) {
+  if (args.top_ports > 0) {
+    printf("Ports to scan: top %d most frequently open\n", args.port_list_size);
+  } else if (args.use_port_list) {
     printf("Ports to scan: ");
     for (int i = 0; i < args.port_list_size; i++) {
       printf("%d", args.port_list[i]);
@@ -73,14 +582,19 @@ int main(int argc, char *argv[])
       }
     }
     printf("\n");
-  } else if (args.port_range[0] != 0) {
-    printf("Port range: %d-%d\n", args.port_range[0], args.port_range[1]);
+  } else if (args.port_spec) {
+    char spec[256];
+    port_bitmap_format(&args.port_spec->tcp, spec, sizeof(spec));
+    printf("Ports to scan: %s\n", spec);
   } else {
     printf("Using common ports\n");
   }
   
-  // Initialize scanner
-  if (!init_scanner())
+  // Initialize scanner, with the memory of the whole scan set aside before it starts
+  int planned_ports = args.use_port_list ? args.port_list_size
+                      : args.port_spec     ? port_bitmap_count(&args.port_spec->tcp)
+                                           : SERVICE_COUNT;
+  if (!init_scanner() || !scanner_reserve(planned_ports))
   {
     print_error("Failed to initialize scanner");
     return 1;
@@ -92,6 +606,28 @@ int main(int argc, char *argv[])
   // Get start time
   long start_time = get_timestamp();
 
+  // A SYN scan needs raw sockets; without them the connect scan is the closest substitute
+  if (args.scan_type == SCAN_SYN && !raw_sockets_available())
+  {
+    print_warning("SYN scan requires root privileges, falling back to TCP connect scan");
+    args.scan_type = SCAN_CONNECT;
+  }
+
+  // Live statistics cover the port scan and service detection
+  const char *stats_sink = args.stats_json[0] ? args.stats_json : NULL;
+  if (args.stats_interval_ms > 0 && !scan_stats_start_reporter(args.stats_interval_ms, stats_sink))
+  {
+    print_warning("Could not start the statistics reporter (check --stats-json)");
+  }
+  if (args.trace_file[0] && !trace_start())
+  {
+    print_warning("Could not start tracing");
+  }
+  if (args.metrics_port > 0 && !metrics_start(args.metrics_port))
+  {
+    print_warning("Could not start the metrics endpoint (is the port in use?)");
+  }
+
   // Perform scan based on arguments
   if (args.scan_type == SCAN_SYN || args.scan_type == SCAN_FIN ||
       args.scan_type == SCAN_XMAS || args.scan_type == SCAN_NULL ||
@@ -104,14 +640,11 @@ int main(int argc, char *argv[])
     if (args.use_port_list)
     {
       // Scan specific ports from the list
-      for (int i = 0; i < args.port_list_size; i++)
-      {
-        scan_port(args.target, args.port_list[i], args.scan_type);
-      }
+      scan_port_list(args.target, args.port_list, args.port_list_size, args.scan_type);
     }
-    else if (args.port_range[0] != 0)
+    else if (args.port_spec)
     {
-      scan_ports(args.target, args.port_range[0], args.port_range[1], args.scan_type);
+      scan_port_bitmap(args.target, &args.port_spec->tcp, args.scan_type);
     }
     else
     {
@@ -131,9 +664,9 @@ int main(int argc, char *argv[])
         scan_port(args.target, args.port_list[i], SCAN_CONNECT);
       }
     }
-    else if (args.port_range[0] != 0)
+    else if (args.port_spec)
     {
-      scan_ports(args.target, args.port_range[0], args.port_range[1], SCAN_CONNECT);
+      scan_port_bitmap(args.target, &args.port_spec->tcp, SCAN_CONNECT);
     }
     else
     {
@@ -146,27 +679,51 @@ int main(int argc, char *argv[])
   long duration = end_time - start_time;
 
   // Get open ports
-  int *open_ports = get_open_ports();
+  const int *open_ports = get_open_ports();
   int num_open_ports = get_num_open_ports();
 
   // Perform service detection if requested
+  service_table_t services;
+  service_table_init(&services);
+  bool have_services = false;
   if (args.detect_services && num_open_ports > 0)
   {
     printf("\nPerforming service detection...\n\n");
+
+    // Load the probe database, falling back to the built-in probes
+    version_intensity = args.version_intensity;
+    if (!load_service_probes(args.service_probes_file))
+    {
+      print_warning("Could not load service probe database, using built-in probes");
+      load_default_service_probes();
+    }
+    if (!load_http_requests(args.http_requests_file))
+    {
+      print_warning("Could not load HTTP request sets, using built-in requests");
+      load_default_http_requests();
+    }
     
-    // Allocate array of ServiceInfo structures
-    ServiceInfo *service_info_array = malloc(num_open_ports * sizeof(ServiceInfo));
-    if (service_info_array)
+    // Detect into one scratch ServiceInfo and keep a compact record of each port; the table
+    // is sized for every open port first, so the loop does not allocate
+    ServiceInfo *scratch = malloc(sizeof(ServiceInfo));
+    char *details = malloc(SERVICE_DETAILS_MAX);
+    have_services = scratch && details && service_detection_reserve() &&
+                    service_table_reserve(&services, (size_t)num_open_ports, SERVICE_DETAILS_MAX);
+    if (!have_services)
+    {
+      print_warning("Not enough memory for service detection, skipping it");
+    }
+    else
     {
       // Detect services for each open port
+      scan_stats_gauge_add(GAUGE_SERVICE_QUEUE, num_open_ports);
       for (int i = 0; i < num_open_ports; i++)
       {
-        // Initialize service info
-        memset(&service_info_array[i], 0, sizeof(ServiceInfo));
-        service_info_array[i].port = open_ports[i];
-        
-        // Detect service
-        bool detected = detect_service(args.target, open_ports[i], &service_info_array[i]);
+        // Detect service (detect_service clears the scratch record first)
+        int64_t detect_start = trace_begin();
+        bool detected = detect_service(args.target, open_ports[i], scratch);
+        trace_end(TRACE_SERVICE, detect_start, open_ports[i], "detect_service");
+        scan_stats_gauge_add(GAUGE_SERVICE_QUEUE, -1);
         
         if (args.verbose)
         {
@@ -176,19 +733,31 @@ int main(int argc, char *argv[])
           if (detected)
           {
             printf("  Service: %s\n", 
-                   service_info_array[i].service_name[0] ? 
-                   service_info_array[i].service_name : "unknown");
+                   scratch->service_name[0] ? scratch->service_name : "unknown");
             printf("  Protocol: %s\n", 
-                   service_info_array[i].protocol[0] ? 
-                   service_info_array[i].protocol : "unknown");
+                   scratch->protocol[0] ? scratch->protocol : "unknown");
             printf("  Version: %s\n", 
-                   service_info_array[i].version[0] ? 
-                   service_info_array[i].version : "unknown");
+                   scratch->version[0] ? scratch->version : "unknown");
           }
         }
+
+        format_service_details(scratch, details, SERVICE_DETAILS_MAX);
+        if (!service_table_add(&services, scratch, details))
+        {
+          print_warning("Out of memory recording services, stopping service detection");
+          scan_stats_gauge_add(GAUGE_SERVICE_QUEUE, -(num_open_ports - i - 1));
+          have_services = false;
+          break;
+        }
       }
-      
+    }
+    free(scratch);
+    free(details);
+
+    if (have_services)
+    {
       // Print scan results header
+      int64_t write_start = trace_begin();
       printf("\nScan Results for %s\n", args.target);
       printf("========================\n\n");
       
@@ -206,6 +775,12 @@ int main(int argc, char *argv[])
         for (int i = 0; i < num_open_ports; i++)
         {
           int port = open_ports[i];
+          const service_record_t *record = &services.records[i];
+          const char *service_name = service_table_string(&services, record->service);
+          const char *protocol = service_table_string(&services, record->protocol);
+          const char *version = service_table_text(&services, record->version);
+          uint32_t banner_len;
+          const char *banner = service_table_banner(&services, record->banner, &banner_len);
           
           // Print port with padding
           printf("%-8d  ", port);
@@ -214,39 +789,38 @@ int main(int argc, char *argv[])
           printf("%sOPEN%s    ", COLOR_GREEN, COLOR_RESET);
           
           // Print service name with padding
-          const char *service = service_info_array[i].service_name[0] ? 
-                       service_info_array[i].service_name : 
+          const char *service = service_name[0] ? service_name : 
                        (get_service_name(port) ? get_service_name(port) : "unknown");
           printf("%-15s  ", service);
           
           // Print version info if available
-          if (service_info_array[i].version[0]) {
-            printf("%s%s", COLOR_CYAN, service_info_array[i].version);
+          if (version[0]) {
+            printf("%s%s", COLOR_CYAN, version);
             
             // Print protocol info if available
-            if (service_info_array[i].protocol[0] && 
-                !strstr(service, service_info_array[i].protocol) && 
-                strcasecmp(service_info_array[i].protocol, "tcp") != 0) {
-              printf(" (%s)", service_info_array[i].protocol);
+            if (protocol[0] && !strstr(service, protocol) && strcasecmp(protocol, "tcp") != 0) {
+              printf(" (%s)", protocol);
             }
             
             printf("%s", COLOR_RESET);
-          } else if (service_info_array[i].protocol[0] && 
-                    strcasecmp(service_info_array[i].protocol, "tcp") != 0) {
-            printf("(%s)", service_info_array[i].protocol);
+          } else if (protocol[0] && strcasecmp(protocol, "tcp") != 0) {
+            printf("(%s)", protocol);
           }
           
           printf("\n");
           
+          // Print what the HTTP and TLS probes saw
+          fputs(service_table_text(&services, record->details), stdout);
+          
           // Print banner snippet in verbose mode, formatting it like Nmap
-          if (args.verbose && service_info_array[i].banner[0]) {
+          if (args.verbose && banner[0]) {
             printf("| ");
             // Print first line of banner, cleaning up non-printable chars
             int line_length = 0;
             int max_length = 60; // Limit line length
             
-            for (int j = 0; service_info_array[i].banner[j] && line_length < max_length; j++) {
-              char c = service_info_array[i].banner[j];
+            for (int j = 0; banner[j] && line_length < max_length; j++) {
+              char c = banner[j];
               if (c == '\r' || c == '\n')
                 break;  // Stop at first newline
                 
@@ -259,9 +833,7 @@ int main(int argc, char *argv[])
               }
             }
             
-            // Compare with the same type by using size_t
-            size_t banner_len = strlen(service_info_array[i].banner);
-            if (banner_len > (size_t)line_length)
+            if (banner_len > (uint32_t)line_length)
               printf("...");  // Indicate truncation
               
             printf("\n");
@@ -269,44 +841,137 @@ int main(int argc, char *argv[])
         }
       }
       
-      // Free service info array
-      free(service_info_array);
+      trace_end(TRACE_WRITE, write_start, 0, "results");
     }
     else
     {
-      // Fall back to basic results if memory allocation failed
+      // Fall back to basic results if memory ran out
+      int64_t write_start = trace_begin();
       print_results(args.target, open_ports, num_open_ports);
+      trace_end(TRACE_WRITE, write_start, 0, "results");
     }
   }
   else
   {
     // Print basic results without service detection
+    int64_t write_start = trace_begin();
     print_results(args.target, open_ports, num_open_ports);
+    trace_end(TRACE_WRITE, write_start, 0, "results");
   }
 
-  // Perform OS detection if requested
-  if (args.detect_os)
+  // Results file, sorted so that the files of several shards merge into one
+  if (args.output_file[0])
   {
-    char os_info[256];
-    if (detect_os(args.target, os_info, sizeof(os_info)))
+    char addr[INET_ADDRSTRLEN] = "";
+    if (!resolve_hostname(args.target, addr, sizeof(addr)) ||
+        !results_file_write(args.output_file, addr, args.shard_index, args.shard_count,
+                            open_ports, have_services ? &services : NULL, num_open_ports))
     {
-      print_os_info(os_info);
+      print_warning("Could not write the results file");
+    }
+  }
+  if (args.binary_file[0])
+  {
+    char addr[INET_ADDRSTRLEN] = "";
+    if (!resolve_hostname(args.target, addr, sizeof(addr)) ||
+        !results_binary_write(args.binary_file, addr, args.shard_index, args.shard_count,
+                              open_ports, have_services ? &services : NULL, num_open_ports))
+    {
+      print_warning("Could not write the binary results file");
+    }
+  }
+  service_table_free(&services);
+
+  scan_stats_stop_reporter();
+
+  // OS detection: the SYN scan's SYN-ACKs give a passive guess for free, and active probing
+  // (-O) only runs when that guess is missing or ambiguous
+  if (args.detect_os || args.scan_type == SCAN_SYN)
+  {
+    char os_info[768] = "";
+    bool passive_conclusive = false;
+
+    if (!load_os_db(args.os_db_file))
+    {
+      if (args.detect_os)
+        print_warning("Could not load OS signature database");
     }
     else
     {
-      print_warning("OS detection failed or inconclusive");
+      char ip[64];
+      uint32_t addr = resolve_hostname(args.target, ip, sizeof(ip)) ? inet_addr(ip) : 0;
+      os_match_t match;
+      os_response_t syn_ack;
+      if (args.scan_type == SCAN_SYN && passive_os_guess(addr, &match, &syn_ack))
+      {
+        passive_conclusive = !passive_os_ambiguous(addr, &match);
+        int used = snprintf(os_info, sizeof(os_info), "Passive guess: %s (%d%% match", match.name,
+                            match.score);
+        if (match.runner_up > 0)
+          used += snprintf(os_info + used, sizeof(os_info) - used, ", next OS class %d%%",
+                           match.runner_up);
+        snprintf(os_info + used, sizeof(os_info) - used, ")%s\nSYN-ACK: ttl=%u win=%u ops=%s%s",
+                 passive_conclusive ? "" : " - ambiguous", syn_ack.ttl, syn_ack.window,
+                 syn_ack.options[0] ? syn_ack.options : "-", syn_ack.df ? " df" : "");
+      }
+
+      if (args.detect_os && !passive_conclusive)
+      {
+        size_t used = strlen(os_info);
+        if (used > 0 && used + 1 < sizeof(os_info))
+        {
+          os_info[used++] = '\n';
+          os_info[used] = '\0';
+        }
+        if (!detect_os(args.target, os_info + used, sizeof(os_info) - used))
+        {
+          print_warning(os_info + used);
+          os_info[used > 0 ? used - 1 : 0] = '\0';
+        }
+      }
+      else if (args.detect_os && args.verbose)
+      {
+        printf("\nPassive OS guess is conclusive, skipping active OS probes\n");
+      }
+    }
+
+    if (os_info[0])
+    {
+      print_os_info(os_info);
     }
   }
 
   // Print scan summary
+  int64_t write_start = trace_begin();
   print_scan_summary(args.target, num_open_ports, duration);
+  trace_end(TRACE_WRITE, write_start, 0, "summary");
 
   // Print summary
   printf("\nNeptune Scan completed in %ld seconds. %d open ports found.\n", 
          duration, num_open_ports);
 
+  // Trace details point into the probe database, so write it before the cleanup
+  if (trace_enabled)
+  {
+    uint64_t events = 0, dropped = 0;
+    if (trace_write(args.trace_file, &events, &dropped))
+    {
+      printf("Trace written to %s (%llu events, %llu overwritten or dropped)\n", args.trace_file,
+             (unsigned long long)events, (unsigned long long)dropped);
+    }
+    else
+    {
+      print_warning("Could not write the trace file");
+    }
+  }
+
   // Cleanup
+  metrics_stop();
+  free_service_probes();
+  free_os_db();
+  unload_services_db();
   cleanup_scanner();
+  exclude_list_free(&exclude);
   cleanup_args(&args);
 
 #ifdef _WIN32
@@ -0,0 +1,280 @@
+/**
+ * Neptune Scanner - Metrics Endpoint
+ * metrics.c - Prometheus text rendering and the /metrics listener thread
+ */
+
+#include "../include/metrics.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#define close_socket close
+#endif
+
+#define REQUEST_MAX 2048
+#define RESPONSE_MAX 16384
+
+// Prometheus name and help text of each scan_stat_t; port outcomes share one labelled metric
+static const struct
+{
+  const char *name;
+  const char *help;
+} COUNTERS[STAT_COUNT] = {
+    [STAT_PROBES_SENT] = {"neptune_probes_sent_total", "Probes sent, including retransmissions"},
+    [STAT_RESPONSES] = {"neptune_responses_total", "Replies matched to a probe"},
+    [STAT_RETRANSMITS] = {"neptune_retransmits_total", "Probes sent again after a timeout"},
+    [STAT_TIMEOUTS] = {"neptune_timeouts_total", "Waits for a reply that ran out"},
+    [STAT_BYTES_SENT] = {"neptune_bytes_sent_total", "Bytes sent by probes and service detection"},
+    [STAT_BYTES_RECEIVED] = {"neptune_bytes_received_total",
+                             "Bytes received by probes and service detection"},
+};
+
+static const struct
+{
+  const char *name;
+  const char *help;
+} GAUGES[GAUGE_COUNT] = {
+    [GAUGE_IN_FLIGHT] = {"neptune_in_flight_probes", "Probes sent and waiting for a reply"},
+    [GAUGE_ACTIVE_HOSTS] = {"neptune_active_hosts", "Hosts being scanned"},
+    [GAUGE_PROBE_QUEUE] = {"neptune_probe_queue_depth", "Ports of running scans not probed yet"},
+    [GAUGE_SERVICE_QUEUE] = {"neptune_service_queue_depth",
+                             "Open ports waiting for service detection"},
+};
+
+// Histogram bucket bounds in microseconds (100 us to 10 s)
+static const int64_t RTT_BOUNDS[] = {100,    250,    500,     1000,    2500,    5000,
+                                     10000,  25000,  50000,   100000,  250000,  500000,
+                                     1000000, 2500000, 5000000, 10000000};
+
+static struct
+{
+  bool running;
+  atomic_bool stop;
+  pthread_t thread;
+  int sock;
+} server = {.sock = -1};
+
+// Append to the response; sets *len past the end of the buffer once it overflows
+static void append(char *buffer, size_t size, size_t *len, const char *format, ...)
+{
+  if (*len >= size)
+    return;
+
+  va_list ap;
+  va_start(ap, format);
+  int written = vsnprintf(buffer + *len, size - *len, format, ap);
+  va_end(ap);
+  *len = written < 0 ? size : *len + (size_t)written;
+}
+
+size_t metrics_render(const scan_stats_snapshot_t *snapshot, char *buffer, size_t size)
+{
+  size_t len = 0;
+
+  for (int i = 0; i < STAT_COUNT; i++)
+  {
+    if (!COUNTERS[i].name)
+      continue;
+    append(buffer, size, &len, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", COUNTERS[i].name,
+           COUNTERS[i].help, COUNTERS[i].name, COUNTERS[i].name,
+           (unsigned long long)snapshot->counters[i]);
+  }
+
+  append(buffer, size, &len,
+         "# HELP neptune_ports_total Ports scanned, by outcome\n"
+         "# TYPE neptune_ports_total counter\n"
+         "neptune_ports_total{state=\"open\"} %llu\n"
+         "neptune_ports_total{state=\"closed\"} %llu\n"
+         "neptune_ports_total{state=\"filtered\"} %llu\n",
+         (unsigned long long)snapshot->counters[STAT_OPEN],
+         (unsigned long long)snapshot->counters[STAT_CLOSED],
+         (unsigned long long)snapshot->counters[STAT_FILTERED]);
+  append(buffer, size, &len,
+         "# HELP neptune_targets_total Ports the scans set out to check\n"
+         "# TYPE neptune_targets_total counter\nneptune_targets_total %llu\n",
+         (unsigned long long)snapshot->targets);
+
+  for (int i = 0; i < GAUGE_COUNT; i++)
+  {
+    append(buffer, size, &len, "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n", GAUGES[i].name,
+           GAUGES[i].help, GAUGES[i].name, GAUGES[i].name, (long long)snapshot->gauges[i]);
+  }
+
+  // The fine-grained histogram folded into the fixed bounds; a bucket counts towards a bound
+  // when all of its RTTs are at or below it
+  append(buffer, size, &len,
+         "# HELP neptune_rtt_seconds Round-trip time of probes answered on the first try\n"
+         "# TYPE neptune_rtt_seconds histogram\n");
+  uint64_t cumulative = 0;
+  int bucket = 0;
+  for (size_t b = 0; b < sizeof(RTT_BOUNDS) / sizeof(RTT_BOUNDS[0]); b++)
+  {
+    while (bucket < STATS_RTT_BUCKETS && scan_stats_rtt_bucket_high(bucket) <= RTT_BOUNDS[b])
+      cumulative += snapshot->rtt[bucket++];
+    append(buffer, size, &len, "neptune_rtt_seconds_bucket{le=\"%g\"} %llu\n",
+           (double)RTT_BOUNDS[b] / 1e6, (unsigned long long)cumulative);
+  }
+  append(buffer, size, &len,
+         "neptune_rtt_seconds_bucket{le=\"+Inf\"} %llu\nneptune_rtt_seconds_sum %.6f\n"
+         "neptune_rtt_seconds_count %llu\n",
+         (unsigned long long)snapshot->rtt_count, (double)snapshot->rtt_sum_us / 1e6,
+         (unsigned long long)snapshot->rtt_count);
+
+  append(buffer, size, &len,
+         "# HELP process_cpu_seconds_total User and system CPU time spent\n"
+         "# TYPE process_cpu_seconds_total counter\nprocess_cpu_seconds_total %.3f\n",
+         snapshot->cpu_seconds);
+
+  return len < size ? len : 0;
+}
+
+// Read the request head and send the reply; the socket has send and receive timeouts
+static void serve_client(int client)
+{
+  char request[REQUEST_MAX];
+  size_t got = 0;
+  while (got < sizeof(request) - 1)
+  {
+    int n = (int)recv(client, request + got, (int)(sizeof(request) - 1 - got), 0);
+    if (n <= 0)
+      return;
+    got += (size_t)n;
+    request[got] = '\0';
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+      break;
+  }
+  request[got] = '\0';
+
+  static char body[RESPONSE_MAX]; // Only the server thread renders
+  char head[256];
+  size_t body_len = 0;
+  const char *status = "404 Not Found";
+  const char *type = "text/plain";
+
+  if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0)
+  {
+    scan_stats_snapshot_t snapshot;
+    scan_stats_snapshot(&snapshot);
+    body_len = metrics_render(&snapshot, body, sizeof(body));
+    status = body_len > 0 ? "200 OK" : "500 Internal Server Error";
+    type = "text/plain; version=0.0.4; charset=utf-8";
+  }
+  else if (strncmp(request, "GET ", 4) != 0)
+  {
+    status = "405 Method Not Allowed";
+  }
+  if (body_len == 0)
+    body_len = (size_t)snprintf(body, sizeof(body), "%s\n", status);
+
+  int head_len = snprintf(head, sizeof(head),
+                          "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                          "Connection: close\r\n\r\n",
+                          status, type, body_len);
+  if (send(client, head, head_len, 0) == head_len)
+    send(client, body, (int)body_len, 0);
+}
+
+static void set_timeouts(int sock)
+{
+#ifdef _WIN32
+  DWORD timeout = METRICS_IO_TIMEOUT;
+#else
+  struct timeval timeout = {METRICS_IO_TIMEOUT / 1000, (METRICS_IO_TIMEOUT % 1000) * 1000};
+#endif
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+}
+
+static void *server_thread(void *arg)
+{
+  (void)arg;
+
+  // Scrapes must never take CPU from the probes; see reporter_thread in scan_stats.c
+#ifdef _WIN32
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+  setpriority(PRIO_PROCESS, 0, 10);
+#endif
+
+  while (!atomic_load(&server.stop))
+  {
+    // Wake up regularly to notice metrics_stop
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(server.sock, &readfds);
+    struct timeval tv = {0, 200000};
+    if (select(server.sock + 1, &readfds, NULL, NULL, &tv) <= 0)
+      continue;
+
+    int client = (int)accept(server.sock, NULL, NULL);
+    if (client < 0)
+      continue;
+    set_timeouts(client);
+    serve_client(client);
+    close_socket(client);
+  }
+  return NULL;
+}
+
+bool metrics_start(int port)
+{
+  if (server.running || port < 1 || port > 65535)
+    return false;
+
+  server.sock = (int)socket(AF_INET, SOCK_STREAM, 0);
+  if (server.sock < 0)
+    return false;
+
+  int reuse = 1;
+  setsockopt(server.sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((unsigned short)port);
+  if (bind(server.sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(server.sock, 16) != 0)
+  {
+    close_socket(server.sock);
+    server.sock = -1;
+    return false;
+  }
+
+  atomic_store(&server.stop, false);
+  if (pthread_create(&server.thread, NULL, server_thread, NULL) != 0)
+  {
+    close_socket(server.sock);
+    server.sock = -1;
+    return false;
+  }
+  server.running = true;
+  return true;
+}
+
+void metrics_stop(void)
+{
+  if (!server.running)
+    return;
+
+  atomic_store(&server.stop, true);
+  pthread_join(server.thread, NULL);
+  close_socket(server.sock);
+  server.sock = -1;
+  server.running = false;
+}
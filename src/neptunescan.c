@@ -0,0 +1,548 @@
+/**
+ * Neptune Scanner - Library API
+ * neptunescan.c - Scan contexts, their worker threads and the result delivery
+ */
+
+#include "../include/neptunescan.h"
+#include "../include/config.h"
+#include "../include/http_probe.h"
+#include "../include/scan_stats.h"
+#include "../include/scanner.h"
+#include "../include/service_detection.h"
+#include "../include/service_probes.h"
+#include "../include/syn_engine.h"
+#include "../include/transport.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#define MAX_CONCURRENCY 1024 // Upper bound on neptune_scan_options_t.concurrency
+#define SYN_OUTSTANDING 1024 // Probes in flight per SYN scan, and local ports reserved for it
+#define SYN_RANGES ((65536 - SYN_ENGINE_BASE_PORT) / SYN_OUTSTANDING) // SYN scans at once
+#define STEP_WAIT 50000      // Microseconds a SYN scan waits for replies between cancel checks
+
+// A target host; also the SYN engine job context
+typedef struct
+{
+  neptune_scan_ctx *scan;
+  char *host;
+  uint32_t addr;
+} scan_target_t;
+
+// An open port waiting for service detection
+typedef struct
+{
+  int target;
+  uint16_t port;
+} open_port_t;
+
+struct neptune_scan_ctx
+{
+  neptune_scan_options_t options;
+  neptune_result_fn on_result;
+  void *user;
+
+  // Set up before neptune_scan_start, read-only afterwards
+  scan_target_t *targets;
+  int num_targets;
+  int targets_capacity;
+  port_bitmap_t wanted;      // Ports added so far
+  uint16_t *ports;           // The wanted ports in order, made by neptune_scan_start
+  int num_ports;
+
+  // Under report_lock, which also keeps callbacks from overlapping
+  pthread_mutex_t report_lock;
+  neptune_scan_stats_t stats;
+  open_port_t *open;
+  int num_open;
+  int open_capacity;
+
+  pthread_mutex_t done_lock;
+  pthread_cond_t done_cond;
+  atomic_bool done;
+  atomic_bool cancel;
+  atomic_int_fast64_t next_probe; // Connect scan: next target and port pair to probe
+  bool started;
+  pthread_t thread;
+  int syn_range;                  // Local port range of a SYN scan, -1 when none is held
+};
+
+// Local port ranges held by running SYN scans, one bit each
+static pthread_mutex_t syn_ranges_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t syn_ranges_used;
+
+// The process-wide detection databases, and the running scans that read them
+static pthread_mutex_t databases_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool databases_loaded;
+static int detecting_scans;
+
+// Load the databases, falling back to the built-ins; the caller holds databases_lock
+static bool load_databases(const char *service_probes_file, const char *http_requests_file)
+{
+  bool ok = true;
+  if (!service_probes_file || !load_service_probes(service_probes_file))
+  {
+    ok = ok && !service_probes_file;
+    load_default_service_probes();
+  }
+  if (!http_requests_file || !load_http_requests(http_requests_file))
+  {
+    ok = ok && !http_requests_file;
+    load_default_http_requests();
+  }
+  databases_loaded = true;
+  return ok;
+}
+
+bool neptune_init(const char *service_probes_file, const char *http_requests_file)
+{
+  // Replacing the tables would free them under the detection threads of running scans
+  pthread_mutex_lock(&databases_lock);
+  bool ok = detecting_scans == 0 && load_databases(service_probes_file, http_requests_file);
+  pthread_mutex_unlock(&databases_lock);
+  return ok;
+}
+
+void neptune_cleanup(void)
+{
+  pthread_mutex_lock(&databases_lock);
+  if (detecting_scans == 0)
+  {
+    free_service_probes();
+    databases_loaded = false;
+  }
+  pthread_mutex_unlock(&databases_lock);
+}
+
+void neptune_scan_options_init(neptune_scan_options_t *options)
+{
+  memset(options, 0, sizeof(*options));
+  options->scan_type = NEPTUNE_SCAN_CONNECT;
+  options->timeout_ms = DEFAULT_TIMEOUT;
+  options->retries = SYN_ENGINE_RETRIES;
+  options->concurrency = 64;
+}
+
+neptune_scan_ctx *neptune_scan_create(const neptune_scan_options_t *options,
+                                      neptune_result_fn on_result, void *user)
+{
+  if (!options || !on_result || options->timeout_ms < 1 || options->retries < 0 ||
+      options->rate < 0 || options->concurrency < 1 || options->concurrency > MAX_CONCURRENCY ||
+      (options->scan_type != NEPTUNE_SCAN_CONNECT && options->scan_type != NEPTUNE_SCAN_SYN))
+    return NULL;
+
+  neptune_scan_ctx *scan = calloc(1, sizeof(*scan));
+  if (!scan)
+    return NULL;
+
+#ifdef _WIN32
+  // Winsock counts its users, so every scan can hold its own reference
+  WSADATA wsa_data;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+  {
+    free(scan);
+    return NULL;
+  }
+#endif
+
+  scan->options = *options;
+  scan->on_result = on_result;
+  scan->user = user;
+  scan->syn_range = -1;
+  pthread_mutex_init(&scan->report_lock, NULL);
+  pthread_mutex_init(&scan->done_lock, NULL);
+  pthread_cond_init(&scan->done_cond, NULL);
+  return scan;
+}
+
+bool neptune_scan_add_target(neptune_scan_ctx *scan, const char *host)
+{
+  if (scan->started)
+    return false;
+
+  struct addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(host, NULL, &hints, &result) != 0)
+    return false;
+  uint32_t addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(result);
+
+  if (scan->num_targets == scan->targets_capacity)
+  {
+    int capacity = scan->targets_capacity ? scan->targets_capacity * 2 : 4;
+    scan_target_t *targets = realloc(scan->targets, (size_t)capacity * sizeof(*targets));
+    if (!targets)
+      return false;
+    scan->targets = targets;
+    scan->targets_capacity = capacity;
+  }
+
+  char *copy = malloc(strlen(host) + 1);
+  if (!copy)
+    return false;
+  strcpy(copy, host);
+  scan->targets[scan->num_targets++] = (scan_target_t){scan, copy, addr};
+  return true;
+}
+
+bool neptune_scan_add_ports(neptune_scan_ctx *scan, const char *spec)
+{
+  if (scan->started)
+    return false;
+
+  // The whole spec is compiled before any of it is added; scans are TCP only
+  port_spec_t ports;
+  char error[128];
+  if (!port_spec_parse(spec, &ports, error, sizeof(error)) || port_bitmap_count(&ports.udp) > 0)
+    return false;
+
+  for (int i = 0; i < PORT_BITMAP_WORDS; i++)
+    scan->wanted.bits[i] |= ports.tcp.bits[i];
+  return true;
+}
+
+// Deliver one result and count it; called from any of the scan's threads
+static void report_port(neptune_scan_ctx *scan, int target, uint16_t port,
+                        neptune_port_state_t state)
+{
+  pthread_mutex_lock(&scan->report_lock);
+  scan->stats.probed++;
+  if (state == NEPTUNE_PORT_OPEN)
+  {
+    scan->stats.open++;
+    if (scan->options.detect_services)
+    {
+      if (scan->num_open == scan->open_capacity)
+      {
+        int capacity = scan->open_capacity ? scan->open_capacity * 2 : 16;
+        open_port_t *open = realloc(scan->open, (size_t)capacity * sizeof(*open));
+        if (open)
+        {
+          scan->open = open;
+          scan->open_capacity = capacity;
+        }
+      }
+      if (scan->num_open < scan->open_capacity)
+        scan->open[scan->num_open++] = (open_port_t){target, port};
+    }
+  }
+  else if (state == NEPTUNE_PORT_CLOSED)
+  {
+    scan->stats.closed++;
+  }
+  else
+  {
+    scan->stats.filtered++;
+  }
+
+  if (state == NEPTUNE_PORT_OPEN || scan->options.report_closed)
+  {
+    neptune_result_t result = {.event = NEPTUNE_EVENT_PORT,
+                               .target = scan->targets[target].host,
+                               .addr = scan->targets[target].addr,
+                               .port = port,
+                               .state = state};
+    scan->on_result(scan->user, &result);
+  }
+  pthread_mutex_unlock(&scan->report_lock);
+}
+
+static neptune_port_state_t public_state(port_state_t state)
+{
+  return state == PORT_STATE_OPEN     ? NEPTUNE_PORT_OPEN
+         : state == PORT_STATE_CLOSED ? NEPTUNE_PORT_CLOSED
+                                      : NEPTUNE_PORT_FILTERED;
+}
+
+// SYN engine callback; the context is the scan_target_t of the job
+static void record_syn_result(void *context, uint32_t addr, uint16_t port, port_state_t state,
+                              const os_response_t *reply)
+{
+  (void)addr;
+  (void)reply;
+  scan_target_t *target = context;
+  report_port(target->scan, (int)(target - target->scan->targets), port, public_state(state));
+}
+
+// Run a SYN scan: one engine job per target, stepped until done or cancelled
+static void run_syn_scan(neptune_scan_ctx *scan)
+{
+  transport_t *transport = transport_raw_open();
+  if (!transport)
+    return;
+
+  syn_engine_config_t config;
+  syn_engine_default_config(&config);
+  config.max_outstanding = SYN_OUTSTANDING;
+  config.base_port = (uint16_t)(SYN_ENGINE_BASE_PORT + scan->syn_range * SYN_OUTSTANDING);
+  config.rate = scan->options.rate;
+  config.retries = scan->options.retries;
+  config.timeout_us = (int64_t)scan->options.timeout_ms * 1000;
+
+  syn_engine_t *engine = syn_engine_create(transport, &config);
+  bool ok = engine != NULL;
+  for (int i = 0; ok && i < scan->num_targets; i++)
+  {
+    ok = syn_engine_add_job(engine, scan->targets[i].addr, 1, scan->ports, scan->num_ports, 1,
+                            record_syn_result, &scan->targets[i]) != NULL;
+  }
+  while (ok && !atomic_load(&scan->cancel) && syn_engine_busy(engine))
+    ok = syn_engine_step(engine, STEP_WAIT);
+
+  syn_engine_destroy(engine);
+  transport->ops->close(transport);
+}
+
+// Connect scan worker: take target and port pairs until none are left
+static void *connect_worker(void *arg)
+{
+  neptune_scan_ctx *scan = arg;
+  int64_t total = (int64_t)scan->num_targets * scan->num_ports;
+
+  while (!atomic_load(&scan->cancel))
+  {
+    int64_t index = atomic_fetch_add(&scan->next_probe, 1);
+    if (index >= total)
+      break;
+    scan_stats_gauge_add(GAUGE_PROBE_QUEUE, -1);
+
+    // Port by port across the targets, like the SYN engine
+    int target = (int)(index % scan->num_targets);
+    uint16_t port = scan->ports[index / scan->num_targets];
+    port_state_t state;
+    if (connect_probe(scan->targets[target].addr, port, scan->options.timeout_ms, &state))
+      report_port(scan, target, port, public_state(state));
+  }
+  return NULL;
+}
+
+static void run_connect_scan(neptune_scan_ctx *scan)
+{
+  int64_t total = (int64_t)scan->num_targets * scan->num_ports;
+  int num_workers = total < scan->options.concurrency ? (int)total : scan->options.concurrency;
+  pthread_t *workers = malloc((size_t)num_workers * sizeof(pthread_t));
+  if (!workers)
+    return;
+
+  scan_stats_gauge_add(GAUGE_PROBE_QUEUE, total);
+  scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, scan->num_targets);
+  int started = 0;
+  while (started < num_workers &&
+         pthread_create(&workers[started], NULL, connect_worker, scan) == 0)
+    started++;
+  if (started == 0)
+    connect_worker(scan);
+  for (int i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+
+  // Pairs left behind by a cancel never leave the queue otherwise
+  int64_t taken = atomic_load(&scan->next_probe);
+  if (taken < total)
+    scan_stats_gauge_add(GAUGE_PROBE_QUEUE, -(total - taken));
+  scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, -scan->num_targets);
+  free(workers);
+}
+
+// Identify the services on the open ports, one at a time, until done or cancelled
+static void detect_services(neptune_scan_ctx *scan)
+{
+  // The port scan is over, so the open list no longer changes
+  scan_stats_gauge_add(GAUGE_SERVICE_QUEUE, scan->num_open);
+  int i = 0;
+  for (; i < scan->num_open && !atomic_load(&scan->cancel); i++)
+  {
+    const scan_target_t *target = &scan->targets[scan->open[i].target];
+    ServiceInfo info;
+    memset(&info, 0, sizeof(info));
+    info.port = scan->open[i].port;
+    bool detected = detect_service_at(target->host, target->addr, scan->open[i].port, &info);
+    scan_stats_gauge_add(GAUGE_SERVICE_QUEUE, -1);
+    if (!detected)
+      continue;
+
+    neptune_result_t result = {.event = NEPTUNE_EVENT_SERVICE,
+                               .target = target->host,
+                               .addr = target->addr,
+                               .port = scan->open[i].port,
+                               .state = NEPTUNE_PORT_OPEN,
+                               .service = info.service_name,
+                               .protocol = info.protocol,
+                               .version = info.version};
+    pthread_mutex_lock(&scan->report_lock);
+    scan->on_result(scan->user, &result);
+    pthread_mutex_unlock(&scan->report_lock);
+  }
+  scan_stats_gauge_add(GAUGE_SERVICE_QUEUE, -(scan->num_open - i));
+}
+
+static void *scan_thread(void *arg)
+{
+  neptune_scan_ctx *scan = arg;
+  scan_stats_expect((uint64_t)scan->num_targets * (uint64_t)scan->num_ports);
+
+  if (scan->options.scan_type == NEPTUNE_SCAN_SYN)
+    run_syn_scan(scan);
+  else
+    run_connect_scan(scan);
+  if (scan->options.detect_services)
+  {
+    detect_services(scan);
+    pthread_mutex_lock(&databases_lock);
+    detecting_scans--;
+    pthread_mutex_unlock(&databases_lock);
+  }
+
+  if (scan->syn_range >= 0)
+  {
+    pthread_mutex_lock(&syn_ranges_lock);
+    syn_ranges_used &= ~(1u << scan->syn_range);
+    pthread_mutex_unlock(&syn_ranges_lock);
+    scan->syn_range = -1;
+  }
+
+  pthread_mutex_lock(&scan->report_lock);
+  scan->stats.cancelled = atomic_load(&scan->cancel);
+  neptune_result_t result = {.event = NEPTUNE_EVENT_DONE};
+  scan->on_result(scan->user, &result);
+  pthread_mutex_unlock(&scan->report_lock);
+
+  pthread_mutex_lock(&scan->done_lock);
+  atomic_store(&scan->done, true);
+  pthread_cond_broadcast(&scan->done_cond);
+  pthread_mutex_unlock(&scan->done_lock);
+  return NULL;
+}
+
+bool neptune_scan_start(neptune_scan_ctx *scan)
+{
+  if (scan->started || scan->num_targets == 0)
+    return false;
+
+  int num_ports = port_bitmap_count(&scan->wanted);
+  if (num_ports == 0)
+    return false;
+  free(scan->ports);
+  scan->ports = malloc((size_t)num_ports * sizeof(uint16_t));
+  if (!scan->ports)
+    return false;
+  scan->num_ports = 0;
+  for (int port = port_bitmap_next(&scan->wanted, 0); port >= 0;
+       port = port_bitmap_next(&scan->wanted, port + 1))
+    scan->ports[scan->num_ports++] = (uint16_t)port;
+
+  // A SYN scan needs raw sockets and local ports no other scan in the process uses
+  if (scan->options.scan_type == NEPTUNE_SCAN_SYN)
+  {
+    transport_t *probe = transport_raw_open();
+    if (!probe)
+      return false;
+    probe->ops->close(probe);
+
+    pthread_mutex_lock(&syn_ranges_lock);
+    for (int i = 0; i < SYN_RANGES && scan->syn_range < 0; i++)
+    {
+      if (!(syn_ranges_used & (1u << i)))
+      {
+        syn_ranges_used |= 1u << i;
+        scan->syn_range = i;
+      }
+    }
+    pthread_mutex_unlock(&syn_ranges_lock);
+    if (scan->syn_range < 0)
+      return false;
+  }
+
+  // Service detection without neptune_init uses the built-in probes; the count keeps
+  // neptune_init and neptune_cleanup off the databases until the scan is over
+  if (scan->options.detect_services)
+  {
+    pthread_mutex_lock(&databases_lock);
+    if (!databases_loaded)
+      load_databases(NULL, NULL);
+    detecting_scans++;
+    pthread_mutex_unlock(&databases_lock);
+  }
+
+  if (pthread_create(&scan->thread, NULL, scan_thread, scan) != 0)
+  {
+    if (scan->options.detect_services)
+    {
+      pthread_mutex_lock(&databases_lock);
+      detecting_scans--;
+      pthread_mutex_unlock(&databases_lock);
+    }
+    if (scan->syn_range >= 0)
+    {
+      pthread_mutex_lock(&syn_ranges_lock);
+      syn_ranges_used &= ~(1u << scan->syn_range);
+      pthread_mutex_unlock(&syn_ranges_lock);
+      scan->syn_range = -1;
+    }
+    return false;
+  }
+  scan->started = true;
+  return true;
+}
+
+void neptune_scan_cancel(neptune_scan_ctx *scan)
+{
+  atomic_store(&scan->cancel, true);
+}
+
+bool neptune_scan_running(const neptune_scan_ctx *scan)
+{
+  return scan->started && !atomic_load(&scan->done);
+}
+
+void neptune_scan_wait(neptune_scan_ctx *scan)
+{
+  if (!scan->started)
+    return;
+  pthread_mutex_lock(&scan->done_lock);
+  while (!atomic_load(&scan->done))
+    pthread_cond_wait(&scan->done_cond, &scan->done_lock);
+  pthread_mutex_unlock(&scan->done_lock);
+}
+
+void neptune_scan_get_stats(const neptune_scan_ctx *scan, neptune_scan_stats_t *stats)
+{
+  neptune_scan_ctx *mutable_scan = (neptune_scan_ctx *)scan;
+  pthread_mutex_lock(&mutable_scan->report_lock);
+  *stats = scan->stats;
+  pthread_mutex_unlock(&mutable_scan->report_lock);
+}
+
+void neptune_scan_destroy(neptune_scan_ctx *scan)
+{
+  if (!scan)
+    return;
+
+  if (scan->started)
+  {
+    neptune_scan_cancel(scan);
+    pthread_join(scan->thread, NULL);
+  }
+  for (int i = 0; i < scan->num_targets; i++)
+    free(scan->targets[i].host);
+  free(scan->targets);
+  free(scan->ports);
+  free(scan->open);
+  pthread_mutex_destroy(&scan->report_lock);
+  pthread_mutex_destroy(&scan->done_lock);
+  pthread_cond_destroy(&scan->done_cond);
+  free(scan);
+#ifdef _WIN32
+  WSACleanup();
+#endif
+}
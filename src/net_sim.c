@@ -0,0 +1,347 @@
+/**
+ * Neptune Scanner - Network Simulator
+ * net_sim.c - Simulated hosts, reply event queue and virtual clock
+ */
+
+#include "../include/net_sim.h"
+#include "../include/advanced_scan.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+// A reply in flight
+typedef struct
+{
+  int64_t time;        // Virtual delivery time
+  uint64_t order;      // Tie-breaker keeping delivery order deterministic
+  uint32_t addr;
+  uint16_t port;
+  uint16_t local_port;
+  uint8_t flags;
+} sim_event_t;
+
+// RST token bucket of one host
+typedef struct
+{
+  uint32_t addr;       // Host address (0 = empty slot)
+  double tokens;       // RSTs the host may still send
+  int64_t refilled;    // Virtual time of the last refill
+} sim_limiter_t;
+
+typedef struct
+{
+  transport_t base;
+  net_sim_config_t config;
+  uint16_t *open_ports;       // Copy of config.open_ports
+  int64_t now;                // Virtual clock
+  uint64_t rng;               // Packet fate generator state
+  uint64_t next_order;
+  sim_event_t *events;        // Min-heap on (time, order)
+  size_t num_events;
+  size_t events_capacity;
+  sim_limiter_t *limiters;    // Open-addressing table of hosts that have sent RSTs
+  size_t limiters_capacity;   // Power of two
+  size_t num_limiters;
+  net_sim_stats_t stats;
+} net_sim_t;
+
+// SplitMix64 finalizer: a well-mixed hash of the seed and the probed tuple
+static uint64_t mix(uint64_t x)
+{
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+// Uniform fraction in [0, 1) from a hash
+static double fraction(uint64_t hash)
+{
+  return (double)(hash >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double host_fraction(const net_sim_t *sim, uint32_t host, uint64_t salt)
+{
+  return fraction(mix(sim->config.seed ^ (salt << 32) ^ host));
+}
+
+static double next_random(net_sim_t *sim)
+{
+  sim->rng = mix(sim->rng);
+  return fraction(sim->rng);
+}
+
+// Host index of an address, or -1 if it is outside the simulated block or not up
+static int64_t live_host(const net_sim_t *sim, uint32_t addr)
+{
+  uint32_t index = ntohl(addr) - ntohl(sim->config.first_addr);
+  if (index >= sim->config.num_hosts || host_fraction(sim, index, 1) >= sim->config.host_up)
+    return -1;
+  return index;
+}
+
+static bool port_open(const net_sim_t *sim, uint32_t host, uint16_t port)
+{
+  for (int i = 0; i < sim->config.num_open_ports; i++)
+  {
+    if (sim->open_ports[i] == port)
+      return true;
+  }
+  return sim->config.port_open_rate > 0 &&
+         fraction(mix(sim->config.seed ^ ((uint64_t)port << 40) ^ host)) <
+             sim->config.port_open_rate;
+}
+
+static bool event_before(const sim_event_t *a, const sim_event_t *b)
+{
+  return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+static bool push_event(net_sim_t *sim, const sim_event_t *event)
+{
+  if (sim->num_events == sim->events_capacity)
+  {
+    size_t capacity = sim->events_capacity ? sim->events_capacity * 2 : 1024;
+    sim_event_t *grown = realloc(sim->events, capacity * sizeof(sim_event_t));
+    if (!grown)
+      return false;
+    sim->events = grown;
+    sim->events_capacity = capacity;
+  }
+
+  size_t i = sim->num_events++;
+  while (i > 0 && event_before(event, &sim->events[(i - 1) / 2]))
+  {
+    sim->events[i] = sim->events[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  sim->events[i] = *event;
+  return true;
+}
+
+static sim_event_t pop_event(net_sim_t *sim)
+{
+  sim_event_t top = sim->events[0];
+  sim_event_t last = sim->events[--sim->num_events];
+  size_t i = 0;
+  for (;;)
+  {
+    size_t child = 2 * i + 1;
+    if (child >= sim->num_events)
+      break;
+    if (child + 1 < sim->num_events && event_before(&sim->events[child + 1], &sim->events[child]))
+      child++;
+    if (!event_before(&sim->events[child], &last))
+      break;
+    sim->events[i] = sim->events[child];
+    i = child;
+  }
+  if (sim->num_events > 0)
+    sim->events[i] = last;
+  return top;
+}
+
+// Find a host's RST bucket, creating a full one on first use; NULL on allocation failure
+static sim_limiter_t *find_limiter(net_sim_t *sim, uint32_t addr)
+{
+  if ((sim->num_limiters + 1) * 2 > sim->limiters_capacity)
+  {
+    size_t capacity = sim->limiters_capacity ? sim->limiters_capacity * 2 : 1024;
+    sim_limiter_t *table = calloc(capacity, sizeof(sim_limiter_t));
+    if (!table)
+      return NULL;
+    for (size_t i = 0; i < sim->limiters_capacity; i++)
+    {
+      if (sim->limiters[i].addr == 0)
+        continue;
+      size_t j = mix(sim->limiters[i].addr) & (capacity - 1);
+      while (table[j].addr != 0)
+        j = (j + 1) & (capacity - 1);
+      table[j] = sim->limiters[i];
+    }
+    free(sim->limiters);
+    sim->limiters = table;
+    sim->limiters_capacity = capacity;
+  }
+
+  size_t i = mix(addr) & (sim->limiters_capacity - 1);
+  while (sim->limiters[i].addr != 0 && sim->limiters[i].addr != addr)
+    i = (i + 1) & (sim->limiters_capacity - 1);
+
+  sim_limiter_t *limiter = &sim->limiters[i];
+  if (limiter->addr == 0)
+  {
+    limiter->addr = addr;
+    limiter->tokens = sim->config.rst_per_sec;
+    limiter->refilled = sim->now;
+    sim->num_limiters++;
+  }
+  return limiter;
+}
+
+// Whether a host may send another RST now
+static bool take_rst_token(net_sim_t *sim, uint32_t addr)
+{
+  if (sim->config.rst_per_sec <= 0)
+    return true;
+
+  sim_limiter_t *limiter = find_limiter(sim, addr);
+  if (!limiter)
+    return true;
+
+  double rate = sim->config.rst_per_sec;
+  limiter->tokens += (double)(sim->now - limiter->refilled) * rate / 1e6;
+  if (limiter->tokens > rate)
+    limiter->tokens = rate;
+  limiter->refilled = sim->now;
+
+  if (limiter->tokens < 1.0)
+    return false;
+  limiter->tokens -= 1.0;
+  return true;
+}
+
+static int64_t sim_now(transport_t *transport)
+{
+  return ((net_sim_t *)transport)->now;
+}
+
+static bool sim_send_syn(transport_t *transport, uint32_t addr, uint16_t port, uint16_t local_port)
+{
+  net_sim_t *sim = (net_sim_t *)transport;
+  sim->stats.probes++;
+
+  int64_t host = live_host(sim, addr);
+  if (host < 0)
+  {
+    sim->stats.unanswered++;
+    return true;
+  }
+  if (next_random(sim) < sim->config.loss)
+  {
+    sim->stats.lost++;
+    return true;
+  }
+
+  sim_event_t event = {0, 0, addr, port, local_port, TCP_SYN | TCP_ACK};
+  if (!port_open(sim, (uint32_t)host, port))
+  {
+    if (host_fraction(sim, (uint32_t)host, 2) < sim->config.firewalled)
+    {
+      sim->stats.unanswered++;
+      return true;
+    }
+    if (!take_rst_token(sim, addr))
+    {
+      sim->stats.rst_limited++;
+      return true;
+    }
+    event.flags = TCP_RST | TCP_ACK;
+  }
+
+  if (next_random(sim) < sim->config.loss)
+  {
+    sim->stats.lost++;
+    return true;
+  }
+
+  double spread = host_fraction(sim, (uint32_t)host, 3) * (double)sim->config.rtt_spread_us;
+  double jitter = next_random(sim) * (double)sim->config.rtt_jitter_us;
+  event.time = sim->now + sim->config.rtt_us + (int64_t)spread + (int64_t)jitter;
+  event.order = sim->next_order++;
+  return push_event(sim, &event);
+}
+
+static int sim_poll(transport_t *transport, transport_reply_t *replies, int max, int64_t timeout_us)
+{
+  net_sim_t *sim = (net_sim_t *)transport;
+  int64_t deadline = sim->now + (timeout_us > 0 ? timeout_us : 0);
+  int count = 0;
+
+  // Jump to the first reply due before the deadline, then take everything due at that instant
+  while (count < max && sim->num_events > 0 && sim->events[0].time <= deadline)
+  {
+    sim_event_t event = pop_event(sim);
+    if (event.time > sim->now)
+      sim->now = event.time;
+    deadline = sim->now;
+
+    transport_reply_t *reply = &replies[count++];
+    memset(reply, 0, sizeof(*reply));
+    reply->addr = event.addr;
+    reply->port = event.port;
+    reply->local_port = event.local_port;
+    reply->tcp.responded = true;
+    reply->tcp.ttl = 64 - (uint8_t)(mix(event.addr) % 24);
+    reply->tcp.df = true;
+    reply->tcp.flags = event.flags;
+    reply->tcp.wscale = -1;
+    if (event.flags & TCP_SYN)
+    {
+      reply->tcp.window = 64240;
+      strcpy(reply->tcp.options, "MSTNW");
+      reply->tcp.mss = 1460;
+      reply->tcp.wscale = 7;
+      sim->stats.syn_acks++;
+    }
+    else
+    {
+      sim->stats.rsts++;
+    }
+  }
+
+  if (count == 0)
+    sim->now = deadline;
+  return count;
+}
+
+static void sim_close(transport_t *transport)
+{
+  net_sim_t *sim = (net_sim_t *)transport;
+  free(sim->open_ports);
+  free(sim->events);
+  free(sim->limiters);
+  free(sim);
+}
+
+static const transport_ops_t SIM_OPS = {sim_now, sim_send_syn, sim_poll, sim_close};
+
+transport_t *net_sim_open(const net_sim_config_t *config)
+{
+  net_sim_t *sim = calloc(1, sizeof(net_sim_t));
+  if (!sim)
+    return NULL;
+
+  sim->config = *config;
+  if (config->num_open_ports > 0)
+  {
+    sim->open_ports = malloc((size_t)config->num_open_ports * sizeof(uint16_t));
+    if (!sim->open_ports)
+    {
+      free(sim);
+      return NULL;
+    }
+    memcpy(sim->open_ports, config->open_ports, (size_t)config->num_open_ports * sizeof(uint16_t));
+  }
+  sim->config.open_ports = sim->open_ports;
+  sim->rng = config->seed ^ 0x5DEECE66Dull;
+  sim->base.ops = &SIM_OPS;
+  return &sim->base;
+}
+
+bool net_sim_port_open(const transport_t *transport, uint32_t addr, uint16_t port)
+{
+  const net_sim_t *sim = (const net_sim_t *)transport;
+  int64_t host = live_host(sim, addr);
+  return host >= 0 && port_open(sim, (uint32_t)host, port);
+}
+
+void net_sim_get_stats(const transport_t *transport, net_sim_stats_t *stats)
+{
+  *stats = ((const net_sim_t *)transport)->stats;
+}
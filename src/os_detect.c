@@ -0,0 +1,1053 @@
+/**
+ * Neptune Scanner - OS Detection
+ * os_detect.c - Probe engine, signature database and fingerprint matching
+ */
+
+#include "../include/os_detect.h"
+#include "../include/advanced_scan.h"
+#include "../include/config.h"
+#include "../include/scanner.h"
+#include "../include/utils.h"
+#include <ctype.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Score weights of the fingerprint fields
+#define WEIGHT_RESPONDED 2
+#define WEIGHT_TTL 3
+#define WEIGHT_DF 1
+#define WEIGHT_WINDOW 3
+#define WEIGHT_OPTIONS 5
+#define WEIGHT_WSCALE 2
+#define WEIGHT_MSS 1
+#define WEIGHT_FLAGS 2
+
+// Probe names as used in the database, indexed by os_probe_t
+static const char *const PROBE_NAMES[OS_PROBE_COUNT] = {"SYN", "PLAIN", "ACK", "CLOSED", "ICMP"};
+
+// Accepted values of a numeric field; an empty set matches anything
+typedef struct
+{
+  uint16_t values[OS_MAX_ALTERNATIVES];
+  int count;
+} value_set_t;
+
+// Expected response to one probe
+typedef struct
+{
+  int responds;                                            // 1, 0, or -1 for either
+  value_set_t ttl;                                         // Initial TTLs
+  int df;                                                  // 1, 0, or -1 for either
+  value_set_t window;                                      // TCP windows
+  char options[OS_MAX_ALTERNATIVES][OS_MAX_OPTIONS_LEN + 1]; // Option layouts
+  int num_options;                                         // Number of option layouts (0 = any)
+  value_set_t wscale;                                      // Window scale values
+  value_set_t mss;                                         // MSS values
+  value_set_t flags;                                       // TCP flag combinations
+} os_test_t;
+
+typedef struct
+{
+  char name[96];                    // OS name and version range
+  char os_class[64];                // Vendor and device type
+  os_test_t tests[OS_PROBE_COUNT]; // Expected responses
+} os_signature_t;
+
+// Signatures sharing an initial TTL and SYN option layout
+typedef struct
+{
+  uint32_t hash;                        // Hash of the key, 0 for an empty slot
+  uint8_t ttl;                          // Initial TTL
+  char options[OS_MAX_OPTIONS_LEN + 1]; // SYN option layout
+  int *members;                         // Signature numbers
+  int count;                            // Number of members
+  int capacity;                         // Allocated members
+} os_bucket_t;
+
+// Loaded signature database and its index
+static os_signature_t *signatures = NULL;
+static int num_signatures = 0;
+static os_bucket_t *buckets = NULL;
+static size_t num_buckets = 0; // Power of two
+static int *unindexed = NULL;  // Signatures without a fixed TTL and SYN option layout
+static int num_unindexed = 0;
+
+// Round an observed TTL up to the initial TTL the sender most likely used
+static uint8_t initial_ttl(uint8_t ttl)
+{
+  if (ttl <= 32)
+    return 32;
+  if (ttl <= 64)
+    return 64;
+  if (ttl <= 128)
+    return 128;
+  return 255;
+}
+
+static bool set_contains(const value_set_t *set, unsigned value)
+{
+  for (int i = 0; i < set->count; i++)
+  {
+    if (set->values[i] == value)
+      return true;
+  }
+  return false;
+}
+
+// Parse TCP flag letters ("SA", "RA", "R") into TCP_* bits; returns -1 on an unknown letter
+static int parse_flags(const char *text, size_t len)
+{
+  int flags = 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    switch (text[i])
+    {
+    case 'F':
+      flags |= TCP_FIN;
+      break;
+    case 'S':
+      flags |= TCP_SYN;
+      break;
+    case 'R':
+      flags |= TCP_RST;
+      break;
+    case 'P':
+      flags |= TCP_PSH;
+      break;
+    case 'A':
+      flags |= TCP_ACK;
+      break;
+    case 'U':
+      flags |= TCP_URG;
+      break;
+    default:
+      return -1;
+    }
+  }
+  return flags;
+}
+
+// Parse "64|128" style alternatives into a value set
+static bool parse_value_set(const char *text, bool flag_letters, value_set_t *set)
+{
+  set->count = 0;
+  while (*text)
+  {
+    size_t len = strcspn(text, "|");
+    if (len == 0 || set->count >= OS_MAX_ALTERNATIVES)
+      return false;
+
+    long value;
+    if (flag_letters)
+    {
+      value = parse_flags(text, len);
+    }
+    else
+    {
+      char *end;
+      value = strtol(text, &end, 10);
+      if (end != text + len)
+        return false;
+    }
+    if (value < 0 || value > 65535)
+      return false;
+
+    set->values[set->count++] = (uint16_t)value;
+    text += len;
+    if (*text == '|')
+      text++;
+  }
+  return set->count > 0;
+}
+
+// Parse "key=value" into a test; returns false on a malformed pair
+static bool parse_test_field(const char *key, const char *value, os_test_t *test)
+{
+  if (strcmp(key, "resp") == 0 || strcmp(key, "df") == 0)
+  {
+    int yes = strcmp(value, "Y") == 0 ? 1 : strcmp(value, "N") == 0 ? 0 : -1;
+    if (yes < 0)
+      return false;
+    if (key[0] == 'r')
+      test->responds = yes;
+    else
+      test->df = yes;
+    return true;
+  }
+  if (strcmp(key, "ttl") == 0)
+    return parse_value_set(value, false, &test->ttl);
+  if (strcmp(key, "win") == 0)
+    return parse_value_set(value, false, &test->window);
+  if (strcmp(key, "ws") == 0)
+    return parse_value_set(value, false, &test->wscale);
+  if (strcmp(key, "mss") == 0)
+    return parse_value_set(value, false, &test->mss);
+  if (strcmp(key, "flags") == 0)
+    return parse_value_set(value, true, &test->flags);
+  if (strcmp(key, "ops") == 0)
+  {
+    test->num_options = 0;
+    while (*value)
+    {
+      size_t len = strcspn(value, "|");
+      if (len > OS_MAX_OPTIONS_LEN || test->num_options >= OS_MAX_ALTERNATIVES)
+        return false;
+      if (len == 1 && value[0] == '-') // "-" stands for no options at all
+        len = 0;
+      memcpy(test->options[test->num_options], value, len);
+      test->options[test->num_options][len] = '\0';
+      test->num_options++;
+      value += strcspn(value, "|");
+      if (*value == '|')
+        value++;
+    }
+    return test->num_options > 0;
+  }
+  return true; // Unknown keys are ignored so newer files still load
+}
+
+static void init_signature(os_signature_t *signature)
+{
+  memset(signature, 0, sizeof(*signature));
+  for (int i = 0; i < OS_PROBE_COUNT; i++)
+  {
+    signature->tests[i].responds = -1;
+    signature->tests[i].df = -1;
+  }
+}
+
+static uint32_t bucket_hash(uint8_t ttl, const char *options)
+{
+  uint32_t hash = 2166136261u ^ ttl;
+  hash *= 16777619u;
+  for (const char *p = options; *p; p++)
+  {
+    hash ^= (unsigned char)*p;
+    hash *= 16777619u;
+  }
+  return hash ? hash : 1; // 0 marks an empty slot
+}
+
+// Find the bucket for a key; returns an empty slot if the key is absent
+static os_bucket_t *find_bucket(uint8_t ttl, const char *options)
+{
+  uint32_t hash = bucket_hash(ttl, options);
+  for (size_t i = hash & (num_buckets - 1);; i = (i + 1) & (num_buckets - 1))
+  {
+    os_bucket_t *bucket = &buckets[i];
+    if (bucket->hash == 0 ||
+        (bucket->hash == hash && bucket->ttl == ttl && strcmp(bucket->options, options) == 0))
+    {
+      return bucket;
+    }
+  }
+}
+
+static bool append_member(int **members, int *count, int *capacity, int signature)
+{
+  if (*count == *capacity)
+  {
+    int new_capacity = *capacity ? *capacity * 2 : 8;
+    int *grown = realloc(*members, (size_t)new_capacity * sizeof(int));
+    if (!grown)
+      return false;
+    *members = grown;
+    *capacity = new_capacity;
+  }
+  (*members)[(*count)++] = signature;
+  return true;
+}
+
+// Index the signatures by initial TTL and SYN option layout
+static bool build_index(void)
+{
+  // Every TTL/layout combination of every signature may need its own bucket
+  size_t keys = 0;
+  for (int i = 0; i < num_signatures; i++)
+  {
+    const os_test_t *syn = &signatures[i].tests[OS_PROBE_SYN];
+    keys += (size_t)syn->ttl.count * (size_t)syn->num_options;
+  }
+  num_buckets = 16;
+  while (num_buckets < keys * 2)
+    num_buckets *= 2;
+
+  buckets = calloc(num_buckets, sizeof(os_bucket_t));
+  if (!buckets)
+    return false;
+
+  int unindexed_capacity = 0;
+  for (int i = 0; i < num_signatures; i++)
+  {
+    const os_test_t *syn = &signatures[i].tests[OS_PROBE_SYN];
+    if (syn->ttl.count == 0 || syn->num_options == 0 || syn->responds == 0)
+    {
+      if (!append_member(&unindexed, &num_unindexed, &unindexed_capacity, i))
+        return false;
+      continue;
+    }
+
+    for (int t = 0; t < syn->ttl.count; t++)
+    {
+      for (int o = 0; o < syn->num_options; o++)
+      {
+        uint8_t ttl = (uint8_t)syn->ttl.values[t];
+        os_bucket_t *bucket = find_bucket(ttl, syn->options[o]);
+        if (bucket->hash == 0)
+        {
+          bucket->hash = bucket_hash(ttl, syn->options[o]);
+          bucket->ttl = ttl;
+          strcpy(bucket->options, syn->options[o]);
+        }
+        if (!append_member(&bucket->members, &bucket->count, &bucket->capacity, i))
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Parses the signature database from a buffer
+ *
+ * @param buffer File contents (modified in place)
+ * @param path File name for warnings
+ * @return Number of signatures loaded
+ */
+static int parse_os_db(char *buffer, const char *path)
+{
+  int capacity = 0;
+  os_signature_t *current = NULL;
+  int line_number = 0;
+  char *line = buffer;
+
+  while (line && *line)
+  {
+    char *next = strchr(line, '\n');
+    if (next)
+      *next++ = '\0';
+    line_number++;
+
+    // Strip trailing CR and leading whitespace
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r')
+      line[len - 1] = '\0';
+    while (isspace((unsigned char)*line))
+      line++;
+
+    if (*line == '\0' || *line == '#')
+    {
+      line = next;
+      continue;
+    }
+
+    if (strncmp(line, "Fingerprint ", 12) == 0)
+    {
+      current = NULL;
+      if (num_signatures == capacity)
+      {
+        if (capacity >= OS_MAX_SIGNATURES)
+          break;
+        capacity = capacity ? capacity * 2 : 64;
+        os_signature_t *grown = realloc(signatures, (size_t)capacity * sizeof(os_signature_t));
+        if (!grown)
+          break;
+        signatures = grown;
+      }
+      current = &signatures[num_signatures++];
+      init_signature(current);
+      strncpy(current->name, line + 12, sizeof(current->name) - 1);
+    }
+    else if (current && strncmp(line, "Class ", 6) == 0)
+    {
+      strncpy(current->os_class, line + 6, sizeof(current->os_class) - 1);
+    }
+    else if (current)
+    {
+      // "<PROBE> key=value key=value ..."
+      char *token = strtok(line, " \t");
+      int probe = 0;
+      while (probe < OS_PROBE_COUNT && strcmp(token, PROBE_NAMES[probe]) != 0)
+        probe++;
+
+      if (probe == OS_PROBE_COUNT)
+      {
+        fprintf(stderr, "Warning: %s:%d: unknown probe %s\n", path, line_number, token);
+      }
+      else
+      {
+        while ((token = strtok(NULL, " \t")) != NULL)
+        {
+          char *equals = strchr(token, '=');
+          if (!equals)
+            continue;
+          *equals = '\0';
+          if (!parse_test_field(token, equals + 1, &current->tests[probe]))
+            fprintf(stderr, "Warning: %s:%d: bad value for %s\n", path, line_number, token);
+        }
+      }
+    }
+
+    line = next;
+  }
+
+  return num_signatures;
+}
+
+bool load_os_db(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size <= 0)
+  {
+    fclose(file);
+    return false;
+  }
+
+  char *buffer = malloc((size_t)size + 1);
+  if (!buffer)
+  {
+    fclose(file);
+    return false;
+  }
+
+  size_t read = fread(buffer, 1, (size_t)size, file);
+  fclose(file);
+  buffer[read] = '\0';
+
+  free_os_db();
+  int loaded = parse_os_db(buffer, path);
+  free(buffer);
+
+  if (loaded == 0 || !build_index())
+  {
+    free_os_db();
+    return false;
+  }
+  return true;
+}
+
+void free_os_db(void)
+{
+  for (size_t i = 0; i < num_buckets; i++)
+    free(buckets[i].members);
+  free(buckets);
+  free(unindexed);
+  free(signatures);
+  buckets = NULL;
+  num_buckets = 0;
+  unindexed = NULL;
+  num_unindexed = 0;
+  signatures = NULL;
+  num_signatures = 0;
+}
+
+// Score one probe's response; adds the weights of the checked fields to possible
+static int score_test(const os_test_t *test, const os_response_t *response, int *possible)
+{
+  int got = 0;
+
+  if (test->responds >= 0)
+  {
+    *possible += WEIGHT_RESPONDED;
+    if (test->responds == (int)response->responded)
+      got += WEIGHT_RESPONDED;
+    else
+      return got; // The remaining fields describe a response that is not there
+  }
+  if (!response->responded)
+    return got;
+
+  if (test->ttl.count > 0)
+  {
+    *possible += WEIGHT_TTL;
+    if (set_contains(&test->ttl, initial_ttl(response->ttl)))
+      got += WEIGHT_TTL;
+  }
+  if (test->df >= 0)
+  {
+    *possible += WEIGHT_DF;
+    if (test->df == (int)response->df)
+      got += WEIGHT_DF;
+  }
+  if (test->window.count > 0)
+  {
+    *possible += WEIGHT_WINDOW;
+    if (set_contains(&test->window, response->window))
+      got += WEIGHT_WINDOW;
+  }
+  if (test->num_options > 0)
+  {
+    *possible += WEIGHT_OPTIONS;
+    for (int i = 0; i < test->num_options; i++)
+    {
+      if (strcmp(test->options[i], response->options) == 0)
+      {
+        got += WEIGHT_OPTIONS;
+        break;
+      }
+    }
+  }
+  if (test->wscale.count > 0)
+  {
+    *possible += WEIGHT_WSCALE;
+    if (response->wscale >= 0 && set_contains(&test->wscale, (unsigned)response->wscale))
+      got += WEIGHT_WSCALE;
+  }
+  if (test->mss.count > 0)
+  {
+    *possible += WEIGHT_MSS;
+    if (set_contains(&test->mss, response->mss))
+      got += WEIGHT_MSS;
+  }
+  if (test->flags.count > 0)
+  {
+    *possible += WEIGHT_FLAGS;
+    if (set_contains(&test->flags, response->flags))
+      got += WEIGHT_FLAGS;
+  }
+  return got;
+}
+
+// Match quality of one signature, 0-100
+static int score_signature(const os_signature_t *signature, const os_fingerprint_t *fingerprint)
+{
+  int got = 0;
+  int possible = 0;
+  for (int i = 0; i < OS_PROBE_COUNT; i++)
+    got += score_test(&signature->tests[i], &fingerprint->responses[i], &possible);
+  return possible ? got * 100 / possible : 0;
+}
+
+// Score a list of signatures, keeping the best one and the best of another class
+static void score_candidates(const int *candidates, int count, const os_fingerprint_t *fingerprint,
+                             os_match_t *match)
+{
+  for (int i = 0; i < count; i++)
+  {
+    const os_signature_t *signature = &signatures[candidates ? candidates[i] : i];
+    int score = score_signature(signature, fingerprint);
+    if (score > match->score)
+    {
+      if (match->name && strcmp(match->os_class, signature->os_class) != 0)
+        match->runner_up = match->score;
+      match->name = signature->name;
+      match->os_class = signature->os_class;
+      match->score = score;
+    }
+    else if (score > match->runner_up && strcmp(match->os_class, signature->os_class) != 0)
+    {
+      match->runner_up = score;
+    }
+  }
+}
+
+bool os_match_fingerprint(const os_fingerprint_t *fingerprint, os_match_t *match)
+{
+  memset(match, 0, sizeof(*match));
+  match->os_class = "";
+
+  // Fast path: only the signatures that share the SYN response's TTL and option layout
+  const os_response_t *syn = &fingerprint->responses[OS_PROBE_SYN];
+  if (syn->responded && num_buckets > 0)
+  {
+    const os_bucket_t *bucket = find_bucket(initial_ttl(syn->ttl), syn->options);
+    if (bucket->hash != 0)
+      score_candidates(bucket->members, bucket->count, fingerprint, match);
+    score_candidates(unindexed, num_unindexed, fingerprint, match);
+  }
+
+  // Nothing close among the indexed candidates (or no SYN response): score everything
+  if (match->score < OS_MATCH_THRESHOLD)
+  {
+    memset(match, 0, sizeof(*match));
+    match->os_class = "";
+    score_candidates(NULL, num_signatures, fingerprint, match);
+  }
+
+  return match->score > 0;
+}
+
+static void put_u16(unsigned char *out, unsigned value)
+{
+  out[0] = (unsigned char)(value >> 8);
+  out[1] = (unsigned char)value;
+}
+
+static void put_u32(unsigned char *out, uint32_t value)
+{
+  out[0] = (unsigned char)(value >> 24);
+  out[1] = (unsigned char)(value >> 16);
+  out[2] = (unsigned char)(value >> 8);
+  out[3] = (unsigned char)value;
+}
+
+void os_random_seed(uint64_t *state)
+{
+  // The call count keeps seeds apart within one second; splitmix64 spreads them out
+  static atomic_uint_fast64_t calls;
+  uint64_t z = (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)state ^
+               (atomic_fetch_add(&calls, 1) + 1) * 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z ^= z >> 31;
+  *state = z ? z : 0x9E3779B97F4A7C15ull;
+}
+
+uint32_t os_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return (uint32_t)(x >> 32);
+}
+
+size_t os_build_tcp_probe(unsigned char *segment, uint32_t saddr, uint32_t daddr, uint16_t sport,
+                          uint16_t dport, uint8_t flags, bool options, uint64_t *rng)
+{
+  // Pseudo header followed by the segment, so the checksum covers both in one pass
+  uint16_t words[(12 + OS_MAX_PROBE_LEN) / 2];
+  unsigned char *buffer = (unsigned char *)words;
+  unsigned char *tcp = buffer + 12;
+  size_t len = options ? 40 : 20;
+
+  memset(buffer, 0, sizeof(words));
+  memcpy(buffer, &saddr, 4);
+  memcpy(buffer + 4, &daddr, 4);
+  buffer[9] = 6; // IPPROTO_TCP
+  put_u16(buffer + 10, (unsigned)len);
+
+  put_u16(tcp, sport);
+  put_u16(tcp + 2, dport);
+  put_u32(tcp + 4, os_random(rng));
+  put_u32(tcp + 8, flags & TCP_ACK ? os_random(rng) : 0);
+  tcp[12] = (unsigned char)((len / 4) << 4);
+  tcp[13] = flags;
+  put_u16(tcp + 14, options ? 1 : 1024);
+
+  if (options)
+  {
+    // Window scale 10, NOP, MSS 1460, timestamp, SACK permitted
+    static const unsigned char SYN_OPTIONS[20] = {3, 3, 10, 1, 2, 4, 0x05, 0xB4, 8, 10,
+                                                  0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 4, 2};
+    memcpy(tcp + 20, SYN_OPTIONS, sizeof(SYN_OPTIONS));
+  }
+
+  unsigned short check = tcp_checksum(words, (int)(12 + len));
+  memcpy(tcp + 16, &check, 2);
+  memcpy(segment, tcp, len);
+  return len;
+}
+
+// Parse the TCP options of a response into a layout string plus MSS and window scale
+static void parse_tcp_options(const unsigned char *options, size_t len, os_response_t *response)
+{
+  size_t n = 0;
+  response->mss = 0;
+  response->wscale = -1;
+
+  for (size_t i = 0; i < len && n < OS_MAX_OPTIONS_LEN;)
+  {
+    unsigned char kind = options[i];
+    if (kind == 0)
+    {
+      response->options[n++] = 'E';
+      break;
+    }
+    if (kind == 1)
+    {
+      response->options[n++] = 'N';
+      i++;
+      continue;
+    }
+    if (i + 1 >= len || options[i + 1] < 2 || i + options[i + 1] > len)
+      break;
+
+    unsigned char size = options[i + 1];
+    switch (kind)
+    {
+    case 2:
+      response->options[n++] = 'M';
+      if (size == 4)
+        response->mss = (uint16_t)(options[i + 2] << 8 | options[i + 3]);
+      break;
+    case 3:
+      response->options[n++] = 'W';
+      if (size == 3)
+        response->wscale = options[i + 2];
+      break;
+    case 4:
+      response->options[n++] = 'S';
+      break;
+    case 8:
+      response->options[n++] = 'T';
+      break;
+    default:
+      response->options[n++] = '?';
+      break;
+    }
+    i += size;
+  }
+  response->options[n] = '\0';
+}
+
+bool os_parse_tcp_response(const unsigned char *packet, size_t len, os_response_t *response)
+{
+  size_t ihl = (size_t)(packet[0] & 0x0F) * 4;
+  if (len < ihl + 20 || packet[9] != 6)
+    return false;
+
+  const unsigned char *tcp = packet + ihl;
+  size_t doff = (size_t)(tcp[12] >> 4) * 4;
+  response->responded = true;
+  response->ttl = packet[8];
+  response->df = (packet[6] & 0x40) != 0;
+  response->flags = tcp[13] & 0x3F;
+  response->window = (uint16_t)(tcp[14] << 8 | tcp[15]);
+  if (doff >= 20 && ihl + doff <= len)
+  {
+    parse_tcp_options(tcp + 20, doff - 20, response);
+  }
+  else
+  {
+    response->options[0] = '\0';
+    response->mss = 0;
+    response->wscale = -1;
+  }
+  return true;
+}
+
+#ifndef _WIN32
+
+uint32_t os_source_address(uint32_t target)
+{
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0)
+    return 0;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = target;
+  addr.sin_port = htons(9);
+
+  socklen_t len = sizeof(addr);
+  uint32_t source = 0;
+  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+      getsockname(sock, (struct sockaddr *)&addr, &len) == 0)
+  {
+    source = addr.sin_addr.s_addr;
+  }
+  close(sock);
+  return source;
+}
+
+// Probe batch state shared by the send and receive halves
+typedef struct
+{
+  const os_target_t *targets;
+  int count;
+  os_fingerprint_t *fingerprints;
+  uint32_t *sources;   // Local address per target
+  uint16_t base_port;  // Source port of probe p to target t is base_port + t * OS_PROBE_COUNT + p
+  uint16_t icmp_id;    // Identifier of our echo requests
+  uint64_t rng;        // Sequence and acknowledgment numbers of the batch's probes
+} os_batch_t;
+
+static int probe_dest_port(const os_target_t *target, int probe)
+{
+  return probe == OS_PROBE_CLOSED ? target->closed_port : target->open_port;
+}
+
+// Whether a probe can be sent to a target at all
+static bool probe_applies(const os_target_t *target, int probe)
+{
+  return probe == OS_PROBE_ICMP || probe_dest_port(target, probe) > 0;
+}
+
+static void send_probe(os_batch_t *batch, int tcp_sock, int icmp_sock, int t, int probe)
+{
+  const os_target_t *target = &batch->targets[t];
+  struct sockaddr_in dest;
+  memset(&dest, 0, sizeof(dest));
+  dest.sin_family = AF_INET;
+  dest.sin_addr.s_addr = target->addr;
+
+  if (probe == OS_PROBE_ICMP)
+  {
+    uint16_t words[64 / 2];
+    unsigned char *icmp = (unsigned char *)words;
+    memset(words, 0, sizeof(words));
+    icmp[0] = 8; // Echo request
+    put_u16(icmp + 4, batch->icmp_id);
+    put_u16(icmp + 6, (unsigned)t);
+    for (size_t i = 8; i < sizeof(words); i++)
+      icmp[i] = (unsigned char)i;
+    unsigned short check = ip_checksum(words, (int)sizeof(words));
+    memcpy(icmp + 2, &check, 2);
+    sendto(icmp_sock, (const char *)icmp, sizeof(words), 0, (struct sockaddr *)&dest,
+           sizeof(dest));
+    return;
+  }
+
+  static const uint8_t FLAGS[OS_PROBE_COUNT] = {TCP_SYN, TCP_SYN, TCP_ACK, TCP_SYN, 0};
+  unsigned char segment[OS_MAX_PROBE_LEN];
+  uint16_t sport = (uint16_t)(batch->base_port + t * OS_PROBE_COUNT + probe);
+  size_t len = os_build_tcp_probe(segment, batch->sources[t], target->addr, sport,
+                               (uint16_t)probe_dest_port(target, probe), FLAGS[probe],
+                               probe == OS_PROBE_SYN, &batch->rng);
+  sendto(tcp_sock, (const char *)segment, len, 0, (struct sockaddr *)&dest, sizeof(dest));
+}
+
+// Record a TCP response if it answers one of our probes; returns true if it was new
+static bool receive_tcp(const os_batch_t *batch, const unsigned char *packet, size_t len)
+{
+  size_t ihl = (size_t)(packet[0] & 0x0F) * 4;
+  if (len < ihl + 20 || packet[9] != 6)
+    return false;
+
+  const unsigned char *tcp = packet + ihl;
+  int sport = tcp[0] << 8 | tcp[1];
+  int dport = tcp[2] << 8 | tcp[3];
+  int slot = dport - batch->base_port;
+  if (slot < 0 || slot >= batch->count * OS_PROBE_COUNT)
+    return false;
+
+  int t = slot / OS_PROBE_COUNT;
+  int probe = slot % OS_PROBE_COUNT;
+  const os_target_t *target = &batch->targets[t];
+  uint32_t saddr;
+  memcpy(&saddr, packet + 12, 4);
+  if (probe == OS_PROBE_ICMP || saddr != target->addr || sport != probe_dest_port(target, probe))
+    return false;
+
+  os_response_t *response = &batch->fingerprints[t].responses[probe];
+  if (response->responded)
+    return false;
+
+  os_parse_tcp_response(packet, len, response);
+  return true;
+}
+
+// Record an ICMP echo reply if it answers one of our requests; returns true if it was new
+static bool receive_icmp(const os_batch_t *batch, const unsigned char *packet, size_t len)
+{
+  size_t ihl = (size_t)(packet[0] & 0x0F) * 4;
+  if (len < ihl + 8 || packet[9] != 1)
+    return false;
+
+  const unsigned char *icmp = packet + ihl;
+  int id = icmp[4] << 8 | icmp[5];
+  int t = icmp[6] << 8 | icmp[7];
+  if (icmp[0] != 0 || id != batch->icmp_id || t >= batch->count)
+    return false;
+
+  uint32_t saddr;
+  memcpy(&saddr, packet + 12, 4);
+  os_response_t *response = &batch->fingerprints[t].responses[OS_PROBE_ICMP];
+  if (saddr != batch->targets[t].addr || response->responded)
+    return false;
+
+  response->responded = true;
+  response->ttl = packet[8];
+  response->df = (packet[6] & 0x40) != 0;
+  response->wscale = -1;
+  return true;
+}
+
+bool os_probe_hosts(const os_target_t *targets, int count, os_fingerprint_t *fingerprints)
+{
+  if (count <= 0 || count > OS_MAX_BATCH)
+    return false;
+
+  int tcp_sock = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+  int icmp_sock = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+  uint32_t *sources = calloc((size_t)count, sizeof(uint32_t));
+  if (tcp_sock < 0 || icmp_sock < 0 || !sources)
+  {
+    if (tcp_sock >= 0)
+      close(tcp_sock);
+    if (icmp_sock >= 0)
+      close(icmp_sock);
+    free(sources);
+    return false;
+  }
+
+  // A state of our own: rand() is shared by the whole process and not safe across threads
+  os_batch_t batch = {targets, count, fingerprints, sources, 0, 0, 0};
+  os_random_seed(&batch.rng);
+  batch.base_port =
+      (uint16_t)(32768 + os_random(&batch.rng) % (65535 - 32768 - OS_MAX_BATCH * OS_PROBE_COUNT));
+  batch.icmp_id = (uint16_t)os_random(&batch.rng);
+
+  int outstanding = 0;
+  for (int t = 0; t < count; t++)
+  {
+    memset(&fingerprints[t], 0, sizeof(os_fingerprint_t));
+    sources[t] = os_source_address(targets[t].addr);
+    for (int p = 0; p < OS_PROBE_COUNT; p++)
+    {
+      fingerprints[t].responses[p].wscale = -1;
+      if (probe_applies(&targets[t], p))
+        outstanding++;
+    }
+  }
+
+  // Each try resends whatever is still unanswered, then listens for its share of the timeout
+  long slice = OS_DETECTION_TIMEOUT / OS_DETECTION_TRIES;
+  for (int attempt = 0; attempt < OS_DETECTION_TRIES && outstanding > 0; attempt++)
+  {
+    for (int t = 0; t < count; t++)
+    {
+      for (int p = 0; p < OS_PROBE_COUNT; p++)
+      {
+        if (probe_applies(&targets[t], p) && !fingerprints[t].responses[p].responded)
+          send_probe(&batch, tcp_sock, icmp_sock, t, p);
+      }
+    }
+
+    long deadline = get_timestamp() + slice;
+    long now;
+    while (outstanding > 0 && (now = get_timestamp()) < deadline)
+    {
+      fd_set read_fds;
+      FD_ZERO(&read_fds);
+      FD_SET(tcp_sock, &read_fds);
+      FD_SET(icmp_sock, &read_fds);
+      struct timeval tv = {(deadline - now) / 1000, ((deadline - now) % 1000) * 1000};
+      int max_fd = tcp_sock > icmp_sock ? tcp_sock : icmp_sock;
+      if (select(max_fd + 1, &read_fds, NULL, NULL, &tv) <= 0)
+        break;
+
+      unsigned char packet[1500];
+      if (FD_ISSET(tcp_sock, &read_fds))
+      {
+        ssize_t len = recv(tcp_sock, packet, sizeof(packet), 0);
+        if (len > 0 && receive_tcp(&batch, packet, (size_t)len))
+          outstanding--;
+      }
+      if (FD_ISSET(icmp_sock, &read_fds))
+      {
+        ssize_t len = recv(icmp_sock, packet, sizeof(packet), 0);
+        if (len > 0 && receive_icmp(&batch, packet, (size_t)len))
+          outstanding--;
+      }
+    }
+  }
+
+  close(tcp_sock);
+  close(icmp_sock);
+  free(sources);
+  return true;
+}
+
+#else
+
+bool os_probe_hosts(const os_target_t *targets, int count, os_fingerprint_t *fingerprints)
+{
+  // Windows does not allow TCP over raw sockets
+  (void)targets;
+  (void)count;
+  (void)fingerprints;
+  return false;
+}
+
+#endif
+
+// Choose a port that the scan did not find open, for the closed-port probe
+static int pick_closed_port(const int *open_ports, int num_open_ports)
+{
+  uint64_t rng;
+  os_random_seed(&rng);
+  for (int port = 40000 + (int)(os_random(&rng) % 20000);; port = port % 65535 + 1)
+  {
+    bool open = false;
+    for (int i = 0; i < num_open_ports && !open; i++)
+      open = open_ports[i] == port;
+    if (!open)
+      return port;
+  }
+}
+
+bool detect_os(const char *target, char *os_info, size_t os_info_size)
+{
+  if (num_signatures == 0 && !load_os_db(OS_DB_FILE))
+  {
+    snprintf(os_info, os_info_size, "OS signature database %s could not be loaded", OS_DB_FILE);
+    return false;
+  }
+
+  os_target_t host;
+  memset(&host, 0, sizeof(host));
+  struct hostent *he = gethostbyname(target);
+  if (he != NULL)
+    memcpy(&host.addr, he->h_addr_list[0], 4);
+  else
+    host.addr = inet_addr(target);
+
+  int num_open_ports = get_num_open_ports();
+  const int *open_ports = get_open_ports();
+  if (!open_ports)
+    num_open_ports = 0;
+  host.open_port = num_open_ports > 0 ? open_ports[0] : 0;
+  host.closed_port = pick_closed_port(open_ports, num_open_ports);
+
+  os_fingerprint_t fingerprint;
+  if (!os_probe_hosts(&host, 1, &fingerprint))
+  {
+    snprintf(os_info, os_info_size, "OS detection needs raw socket privileges (run as root)");
+    return false;
+  }
+
+  os_match_t match;
+  if (!os_match_fingerprint(&fingerprint, &match))
+  {
+    snprintf(os_info, os_info_size, "No OS matches for host (no usable responses)");
+    return false;
+  }
+
+  const os_response_t *syn = &fingerprint.responses[OS_PROBE_SYN];
+  char details[96] = "";
+  if (syn->responded)
+  {
+    snprintf(details, sizeof(details), "\nSYN-ACK: ttl=%u win=%u ops=%s%s", syn->ttl,
+             syn->window, syn->options[0] ? syn->options : "-", syn->df ? " df" : "");
+  }
+
+  if (match.score >= OS_MATCH_THRESHOLD)
+  {
+    snprintf(os_info, os_info_size, "Running: %s\nOS details: %s (%d%% match)%s%s",
+             match.os_class, match.name, match.score,
+             host.open_port ? "" : "\nWarning: no open port found, results may be unreliable",
+             details);
+  }
+  else
+  {
+    snprintf(os_info, os_info_size, "No exact OS matches; closest: %s (%d%%)%s", match.name,
+             match.score, details);
+  }
+  return true;
+}
@@ -0,0 +1,138 @@
+/**
+ * Neptune Scanner - Passive OS Inference
+ * passive_os.c - Per-host SYN-ACK records and guesses from them
+ */
+
+#include "../include/passive_os.h"
+#include "../include/config.h"
+#include <pthread.h>
+#include <string.h>
+
+// SYN-ACK seen from one host
+typedef struct
+{
+  uint32_t addr;          // Host address (0 = empty slot)
+  os_response_t syn_ack;  // First SYN-ACK received
+  bool inconsistent;      // A later SYN-ACK came from a different-looking stack
+} passive_host_t;
+
+// Open-addressing table of hosts, keyed by address
+static passive_host_t hosts[PASSIVE_OS_MAX_HOSTS];
+static int num_hosts = 0;
+static pthread_mutex_t hosts_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Slot where the probe sequence of an address starts
+static uint32_t home_slot(uint32_t addr)
+{
+  return (addr * 2654435761u) % PASSIVE_OS_MAX_HOSTS;
+}
+
+// Find the slot for an address, or the empty slot where it belongs; NULL if the table is full
+static passive_host_t *find_host(uint32_t addr)
+{
+  uint32_t hash = home_slot(addr);
+  for (int probe = 0; probe < PASSIVE_OS_MAX_HOSTS; probe++)
+  {
+    passive_host_t *host = &hosts[(hash + (uint32_t)probe) % PASSIVE_OS_MAX_HOSTS];
+    if (host->addr == addr || host->addr == 0)
+      return host;
+  }
+  return NULL;
+}
+
+// Whether two SYN-ACKs came from the same kind of stack
+static bool same_stack(const os_response_t *a, const os_response_t *b)
+{
+  return a->ttl == b->ttl && a->df == b->df && a->window == b->window &&
+         a->wscale == b->wscale && strcmp(a->options, b->options) == 0;
+}
+
+void passive_os_record(uint32_t addr, const os_response_t *syn_ack)
+{
+  if (addr == 0)
+    return;
+
+  pthread_mutex_lock(&hosts_mutex);
+  passive_host_t *host = find_host(addr);
+  if (host && host->addr == 0)
+  {
+    // Keep one slot free so lookups of unknown hosts always terminate
+    if (num_hosts < PASSIVE_OS_MAX_HOSTS - 1)
+    {
+      host->addr = addr;
+      host->syn_ack = *syn_ack;
+      host->inconsistent = false;
+      num_hosts++;
+    }
+  }
+  else if (host && !same_stack(&host->syn_ack, syn_ack))
+  {
+    host->inconsistent = true;
+  }
+  pthread_mutex_unlock(&hosts_mutex);
+}
+
+bool passive_os_guess(uint32_t addr, os_match_t *match, os_response_t *syn_ack)
+{
+  os_fingerprint_t fingerprint;
+  memset(&fingerprint, 0, sizeof(fingerprint));
+
+  pthread_mutex_lock(&hosts_mutex);
+  passive_host_t *host = addr ? find_host(addr) : NULL;
+  bool found = host && host->addr == addr;
+  if (found)
+    fingerprint.responses[OS_PROBE_SYN] = host->syn_ack;
+  pthread_mutex_unlock(&hosts_mutex);
+
+  if (!found)
+    return false;
+  if (syn_ack)
+    *syn_ack = fingerprint.responses[OS_PROBE_SYN];
+
+  // Only the SYN response is present, so only the signatures' SYN lines are scored
+  return os_match_fingerprint(&fingerprint, match);
+}
+
+bool passive_os_ambiguous(uint32_t addr, const os_match_t *match)
+{
+  pthread_mutex_lock(&hosts_mutex);
+  passive_host_t *host = addr ? find_host(addr) : NULL;
+  bool inconsistent = host && host->addr == addr && host->inconsistent;
+  pthread_mutex_unlock(&hosts_mutex);
+
+  return inconsistent || match->score < OS_MATCH_THRESHOLD ||
+         match->score - match->runner_up < PASSIVE_OS_MARGIN;
+}
+
+void passive_os_forget(uint32_t addr)
+{
+  pthread_mutex_lock(&hosts_mutex);
+  passive_host_t *host = addr ? find_host(addr) : NULL;
+  if (host && host->addr == addr)
+  {
+    // Shift later hosts of the probe run back into the hole, so that no lookup stops short
+    uint32_t hole = (uint32_t)(host - hosts);
+    for (uint32_t next = (hole + 1) % PASSIVE_OS_MAX_HOSTS; hosts[next].addr;
+         next = (next + 1) % PASSIVE_OS_MAX_HOSTS)
+    {
+      uint32_t home = home_slot(hosts[next].addr);
+      bool movable = hole < next ? home <= hole || home > next : home <= hole && home > next;
+      if (movable)
+      {
+        hosts[hole] = hosts[next];
+        hole = next;
+      }
+    }
+    memset(&hosts[hole], 0, sizeof(hosts[hole]));
+    num_hosts--;
+  }
+  pthread_mutex_unlock(&hosts_mutex);
+}
+
+void passive_os_reset(void)
+{
+  pthread_mutex_lock(&hosts_mutex);
+  memset(hosts, 0, sizeof(hosts));
+  num_hosts = 0;
+  pthread_mutex_unlock(&hosts_mutex);
+}
@@ -0,0 +1,189 @@
+/**
+ * Neptune Scanner - Port Specifications
+ * port_spec.c - Port spec parser and port bitmap operations
+ */
+
+#include "../include/port_spec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void port_bitmap_clear(port_bitmap_t *bitmap)
+{
+  memset(bitmap, 0, sizeof(*bitmap));
+}
+
+void port_bitmap_set_range(port_bitmap_t *bitmap, int first, int last)
+{
+  // Partial words at the ends, whole words in between
+  int first_word = first >> 6;
+  int last_word = last >> 6;
+  uint64_t head = ~0ull << (first & 63);
+  uint64_t tail = ~0ull >> (63 - (last & 63));
+  if (first_word == last_word)
+  {
+    bitmap->bits[first_word] |= head & tail;
+    return;
+  }
+  bitmap->bits[first_word] |= head;
+  for (int word = first_word + 1; word < last_word; word++)
+    bitmap->bits[word] = ~0ull;
+  bitmap->bits[last_word] |= tail;
+}
+
+int port_bitmap_count(const port_bitmap_t *bitmap)
+{
+  int count = 0;
+  for (int word = 0; word < PORT_BITMAP_WORDS; word++)
+    count += __builtin_popcountll(bitmap->bits[word]);
+  return count;
+}
+
+int port_bitmap_to_list(const port_bitmap_t *bitmap, int *ports, int max)
+{
+  int count = 0;
+  for (int port = port_bitmap_next(bitmap, 0); port >= 0 && count < max;
+       port = port_bitmap_next(bitmap, port + 1))
+    ports[count++] = port;
+  return count;
+}
+
+void port_bitmap_format(const port_bitmap_t *bitmap, char *buffer, size_t size)
+{
+  size_t len = 0;
+  buffer[0] = '\0';
+  for (int port = port_bitmap_next(bitmap, 0); port >= 0;)
+  {
+    int last = port;
+    while (last < 65535 && port_bitmap_test(bitmap, last + 1))
+      last++;
+
+    char item[16];
+    const char *comma = len ? "," : "";
+    int item_len = last > port ? snprintf(item, sizeof(item), "%s%d-%d", comma, port, last)
+                               : snprintf(item, sizeof(item), "%s%d", comma, port);
+    if (len + (size_t)item_len + 4 > size)
+    {
+      if (len + 4 <= size)
+        strcpy(buffer + len, "...");
+      return;
+    }
+    memcpy(buffer + len, item, (size_t)item_len + 1);
+    len += (size_t)item_len;
+    port = last < 65535 ? port_bitmap_next(bitmap, last + 1) : -1;
+  }
+}
+
+// Parse a port number at *p (0-65535), advancing past it
+static bool parse_port(const char **p, long *port)
+{
+  char *end;
+  if (**p < '0' || **p > '9')
+    return false;
+  *port = strtol(*p, &end, 10);
+  *p = end;
+  return *port <= 65535;
+}
+
+bool port_spec_parse(const char *text, port_spec_t *spec, char *error, size_t error_size)
+{
+  port_spec_t *excluded = calloc(1, sizeof(port_spec_t));
+  if (!excluded)
+  {
+    snprintf(error, error_size, "out of memory");
+    return false;
+  }
+  memset(spec, 0, sizeof(*spec));
+
+  bool udp = false;
+  bool excluding = false;
+  const char *p = text;
+  bool ok = *p != '\0';
+  while (ok && *p)
+  {
+    const char *item = p;
+    if (*p == '[')
+    {
+      ok = !excluding;
+      excluding = true;
+      p++;
+    }
+
+    // A protocol prefix applies to this item and the ones after it
+    if ((p[0] == 'T' || p[0] == 't' || p[0] == 'U' || p[0] == 'u') && p[1] == ':')
+    {
+      udp = p[0] == 'U' || p[0] == 'u';
+      p += 2;
+    }
+    bool exclude_item = excluding;
+
+    long first = 1, last = 65535;
+    if (*p == '-')
+    {
+      p++;
+      if (*p >= '0' && *p <= '9')
+        ok = ok && parse_port(&p, &last);
+    }
+    else
+    {
+      ok = ok && parse_port(&p, &first);
+      last = first;
+      if (ok && *p == '-')
+      {
+        p++;
+        last = 65535;
+        if (*p >= '0' && *p <= '9')
+          ok = parse_port(&p, &last);
+      }
+    }
+
+    if (ok && *p == ']')
+    {
+      ok = excluding;
+      excluding = false;
+      p++;
+    }
+    ok = ok && first <= last && (*p == ',' || *p == '\0');
+    if (ok && *p == ',' && p[1] == '\0')
+    {
+      snprintf(error, error_size, "port spec ends with ','");
+      ok = false;
+      break;
+    }
+    if (!ok)
+    {
+      int item_len = (int)strcspn(item, ",");
+      snprintf(error, error_size, "invalid port spec item \"%.*s\"", item_len, item);
+      break;
+    }
+
+    port_spec_t *target = exclude_item ? excluded : spec;
+    port_bitmap_set_range(udp ? &target->udp : &target->tcp, (int)first, (int)last);
+    if (*p == ',')
+      p++;
+  }
+
+  if (ok && excluding)
+  {
+    snprintf(error, error_size, "unclosed '[' in port spec");
+    ok = false;
+  }
+  if (ok)
+  {
+    for (int word = 0; word < PORT_BITMAP_WORDS; word++)
+    {
+      spec->tcp.bits[word] &= ~excluded->tcp.bits[word];
+      spec->udp.bits[word] &= ~excluded->udp.bits[word];
+    }
+    if (port_bitmap_count(&spec->tcp) + port_bitmap_count(&spec->udp) == 0)
+    {
+      snprintf(error, error_size, "port spec selects no ports");
+      ok = false;
+    }
+  }
+  if (!ok && text[0] == '\0')
+    snprintf(error, error_size, "empty port spec");
+
+  free(excluded);
+  return ok;
+}
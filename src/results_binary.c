@@ -0,0 +1,100 @@
+/**
+ * Neptune Scanner - Binary Results
+ * results_binary.c - Writing binary results files
+ */
+
+#include "../include/results_binary.h"
+#include "../include/results_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void put_u16(FILE *file, uint32_t value)
+{
+  fputc(value & 0xFF, file);
+  fputc(value >> 8 & 0xFF, file);
+}
+
+static void put_u32(FILE *file, uint32_t value)
+{
+  put_u16(file, value & 0xFFFF);
+  put_u16(file, value >> 16);
+}
+
+bool results_binary_write(const char *path, const char *addr, int shard_index, int shard_count,
+                          const int *ports, const service_table_t *services, int count)
+{
+  unsigned a, b, c, d;
+  if (sscanf(addr, "%u.%u.%u.%u", &a, &b, &c, &d) != 4)
+    return false;
+
+  // Same order as the text results file
+  int unique;
+  result_ref_t *order = results_file_order(ports, count, &unique);
+  if (!order)
+    return false;
+
+  FILE *file = fopen(path, "wb");
+  if (!file)
+  {
+    free(order);
+    return false;
+  }
+
+  fwrite(RESULTS_BINARY_MAGIC, 1, 4, file);
+  put_u32(file, RESULTS_BINARY_VERSION);
+  put_u32(file, a << 24 | b << 16 | c << 8 | d);
+  put_u16(file, (uint32_t)shard_index);
+  put_u16(file, (uint32_t)shard_count);
+
+  // The table's IDs are written as they are, so tables are dumped in ID order
+  uint32_t num_strings = services && services->num_strings ? services->num_strings - 1 : 0;
+  put_u32(file, num_strings);
+  for (uint32_t id = 1; id <= num_strings; id++)
+  {
+    const char *text = service_table_string(services, id);
+    size_t len = strlen(text);
+    len = len > 0xFFFF ? 0xFFFF : len;
+    put_u16(file, (uint32_t)len);
+    fwrite(text, 1, len, file);
+  }
+
+  uint32_t num_banners = services && services->num_banners ? services->num_banners - 1 : 0;
+  put_u32(file, num_banners);
+  for (uint32_t id = 1; id <= num_banners; id++)
+  {
+    uint32_t len;
+    const char *banner = service_table_banner(services, id, &len);
+    put_u32(file, len);
+    fwrite(banner, 1, len, file);
+  }
+
+  put_u32(file, (uint32_t)unique);
+  for (int i = 0; i < unique; i++)
+  {
+    put_u16(file, (uint32_t)order[i].port);
+    if (!services)
+    {
+      put_u32(file, 0);
+      put_u32(file, 0);
+      put_u32(file, 0);
+      put_u16(file, 0);
+      continue;
+    }
+    const service_record_t *record = &services->records[order[i].index];
+    const char *version = service_table_text(services, record->version);
+    size_t len = strlen(version);
+    len = len > 0xFFFF ? 0xFFFF : len;
+    put_u32(file, record->service);
+    put_u32(file, record->protocol);
+    put_u32(file, record->banner);
+    put_u16(file, (uint32_t)len);
+    fwrite(version, 1, len, file);
+  }
+
+  bool ok = !ferror(file);
+  if (fclose(file) != 0)
+    ok = false;
+  free(order);
+  return ok;
+}
@@ -0,0 +1,131 @@
+/**
+ * Neptune Scanner - Results File
+ * results_file.c - Writing results files and reading their sort keys
+ */
+
+#include "../include/results_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// By port, then by position, so that the first of repeated ports is the one kept
+static int compare_ref(const void *a, const void *b)
+{
+  const result_ref_t *x = a, *y = b;
+  if (x->port != y->port)
+    return x->port - y->port;
+  return x->index - y->index;
+}
+
+result_ref_t *results_file_order(const int *ports, int count, int *unique)
+{
+  result_ref_t *order = malloc((size_t)(count > 0 ? count : 1) * sizeof(result_ref_t));
+  if (!order)
+    return NULL;
+  for (int i = 0; i < count; i++)
+    order[i] = (result_ref_t){ports[i], i};
+  qsort(order, (size_t)count, sizeof(result_ref_t), compare_ref);
+  *unique = 0;
+  for (int i = 0; i < count; i++)
+  {
+    if (*unique == 0 || order[i].port != order[*unique - 1].port)
+      order[(*unique)++] = order[i];
+  }
+  return order;
+}
+
+// Write a field with the characters that would break the line format replaced
+static void write_field(FILE *file, const char *text)
+{
+  for (const char *c = text; *c; c++)
+    fputc(*c == '\t' || *c == '\r' || *c == '\n' ? ' ' : *c, file);
+}
+
+bool results_file_write(const char *path, const char *addr, int shard_index, int shard_count,
+                        const int *ports, const service_table_t *services, int count)
+{
+  int unique;
+  result_ref_t *order = results_file_order(ports, count, &unique);
+  if (!order)
+    return false;
+
+  FILE *file = fopen(path, "w");
+  if (!file)
+  {
+    free(order);
+    return false;
+  }
+
+  fprintf(file, "%s\n", RESULTS_FILE_FORMAT);
+  if (shard_index > 0)
+    fprintf(file, "# shard %d/%d\n", shard_index, shard_count);
+  for (int i = 0; i < unique; i++)
+  {
+    int n = order[i].index;
+    fprintf(file, "%s\t%d\topen\t", addr, ports[n]);
+    if (services)
+    {
+      const service_record_t *record = &services->records[n];
+      write_field(file, service_table_string(services, record->service));
+      fputc('\t', file);
+      write_field(file, service_table_text(services, record->version));
+    }
+    else
+    {
+      fputc('\t', file);
+    }
+    fputc('\n', file);
+  }
+
+  bool ok = !ferror(file);
+  if (fclose(file) != 0)
+    ok = false;
+  free(order);
+  return ok;
+}
+
+static int compare_key(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+bool results_file_write_keys(const char *path, int shard_index, int shard_count, uint64_t *keys,
+                             size_t count)
+{
+  qsort(keys, count, sizeof(uint64_t), compare_key);
+
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return false;
+
+  fprintf(file, "%s\n", RESULTS_FILE_FORMAT);
+  if (shard_index > 0)
+    fprintf(file, "# shard %d/%d\n", shard_index, shard_count);
+  for (size_t i = 0; i < count; i++)
+  {
+    if (i > 0 && keys[i] == keys[i - 1])
+      continue;
+    uint32_t addr = (uint32_t)(keys[i] >> 16);
+    fprintf(file, "%u.%u.%u.%u\t%u\topen\t\t\n", addr >> 24, (addr >> 16) & 255, (addr >> 8) & 255,
+            addr & 255, (unsigned)(keys[i] & 0xFFFF));
+  }
+
+  bool ok = !ferror(file);
+  if (fclose(file) != 0)
+    ok = false;
+  return ok;
+}
+
+bool results_file_key(const char *line, uint64_t *key)
+{
+  unsigned a, b, c, d, port;
+  int len = 0;
+  if (line[0] == '#' ||
+      sscanf(line, "%u.%u.%u.%u\t%u%n", &a, &b, &c, &d, &port, &len) != 5 ||
+      a > 255 || b > 255 || c > 255 || d > 255 || port > 65535 || line[len] != '\t')
+    return false;
+
+  *key = (uint64_t)(a << 24 | b << 16 | c << 8 | d) << 16 | port;
+  return true;
+}
@@ -0,0 +1,525 @@
+/**
+ * Neptune Scanner - Live Scan Statistics
+ * scan_stats.c - Sharded counters, log-linear RTT histograms and the reporter thread
+ */
+
+#include "../include/scan_stats.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <netdb.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// One thread's counters; padded so that no two shards share a cache line
+typedef struct stats_shard
+{
+  char padding[64];
+  atomic_uint_fast64_t counters[STAT_COUNT];
+  atomic_uint_fast64_t rtt_count;
+  atomic_uint_fast64_t rtt_sum_us;
+  atomic_uint_fast64_t rtt[STATS_RTT_BUCKETS];
+  atomic_bool in_use;           // Owned by a live thread
+  struct stats_shard *next;     // Next shard in the list (never removed)
+  char padding_end[64];
+} stats_shard_t;
+
+static const char *const counter_names[STAT_COUNT] = {
+    "probes_sent", "responses", "retransmits", "timeouts",      "open",
+    "closed",      "filtered",  "bytes_sent",  "bytes_received"};
+
+static const char *const gauge_names[GAUGE_COUNT] = {"in_flight", "active_hosts", "probe_queue",
+                                                     "service_queue"};
+
+static _Atomic(stats_shard_t *) shard_list;
+static atomic_int num_shards;
+static stats_shard_t overflow_shard;
+static atomic_uint_fast64_t expected_targets;
+static atomic_int_fast64_t gauges[GAUGE_COUNT];
+
+static _Thread_local stats_shard_t *local_shard;
+static pthread_key_t shard_key;
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+
+// The reporter thread and its state
+static struct
+{
+  bool running;
+  bool stop;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int interval_ms;
+  FILE *json_file;             // JSON sink when it is a file
+  int json_sock;               // JSON sink when it is a socket (-1 = none)
+  int64_t started_us;
+  scan_stats_snapshot_t last;  // Snapshot of the previous report
+} reporter = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER,
+              .json_sock = -1};
+
+// Thread exit: hand the shard to the next thread that needs one
+static void release_shard(void *shard)
+{
+  atomic_store(&((stats_shard_t *)shard)->in_use, false);
+}
+
+static void create_shard_key(void)
+{
+  pthread_key_create(&shard_key, release_shard);
+}
+
+// Create a shard and add it to the list; NULL once STATS_MAX_SHARDS exist
+static stats_shard_t *new_shard(bool in_use)
+{
+  if (atomic_fetch_add(&num_shards, 1) >= STATS_MAX_SHARDS)
+    return NULL;
+
+  stats_shard_t *shard = calloc(1, sizeof(*shard));
+  if (!shard)
+    return NULL;
+  atomic_store(&shard->in_use, in_use);
+  shard->next = atomic_load(&shard_list);
+  while (!atomic_compare_exchange_weak(&shard_list, &shard->next, shard))
+    ;
+  return shard;
+}
+
+void scan_stats_reserve(int threads)
+{
+  int wanted = threads < STATS_MAX_SHARDS ? threads : STATS_MAX_SHARDS;
+  while (atomic_load(&num_shards) < wanted && new_shard(false))
+    ;
+}
+
+// The calling thread's shard, claiming a free one or creating one on first use
+static stats_shard_t *thread_shard(void)
+{
+  if (local_shard)
+    return local_shard;
+
+  pthread_once(&shard_key_once, create_shard_key);
+
+  stats_shard_t *shard = NULL;
+  for (stats_shard_t *s = atomic_load(&shard_list); s && !shard; s = s->next)
+  {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&s->in_use, &expected, true))
+      shard = s;
+  }
+
+  if (!shard)
+    shard = new_shard(true);
+
+  if (!shard)
+  {
+    local_shard = &overflow_shard;
+    return local_shard;
+  }
+  pthread_setspecific(shard_key, shard);
+  local_shard = shard;
+  return shard;
+}
+
+// Histogram bucket of an RTT: exact below STATS_RTT_SUB_BUCKETS, then log-linear
+static int rtt_bucket(uint64_t rtt_us)
+{
+  if (rtt_us < STATS_RTT_SUB_BUCKETS)
+    return (int)rtt_us;
+
+  int exponent = 63 - __builtin_clzll(rtt_us);
+  if (exponent > STATS_RTT_MAX_EXPONENT)
+    return STATS_RTT_BUCKETS - 1;
+  int sub = (int)((rtt_us >> (exponent - STATS_RTT_SUB_BITS)) & (STATS_RTT_SUB_BUCKETS - 1));
+  return (exponent - STATS_RTT_SUB_BITS + 1) * STATS_RTT_SUB_BUCKETS + sub;
+}
+
+int64_t scan_stats_rtt_bucket_high(int index)
+{
+  if (index < STATS_RTT_SUB_BUCKETS)
+    return index;
+
+  int shift = index / STATS_RTT_SUB_BUCKETS - 1;
+  int64_t low = (int64_t)(STATS_RTT_SUB_BUCKETS + index % STATS_RTT_SUB_BUCKETS) << shift;
+  return low + ((int64_t)1 << shift) - 1;
+}
+
+static void add_shard(scan_stats_snapshot_t *snapshot, stats_shard_t *shard)
+{
+  for (int i = 0; i < STAT_COUNT; i++)
+    snapshot->counters[i] += atomic_load_explicit(&shard->counters[i], memory_order_relaxed);
+  snapshot->rtt_count += atomic_load_explicit(&shard->rtt_count, memory_order_relaxed);
+  snapshot->rtt_sum_us += atomic_load_explicit(&shard->rtt_sum_us, memory_order_relaxed);
+  for (int i = 0; i < STATS_RTT_BUCKETS; i++)
+    snapshot->rtt[i] += atomic_load_explicit(&shard->rtt[i], memory_order_relaxed);
+}
+
+static double cpu_seconds(void)
+{
+#ifdef _WIN32
+  FILETIME created, exited, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+    return 0;
+  ULARGE_INTEGER k = {.LowPart = kernel.dwLowDateTime, .HighPart = kernel.dwHighDateTime};
+  ULARGE_INTEGER u = {.LowPart = user.dwLowDateTime, .HighPart = user.dwHighDateTime};
+  return (double)(k.QuadPart + u.QuadPart) / 1e7;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) < 0)
+    return 0;
+  return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+const char *scan_stats_counter_name(scan_stat_t stat)
+{
+  return stat >= 0 && stat < STAT_COUNT ? counter_names[stat] : "unknown";
+}
+
+const char *scan_stats_gauge_name(scan_gauge_t gauge)
+{
+  return gauge >= 0 && gauge < GAUGE_COUNT ? gauge_names[gauge] : "unknown";
+}
+
+void scan_stats_add(scan_stat_t stat, uint64_t amount)
+{
+  atomic_fetch_add_explicit(&thread_shard()->counters[stat], amount, memory_order_relaxed);
+}
+
+void scan_stats_record_rtt(int64_t rtt_us)
+{
+  if (rtt_us < 0)
+    rtt_us = 0;
+
+  stats_shard_t *shard = thread_shard();
+  atomic_fetch_add_explicit(&shard->rtt[rtt_bucket((uint64_t)rtt_us)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&shard->rtt_sum_us, (uint64_t)rtt_us, memory_order_relaxed);
+  atomic_fetch_add_explicit(&shard->rtt_count, 1, memory_order_relaxed);
+}
+
+void scan_stats_gauge_add(scan_gauge_t gauge, int64_t delta)
+{
+  atomic_fetch_add_explicit(&gauges[gauge], delta, memory_order_relaxed);
+}
+
+void scan_stats_expect(uint64_t targets)
+{
+  atomic_fetch_add_explicit(&expected_targets, targets, memory_order_relaxed);
+}
+
+int64_t scan_stats_now_us(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (int64_t)(counter.QuadPart / frequency.QuadPart * 1000000 +
+                   counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+void scan_stats_snapshot(scan_stats_snapshot_t *snapshot)
+{
+  memset(snapshot, 0, sizeof(*snapshot));
+  snapshot->taken_us = scan_stats_now_us();
+  snapshot->cpu_seconds = cpu_seconds();
+  snapshot->targets = atomic_load_explicit(&expected_targets, memory_order_relaxed);
+  for (int i = 0; i < GAUGE_COUNT; i++)
+    snapshot->gauges[i] = atomic_load_explicit(&gauges[i], memory_order_relaxed);
+
+  for (stats_shard_t *shard = atomic_load(&shard_list); shard; shard = shard->next)
+    add_shard(snapshot, shard);
+  add_shard(snapshot, &overflow_shard);
+}
+
+int64_t scan_stats_rtt_percentile(const scan_stats_snapshot_t *snapshot, double percentile)
+{
+  if (snapshot->rtt_count == 0)
+    return 0;
+
+  uint64_t rank = (uint64_t)(percentile / 100.0 * (double)snapshot->rtt_count + 0.999999);
+  if (rank < 1)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < STATS_RTT_BUCKETS; i++)
+  {
+    seen += snapshot->rtt[i];
+    if (seen >= rank)
+      return scan_stats_rtt_bucket_high(i);
+  }
+  return scan_stats_rtt_bucket_high(STATS_RTT_BUCKETS - 1);
+}
+
+// Open the JSON sink: "tcp:HOST:PORT", "unix:PATH" or a file path
+static bool open_sink(const char *sink)
+{
+  if (strncmp(sink, "tcp:", 4) == 0)
+  {
+    char host[256];
+    snprintf(host, sizeof(host), "%s", sink + 4);
+    char *port = strrchr(host, ':');
+    if (!port)
+      return false;
+    *port++ = '\0';
+
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &result) != 0)
+      return false;
+
+    int sock = -1;
+    for (struct addrinfo *ai = result; ai && sock < 0; ai = ai->ai_next)
+    {
+      sock = (int)socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (sock >= 0 && connect(sock, ai->ai_addr, (int)ai->ai_addrlen) != 0)
+      {
+#ifdef _WIN32
+        closesocket(sock);
+#else
+        close(sock);
+#endif
+        sock = -1;
+      }
+    }
+    freeaddrinfo(result);
+    reporter.json_sock = sock;
+    return sock >= 0;
+  }
+
+  if (strncmp(sink, "unix:", 5) == 0)
+  {
+#ifdef _WIN32
+    return false;
+#else
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sink + 5) >= sizeof(addr.sun_path))
+      return false;
+    strcpy(addr.sun_path, sink + 5);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+      return false;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+      close(sock);
+      return false;
+    }
+    reporter.json_sock = sock;
+    return true;
+#endif
+  }
+
+  reporter.json_file = fopen(sink, "w");
+  return reporter.json_file != NULL;
+}
+
+static void close_sink(void)
+{
+  if (reporter.json_file)
+    fclose(reporter.json_file);
+  if (reporter.json_sock >= 0)
+  {
+#ifdef _WIN32
+    closesocket(reporter.json_sock);
+#else
+    close(reporter.json_sock);
+#endif
+  }
+  reporter.json_file = NULL;
+  reporter.json_sock = -1;
+}
+
+static void write_sink(const char *text, size_t len)
+{
+  if (reporter.json_file)
+  {
+    fwrite(text, 1, len, reporter.json_file);
+    fflush(reporter.json_file);
+    return;
+  }
+
+  // A reader that goes away must not stop the scan, so errors just drop the socket
+  while (reporter.json_sock >= 0 && len > 0)
+  {
+#ifdef MSG_NOSIGNAL
+    int sent = (int)send(reporter.json_sock, text, len, MSG_NOSIGNAL);
+#else
+    int sent = (int)send(reporter.json_sock, text, (int)len, 0);
+#endif
+    if (sent <= 0)
+    {
+      close_sink();
+      return;
+    }
+    text += sent;
+    len -= (size_t)sent;
+  }
+}
+
+// Print one report covering the time since the previous one
+static void report(bool final)
+{
+  scan_stats_snapshot_t *now = malloc(sizeof(*now));
+  if (!now)
+    return;
+  scan_stats_snapshot(now);
+
+  const scan_stats_snapshot_t *last = &reporter.last;
+  const uint64_t *c = now->counters;
+  double elapsed = (double)(now->taken_us - reporter.started_us) / 1e6;
+  double interval = (double)(now->taken_us - last->taken_us) / 1e6;
+  if (interval <= 0)
+    interval = 1e-6;
+
+  double rates[STAT_COUNT];
+  for (int i = 0; i < STAT_COUNT; i++)
+    rates[i] = (double)(c[i] - last->counters[i]) / interval;
+  double cpu_percent = (now->cpu_seconds - last->cpu_seconds) / interval * 100.0;
+
+  uint64_t done = c[STAT_OPEN] + c[STAT_CLOSED] + c[STAT_FILTERED];
+  int64_t p50 = scan_stats_rtt_percentile(now, 50);
+  int64_t p90 = scan_stats_rtt_percentile(now, 90);
+  int64_t p99 = scan_stats_rtt_percentile(now, 99);
+  int64_t max = scan_stats_rtt_percentile(now, 100);
+  double mean = now->rtt_count ? (double)now->rtt_sum_us / (double)now->rtt_count : 0;
+
+  fprintf(stderr,
+          "[%s %6.1fs] done %llu/%llu (%.1f%%)  sent %llu (%.0f/s)  resp %llu  retx %llu  "
+          "timeouts %llu | open %llu closed %llu filtered %llu | rtt p50/p90/p99 %.2f/%.2f/%.2f "
+          "ms | cpu %.0f%% | tx %.0f KB/s rx %.0f KB/s\n",
+          final ? "final" : "stats", elapsed, (unsigned long long)done,
+          (unsigned long long)now->targets,
+          now->targets ? 100.0 * (double)done / (double)now->targets : 0.0,
+          (unsigned long long)c[STAT_PROBES_SENT], rates[STAT_PROBES_SENT],
+          (unsigned long long)c[STAT_RESPONSES], (unsigned long long)c[STAT_RETRANSMITS],
+          (unsigned long long)c[STAT_TIMEOUTS], (unsigned long long)c[STAT_OPEN],
+          (unsigned long long)c[STAT_CLOSED], (unsigned long long)c[STAT_FILTERED], p50 / 1e3,
+          p90 / 1e3, p99 / 1e3, cpu_percent, rates[STAT_BYTES_SENT] / 1024,
+          rates[STAT_BYTES_RECEIVED] / 1024);
+
+  if (reporter.json_file || reporter.json_sock >= 0)
+  {
+    char line[2048];
+    int len = snprintf(line, sizeof(line), "{\"elapsed\":%.3f,\"interval\":%.3f,\"final\":%s,"
+                                           "\"targets\":%llu,\"done\":%llu",
+                       elapsed, interval, final ? "true" : "false",
+                       (unsigned long long)now->targets, (unsigned long long)done);
+    for (int i = 0; i < STAT_COUNT; i++)
+      len += snprintf(line + len, sizeof(line) - (size_t)len, ",\"%s\":%llu", counter_names[i],
+                      (unsigned long long)c[i]);
+    len += snprintf(line + len, sizeof(line) - (size_t)len, ",\"rates\":{");
+    for (int i = 0; i < STAT_COUNT; i++)
+      len += snprintf(line + len, sizeof(line) - (size_t)len, "%s\"%s\":%.1f", i ? "," : "",
+                      counter_names[i], rates[i]);
+    len += snprintf(line + len, sizeof(line) - (size_t)len,
+                    "},\"rtt_us\":{\"count\":%llu,\"mean\":%.1f,\"p50\":%lld,\"p90\":%lld,"
+                    "\"p99\":%lld,\"max\":%lld},\"cpu_percent\":%.1f",
+                    (unsigned long long)now->rtt_count, mean, (long long)p50, (long long)p90,
+                    (long long)p99, (long long)max, cpu_percent);
+    for (int i = 0; i < GAUGE_COUNT; i++)
+      len += snprintf(line + len, sizeof(line) - (size_t)len, ",\"%s\":%lld", gauge_names[i],
+                      (long long)now->gauges[i]);
+    len += snprintf(line + len, sizeof(line) - (size_t)len, "}\n");
+    write_sink(line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1);
+  }
+
+  reporter.last = *now;
+  free(now);
+}
+
+static void *reporter_thread(void *arg)
+{
+  (void)arg;
+
+  // Reports must never take CPU from the probes. On Linux the nice value is per thread, so this
+  // only lowers the reporter; elsewhere it would lower the whole scan, so leave it
+#ifdef _WIN32
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+  setpriority(PRIO_PROCESS, 0, 10);
+#endif
+
+  pthread_mutex_lock(&reporter.lock);
+  while (!reporter.stop)
+  {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += reporter.interval_ms / 1000;
+    deadline.tv_nsec += (long)(reporter.interval_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    while (!reporter.stop && pthread_cond_timedwait(&reporter.wake, &reporter.lock, &deadline) == 0)
+      ;
+    if (reporter.stop)
+      break;
+
+    pthread_mutex_unlock(&reporter.lock);
+    report(false);
+    pthread_mutex_lock(&reporter.lock);
+  }
+  pthread_mutex_unlock(&reporter.lock);
+  return NULL;
+}
+
+bool scan_stats_start_reporter(int interval_ms, const char *json_sink)
+{
+  if (reporter.running || interval_ms <= 0)
+    return false;
+  if (json_sink && json_sink[0] && !open_sink(json_sink))
+    return false;
+
+  reporter.interval_ms = interval_ms;
+  reporter.stop = false;
+  scan_stats_snapshot(&reporter.last);
+  reporter.started_us = reporter.last.taken_us;
+
+  if (pthread_create(&reporter.thread, NULL, reporter_thread, NULL) != 0)
+  {
+    close_sink();
+    return false;
+  }
+  reporter.running = true;
+  return true;
+}
+
+void scan_stats_stop_reporter(void)
+{
+  if (!reporter.running)
+    return;
+
+  pthread_mutex_lock(&reporter.lock);
+  reporter.stop = true;
+  pthread_cond_signal(&reporter.wake);
+  pthread_mutex_unlock(&reporter.lock);
+  pthread_join(reporter.thread, NULL);
+  reporter.running = false;
+
+  report(true);
+  close_sink();
+}
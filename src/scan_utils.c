@@ -24,4 +24,29 @@ const char *scan_type_to_string(scan_type_t scan_type)
   default:
     return "Unknown";
   }
-}
\ No newline at end of file
+}
+
+int shard_ports(int *ports, int count, int shard_index, int shard_count)
+{
+  int kept = 0;
+  for (int i = shard_index - 1; i < count; i += shard_count)
+  {
+    ports[kept++] = ports[i];
+  }
+  return kept;
+}
+
+void shard_port_bitmap(const port_bitmap_t *ports, int rotation, int shard_index,
+                       int shard_count, port_bitmap_t *shard)
+{
+  port_bitmap_clear(shard);
+  int position = rotation;
+  for (int port = port_bitmap_next(ports, 0); port >= 0; port = port_bitmap_next(ports, port + 1))
+  {
+    if (position == shard_index - 1)
+    {
+      port_bitmap_set(shard, port);
+    }
+    position = position + 1 == shard_count ? 0 : position + 1;
+  }
+}
@@ -26,62 +26,24 @@
 
 #include "../include/scanner.h"
 #include "../include/config.h"
+#include "../include/services.h"
 #include "../include/utils.h"
 #include "../include/advanced_scan.h"
+#include "../include/passive_os.h"
+#include "../include/syn_engine.h"
+#include "../include/scan_stats.h"
+#include "../include/trace.h"
+#include "../include/scan_utils.h"
 
 // Static variables for tracking open ports
 static int *open_ports = NULL;
 static int num_open_ports = 0;
+static int open_ports_capacity = 0;
 static pthread_mutex_t open_ports_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-// Array of common services for port identification
-typedef struct
-{
-  int port;
-  const char *service;
-  const char *description;
-} PortInfo;
-
-// Common port information
-static const PortInfo PORT_INFO[] = {
-    {20, "FTP-DATA", "File Transfer Protocol (Data)"},
-    {21, "FTP", "File Transfer Protocol (Control)"},
-    {22, "SSH", "Secure Shell"},
-    {23, "TELNET", "Telnet protocol"},
-    {25, "SMTP", "Simple Mail Transfer Protocol"},
-    {53, "DNS", "Domain Name System"},
-    {80, "HTTP", "Hypertext Transfer Protocol"},
-    {110, "POP3", "Post Office Protocol v3"},
-    {143, "IMAP", "Internet Message Access Protocol"},
-    {443, "HTTPS", "HTTP Secure"},
-    {445, "SMB", "Server Message Block"},
-    {3306, "MYSQL", "MySQL Database"},
-    {3389, "RDP", "Remote Desktop Protocol"},
-    {5432, "POSTGRESQL", "PostgreSQL Database"},
-    {8080, "HTTP-ALT", "Alternative HTTP Port"},
-    // Add more common ports as needed
-    {0, NULL, NULL} // Sentinel value to mark the end of the array
-};
-
-// Common ports to scan
-static const int COMMON_PORTS_TO_SCAN[MAX_COMMON_PORTS] = {
-    21,   // FTP
-    22,   // SSH
-    23,   // Telnet
-    25,   // SMTP
-    53,   // DNS
-    80,   // HTTP
-    110,  // POP3
-    143,  // IMAP
-    443,  // HTTPS
-    445,  // SMB
-    3306, // MySQL
-    3389, // RDP
-    5432, // PostgreSQL
-    5900, // VNC
-    8080, // HTTP Proxy
-    8443  // HTTPS Alternative
-};
+// Per-scan working memory (thread arguments, results, SYN port lists), sized by scanner_reserve
+static void *scan_slab = NULL;
+static size_t scan_slab_size = 0;
 
 // Thread arguments structure
 typedef struct
@@ -93,38 +55,82 @@ typedef struct
   scan_type_t scan_type;
 } scan_thread_args_t;
 
+// Ports of a connect scan shared by its workers, each taking the next port off the bitmap
+typedef struct
+{
+  const port_bitmap_t *ports;
+  uint32_t addr;       // Target address, network byte order
+  int next_port;       // Lowest port no worker has taken yet
+  port_bitmap_t open;  // Open ports found so far
+  pthread_mutex_t lock;
+} port_pool_t;
+
+// Target blocks a multi-host SYN scan keeps in the engine at once
+#define SWEEP_JOBS 8
+
+// Threads of a connect scan, and so connections in flight at once
+#define SCAN_WORKERS 256
+
+// Slab bytes needed to scan count ports (the port list of a SYN scan)
+#define SLAB_BYTES_PER_PORT sizeof(uint16_t)
+
 // Forward declaration of is_port_open_connect
 int is_port_open_connect(const char *target, int port);
 
-/**
- * Gets a list of all open ports found during the scan.
- * The caller is responsible for freeing the returned array.
- *
- * @return A dynamically allocated array of open ports
- */
-int *get_open_ports(void)
+// Grow the open port list to hold at least capacity ports; call with open_ports_mutex held
+static bool reserve_open_ports(int capacity)
 {
-  pthread_mutex_lock(&open_ports_mutex);
+  if (capacity <= open_ports_capacity)
+    return true;
+  int *grown = realloc(open_ports, (size_t)capacity * sizeof(int));
+  if (!grown)
+    return false;
+  open_ports = grown;
+  open_ports_capacity = capacity;
+  return true;
+}
 
-  if (num_open_ports == 0)
+// The scan slab, grown to at least size bytes (only when scanner_reserve was not told enough)
+static void *scratch(size_t size)
+{
+  if (size > scan_slab_size)
   {
-    pthread_mutex_unlock(&open_ports_mutex);
-    return NULL;
+    void *grown = realloc(scan_slab, size);
+    if (!grown)
+      return NULL;
+    scan_slab = grown;
+    scan_slab_size = size;
   }
+  return scan_slab;
+}
 
-  // Allocate memory for the copy
-  int *ports_copy = malloc(num_open_ports * sizeof(int));
-  if (!ports_copy)
-  {
-    pthread_mutex_unlock(&open_ports_mutex);
-    return NULL;
-  }
+bool scanner_reserve(int max_ports)
+{
+  if (max_ports < 1)
+    return true;
 
-  // Copy the ports
-  memcpy(ports_copy, open_ports, num_open_ports * sizeof(int));
+  // Every worker of a connect scan takes a statistics shard as it starts
+  scan_stats_reserve(max_ports < SCAN_WORKERS ? max_ports : SCAN_WORKERS);
 
+  pthread_mutex_lock(&open_ports_mutex);
+  bool reserved = reserve_open_ports(max_ports);
+  pthread_mutex_unlock(&open_ports_mutex);
+  return reserved && scratch((size_t)max_ports * SLAB_BYTES_PER_PORT) != NULL;
+}
+
+/**
+ * Gets the list of open ports found during the scan.
+ * The list belongs to the scanner and stays valid until cleanup_scanner; read it once the
+ * scan has finished.
+ *
+ * @return The open ports, or NULL if there are none
+ */
+const int *get_open_ports(void)
+{
+  pthread_mutex_lock(&open_ports_mutex);
+  const int *ports = num_open_ports > 0 ? open_ports : NULL;
   pthread_mutex_unlock(&open_ports_mutex);
-  return ports_copy;
+  return ports;
 }
 
 /**
@@ -145,61 +151,94 @@ int get_num_open_ports(void)
  * This function is for internal use by the scanner.
  *
  * @param port The port number to add
- * @return 0 on success, -1 if the list is full
+ * @return 1 on success, 0 if memory runs out
  */
 int add_open_port(int port)
 {
   pthread_mutex_lock(&open_ports_mutex);
 
-  // Reallocate memory for the new port
-  int *new_ports = realloc(open_ports, (num_open_ports + 1) * sizeof(int));
-  if (!new_ports)
+  // The list is normally sized by scanner_reserve; past that it doubles
+  if (num_open_ports == open_ports_capacity &&
+      !reserve_open_ports(open_ports_capacity ? open_ports_capacity * 2 : 64))
   {
     pthread_mutex_unlock(&open_ports_mutex);
     return 0;
   }
-
-  open_ports = new_ports;
   open_ports[num_open_ports++] = port;
 
   pthread_mutex_unlock(&open_ports_mutex);
   return 1;
 }
 
-/**
- * Gets service information for a specific port
- *
- * @param port The port number
- * @return A pointer to the service name or "Unknown" if not found
- */
-const char *get_service_name(int port)
+// SYN engine result callback: record open ports, and their SYN-ACKs for the passive OS guess
+static void record_syn_result(void *context, uint32_t addr, uint16_t port, port_state_t state,
+                              const os_response_t *reply)
 {
-  for (int i = 0; PORT_INFO[i].service != NULL; i++)
+  (void)context;
+  if (state == PORT_STATE_OPEN)
   {
-    if (PORT_INFO[i].port == port)
-    {
-      return PORT_INFO[i].service;
-    }
+    add_open_port(port);
+    passive_os_record(addr, reply);
   }
-  return "Unknown";
 }
 
-/**
- * Gets service description for a specific port
- *
- * @param port The port number
- * @return A pointer to the service description or "Unknown service" if not found
- */
-const char *get_service_description(int port)
+// Scan ports with the SYN engine over the raw-socket transport: a list in its order, or the
+// ports of a bitmap (list NULL) in ascending order
+static void syn_scan(const char *target, const uint16_t *list, const port_bitmap_t *bitmap,
+                     int count)
 {
-  for (int i = 0; PORT_INFO[i].description != NULL; i++)
+  struct addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  int64_t resolve_start = trace_begin();
+  int resolved = count > 0 ? getaddrinfo(target, NULL, &hints, &result) : -1;
+  trace_end(TRACE_RESOLVE, resolve_start, 0, NULL);
+  if (resolved != 0)
   {
-    if (PORT_INFO[i].port == port)
-    {
-      return PORT_INFO[i].description;
-    }
+    return;
+  }
+  uint32_t addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(result);
+
+  scan_stats_expect((uint64_t)count);
+  transport_t *transport = transport_raw_open();
+  if (!transport)
+  {
+    return;
+  }
+
+  syn_engine_config_t config;
+  syn_engine_default_config(&config);
+  config.timeout_us = (int64_t)DEFAULT_TIMEOUT * 1000;
+  config.rate = scan_rate;
+  syn_engine_t *engine = syn_engine_create(transport, &config);
+  syn_job_t *job = NULL;
+  if (engine)
+  {
+    job = list ? syn_engine_add_job(engine, addr, 1, list, count, 1, record_syn_result, NULL)
+               : syn_engine_add_bitmap_job(engine, addr, 1, bitmap, 1, record_syn_result, NULL);
+  }
+  bool ok = job != NULL;
+  while (ok && !syn_engine_job_finished(job, NULL))
+  {
+    ok = syn_engine_step(engine, -1);
+  }
+  syn_engine_destroy(engine);
+  transport->ops->close(transport);
+}
+
+static void syn_scan_ports(const char *target, const int *ports, int count)
+{
+  uint16_t *list = scratch((size_t)(count > 0 ? count : 1) * sizeof(uint16_t));
+  if (!list)
+  {
+    return;
+  }
+  for (int i = 0; i < count; i++)
+  {
+    list[i] = (uint16_t)ports[i];
   }
-  return "Unknown service";
+  syn_scan(target, list, NULL, count);
 }
 
 /**
@@ -210,17 +249,33 @@ const char *get_service_description(int port)
  */
 void scan_common_ports(const char *target, scan_type_t scan_type)
 {
-  printf("Scanning %d common ports on %s...\n\n", MAX_COMMON_PORTS, target);
+  printf("Scanning %d common ports on %s...\n\n", SERVICE_COUNT, target);
+
+  if (scan_type == SCAN_SYN)
+  {
+    int ports[SERVICE_COUNT];
+    for (int i = 0; i < SERVICE_COUNT; i++)
+    {
+      ports[i] = SERVICES[i].port;
+    }
+    syn_scan_ports(target, ports, SERVICE_COUNT);
+    return;
+  }
 
-  // Loop through each common port
-  for (int i = 0; i < MAX_COMMON_PORTS; i++)
+  // Loop through each common port, most frequently open first
+  scan_stats_expect(SERVICE_COUNT);
+  scan_stats_gauge_add(GAUGE_PROBE_QUEUE, SERVICE_COUNT);
+  scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, 1);
+  for (int i = 0; i < SERVICE_COUNT; i++)
   {
-    int port = COMMON_PORTS_TO_SCAN[i];
+    int port = SERVICES[i].port;
+    scan_stats_gauge_add(GAUGE_PROBE_QUEUE, -1);
     if (is_port_open(target, port, scan_type))
     {
       add_open_port(port);
     }
   }
+  scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, -1);
 }
 
 // Function to set socket to non-blocking mode
@@ -237,47 +292,53 @@ static int set_nonblocking(int sockfd)
 #endif
 }
 
-// Thread function to scan a single port
-void *scan_port_thread(void *arg)
+// Count the outcome of a connect probe in the live statistics and the trace
+static void count_connect_probe(int port, int64_t sent_at, port_state_t state)
 {
-  scan_thread_args_t *args = (scan_thread_args_t *)arg;
-  struct sockaddr_in addr;
-  int sockfd;
-  int result = 0;
-
-  // Create socket
-  sockfd = socket(AF_INET, SOCK_STREAM, 0);
-  if (sockfd < 0)
+  if (trace_enabled)
   {
-    *args->result = 0;
-    return NULL;
+    trace_record(TRACE_CONNECT, sent_at, scan_stats_now_us() - sent_at, port, 0,
+                 state == PORT_STATE_OPEN     ? "open"
+                 : state == PORT_STATE_CLOSED ? "closed"
+                                              : "filtered");
   }
-
-  // Set non-blocking mode
-  if (set_nonblocking(sockfd) < 0)
+  scan_stats_gauge_add(GAUGE_IN_FLIGHT, -1);
+  if (state == PORT_STATE_FILTERED)
   {
-    close(sockfd);
-    *args->result = 0;
-    return NULL;
+    scan_stats_add(STAT_TIMEOUTS, 1);
+    scan_stats_add(STAT_FILTERED, 1);
+    return;
   }
+  scan_stats_add(STAT_RESPONSES, 1);
+  scan_stats_record_rtt(scan_stats_now_us() - sent_at);
+  scan_stats_add(state == PORT_STATE_OPEN ? STAT_OPEN : STAT_CLOSED, 1);
+}
 
-  // Setup address structure
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(args->port);
+bool connect_probe(uint32_t addr, int port, int timeout_ms, port_state_t *state)
+{
+  struct sockaddr_in sin;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = addr;
+  sin.sin_port = htons(port);
 
-  // Resolve hostname if needed
-  struct hostent *he = gethostbyname(args->target);
-  if (he == NULL)
+  // Create socket and set non-blocking mode
+  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sockfd < 0)
+  {
+    return false;
+  }
+  if (set_nonblocking(sockfd) < 0)
   {
     close(sockfd);
-    *args->result = 0;
-    return NULL;
+    return false;
   }
-  memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
 
   // Attempt connection
-  if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  int64_t sent_at = scan_stats_now_us();
+  scan_stats_add(STAT_PROBES_SENT, 1);
+  scan_stats_gauge_add(GAUGE_IN_FLIGHT, 1);
+  if (connect(sockfd, (struct sockaddr *)&sin, sizeof(sin)) < 0)
   {
 #ifdef _WIN32
     if (WSAGetLastError() != WSAEWOULDBLOCK)
@@ -286,9 +347,10 @@ void *scan_port_thread(void *arg)
     if (errno != EINPROGRESS)
     {
 #endif
+      *state = PORT_STATE_CLOSED;
+      count_connect_probe(port, sent_at, *state);
       close(sockfd);
-      *args->result = 0;
-      return NULL;
+      return true;
     }
   }
 
@@ -297,10 +359,11 @@ void *scan_port_thread(void *arg)
   struct timeval tv;
   FD_ZERO(&fdset);
   FD_SET(sockfd, &fdset);
-  tv.tv_sec = args->timeout / 1000;
-  tv.tv_usec = (args->timeout % 1000) * 1000;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
 
   // Wait for connection or timeout
+  *state = PORT_STATE_FILTERED;
   if (select(sockfd + 1, NULL, &fdset, NULL, &tv) > 0)
   {
     int so_error;
@@ -312,14 +375,37 @@ void *scan_port_thread(void *arg)
 #else
     getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &so_error, &len);
 #endif
-    if (so_error == 0)
-    {
-      result = 1;
-    }
+    *state = so_error == 0 ? PORT_STATE_OPEN : PORT_STATE_CLOSED;
   }
+  count_connect_probe(port, sent_at, *state);
 
   close(sockfd);
-  *args->result = result;
+  return true;
+}
+
+// Thread function to scan a single port
+void *scan_port_thread(void *arg)
+{
+  scan_thread_args_t *args = (scan_thread_args_t *)arg;
+  scan_stats_gauge_add(GAUGE_PROBE_QUEUE, -1);
+  *args->result = 0;
+
+  // Resolve hostname if needed
+  int64_t resolve_start = trace_begin();
+  struct hostent *he = gethostbyname(args->target);
+  trace_end(TRACE_RESOLVE, resolve_start, args->port, NULL);
+  if (he == NULL)
+  {
+    return NULL;
+  }
+  uint32_t addr;
+  memcpy(&addr, he->h_addr_list[0], sizeof(addr));
+
+  port_state_t state;
+  if (connect_probe(addr, args->port, args->timeout, &state) && state == PORT_STATE_OPEN)
+  {
+    *args->result = 1;
+  }
   return NULL;
 }
 
@@ -361,40 +447,109 @@ int is_port_open(const char *target, int port, scan_type_t scan_type)
  */
 void scan_ports(const char *target, int start_port, int end_port, scan_type_t scan_type)
 {
-  int num_ports = end_port - start_port + 1;
-  int *results = (int *)malloc(num_ports * sizeof(int));
-  scan_thread_args_t *args = (scan_thread_args_t *)malloc(num_ports * sizeof(scan_thread_args_t));
-  pthread_t *threads = (pthread_t *)malloc(num_ports * sizeof(pthread_t));
+  port_bitmap_t ports;
+  port_bitmap_clear(&ports);
+  if (start_port >= 0 && start_port <= end_port && end_port <= 65535)
+  {
+    port_bitmap_set_range(&ports, start_port, end_port);
+  }
+  scan_port_bitmap(target, &ports, scan_type);
+}
 
-  // Initialize thread arguments
-  for (int i = 0; i < num_ports; i++)
+// Connect scan worker: probe ports off the pool until none are left
+static void *scan_pool_worker(void *arg)
+{
+  port_pool_t *pool = arg;
+  for (;;)
   {
-    args[i].target = target;
-    args[i].port = start_port + i;
-    args[i].result = &results[i];
-    args[i].timeout = DEFAULT_TIMEOUT;
-    args[i].scan_type = scan_type;
+    pthread_mutex_lock(&pool->lock);
+    int port = port_bitmap_next(pool->ports, pool->next_port);
+    pool->next_port = port >= 0 ? port + 1 : 65536;
+    pthread_mutex_unlock(&pool->lock);
+    if (port < 0)
+    {
+      return NULL;
+    }
+
+    scan_stats_gauge_add(GAUGE_PROBE_QUEUE, -1);
+    port_state_t state;
+    if (connect_probe(pool->addr, port, DEFAULT_TIMEOUT, &state) && state == PORT_STATE_OPEN)
+    {
+      pthread_mutex_lock(&pool->lock);
+      port_bitmap_set(&pool->open, port);
+      pthread_mutex_unlock(&pool->lock);
+    }
   }
+}
 
-  // Create threads
-  for (int i = 0; i < num_ports; i++)
+/**
+ * Scans the ports of a bitmap on the specified target host, in ascending order.
+ *
+ * @param target The hostname or IP address to scan
+ * @param ports The ports to scan
+ * @param scan_type The type of scan to perform
+ */
+void scan_port_bitmap(const char *target, const port_bitmap_t *ports, scan_type_t scan_type)
+{
+  int num_ports = port_bitmap_count(ports);
+
+  // The SYN engine keeps all probes in flight from one thread
+  if (scan_type == SCAN_SYN)
   {
-    pthread_create(&threads[i], NULL, scan_port_thread, &args[i]);
+    syn_scan(target, NULL, ports, num_ports);
+    return;
   }
 
-  // Wait for threads to complete
-  for (int i = 0; i < num_ports; i++)
+  // Resolve once for every worker; getaddrinfo is reentrant, gethostbyname is not
+  struct addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  int64_t resolve_start = trace_begin();
+  int resolved = num_ports > 0 ? getaddrinfo(target, NULL, &hints, &result) : -1;
+  trace_end(TRACE_RESOLVE, resolve_start, 0, NULL);
+  if (resolved != 0)
   {
-    pthread_join(threads[i], NULL);
-    if (results[i] == 1)
-    {
-      add_open_port(start_port + i);
-    }
+    return;
+  }
+
+  port_pool_t pool;
+  pool.ports = ports;
+  pool.addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+  pool.next_port = 0;
+  port_bitmap_clear(&pool.open);
+  pthread_mutex_init(&pool.lock, NULL);
+  freeaddrinfo(result);
+
+  scan_stats_expect((uint64_t)num_ports);
+  scan_stats_gauge_add(GAUGE_PROBE_QUEUE, num_ports);
+  scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, 1);
+
+  // A bounded set of workers pulls the ports; if none can be started, probe from this thread
+  pthread_t workers[SCAN_WORKERS];
+  int num_workers = num_ports < SCAN_WORKERS ? num_ports : SCAN_WORKERS;
+  int started = 0;
+  while (started < num_workers &&
+         pthread_create(&workers[started], NULL, scan_pool_worker, &pool) == 0)
+  {
+    started++;
+  }
+  if (started == 0)
+  {
+    scan_pool_worker(&pool);
+  }
+  for (int i = 0; i < started; i++)
+  {
+    pthread_join(workers[i], NULL);
   }
+  pthread_mutex_destroy(&pool.lock);
 
-  free(results);
-  free(args);
-  free(threads);
+  // Report in ascending order, however the probes finished
+  for (int port = port_bitmap_next(&pool.open, 0); port >= 0;
+       port = port_bitmap_next(&pool.open, port + 1))
+  {
+    add_open_port(port);
+  }
+  scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, -1);
 }
 
 /**
@@ -410,6 +565,16 @@ void scan_port(const char *target, int port, scan_type_t scan_type)
   scan_thread_args_t args;
   pthread_t thread;
 
+  if (scan_type == SCAN_SYN)
+  {
+    syn_scan_ports(target, &port, 1);
+    return;
+  }
+
+  scan_stats_expect(1);
+  scan_stats_gauge_add(GAUGE_PROBE_QUEUE, 1);
+  scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, 1);
+
   // Initialize thread arguments
   args.target = target;
   args.port = port;
@@ -417,23 +582,248 @@ void scan_port(const char *target, int port, scan_type_t scan_type)
   args.timeout = DEFAULT_TIMEOUT;
   args.scan_type = scan_type;
 
-  // Create thread
-  pthread_create(&thread, NULL, scan_port_thread, &args);
-
-  // Wait for thread to complete
-  pthread_join(thread, NULL);
+  // Probe from a thread, or from this one if no thread can be created
+  if (pthread_create(&thread, NULL, scan_port_thread, &args) == 0)
+  {
+    pthread_join(thread, NULL);
+  }
+  else
+  {
+    scan_port_thread(&args);
+  }
+  scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, -1);
   if (result == 1)
   {
     add_open_port(port);
   }
 }
 
+/**
+ * Scans a list of ports on the specified target host.
+ *
+ * @param target The hostname or IP address to scan
+ * @param ports The ports to scan
+ * @param count The number of ports
+ * @param scan_type The type of scan to perform
+ */
+void scan_port_list(const char *target, const int *ports, int count, scan_type_t scan_type)
+{
+  if (scan_type == SCAN_SYN)
+  {
+    syn_scan_ports(target, ports, count);
+    return;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    scan_port(target, ports[i], scan_type);
+  }
+}
+
+// Where a multi-host scan reports its open ports, and the slice of targets x ports it scans
+typedef struct
+{
+  target_open_fn on_open;
+  target_done_fn on_done;
+  void *context;
+  const port_bitmap_t *ports;
+  int shard_index;         // 1-based, 0 when the scan is not sharded
+  int shard_count;
+  target_block_t pending;  // Rest of a block split into shard runs
+  bool has_pending;
+  port_bitmap_t run_ports; // Ports of the current shard run
+} sweep_t;
+
+static void record_sweep_result(void *context, uint32_t addr, uint16_t port, port_state_t state,
+                                const os_response_t *reply)
+{
+  sweep_t *sweep = context;
+  if (state == PORT_STATE_OPEN)
+  {
+    sweep->on_open(sweep->context, ntohl(addr), port);
+    passive_os_record(addr, reply);
+  }
+}
+
+/**
+ * Takes the next run of hosts that are scanned on the same ports
+ *
+ * Unsharded, a run is a whole block with every port. Sharded, blocks are cut at multiples of
+ * SHARD_RUN_HOSTS, and a run gets the ports of its shard for that stretch of addresses.
+ *
+ * @param targets Target stream
+ * @param sweep Sweep
+ * @param wait Wait for the producer when no block is queued yet
+ * @param run Receives the hosts
+ * @return The ports of the run (possibly none), or NULL when no block is available
+ */
+static const port_bitmap_t *next_sweep_run(target_stream_t *targets, sweep_t *sweep, bool wait,
+                                           target_block_t *run)
+{
+  if (!sweep->has_pending)
+  {
+    if (!target_stream_next(targets, &sweep->pending, wait))
+    {
+      return NULL;
+    }
+    sweep->has_pending = true;
+  }
+  if (sweep->shard_count <= 1)
+  {
+    *run = sweep->pending;
+    sweep->has_pending = false;
+    return sweep->ports;
+  }
+
+  uint32_t stretch = sweep->pending.first / SHARD_RUN_HOSTS;
+  uint32_t stretch_last = sweep->pending.first | (SHARD_RUN_HOSTS - 1);
+  run->first = sweep->pending.first;
+  run->last = sweep->pending.last < stretch_last ? sweep->pending.last : stretch_last;
+  sweep->has_pending = run->last != sweep->pending.last;
+  sweep->pending.first = run->last + 1;
+  shard_port_bitmap(sweep->ports, (int)(stretch % (uint32_t)sweep->shard_count),
+                    sweep->shard_index, sweep->shard_count, &sweep->run_ports);
+  return &sweep->run_ports;
+}
+
+// SYN scan of a target stream: each run of hosts is a job, and finished jobs make room for
+// the next runs, so the engine never holds more than SWEEP_JOBS of them
+static uint64_t syn_sweep(target_stream_t *targets, sweep_t *sweep)
+{
+  transport_t *transport = transport_raw_open();
+  if (!transport)
+  {
+    return 0;
+  }
+  syn_engine_config_t config;
+  syn_engine_default_config(&config);
+  config.timeout_us = (int64_t)DEFAULT_TIMEOUT * 1000;
+  config.rate = scan_rate;
+  syn_engine_t *engine = syn_engine_create(transport, &config);
+
+  syn_job_t *jobs[SWEEP_JOBS];
+  target_block_t runs[SWEEP_JOBS]; // Hosts of each job
+  int num_jobs = 0;
+  uint64_t hosts = 0;
+  bool ok = engine != NULL;
+  while (ok)
+  {
+    for (int i = 0; i < num_jobs;)
+    {
+      if (syn_engine_job_finished(jobs[i], NULL))
+      {
+        syn_engine_remove_job(engine, jobs[i]);
+        if (sweep->on_done)
+        {
+          sweep->on_done(sweep->context, runs[i].first, runs[i].last);
+        }
+        num_jobs--;
+        jobs[i] = jobs[num_jobs];
+        runs[i] = runs[num_jobs];
+      }
+      else
+      {
+        i++;
+      }
+    }
+
+    // Wait for the producer only when the engine has nothing else to do
+    target_block_t run;
+    const port_bitmap_t *ports;
+    while (ok && num_jobs < SWEEP_JOBS &&
+           (ports = next_sweep_run(targets, sweep, num_jobs == 0, &run)) != NULL)
+    {
+      uint32_t num_hosts = run.last - run.first + 1;
+      int num_ports = port_bitmap_count(ports);
+      if (num_ports == 0)
+      {
+        continue;
+      }
+      scan_stats_expect((uint64_t)num_hosts * (uint64_t)num_ports);
+      jobs[num_jobs] = syn_engine_add_bitmap_job(engine, htonl(run.first), num_hosts, ports, 1,
+                                                 record_sweep_result, sweep);
+      ok = jobs[num_jobs] != NULL;
+      if (ok)
+      {
+        runs[num_jobs++] = run;
+        hosts += num_hosts;
+      }
+    }
+    if (num_jobs == 0)
+    {
+      break;
+    }
+    ok = ok && syn_engine_step(engine, -1);
+  }
+
+  // Jobs left over when the engine failed end here, with what they found so far
+  for (int i = 0; i < num_jobs && sweep->on_done; i++)
+  {
+    sweep->on_done(sweep->context, runs[i].first, runs[i].last);
+  }
+  syn_engine_destroy(engine);
+  transport->ops->close(transport);
+  return hosts;
+}
+
+uint64_t scan_target_stream(target_stream_t *targets, const port_bitmap_t *ports,
+                            int shard_index, int shard_count, scan_type_t scan_type,
+                            target_open_fn on_open, target_done_fn on_done, void *context)
+{
+  sweep_t sweep;
+  sweep.on_open = on_open;
+  sweep.on_done = on_done;
+  sweep.context = context;
+  sweep.ports = ports;
+  sweep.shard_index = shard_index;
+  sweep.shard_count = shard_count;
+  sweep.has_pending = false;
+  if (scan_type == SCAN_SYN)
+  {
+    return syn_sweep(targets, &sweep);
+  }
+
+  // One host at a time, each scanned like a single-host scan into the open ports list
+  uint64_t hosts = 0;
+  target_block_t run;
+  const port_bitmap_t *run_ports;
+  while ((run_ports = next_sweep_run(targets, &sweep, true, &run)) != NULL)
+  {
+    if (port_bitmap_count(run_ports) == 0)
+    {
+      continue;
+    }
+    uint32_t addr = run.first;
+    do
+    {
+      char target[INET_ADDRSTRLEN];
+      struct in_addr in;
+      in.s_addr = htonl(addr);
+      inet_ntop(AF_INET, &in, target, sizeof(target));
+
+      init_scanner();
+      scan_port_bitmap(target, run_ports, scan_type);
+      for (int i = 0; i < num_open_ports; i++)
+      {
+        on_open(context, addr, open_ports[i]);
+      }
+      hosts++;
+    } while (addr++ != run.last);
+    if (on_done)
+    {
+      on_done(context, run.first, run.last);
+    }
+  }
+  return hosts;
+}
+
 // Function to initialize the scanner
 bool init_scanner(void)
 {
-  // Initialize the open ports list
-  open_ports = NULL;
+  // Start an empty open ports list, keeping memory from an earlier scan
+  pthread_mutex_lock(&open_ports_mutex);
   num_open_ports = 0;
+  pthread_mutex_unlock(&open_ports_mutex);
 
   return true;
 }
@@ -443,12 +833,13 @@ void cleanup_scanner(void)
 {
   pthread_mutex_lock(&open_ports_mutex);
 
-  if (open_ports)
-  {
-    free(open_ports);
-    open_ports = NULL;
-  }
+  free(open_ports);
+  open_ports = NULL;
   num_open_ports = 0;
+  open_ports_capacity = 0;
+  free(scan_slab);
+  scan_slab = NULL;
+  scan_slab_size = 0;
 
   pthread_mutex_unlock(&open_ports_mutex);
 }
@@ -473,7 +864,9 @@ int is_port_open_connect(const char *target, int port)
   addr.sin_family = AF_INET;
   addr.sin_port = htons(port);
 
+  int64_t resolve_start = trace_begin();
   struct hostent *he = gethostbyname(target);
+  trace_end(TRACE_RESOLVE, resolve_start, port, NULL);
   if (he == NULL)
   {
     close(sockfd);
@@ -486,6 +879,9 @@ int is_port_open_connect(const char *target, int port)
   set_nonblocking(sockfd);
 
   // Try to connect
+  int64_t sent_at = scan_stats_now_us();
+  scan_stats_add(STAT_PROBES_SENT, 1);
+  scan_stats_gauge_add(GAUGE_IN_FLIGHT, 1);
   int result = connect(sockfd, (struct sockaddr *)&addr, sizeof(addr));
   if (result < 0)
   {
@@ -519,14 +915,21 @@ int is_port_open_connect(const char *target, int port)
         if (error == 0)
 #endif
         {
+          count_connect_probe(port, sent_at, PORT_STATE_OPEN);
           close(sockfd);
           return 1; // Port is open
         }
       }
+      count_connect_probe(port, sent_at, result > 0 ? PORT_STATE_CLOSED : PORT_STATE_FILTERED);
+    }
+    else
+    {
+      count_connect_probe(port, sent_at, PORT_STATE_CLOSED);
     }
   }
   else
   {
+    count_connect_probe(port, sent_at, PORT_STATE_OPEN);
     close(sockfd);
     return 1; // Port is open
   }
@@ -1,8 +1,17 @@
 #include "../include/service_detection.h"
+#include "../include/config.h"
+#include "../include/service_probes.h"
+#include "../include/banner_match.h"
+#include "../include/services.h"
+#include "../include/http_probe.h"
+#include "../include/scan_stats.h"
+#include "../include/trace.h"
+#include "../include/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -15,211 +24,456 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <fcntl.h>
 #include <errno.h>
 #endif
 
-// Common service entry structure (for internal database only)
+// How a banner read decides that the response is complete
+typedef enum
+{
+  BANNER_END_IDLE,   // Stop after a short quiet period following the last byte
+  BANNER_END_LINE,   // Stop at the end of a complete (final) reply line
+  BANNER_END_HEADERS // Stop at the blank line that ends HTTP headers
+} banner_end_t;
+
+// Largest pipelined request set build_http_requests can produce
+#define HTTP_REQUESTS_BUFFER (MAX_HTTP_REQUESTS * (MAX_HTTP_METHOD + MAX_HTTP_PATH + 384))
+
+// Buffers reused by every detection on a thread, rather than allocated for each port
 typedef struct
 {
-  int port;
-  const char *name;
-  const char *description;
-} CommonServiceEntry;
-
-// Common services database
-static const CommonServiceEntry common_services[] = {
-    {21, "ftp", "File Transfer Protocol"},
-    {22, "ssh", "Secure Shell"},
-    {23, "telnet", "Telnet"},
-    {25, "smtp", "Simple Mail Transfer Protocol"},
-    {53, "dns", "Domain Name System"},
-    {80, "http", "Hypertext Transfer Protocol"},
-    {110, "pop3", "Post Office Protocol 3"},
-    {143, "imap", "Internet Message Access Protocol"},
-    {443, "https", "HTTP Secure"},
-    {445, "smb", "Server Message Block"},
-    {993, "imaps", "IMAP Secure"},
-    {995, "pop3s", "POP3 Secure"},
-    {3306, "mysql", "MySQL Database"},
-    {3389, "rdp", "Remote Desktop Protocol"},
-    {5432, "postgresql", "PostgreSQL Database"},
-    {8080, "http-proxy", "HTTP Proxy"},
-    {0, NULL, NULL} // End marker
-};
+  tls_parser_t tls_parser;
+  char http_response[HTTP_MAX_RESPONSE + 1];
+  char http_requests[HTTP_REQUESTS_BUFFER];
+} detect_scratch_t;
 
-// Function to get service name for a port (local version)
-static const char *get_service_name_local(int port)
+static _Thread_local detect_scratch_t *local_scratch;
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_key_once = PTHREAD_ONCE_INIT;
+
+static void create_scratch_key(void)
 {
-    int i = 0;
-    while (common_services[i].port != 0) {
-        if (common_services[i].port == port) {
-            return common_services[i].name;
-        }
-        i++;
-    }
-    return NULL;
+  pthread_key_create(&scratch_key, free);
+}
+
+// The calling thread's scratch buffers, allocated on first use and freed when the thread exits
+static detect_scratch_t *thread_scratch(void)
+{
+  if (!local_scratch)
+  {
+    pthread_once(&scratch_key_once, create_scratch_key);
+    local_scratch = malloc(sizeof(detect_scratch_t));
+    if (local_scratch)
+      pthread_setspecific(scratch_key, local_scratch);
+  }
+  return local_scratch;
+}
+
+bool service_detection_reserve(void)
+{
+  return thread_scratch() != NULL;
+}
+
+static bool probe_tls(const char *host, uint32_t addr, int port, ServiceInfo *service_info);
+static bool probe_http(const char *host, uint32_t addr, int port, ServiceInfo *service_info);
+
+// Function to set socket to non-blocking mode
+static int set_socket_nonblocking(int sockfd, bool enable)
+{
+#ifdef _WIN32
+  unsigned long mode = enable ? 1 : 0;
+  return ioctlsocket(sockfd, FIONBIO, &mode);
+#else
+  int flags = fcntl(sockfd, F_GETFL, 0);
+  if (flags == -1)
+    return -1;
+  return fcntl(sockfd, F_SETFL, enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+#endif
+}
+
+// Clamp a millisecond value into [low, high]
+static long clamp_ms(long value, long low, long high)
+{
+  if (value < low)
+    return low;
+  if (value > high)
+    return high;
+  return value;
+}
+
+// Wait until the socket is readable; returns >0 if readable, 0 on timeout, <0 on error
+static int wait_readable(int sock, long timeout_ms)
+{
+  fd_set read_fds;
+  struct timeval tv;
+
+  FD_ZERO(&read_fds);
+  FD_SET(sock, &read_fds);
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+  return select(sock + 1, &read_fds, NULL, NULL, &tv);
+}
+
+// Whether a line starts with a three-digit reply code followed by separator
+static bool is_reply_line(const char *line, size_t len, char separator)
+{
+  return len >= 4 && isdigit((unsigned char)line[0]) && isdigit((unsigned char)line[1]) &&
+         isdigit((unsigned char)line[2]) && line[3] == separator;
 }
 
 /**
- * Attempts to grab a banner from a service running on the specified port
- * 
- * @param target The target host address
- * @param port The port to connect to
- * @param banner Buffer to store the banner
- * @param banner_size Size of the banner buffer
- * @return true if a banner was successfully grabbed, false otherwise
+ * Checks whether the bytes received so far form a complete response
+ *
+ * For line-oriented protocols (SSH, FTP, SMTP, POP3, IMAP) a response is complete once the
+ * last received line is terminated. An FTP/SMTP style reply that opens with a "ddd-" line
+ * runs on until a line starting with the same code and a space; the lines between may be free
+ * text (RFC 959, section 4.2). For HTTP the response is complete once the header block has
+ * been terminated.
+ *
+ * @param data Received bytes (NUL terminated)
+ * @param len Number of received bytes
+ * @param mode Termination rule to apply
+ * @return true if no more data needs to be read
  */
-bool grab_banner(const char *target, int port, char *banner, size_t banner_size)
+static bool banner_is_complete(const char *data, size_t len, banner_end_t mode)
 {
-    SOCKET sock;
-    struct sockaddr_in server_addr;
-    int result;
-    fd_set read_fds;
-    struct timeval timeout;
+  if (len == 0)
+    return false;
 
-    // Initialize Winsock if not already done
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        return false;
-    }
+  switch (mode)
+  {
+    case BANNER_END_HEADERS:
+      return strstr(data, "\r\n\r\n") != NULL || strstr(data, "\n\n") != NULL;
 
-    // Create socket
-    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sock == INVALID_SOCKET) {
-        WSACleanup();
+    case BANNER_END_LINE:
+    {
+      if (data[len - 1] != '\n')
         return false;
-    }
+      if (!is_reply_line(data, len, '-'))
+        return true;
 
-    // Set non-blocking mode
-    unsigned long mode = 1;  // Changed from u_long to unsigned long
-    if (ioctlsocket(sock, FIONBIO, &mode) != 0) {
-        closesocket(sock);
-        WSACleanup();
-        return false;
+      // "220-..." opens a multi-line reply; look for its "220 " closing line
+      const char *end = data + len;
+      const char *newline = memchr(data, '\n', len);
+      while (newline && newline + 1 < end)
+      {
+        const char *line = newline + 1;
+        if (is_reply_line(line, (size_t)(end - line), ' ') && memcmp(line, data, 3) == 0)
+          return true;
+        newline = memchr(line, '\n', (size_t)(end - line));
+      }
+      return false;
     }
 
-    // Setup server address
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    
-    // Try to resolve hostname if it's not an IP address
-    struct hostent *he = gethostbyname(target);
-    if (he != NULL) {
-        memcpy(&server_addr.sin_addr, he->h_addr_list[0], he->h_length);
-    } else {
-        server_addr.sin_addr.s_addr = inet_addr(target);
-    }
-    
-    server_addr.sin_port = htons((unsigned short)port);
-
-    // Connect to server
-    result = connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr));
-    if (result == SOCKET_ERROR) {
-        if (WSAGetLastError() != WSAEWOULDBLOCK) {
-            closesocket(sock);
-            WSACleanup();
-            return false;
-        }
-    }
+    case BANNER_END_IDLE:
+    default:
+      return false;
+  }
+}
+
+// Infer the termination rule from the first bytes of a response on an unfamiliar port
+static banner_end_t banner_mode_from_data(const char *data, size_t len)
+{
+  if (len >= 5 && strncmp(data, "HTTP/", 5) == 0)
+    return BANNER_END_HEADERS;
+  if ((len >= 4 && strncmp(data, "SSH-", 4) == 0) || (len >= 3 && strncmp(data, "+OK", 3) == 0) ||
+      (len >= 4 && strncmp(data, "* OK", 4) == 0))
+    return BANNER_END_LINE;
+  if (is_reply_line(data, len, ' ') || is_reply_line(data, len, '-'))
+    return BANNER_END_LINE;
+  return BANNER_END_IDLE;
+}
+
+/**
+ * Reads a response, stopping on a protocol cue rather than on a fixed timeout
+ *
+ * The first byte is awaited for at most first_wait_ms. After that the read continues until the
+ * response is complete according to mode, the buffer is full or the peer closes the connection.
+ * Responses without a recognisable terminator end when no new data arrives within idle_gap_ms.
+ *
+ * @return Number of bytes stored in buffer (NUL terminated)
+ */
+static size_t read_banner(int sock, char *buffer, size_t buffer_size, long first_wait_ms,
+                          long idle_gap_ms, banner_end_t mode)
+{
+  size_t total = 0;
+  long wait_ms = first_wait_ms;
+
+  buffer[0] = '\0';
+  while (total < buffer_size - 1)
+  {
+    if (wait_readable(sock, wait_ms) <= 0)
+      break;
+
+    int received = recv(sock, buffer + total, (int)(buffer_size - 1 - total), 0);
+    if (received <= 0)
+      break;
+    scan_stats_add(STAT_BYTES_RECEIVED, (uint64_t)received);
+
+    total += (size_t)received;
+    buffer[total] = '\0';
+
+    if (mode == BANNER_END_IDLE)
+      mode = banner_mode_from_data(buffer, total);
+
+    if (banner_is_complete(buffer, total, mode))
+      break;
+
+    // Without a protocol cue, the rest of the response is assumed to follow within a short gap;
+    // with one, a known-incomplete response is given the full wait to finish
+    wait_ms = (mode == BANNER_END_IDLE) ? idle_gap_ms : first_wait_ms;
+  }
+
+  return total;
+}
+
+/**
+ * Resolves a probe target to an IPv4 address
+ *
+ * Uses getaddrinfo rather than gethostbyname, whose static result is shared by every thread:
+ * the daemon and the library detect services for several scans at once.
+ *
+ * @param target Host name or address
+ * @param port Port the lookup is traced under
+ * @return The address in network byte order, or INADDR_NONE if it does not resolve
+ */
+static uint32_t resolve_probe_target(const char *target, int port)
+{
+  struct addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+
+  int64_t resolve_start = trace_begin();
+  int status = getaddrinfo(target, NULL, &hints, &result);
+  trace_end(TRACE_RESOLVE, resolve_start, port, NULL);
+  if (status != 0)
+    return INADDR_NONE;
+  uint32_t addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(result);
+  return addr;
+}
+
+/**
+ * Opens a TCP connection to the target, timing the handshake to estimate the RTT
+ *
+ * @param addr The target address, network byte order
+ * @param port The port to connect to
+ * @param rtt_ms Receives the measured handshake time in milliseconds
+ * @return Connected non-blocking socket, or -1 on failure
+ */
+static int open_probe_connection(uint32_t addr, int port, long *rtt_ms)
+{
+  struct sockaddr_in server_addr;
+  int result;
+
+  if (addr == INADDR_NONE)
+    return -1;
+
+#ifdef _WIN32
+  SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (sock == INVALID_SOCKET)
+    return -1;
+#else
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    return -1;
+#endif
+
+  // Set non-blocking mode so the handshake can be timed
+  if (set_socket_nonblocking(sock, true) != 0)
+  {
+    close(sock);
+    return -1;
+  }
 
-    // Set timeout for select operation
-    timeout.tv_sec = 3;  // 3 seconds timeout
-    timeout.tv_usec = 0;
+  // Setup server address
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_addr.s_addr = addr;
+  server_addr.sin_port = htons((unsigned short)port);
+
+  // Connect to server, timing the handshake to estimate the RTT
+  int64_t trace_start = trace_begin();
+  long connect_start = get_timestamp();
+  result = connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
+  if (result < 0)
+  {
+#ifdef _WIN32
+    if (WSAGetLastError() != WSAEWOULDBLOCK)
+#else
+    if (errno != EINPROGRESS)
+#endif
+    {
+      close(sock);
+      return -1;
+    }
 
-    // Wait for connection to complete
-    FD_ZERO(&read_fds);
-    FD_SET(sock, &read_fds);
     fd_set write_fds;
+    fd_set except_fds;
+    struct timeval timeout;
     FD_ZERO(&write_fds);
     FD_SET(sock, &write_fds);
-    fd_set except_fds;
     FD_ZERO(&except_fds);
     FD_SET(sock, &except_fds);
-    
-    result = select(0, &read_fds, &write_fds, &except_fds, &timeout);
-    if (result <= 0 || FD_ISSET(sock, &except_fds)) {
-        closesocket(sock);
-        WSACleanup();
-        return false;
+    timeout.tv_sec = BANNER_CONNECT_TIMEOUT / 1000;
+    timeout.tv_usec = (BANNER_CONNECT_TIMEOUT % 1000) * 1000;
+
+    result = select(sock + 1, NULL, &write_fds, &except_fds, &timeout);
+    if (result <= 0 || FD_ISSET(sock, &except_fds))
+    {
+      close(sock);
+      return -1;
     }
 
-    // Clear any non-blocking mode
-    mode = 0;
-    ioctlsocket(sock, FIONBIO, &mode);
-
-    // Wait for data
-    memset(banner, 0, banner_size);
-    timeout.tv_sec = 2;  // 2 seconds timeout
-    timeout.tv_usec = 0;
-    FD_ZERO(&read_fds);
-    FD_SET(sock, &read_fds);
-    result = select(0, &read_fds, NULL, NULL, &timeout);
-    
-    if (result <= 0) {
-        // Some services don't send a banner unprompted
-        // Send service-specific probes
-        if (port == 80 || port == 443 || port == 8080) {
-            // HTTP request
-            const char *request = "HEAD / HTTP/1.1\r\nHost: ";
-            send(sock, request, strlen(request), 0);
-            send(sock, target, strlen(target), 0);
-            const char *request_tail = "\r\nUser-Agent: NeptuneScanner/3.0\r\nAccept: */*\r\nConnection: close\r\n\r\n";
-            send(sock, request_tail, strlen(request_tail), 0);
-        } else if (port == 21) {
-            // FTP - typically sends a banner unprompted
-            // But we might send a HELP command to get more info
-            const char *request = "HELP\r\n";
-            send(sock, request, strlen(request), 0);
-        } else if (port == 25 || port == 587) {
-            // SMTP
-            const char *request = "EHLO neptunescanner.local\r\n";
-            send(sock, request, strlen(request), 0);
-        } else if (port == 110) {
-            // POP3
-            const char *request = "CAPA\r\n";
-            send(sock, request, strlen(request), 0);
-        } else if (port == 143) {
-            // IMAP
-            const char *request = "a001 CAPABILITY\r\n";
-            send(sock, request, strlen(request), 0);
-        } else if (port == 23) {
-            // Telnet - might not send banner initially
-            // Send a return to trigger a prompt
-            const char *request = "\r\n";
-            send(sock, request, strlen(request), 0);
-        } else if (port == 22) {
-            // SSH typically sends a banner without prompting
-        } else {
-            // Generic probe - just send a newline
-            const char *request = "\r\n";
-            send(sock, request, strlen(request), 0);
-        }
+    int so_error = 0;
+    socklen_t len = sizeof(so_error);
+    getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&so_error, &len);
+    if (so_error != 0)
+    {
+      close(sock);
+      return -1;
+    }
+  }
 
-        // Wait again for data after probe
-        timeout.tv_sec = 3;
-        timeout.tv_usec = 0;
-        FD_ZERO(&read_fds);
-        FD_SET(sock, &read_fds);
-        result = select(0, &read_fds, NULL, NULL, &timeout);
-        if (result <= 0) {
-            closesocket(sock);
-            WSACleanup();
-            return false;
-        }
+  *rtt_ms = get_timestamp() - connect_start;
+  trace_end(TRACE_CONNECT, trace_start, port, "service");
+  return (int)sock;
+}
+
+/**
+ * Sends the probes selected for a port and reads their replies
+ *
+ * Probes come from the probe database, ordered by how likely they are to match the port and
+ * limited by version_intensity. A silent NULL probe leaves the connection open for the next
+ * probe; every other probe after a reply or a send gets a fresh connection.
+ *
+ * @param addr The target address, network byte order
+ * @param port The port to probe
+ * @param banner Buffer that receives the first (or the matching) reply
+ * @param banner_size Size of the banner buffer
+ * @param banner_len Receives the length of the banner, which may hold NULs, or NULL
+ * @param service_info If not NULL, match rules are applied and probing stops at the first match;
+ *                     if NULL, probing stops at the first reply
+ * @param matched Set to true if a match rule identified the service
+ * @return true if any probe got a reply
+ */
+static bool run_service_probes(uint32_t addr, int port, char *banner, size_t banner_size,
+                               size_t *banner_len, ServiceInfo *service_info, bool *matched)
+{
+  const service_probe_t *selected[MAX_SERVICE_PROBES];
+  char response[MAX_BANNER_SIZE];
+  bool got_reply = false;
+  long rtt = 0;
+  int sock = -1;
+
+  *matched = false;
+  if (banner_size < 2)
+    return false;
+  banner[0] = '\0';
+  if (banner_len)
+    *banner_len = 0;
+
+  // The table is loaded once before any scan and only read here, as detection may run on
+  // several threads; a database with no probe for this port means no reply
+  int count = select_service_probes(port, version_intensity, selected, MAX_SERVICE_PROBES);
+  if (count == 0)
+    return false;
+
+  for (int i = 0; i < count; i++)
+  {
+    const service_probe_t *probe = selected[i];
+
+    if (sock < 0)
+    {
+      sock = open_probe_connection(addr, port, &rtt);
+      if (sock < 0)
+        break;
     }
 
-    // Receive data
-    result = recv(sock, banner, (int)banner_size - 1, 0);
-    if (result > 0) {
-        banner[result] = '\0';  // Null terminate
-        closesocket(sock);
-        WSACleanup();
-        return true;
+    long idle_gap = clamp_ms(rtt * 2, BANNER_MIN_IDLE_GAP, BANNER_MAX_IDLE_GAP);
+    long wait;
+    if (probe->payload_len == 0)
+    {
+      // Wait for an unsolicited banner
+      wait = clamp_ms(rtt * BANNER_RTT_MULTIPLIER, BANNER_MIN_WAIT, BANNER_MAX_WAIT);
+    }
+    else
+    {
+      // The reply needs at least one more RTT plus the server's processing time
+      wait = clamp_ms(rtt * BANNER_RTT_MULTIPLIER + BANNER_MIN_WAIT, BANNER_MIN_WAIT,
+                      BANNER_PROBE_MAX_WAIT);
+      int64_t send_start = trace_begin();
+      bool sent = send(sock, (const char *)probe->payload, (int)probe->payload_len, 0) > 0;
+      trace_end(TRACE_SEND, send_start, port, probe->name);
+      if (!sent)
+      {
+        close(sock);
+        sock = -1;
+        continue;
+      }
+      scan_stats_add(STAT_BYTES_SENT, probe->payload_len);
     }
 
-    closesocket(sock);
-    WSACleanup();
-  return false;
+    int64_t wait_start = trace_begin();
+    size_t len = read_banner(sock, response, sizeof(response), wait, idle_gap, BANNER_END_IDLE);
+    trace_end(TRACE_WAIT, wait_start, port, probe->name);
+    if (len == 0)
+    {
+      // A silent NULL probe leaves the connection usable for the next probe
+      if (probe->payload_len > 0)
+      {
+        close(sock);
+        sock = -1;
+      }
+      continue;
+    }
+
+    bool is_match =
+        service_info != NULL && match_service_probe(probe, response, len, service_info);
+    if (!got_reply || is_match)
+    {
+      size_t copy = len < banner_size - 1 ? len : banner_size - 1;
+      memcpy(banner, response, copy);
+      banner[copy] = '\0';
+      if (banner_len)
+        *banner_len = copy;
+      got_reply = true;
+    }
+
+    if (service_info == NULL || is_match)
+    {
+      *matched = is_match;
+      break;
+    }
+
+    close(sock);
+    sock = -1;
+  }
+
+  if (sock >= 0)
+    close(sock);
+
+  return got_reply;
+}
+
+/**
+ * Attempts to grab a banner from a service running on the specified port
+ *
+ * The wait for an unsolicited banner and the idle gap that ends a read are derived from the
+ * round-trip time measured while connecting, so most banners complete within one RTT.
+ *
+ * @param target The target host address
+ * @param port The port to connect to
+ * @param banner Buffer to store the banner
+ * @param banner_size Size of the banner buffer
+ * @return true if a banner was successfully grabbed, false otherwise
+ */
+bool grab_banner(const char *target, int port, char *banner, size_t banner_size)
+{
+  bool matched;
+  return run_service_probes(resolve_probe_target(target, port), port, banner, banner_size, NULL,
+                            NULL, &matched);
 }
 
 /**
@@ -334,330 +588,436 @@ bool detect_service_version(const char *target, int port, char *version, size_t
  * @return true if service was detected, false otherwise
  */
 bool detect_service(const char *host, int port, ServiceInfo *service_info)
+{
+  return detect_service_at(host, resolve_probe_target(host, port), port, service_info);
+}
+
+bool detect_service_at(const char *host, uint32_t addr, int port, ServiceInfo *service_info)
 {
   // Initialize service info
   memset(service_info, 0, sizeof(ServiceInfo));
   service_info->port = port;
 
-  // Try to grab the banner
-  bool banner_grabbed = grab_banner(host, port, service_info->banner, sizeof(service_info->banner));
-  
-  if (banner_grabbed)
-  {
-    // Banner was grabbed, identify service from it
-    identify_service(service_info);
-  }
-  
-  // Try protocol-specific detection based on port
-  bool detected = false;
-  
-  if (port == 80 || port == 443 || port == 8080)
-  {
-    detected = detect_http(host, port, service_info);
-  }
-  else if (port == 21)
+  // Services on TLS ports ignore the plaintext probes, so greet them with a ClientHello first
+  if (is_ssl_port(port))
   {
-    detected = detect_ftp(host, port, service_info);
+    int64_t tls_start = trace_begin();
+    bool tls = probe_tls(host, addr, port, service_info);
+    trace_end(TRACE_SERVICE, tls_start, port, "tls");
+    if (tls)
+      return true;
   }
-  else if (port == 22)
+
+  // Run the probes selected for this port; a matching rule identifies the service directly
+  bool matched = false;
+  int64_t stage_start = trace_begin();
+  bool banner_grabbed =
+      run_service_probes(addr, port, service_info->banner, sizeof(service_info->banner),
+                         &service_info->banner_len, service_info, &matched);
+  trace_end(TRACE_SERVICE, stage_start, port, "probes");
+
+  if (banner_grabbed && !matched)
   {
-    detected = detect_ssh(host, port, service_info);
+    // No rule matched, fall back to the banner heuristics
+    identify_service(service_info);
   }
-  else if (port == 23)
+
+  bool detected = matched || (banner_grabbed && service_info->service_name[0] != '\0');
+
+  // A full GET reveals the page title, and the server software if the probes did not
+  if (strcmp(service_info->protocol, "HTTP") == 0)
   {
-    // Inline implementation of Telnet detection
-    #ifdef _WIN32
-      SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-      if (sock != INVALID_SOCKET)
-    #else
-      int sock = socket(AF_INET, SOCK_STREAM, 0);
-      if (sock >= 0)
-    #endif
+    ServiceInfo probed = *service_info;
+    stage_start = trace_begin();
+    bool http = probe_http(host, addr, port, service_info);
+    trace_end(TRACE_SERVICE, stage_start, port, "http");
+    if (http)
     {
-      struct sockaddr_in addr;
-      addr.sin_family = AF_INET;
-      addr.sin_port = htons(port);
-      addr.sin_addr.s_addr = inet_addr(host);
-
-      if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) >= 0)
+      detected = true;
+      if (probed.version[0] != '\0')
       {
-        // Set receive timeout
-        struct timeval tv;
-        tv.tv_sec = 3;  // 3 seconds
-        tv.tv_usec = 0;
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-
-        char response[1024];
-        #ifdef _WIN32
-          int bytes_read = recv(sock, response, sizeof(response) - 1, 0);
-        #else
-          ssize_t bytes_read = recv(sock, response, sizeof(response) - 1, 0);
-        #endif
-        
-        if (bytes_read > 0)
-        {
-          response[bytes_read] = '\0';
-          strncpy(service_info->protocol, "TELNET", sizeof(service_info->protocol) - 1);
-          service_info->protocol[sizeof(service_info->protocol) - 1] = '\0';
-          
-          strncpy(service_info->service_name, "Telnet", sizeof(service_info->service_name) - 1);
-          service_info->service_name[sizeof(service_info->service_name) - 1] = '\0';
-          
-          strncpy(service_info->banner, response, sizeof(service_info->banner) - 1);
-          service_info->banner[sizeof(service_info->banner) - 1] = '\0';
-          detected = true;
-        }
+        // Keep what the probes identified; only the response details are new
+        http_info_t http = service_info->http;
+        *service_info = probed;
+        service_info->http = http;
       }
-      close(sock);
     }
   }
-  else if (port == 25 || port == 587)
+
+  // A port that stayed silent through every probe may still answer a ClientHello
+  if (!banner_grabbed && !is_ssl_port(port))
   {
-    detected = detect_smtp(host, port, service_info);
+    stage_start = trace_begin();
+    bool tls = probe_tls(host, addr, port, service_info);
+    trace_end(TRACE_SERVICE, stage_start, port, "tls");
+    if (tls)
+      return true;
   }
 
   // If all else fails, try to identify by port number
   if (!detected && service_info->service_name[0] == '\0')
   {
-    for (int i = 0; common_services[i].port != 0; i++)
-  {
-    if (common_services[i].port == port)
-    {
-        strncpy(service_info->service_name, common_services[i].name, sizeof(service_info->service_name) - 1);
-        strncpy(service_info->protocol, "tcp", sizeof(service_info->protocol) - 1);
-        detected = true;
-        break;
-      }
-    }
-  }
-  
-  // Default values if nothing else worked
-  if (!detected && service_info->service_name[0] == '\0')
-  {
-    const char *name = get_service_name_local(port);
-    strncpy(service_info->service_name, name ? name : "unknown", sizeof(service_info->service_name) - 1);
+    service_entry_t known;
+    bool found = lookup_service(port, SERVICE_PROTO_TCP, &known);
+    strncpy(service_info->service_name, found ? known.name : "unknown",
+            sizeof(service_info->service_name) - 1);
     strncpy(service_info->protocol, "tcp", sizeof(service_info->protocol) - 1);
+    detected = found;
   }
-  
+
   return detected;
 }
 
-bool detect_http(const char *host, int port, ServiceInfo *service_info)
+/**
+ * Detects a TLS service and reads its certificate
+ *
+ * Sends a single ClientHello and feeds the reply to the incremental parser as it arrives. The
+ * connection is dropped as soon as the leaf certificate has been parsed, so the handshake is
+ * never completed and no cryptography is needed.
+ *
+ * @param host The target host
+ * @param port The port to check
+ * @param service_info Filled with the TLS version, cipher and certificate on success
+ * @return true if the port speaks TLS
+ */
+bool detect_tls(const char *host, int port, ServiceInfo *service_info)
 {
-#ifdef _WIN32
-  SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-  if (sock == INVALID_SOCKET) {
-#ifdef _DEBUG
-    printf("Socket creation failed, error code: %d\n", WSAGetLastError());
-#endif
+  return probe_tls(host, resolve_probe_target(host, port), port, service_info);
+}
+
+// detect_tls on an address already resolved; host only names the server in the ClientHello
+static bool probe_tls(const char *host, uint32_t addr, int port, ServiceInfo *service_info)
+{
+  tls_info_t *info = &service_info->tls;
+  memset(info, 0, sizeof(*info));
+
+  // SNI only carries host names, never address literals
+  unsigned char hello[TLS_MAX_CLIENT_HELLO];
+  const char *server_name = inet_addr(host) == INADDR_NONE ? host : NULL;
+  size_t hello_len = tls_build_client_hello(server_name, hello, sizeof(hello));
+  if (hello_len == 0)
     return false;
-  }
-#else
-  int sock = socket(AF_INET, SOCK_STREAM, 0);
-  if (sock < 0) {
-#ifdef _DEBUG
-    printf("Socket creation failed\n");
-#endif
+
+  detect_scratch_t *scratch = thread_scratch();
+  if (!scratch)
     return false;
-  }
-#endif
+  tls_parser_t *parser = &scratch->tls_parser;
+  tls_parser_init(parser);
 
-  struct sockaddr_in addr;
-  struct hostent *he;
-  
-  // First try to resolve the hostname in case it's not an IP address
-  if ((he = gethostbyname(host)) != NULL) {
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
-  } else {
-    // Fall back to treating as IP address if hostname resolution fails
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(port);
-  addr.sin_addr.s_addr = inet_addr(host);
+  long rtt = 0;
+  int sock = open_probe_connection(addr, port, &rtt);
+  if (sock < 0)
+    return false;
+
+  tls_parse_status_t status = TLS_PARSE_ERROR;
+  if (send(sock, (const char *)hello, (int)hello_len, 0) == (int)hello_len)
+  {
+    scan_stats_add(STAT_BYTES_SENT, hello_len);
+    long wait = clamp_ms(rtt * BANNER_RTT_MULTIPLIER + BANNER_MIN_WAIT, BANNER_MIN_WAIT,
+                         BANNER_PROBE_MAX_WAIT);
+    unsigned char response[4096];
+
+    status = TLS_PARSE_MORE;
+    while (status == TLS_PARSE_MORE && wait_readable(sock, wait) > 0)
+    {
+      int received = recv(sock, (char *)response, sizeof(response), 0);
+      if (received <= 0)
+        break;
+      scan_stats_add(STAT_BYTES_RECEIVED, (uint64_t)received);
+      status = tls_parser_feed(parser, response, (size_t)received, info);
+    }
   }
 
-  // Set a timeout for connection
-  struct timeval tv;
-  tv.tv_sec = 5;  // 5 seconds connection timeout
-  tv.tv_usec = 0;
-  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
+  close(sock);
 
-  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  // An alert in reply to the ClientHello still proves the port speaks TLS
+  if (!info->server_hello && status != TLS_PARSE_ALERT)
   {
-#ifdef _WIN32
-#ifdef _DEBUG
-    printf("Connection failed, error code: %d\n", WSAGetLastError());
-#endif
-#endif
-    close(sock);
+    memset(info, 0, sizeof(*info));
     return false;
   }
 
-  // Use a more complete HTTP request with Host header to work better with virtual hosts
-  char request[256];
-  snprintf(request, sizeof(request), 
-           "GET / HTTP/1.1\r\nHost: %s\r\nUser-Agent: NeptuneScanner/1.0\r\nAccept: */*\r\nConnection: close\r\n\r\n", 
-           host);
+  service_entry_t known;
+  const char *version = tls_version_name(info->version);
+  snprintf(service_info->service_name, sizeof(service_info->service_name), "ssl/%s",
+           lookup_service(port, SERVICE_PROTO_TCP, &known) ? known.name : "unknown");
+  snprintf(service_info->protocol, sizeof(service_info->protocol), "%s",
+           version ? version : "TLS");
 
-#ifdef _WIN32
-  int sent = send(sock, request, (int)strlen(request), 0);
-  if (sent <= 0) {
-#ifdef _DEBUG
-    printf("Failed to send request, error code: %d\n", WSAGetLastError());
-#endif
-    close(sock);
-    return false;
-  }
-#else
-  int sent = send(sock, request, strlen(request), 0);
-  if (sent <= 0) {
-#ifdef _DEBUG
-    printf("Failed to send request\n");
-#endif
-    close(sock);
-    return false;
+  if (!info->server_hello)
+  {
+    snprintf(service_info->banner, sizeof(service_info->banner), "TLS alert %u", info->alert);
+    service_info->banner_len = strlen(service_info->banner);
+    return true;
   }
-#endif
 
-  char response[4096];  // Larger buffer for bigger responses
-  int total_bytes = 0;
-  int bytes_read;
-  
-  // Set a timeout for recv
-  tv.tv_sec = 3;  // 3 seconds timeout
-  tv.tv_usec = 0;
-  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-  
-  // Read response in chunks
-  while ((size_t)total_bytes < sizeof(response) - 1) {
-#ifdef _WIN32
-    bytes_read = recv(sock, response + total_bytes, sizeof(response) - 1 - total_bytes, 0);
-    if (bytes_read <= 0) {
-      break;  // No more data or error
+  const char *cipher = tls_cipher_name(info->cipher);
+  char cipher_hex[8];
+  snprintf(cipher_hex, sizeof(cipher_hex), "0x%04X", info->cipher);
+  snprintf(service_info->banner, sizeof(service_info->banner),
+           "%s %s; subject: %s; issuer: %s; SAN: %s; valid: %s to %s",
+           version ? version : "TLS", cipher ? cipher : cipher_hex, info->subject, info->issuer,
+           info->san, info->not_before, info->not_after);
+  service_info->banner_len = strlen(service_info->banner);
+  return true;
+}
+
+// Name the server software from the first response's headers and title
+static void identify_http_server(ServiceInfo *service_info)
+{
+  // Identify common servers from the Server header
+  const http_info_t *info = &service_info->http;
+  const char *server_info = info->server;
+  if (server_info[0])
+  {
+    const char *version_start = NULL;
+
+    if (strstr(server_info, "Apache"))
+    {
+      strncpy(service_info->service_name, "Apache", sizeof(service_info->service_name) - 1);
+      version_start = strstr(server_info, "Apache/");
+      if (version_start)
+        version_start += 7; // Skip "Apache/"
     }
-#else
-    bytes_read = recv(sock, response + total_bytes, sizeof(response) - 1 - total_bytes, 0);
-    if (bytes_read <= 0) {
-      break;  // No more data or error
+    else if (strstr(server_info, "nginx"))
+    {
+      strncpy(service_info->service_name, "nginx", sizeof(service_info->service_name) - 1);
+      version_start = strstr(server_info, "nginx/");
+      if (version_start)
+        version_start += 6; // Skip "nginx/"
+    }
+    else if (strstr(server_info, "Microsoft-IIS"))
+    {
+      strncpy(service_info->service_name, "IIS", sizeof(service_info->service_name) - 1);
+      version_start = strstr(server_info, "Microsoft-IIS/");
+      if (version_start)
+        version_start += 14; // Skip "Microsoft-IIS/"
+    }
+    else if (strstr(server_info, "gws"))
+    {
+      // Special case for Google Web Server
+      strncpy(service_info->service_name, "Google Web Server",
+              sizeof(service_info->service_name) - 1);
+      strncpy(service_info->version, "gws", sizeof(service_info->version) - 1);
+    }
+    else
+    {
+      // For other servers, just use the whole Server string
+      strncpy(service_info->service_name, server_info, sizeof(service_info->service_name) - 1);
+    }
+
+    // Extract version if found
+    if (version_start)
+    {
+      size_t j = 0;
+      while (version_start[j] && version_start[j] != ' ' && j < sizeof(service_info->version) - 1)
+      {
+        service_info->version[j] = version_start[j];
+        j++;
+      }
+      service_info->version[j] = '\0';
     }
-#endif
-    total_bytes += bytes_read;
   }
-  
-  close(sock);
 
-  if (total_bytes > 0)
+  // Without a recognised server, fall back to other hints in the response
+  if (!server_info[0] || strcmp(service_info->service_name, server_info) == 0)
   {
-    response[total_bytes] = '\0';
-    
-    // Set basic HTTP protocol
-    strncpy(service_info->protocol, "HTTP", sizeof(service_info->protocol) - 1);
-    service_info->protocol[sizeof(service_info->protocol) - 1] = '\0';
-    
-    strncpy(service_info->service_name, "Web Server", sizeof(service_info->service_name) - 1);
-    service_info->service_name[sizeof(service_info->service_name) - 1] = '\0';
-    
-    // Extract HTTP version from response
-    if (strncmp(response, "HTTP/", 5) == 0) {
-      char http_version[16] = {0};
-      int i = 5;
-      int j = 0;
-      while (response[i] && response[i] != ' ' && j < 15) {
-        http_version[j++] = response[i++];
-      }
-      if (j > 0) {
-        strncpy(service_info->version, http_version, sizeof(service_info->version) - 1);
-        service_info->version[sizeof(service_info->version) - 1] = '\0';
-      }
+    if (strncmp(info->powered_by, "PHP", 3) == 0)
+    {
+      strncpy(service_info->version, "PHP-powered", sizeof(service_info->version) - 1);
     }
-    
-    // Look for Server header
-    const char *server_header = strstr(response, "\r\nServer:");
-    if (server_header) {
-      server_header += 9;  // Skip "\r\nServer:"
-      
-      // Skip whitespace
-      while (*server_header && isspace((unsigned char)*server_header)) {
-        server_header++;
-      }
-      
-      // Extract server info
-      char server_info[128] = {0};
-      int i = 0;
-      while (server_header[i] && server_header[i] != '\r' && i < 127) {
-        server_info[i] = server_header[i];
-        i++;
-      }
-      
-      if (i > 0) {
-        // If we found a Server header, update both service_name and version
-        char *version_start = NULL;
-        
-        // Try to identify common servers
-        if (strstr(server_info, "Apache")) {
-          strncpy(service_info->service_name, "Apache", sizeof(service_info->service_name) - 1);
-          version_start = strstr(server_info, "Apache/");
-          if (version_start) {
-            version_start += 7;  // Skip "Apache/"
-          }
-        } else if (strstr(server_info, "nginx")) {
-          strncpy(service_info->service_name, "nginx", sizeof(service_info->service_name) - 1);
-          version_start = strstr(server_info, "nginx/");
-          if (version_start) {
-            version_start += 6;  // Skip "nginx/"
-          }
-        } else if (strstr(server_info, "Microsoft-IIS")) {
-          strncpy(service_info->service_name, "IIS", sizeof(service_info->service_name) - 1);
-          version_start = strstr(server_info, "Microsoft-IIS/");
-          if (version_start) {
-            version_start += 14;  // Skip "Microsoft-IIS/"
-          }
-        } else if (strstr(server_info, "gws")) {
-          // Special case for Google Web Server
-          strncpy(service_info->service_name, "Google Web Server", sizeof(service_info->service_name) - 1);
-          strncpy(service_info->version, "gws", sizeof(service_info->version) - 1);
-        } else {
-          // For other servers, just use the whole Server string
-          strncpy(service_info->service_name, server_info, sizeof(service_info->service_name) - 1);
-        }
-        
-        // Extract version if found
-        if (version_start) {
-          char version_str[64] = {0};
-          int j = 0;
-          while (version_start[j] && version_start[j] != ' ' && version_start[j] != '\r' && j < 63) {
-            version_str[j] = version_start[j];
-            j++;
-          }
-          if (j > 0) {
-            strncpy(service_info->version, version_str, sizeof(service_info->version) - 1);
-            service_info->version[sizeof(service_info->version) - 1] = '\0';
-          }
-        }
-      }
+    else if (strcmp(info->title, "Google") == 0)
+    {
+      strncpy(service_info->service_name, "Google Web Server",
+              sizeof(service_info->service_name) - 1);
+      strncpy(service_info->version, "gws", sizeof(service_info->version) - 1);
     }
-    
-    // If we don't have a version yet but we know it's a web server, try to determine type from response
-    if (service_info->version[0] == '\0') {
-      if (strstr(response, "X-Powered-By: PHP")) {
-        strncpy(service_info->version, "PHP-powered", sizeof(service_info->version) - 1);
-      } else if (strstr(response, "<title>Google</title>")) {
-        strncpy(service_info->service_name, "Google Web Server", sizeof(service_info->service_name) - 1);
-        strncpy(service_info->version, "gws", sizeof(service_info->version) - 1);
-      } else if (strstr(response, "cloudflare")) {
-        strncpy(service_info->service_name, "Cloudflare", sizeof(service_info->service_name) - 1);
-      }
+    else if (strstr(server_info, "cloudflare"))
+    {
+      strncpy(service_info->service_name, "Cloudflare", sizeof(service_info->service_name) - 1);
     }
-    
-    // Store a portion of the response as banner
-    strncpy(service_info->banner, response, sizeof(service_info->banner) - 1);
-    service_info->banner[sizeof(service_info->banner) - 1] = '\0';
-    
-    return true;
   }
+}
 
-  return false;
+// Outcome of reading one response of a pipeline
+typedef enum
+{
+  HTTP_READ_KEEP_ALIVE, // Response read; the connection can carry the next one
+  HTTP_READ_CLOSED,     // Response read; the server closes the connection after it
+  HTTP_READ_FAILED      // No complete response
+} http_read_t;
+
+// Receive more response bytes; false on timeout, close or a full buffer
+static bool recv_more(int sock, long wait_ms, char *buffer, size_t *total)
+{
+  if (*total >= HTTP_MAX_RESPONSE || wait_readable(sock, wait_ms) <= 0)
+    return false;
+  int received = recv(sock, buffer + *total, (int)(HTTP_MAX_RESPONSE - *total), 0);
+  if (received <= 0)
+    return false;
+  scan_stats_add(STAT_BYTES_RECEIVED, (uint64_t)received);
+  *total += (size_t)received;
+  return true;
+}
+
+// Drop the bytes the parser has consumed from the front of the buffer
+static void discard_consumed(http_parser_t *parser, char *buffer, size_t *total)
+{
+  size_t consumed = http_parser_discard(parser);
+  memmove(buffer, buffer + consumed, *total - consumed);
+  *total -= consumed;
+}
+
+/**
+ * Reads the next response of a pipeline and records it
+ *
+ * The buffer may already hold the start of the response (bytes left over from the previous
+ * one); on return it holds whatever followed this response.
+ *
+ * @param sock Connected socket
+ * @param wait_ms How long to wait for each segment
+ * @param buffer Receive buffer of HTTP_MAX_RESPONSE + 1 bytes
+ * @param total Number of bytes in buffer, updated
+ * @param request The request this response answers
+ * @param service_info Receives the response; the first one also fills the headers and title
+ * @return Whether a response was read and whether the connection stays usable
+ */
+static http_read_t read_http_response(int sock, long wait_ms, char *buffer, size_t *total,
+                                      const http_request_t *request, ServiceInfo *service_info)
+{
+  http_info_t *info = &service_info->http;
+  http_parser_t parser;
+  http_parser_init(&parser);
+  parser.head_request = strcmp(request->method, "HEAD") == 0;
+
+  // Headers and title first; the buffer is not compacted until they have been copied out
+  http_parse_status_t status = *total ? http_parser_feed(&parser, buffer, *total) : HTTP_PARSE_MORE;
+  while (status == HTTP_PARSE_MORE && recv_more(sock, wait_ms, buffer, total))
+    status = http_parser_feed(&parser, buffer, *total);
+  if (status != HTTP_PARSE_DONE && parser.state < HTTP_STATE_BODY)
+    return HTTP_READ_FAILED;
+
+  if (info->num_responses == 0)
+  {
+    http_parser_get_info(&parser, buffer, info);
+    snprintf(service_info->version, sizeof(service_info->version), "%d.%d",
+             parser.version / 10, parser.version % 10);
+
+    // Keep the header block as the banner
+    size_t banner_len = parser.body_start;
+    if (banner_len > sizeof(service_info->banner) - 1)
+      banner_len = sizeof(service_info->banner) - 1;
+    memcpy(service_info->banner, buffer, banner_len);
+    service_info->banner[banner_len] = '\0';
+    service_info->banner_len = banner_len;
+  }
+
+  http_response_t *response = &info->responses[info->num_responses++];
+  snprintf(response->request, sizeof(response->request), "%s %s", request->method,
+           request->path);
+  response->status_code = parser.status_code;
+  response->body_len = -1;
+
+  // The response ended before the title search did; its status is still usable, but where the
+  // next response starts is not known
+  if (status != HTTP_PARSE_DONE)
+    return HTTP_READ_CLOSED;
+
+  // Skip the rest of the body so the next response can be parsed
+  status = http_parser_skip_body(&parser, buffer, *total);
+  while (status == HTTP_PARSE_MORE)
+  {
+    // Reconnecting is cheaper than downloading a large page just to reach the next response
+    if (parser.body_len + parser.body_remaining > HTTP_MAX_SKIP_BODY)
+      return HTTP_READ_CLOSED;
+    discard_consumed(&parser, buffer, total);
+    if (!recv_more(sock, wait_ms, buffer, total))
+      return HTTP_READ_FAILED;
+    status = http_parser_skip_body(&parser, buffer, *total);
+  }
+  if (status != HTTP_PARSE_DONE)
+    return HTTP_READ_FAILED;
+
+  response->body_len = parser.body_len;
+  response->body_hash = parser.body_hash;
+  discard_consumed(&parser, buffer, total);
+  return parser.keep_alive ? HTTP_READ_KEEP_ALIVE : HTTP_READ_CLOSED;
+}
+
+/**
+ * Fingerprints an HTTP server with the request set configured for its port
+ *
+ * All requests are pipelined over one keep-alive connection and the responses are parsed as
+ * they arrive; bodies are hashed and skipped rather than stored. If the server closes the
+ * connection after a response, the remaining requests are sent on a new connection.
+ *
+ * @param host The target host
+ * @param port The port to check
+ * @param service_info Filled with the server software and the response details
+ * @return true if the port answered with an HTTP response
+ */
+bool detect_http(const char *host, int port, ServiceInfo *service_info)
+{
+  return probe_http(host, resolve_probe_target(host, port), port, service_info);
+}
+
+// detect_http on an address already resolved; host only goes into the Host header
+static bool probe_http(const char *host, uint32_t addr, int port, ServiceInfo *service_info)
+{
+  const http_request_set_t *set = select_http_requests(port);
+  detect_scratch_t *scratch = thread_scratch();
+  if (!scratch)
+    return false;
+  char *response = scratch->http_response;
+  char *requests = scratch->http_requests;
+  size_t requests_size = sizeof(scratch->http_requests);
+
+  memset(&service_info->http, 0, sizeof(service_info->http));
+  int next = 0;
+  for (int connection = 0; connection < set->num_requests && next < set->num_requests;
+       connection++)
+  {
+    long rtt = 0;
+    int sock = open_probe_connection(addr, port, &rtt);
+    if (sock < 0)
+      break;
+
+    size_t requests_len = build_http_requests(set, next, host, requests, requests_size);
+    if (requests_len == 0 || send(sock, requests, (int)requests_len, 0) != (int)requests_len)
+    {
+      close(sock);
+      break;
+    }
+    scan_stats_add(STAT_BYTES_SENT, requests_len);
+
+    long wait = clamp_ms(rtt * BANNER_RTT_MULTIPLIER + BANNER_MIN_WAIT, BANNER_MIN_WAIT,
+                         BANNER_PROBE_MAX_WAIT);
+    size_t total = 0;
+    http_read_t outcome = HTTP_READ_KEEP_ALIVE;
+    while (next < set->num_requests && outcome == HTTP_READ_KEEP_ALIVE)
+    {
+      outcome = read_http_response(sock, wait, response, &total, &set->requests[next],
+                                   service_info);
+      if (outcome != HTTP_READ_FAILED)
+        next++;
+    }
+    close(sock);
+
+    if (outcome == HTTP_READ_FAILED)
+      break;
+  }
+
+  if (service_info->http.num_responses == 0)
+    return false;
+
+  strncpy(service_info->protocol, "HTTP", sizeof(service_info->protocol) - 1);
+  service_info->protocol[sizeof(service_info->protocol) - 1] = '\0';
+
+  strncpy(service_info->service_name, "Web Server", sizeof(service_info->service_name) - 1);
+  service_info->service_name[sizeof(service_info->service_name) - 1] = '\0';
+
+  identify_http_server(service_info);
+  return true;
 }
 
 bool detect_ftp(const char *host, int port, ServiceInfo *service_info)
@@ -697,6 +1057,7 @@ bool detect_ftp(const char *host, int port, ServiceInfo *service_info)
     strcpy(service_info->protocol, "FTP");
     strcpy(service_info->service_name, "FTP Server");
     strncpy(service_info->banner, response, sizeof(service_info->banner) - 1);
+    service_info->banner_len = strnlen(service_info->banner, sizeof(service_info->banner));
     return true;
   }
 
@@ -740,6 +1101,7 @@ bool detect_ssh(const char *host, int port, ServiceInfo *service_info)
     strcpy(service_info->protocol, "SSH");
     strcpy(service_info->service_name, "SSH Server");
     strncpy(service_info->banner, response, sizeof(service_info->banner) - 1);
+    service_info->banner_len = strnlen(service_info->banner, sizeof(service_info->banner));
     return true;
   }
 
@@ -783,496 +1145,513 @@ bool detect_smtp(const char *host, int port, ServiceInfo *service_info)
     strcpy(service_info->protocol, "SMTP");
     strcpy(service_info->service_name, "Mail Server");
     strncpy(service_info->banner, response, sizeof(service_info->banner) - 1);
+    service_info->banner_len = strnlen(service_info->banner, sizeof(service_info->banner));
     return true;
   }
 
   return false;
 }
 
+// Banner signatures located by a single automaton pass in identify_service
+typedef enum
+{
+  SIG_HTTP,
+  SIG_SERVER_HEADER,
+  SIG_APACHE,
+  SIG_NGINX,
+  SIG_IIS,
+  SIG_LIGHTTPD,
+  SIG_SSH,
+  SIG_OPENSSH,
+  SIG_FTP,
+  SIG_FILEZILLA,
+  SIG_VSFTPD,
+  SIG_PROFTPD,
+  SIG_MS_FTP,
+  SIG_SMTP,
+  SIG_POSTFIX,
+  SIG_POSTFIX_VERSION,
+  SIG_EXIM,
+  SIG_EXIM_VERSION,
+  SIG_MS_ESMTP,
+  SIG_SENDMAIL,
+  SIG_SENDMAIL_VERSION,
+  SIG_POP3,
+  SIG_DOVECOT,
+  SIG_DOVECOT_VERSION,
+  SIG_UW,
+  SIG_IMAP,
+  SIG_CYRUS,
+  SIG_CYRUS_IMAP,
+  SIG_TELNET,
+  SIG_LOGIN,
+  SIG_USERNAME,
+  SIG_PASSWORD,
+  SIG_LINUX,
+  SIG_UBUNTU,
+  SIG_DEBIAN,
+  SIG_WINDOWS,
+  SIG_COUNT
+} banner_signature_t;
+
+static const char *const BANNER_SIGNATURES[SIG_COUNT] = {
+    [SIG_HTTP] = "HTTP/",
+    [SIG_SERVER_HEADER] = "\r\nServer:",
+    [SIG_APACHE] = "Apache",
+    [SIG_NGINX] = "nginx",
+    [SIG_IIS] = "Microsoft-IIS",
+    [SIG_LIGHTTPD] = "lighttpd",
+    [SIG_SSH] = "SSH-",
+    [SIG_OPENSSH] = "OpenSSH",
+    [SIG_FTP] = "FTP",
+    [SIG_FILEZILLA] = "FileZilla",
+    [SIG_VSFTPD] = "vsftpd",
+    [SIG_PROFTPD] = "ProFTPD",
+    [SIG_MS_FTP] = "Microsoft FTP Service",
+    [SIG_SMTP] = "SMTP",
+    [SIG_POSTFIX] = "Postfix",
+    [SIG_POSTFIX_VERSION] = "Postfix ",
+    [SIG_EXIM] = "Exim",
+    [SIG_EXIM_VERSION] = "Exim ",
+    [SIG_MS_ESMTP] = "Microsoft ESMTP",
+    [SIG_SENDMAIL] = "Sendmail",
+    [SIG_SENDMAIL_VERSION] = "Sendmail ",
+    [SIG_POP3] = "POP3",
+    [SIG_DOVECOT] = "Dovecot",
+    [SIG_DOVECOT_VERSION] = "Dovecot ",
+    [SIG_UW] = "UW",
+    [SIG_IMAP] = "IMAP",
+    [SIG_CYRUS] = "Cyrus",
+    [SIG_CYRUS_IMAP] = "Cyrus IMAP",
+    [SIG_TELNET] = "Telnet",
+    [SIG_LOGIN] = "login:",
+    [SIG_USERNAME] = "Username:",
+    [SIG_PASSWORD] = "Password:",
+    [SIG_LINUX] = "Linux",
+    [SIG_UBUNTU] = "Ubuntu",
+    [SIG_DEBIAN] = "Debian",
+    [SIG_WINDOWS] = "Windows",
+};
+
+// Signature automaton, compiled once on first use
+static ac_automaton_t *signature_matcher = NULL;
+static pthread_once_t signature_matcher_once = PTHREAD_ONCE_INIT;
+
+static void compile_signature_matcher(void)
+{
+  ac_automaton_t *ac = ac_create();
+  if (!ac)
+    return;
+
+  for (int i = 0; i < SIG_COUNT; i++)
+  {
+    if (ac_add_pattern(ac, BANNER_SIGNATURES[i], strlen(BANNER_SIGNATURES[i])) != i)
+    {
+      ac_free(ac);
+      return;
+    }
+  }
+
+  if (!ac_compile(ac))
+  {
+    ac_free(ac);
+    return;
+  }
+  signature_matcher = ac;
+}
+
+/**
+ * Locates every banner signature in one pass
+ *
+ * @param banner NUL-terminated banner
+ * @param hits Receives the offset of the first occurrence of each signature, or -1
+ */
+static void find_banner_signatures(const char *banner, int hits[SIG_COUNT])
+{
+  pthread_once(&signature_matcher_once, compile_signature_matcher);
+
+  if (signature_matcher)
+  {
+    ac_scan(signature_matcher, banner, strlen(banner), hits);
+    return;
+  }
+
+  // Out of memory while compiling: fall back to one search per signature
+  for (int i = 0; i < SIG_COUNT; i++)
+  {
+    const char *found = strstr(banner, BANNER_SIGNATURES[i]);
+    hits[i] = found ? (int)(found - banner) : -1;
+  }
+}
+
+/**
+ * Copies a version token into service_info->version
+ *
+ * The token ends at whitespace, at any character in stop_chars, or at the end of the string.
+ * The version is left unchanged if the token is empty.
+ */
+static void set_version_token(ServiceInfo *service_info, const char *start, const char *stop_chars)
+{
+  size_t j = 0;
+  while (start[j] && !isspace((unsigned char)start[j]) && !strchr(stop_chars, start[j]) &&
+         j < sizeof(service_info->version) - 1)
+  {
+    j++;
+  }
+
+  if (j > 0)
+  {
+    memcpy(service_info->version, start, j);
+    service_info->version[j] = '\0';
+  }
+}
+
+// Copy a string into a fixed-size ServiceInfo field
+#define SET_FIELD(field, value)                                                                    \
+  do                                                                                               \
+  {                                                                                                \
+    strncpy((field), (value), sizeof(field) - 1);                                                  \
+    (field)[sizeof(field) - 1] = '\0';                                                             \
+  } while (0)
+
 // Helper function to identify service from banner
 void identify_service(ServiceInfo *service_info)
 {
-    // Check if we have a banner to work with
-    if (service_info == NULL || service_info->banner[0] == '\0') {
+  // Check if we have a banner to work with
+  if (service_info == NULL || service_info->banner[0] == '\0')
+  {
     return;
-    }
-    
-    const char *banner = service_info->banner;
-    
-    // HTTP detection
-    if (strstr(banner, "HTTP/") != NULL)
+  }
+
+  const char *banner = service_info->banner;
+
+  // One pass finds every signature; the checks below only consult the hit table and run
+  // version extraction for signatures that are actually present
+  int hits[SIG_COUNT];
+  find_banner_signatures(banner, hits);
+
+  // HTTP detection
+  if (hits[SIG_HTTP] >= 0)
+  {
+    SET_FIELD(service_info->protocol, "HTTP");
+    SET_FIELD(service_info->service_name, "http");
+
+    // HTTP version is the token after "HTTP/"
+    set_version_token(service_info, banner + hits[SIG_HTTP] + 5, "");
+
+    // Identify specific web server from Server header
+    if (hits[SIG_SERVER_HEADER] >= 0)
     {
-        strncpy(service_info->protocol, "HTTP", sizeof(service_info->protocol) - 1);
-        strncpy(service_info->service_name, "http", sizeof(service_info->service_name) - 1);
-        
-        // Try to extract HTTP version
-        const char *http_ver = strstr(banner, "HTTP/");
-        if (http_ver) {
-            char version[32] = {0};
-            sscanf(http_ver, "HTTP/%31s", version);
-            
-            // Remove any spaces or newlines
-            char *end = version;
-            while (*end && *end != ' ' && *end != '\r' && *end != '\n')
-                end++;
-            *end = '\0';
-            
-            if (version[0]) {
-                strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-            }
+      const char *server_header = banner + hits[SIG_SERVER_HEADER] + 9; // Skip "\r\nServer:"
+      while (*server_header && isspace((unsigned char)*server_header))
+        server_header++;
+
+      char server_info[64] = {0};
+      int i = 0;
+      while (server_header[i] && server_header[i] != '\r' && i < 63)
+      {
+        server_info[i] = server_header[i];
+        i++;
+      }
+
+      if (i > 0)
+      {
+        // The header value is at most 63 bytes; products absent from the whole banner are
+        // skipped without searching it
+        const char *product;
+        if (hits[SIG_APACHE] >= 0 && (product = strstr(server_info, "Apache")) != NULL)
+        {
+          SET_FIELD(service_info->service_name, "Apache httpd");
+          if ((product = strstr(server_info, "Apache/")) != NULL)
+            set_version_token(service_info, product + 7, "(");
         }
-        
-        // Identify specific web server from Server header
-        const char *server_header = strstr(banner, "\r\nServer:");
-        if (server_header) {
-            server_header += 9; // Skip "\r\nServer:"
-            // Skip whitespace
-            while (*server_header && isspace((unsigned char)*server_header))
-                server_header++;
-            
-            char server_info[64] = {0};
-            int i = 0;
-            while (server_header[i] && server_header[i] != '\r' && i < 63) {
-                server_info[i] = server_header[i];
-                i++;
-            }
-            
-            if (i > 0) {
-                // Check for common web servers
-                if (strstr(server_info, "Apache"))
-                {
-                    strncpy(service_info->service_name, "Apache httpd", sizeof(service_info->service_name) - 1);
-                    // Try to extract version
-                    const char *ver_start = strstr(server_info, "Apache/");
-                    if (ver_start) {
-                        ver_start += 7; // Skip "Apache/"
-                        char version[32] = {0};
-                        int j = 0;
-                        while (ver_start[j] && ver_start[j] != ' ' && ver_start[j] != '(' && j < 31) {
-                            version[j] = ver_start[j];
-                            j++;
-                        }
-                        
-                        if (j > 0) {
-                            strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                        }
-                    }
-                }
-                else if (strstr(server_info, "nginx"))
-                {
-                    strncpy(service_info->service_name, "nginx", sizeof(service_info->service_name) - 1);
-                    // Try to extract version
-                    const char *ver_start = strstr(server_info, "nginx/");
-                    if (ver_start) {
-                        ver_start += 6; // Skip "nginx/"
-                        char version[32] = {0};
-                        int j = 0;
-                        while (ver_start[j] && ver_start[j] != ' ' && j < 31) {
-                            version[j] = ver_start[j];
-                            j++;
-                        }
-                        
-                        if (j > 0) {
-                            strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                        }
-                    }
-                }
-                else if (strstr(server_info, "Microsoft-IIS"))
-                {
-                    strncpy(service_info->service_name, "Microsoft IIS httpd", sizeof(service_info->service_name) - 1);
-                    // Try to extract version
-                    const char *ver_start = strstr(server_info, "Microsoft-IIS/");
-                    if (ver_start) {
-                        ver_start += 14; // Skip "Microsoft-IIS/"
-                        char version[32] = {0};
-                        int j = 0;
-                        while (ver_start[j] && ver_start[j] != ' ' && j < 31) {
-                            version[j] = ver_start[j];
-                            j++;
-                        }
-                        
-                        if (j > 0) {
-                            strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                        }
-                    }
-                }
-                else if (strstr(server_info, "lighttpd"))
-                {
-                    strncpy(service_info->service_name, "lighttpd", sizeof(service_info->service_name) - 1);
-    // Try to extract version
-                    const char *ver_start = strstr(server_info, "lighttpd/");
-                    if (ver_start) {
-                        ver_start += 9; // Skip "lighttpd/"
-                        char version[32] = {0};
-                        int j = 0;
-                        while (ver_start[j] && ver_start[j] != ' ' && j < 31) {
-                            version[j] = ver_start[j];
-                            j++;
-                        }
-                        
-                        if (j > 0) {
-                            strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                        }
-                    }
-                }
-                else
-                {
-                    // For other servers, just use the whole Server string
-                    strncpy(service_info->service_name, server_info, sizeof(service_info->service_name) - 1);
-                }
-            }
+        else if (hits[SIG_NGINX] >= 0 && (product = strstr(server_info, "nginx")) != NULL)
+        {
+          SET_FIELD(service_info->service_name, "nginx");
+          if ((product = strstr(server_info, "nginx/")) != NULL)
+            set_version_token(service_info, product + 6, "");
         }
-        
-        return;
+        else if (hits[SIG_IIS] >= 0 && (product = strstr(server_info, "Microsoft-IIS")) != NULL)
+        {
+          SET_FIELD(service_info->service_name, "Microsoft IIS httpd");
+          if ((product = strstr(server_info, "Microsoft-IIS/")) != NULL)
+            set_version_token(service_info, product + 14, "");
+        }
+        else if (hits[SIG_LIGHTTPD] >= 0 && (product = strstr(server_info, "lighttpd")) != NULL)
+        {
+          SET_FIELD(service_info->service_name, "lighttpd");
+          if ((product = strstr(server_info, "lighttpd/")) != NULL)
+            set_version_token(service_info, product + 9, "");
+        }
+        else
+        {
+          // For other servers, just use the whole Server string
+          SET_FIELD(service_info->service_name, server_info);
+        }
+      }
     }
-    // SSH detection
-    else if (strstr(banner, "SSH-"))
+
+    return;
+  }
+
+  // SSH detection
+  if (hits[SIG_SSH] >= 0)
+  {
+    SET_FIELD(service_info->protocol, "SSH");
+    SET_FIELD(service_info->service_name, "ssh");
+
+    // SSH banner format is typically: SSH-2.0-OpenSSH_8.1p1
+    const char *ssh_banner = banner + hits[SIG_SSH];
+    const char *software = strchr(ssh_banner + 4, '-');
+    if (software && *(software + 1))
     {
-        strncpy(service_info->protocol, "SSH", sizeof(service_info->protocol) - 1);
-        strncpy(service_info->service_name, "ssh", sizeof(service_info->service_name) - 1);
-        
-        // SSH banner format is typically: SSH-2.0-OpenSSH_8.1p1
-        const char *ssh_banner = strstr(banner, "SSH-");
-        if (ssh_banner) {
-            char protocol_version[10] = {0};
-            char software_version[64] = {0};
-            
-            // Parse protocol version (SSH-2.0)
-            sscanf(ssh_banner, "SSH-%9[^-]-", protocol_version);
-            
-            // Parse software version (OpenSSH_8.1p1)
-            const char *software = strchr(ssh_banner + 4, '-');
-            if (software && *(software+1)) {
-                software++; // Skip the dash
-                
-                int i = 0;
-                while (software[i] && software[i] != '\r' && software[i] != '\n' && i < 63) {
-                    software_version[i] = software[i];
-                    i++;
-                }
-                
-                // Determine the SSH implementation
-                if (strstr(software_version, "OpenSSH")) {
-                    strncpy(service_info->service_name, "OpenSSH", sizeof(service_info->service_name) - 1);
-                    
-                    // Extract version (e.g., 8.1p1)
-                    const char *ver = strstr(software_version, "OpenSSH_");
-                    if (ver) {
-                        ver += 8; // Skip "OpenSSH_"
-                        strncpy(service_info->version, ver, sizeof(service_info->version) - 1);
-                    }
-                } else {
-                    // For other SSH implementations, use the software version as is
-                    strncpy(service_info->service_name, software_version, sizeof(service_info->service_name) - 1);
-                }
-            }
-        }
-        
-        return;
+      software++; // Skip the dash
+
+      char software_version[64] = {0};
+      int i = 0;
+      while (software[i] && software[i] != '\r' && software[i] != '\n' && i < 63)
+      {
+        software_version[i] = software[i];
+        i++;
+      }
+
+      // Determine the SSH implementation
+      if (hits[SIG_OPENSSH] >= 0 && strstr(software_version, "OpenSSH"))
+      {
+        SET_FIELD(service_info->service_name, "OpenSSH");
+
+        // Extract version (e.g., 8.1p1)
+        const char *ver = strstr(software_version, "OpenSSH_");
+        if (ver)
+          SET_FIELD(service_info->version, ver + 8);
+      }
+      else
+      {
+        // For other SSH implementations, use the software version as is
+        SET_FIELD(service_info->service_name, software_version);
+      }
     }
-    // FTP detection
-    else if (strstr(banner, "FTP") != NULL || strncmp(banner, "220", 3) == 0)
+
+    return;
+  }
+
+  // FTP detection
+  if (hits[SIG_FTP] >= 0 || strncmp(banner, "220", 3) == 0)
+  {
+    SET_FIELD(service_info->protocol, "FTP");
+    SET_FIELD(service_info->service_name, "ftp");
+
+    char ftp_banner[256] = {0};
+    if (strncmp(banner, "220", 3) == 0)
     {
-        strncpy(service_info->protocol, "FTP", sizeof(service_info->protocol) - 1);
-        strncpy(service_info->service_name, "ftp", sizeof(service_info->service_name) - 1);
-        
-        char ftp_banner[256] = {0};
-        if (strncmp(banner, "220", 3) == 0) {
-            // Skip the 220 code and any spaces
-            const char *start = banner + 3;
-            while (*start && isspace((unsigned char)*start))
-                start++;
-            
-            // Copy the first line of the banner
-            int i = 0;
-            while (start[i] && start[i] != '\r' && start[i] != '\n' && i < 255) {
-                ftp_banner[i] = start[i];
-                i++;
-            }
-            
-            ftp_banner[i] = '\0';
-        } else {
-            // Just use the banner as is
-            strncpy(ftp_banner, banner, sizeof(ftp_banner) - 1);
-        }
-        
-        // Extract FTP server type and version
-        if (strstr(ftp_banner, "FileZilla")) {
-            strncpy(service_info->service_name, "FileZilla ftpd", sizeof(service_info->service_name) - 1);
-            const char *ver = strstr(ftp_banner, "FileZilla Server ");
-            if (ver) {
-                ver += 17; // Skip "FileZilla Server "
-                char version[32] = {0};
-                int j = 0;
-                while (ver[j] && !isspace((unsigned char)ver[j]) && j < 31) {
-                    version[j] = ver[j];
-                    j++;
-                }
-                
-                if (j > 0) {
-                    strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                }
-            }
-        } else if (strstr(ftp_banner, "vsftpd")) {
-            strncpy(service_info->service_name, "vsftpd", sizeof(service_info->service_name) - 1);
-            const char *ver = strstr(ftp_banner, "vsftpd ");
-            if (ver) {
-                ver += 7; // Skip "vsftpd "
-                char version[32] = {0};
-                int j = 0;
-                while (ver[j] && !isspace((unsigned char)ver[j]) && j < 31) {
-                    version[j] = ver[j];
-                    j++;
-                }
-                
-                if (j > 0) {
-                    strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                }
-            }
-        } else if (strstr(ftp_banner, "ProFTPD")) {
-            strncpy(service_info->service_name, "ProFTPD", sizeof(service_info->service_name) - 1);
-            const char *ver = strstr(ftp_banner, "ProFTPD ");
-            if (ver) {
-                ver += 8; // Skip "ProFTPD "
-                char version[32] = {0};
-                int j = 0;
-                while (ver[j] && !isspace((unsigned char)ver[j]) && j < 31) {
-                    version[j] = ver[j];
-                    j++;
-                }
-                
-                if (j > 0) {
-                    strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                }
-            }
-        } else if (strstr(ftp_banner, "Microsoft FTP Service")) {
-            strncpy(service_info->service_name, "Microsoft ftpd", sizeof(service_info->service_name) - 1);
-            // Version is usually not provided directly in the banner
-        } else {
-            // If we couldn't identify a specific server, use the banner content
-            // to provide some information about the server
-            if (strlen(ftp_banner) > 0) {
-                // Extract the first word as the service name if we couldn't identify it otherwise
-                char extracted_name[64] = {0};
-                sscanf(ftp_banner, "%63s", extracted_name);
-                if (strlen(extracted_name) > 0) {
-                    strncpy(service_info->service_name, extracted_name, sizeof(service_info->service_name) - 1);
-                }
-            }
-        }
-        
-        return;
+      // Skip the 220 code and any spaces, then copy the first line of the banner
+      const char *start = banner + 3;
+      while (*start && isspace((unsigned char)*start))
+        start++;
+
+      int i = 0;
+      while (start[i] && start[i] != '\r' && start[i] != '\n' && i < 255)
+      {
+        ftp_banner[i] = start[i];
+        i++;
+      }
     }
-    // SMTP detection
-    else if (strstr(banner, "SMTP") != NULL || strncmp(banner, "220", 3) == 0) 
+    else
     {
-        strncpy(service_info->protocol, "SMTP", sizeof(service_info->protocol) - 1);
-        strncpy(service_info->service_name, "smtp", sizeof(service_info->service_name) - 1);
-        
-        // Check for common mail servers in the banner
-        if (strstr(banner, "Postfix")) {
-            strncpy(service_info->service_name, "Postfix smtpd", sizeof(service_info->service_name) - 1);
-            // Try to extract Postfix version
-            const char *ver = strstr(banner, "Postfix ");
-            if (ver) {
-                ver += 8; // Skip "Postfix "
-                char version[32] = {0};
-                int j = 0;
-                while (ver[j] && !isspace((unsigned char)ver[j]) && j < 31) {
-                    version[j] = ver[j];
-                    j++;
-                }
-                
-                if (j > 0) {
-                    strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                }
-            }
-        } else if (strstr(banner, "Exim")) {
-            strncpy(service_info->service_name, "Exim smtpd", sizeof(service_info->service_name) - 1);
-            // Try to extract Exim version
-            const char *ver = strstr(banner, "Exim ");
-            if (ver) {
-                ver += 5; // Skip "Exim "
-                char version[32] = {0};
-                int j = 0;
-                while (ver[j] && !isspace((unsigned char)ver[j]) && j < 31) {
-                    version[j] = ver[j];
-                    j++;
-                }
-                
-                if (j > 0) {
-                    strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                }
-            }
-        } else if (strstr(banner, "Microsoft ESMTP")) {
-            strncpy(service_info->service_name, "Microsoft ESMTP", sizeof(service_info->service_name) - 1);
-            // Version typically not available in the banner
-        } else if (strstr(banner, "Sendmail")) {
-            strncpy(service_info->service_name, "Sendmail", sizeof(service_info->service_name) - 1);
-            // Try to extract Sendmail version
-            const char *ver = strstr(banner, "Sendmail ");
-            if (ver) {
-                ver += 9; // Skip "Sendmail "
-                char version[32] = {0};
-                int j = 0;
-                while (ver[j] && !isspace((unsigned char)ver[j]) && ver[j] != ';' && j < 31) {
-                    version[j] = ver[j];
-                    j++;
-                }
-                
-                if (j > 0) {
-                    strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                }
-            }
-        }
-        
-        return;
+      // Just use the banner as is
+      strncpy(ftp_banner, banner, sizeof(ftp_banner) - 1);
     }
-    // POP3 detection
-    else if (strstr(banner, "POP3") != NULL || strncmp(banner, "+OK", 3) == 0)
+
+    // Extract FTP server type and version
+    const char *ver;
+    if (hits[SIG_FILEZILLA] >= 0 && strstr(ftp_banner, "FileZilla"))
     {
-        strncpy(service_info->protocol, "POP3", sizeof(service_info->protocol) - 1);
-        strncpy(service_info->service_name, "pop3", sizeof(service_info->service_name) - 1);
-        
-        // Extract server info if available
-        if (strstr(banner, "Dovecot")) {
-            strncpy(service_info->service_name, "Dovecot pop3d", sizeof(service_info->service_name) - 1);
-        } else if (strstr(banner, "UW")) {
-            strncpy(service_info->service_name, "UW POP3", sizeof(service_info->service_name) - 1);
-        } else {
-            // Generic extraction of the banner info
-            const char *banner_start = banner;
-            if (strncmp(banner, "+OK", 3) == 0) {
-                banner_start += 3;
-                while (*banner_start && isspace((unsigned char)*banner_start))
-                    banner_start++;
-            }
-            
-            // If there's meaningful content, use it
-            if (banner_start && *banner_start) {
-                char extracted_info[64] = {0};
-                int i = 0;
-                while (banner_start[i] && banner_start[i] != '\r' && banner_start[i] != '\n' && i < 63) {
-                    extracted_info[i] = banner_start[i];
-                    i++;
-                }
-                
-                if (i > 0) {
-                    strncpy(service_info->version, extracted_info, sizeof(service_info->version) - 1);
-                }
-            }
-        }
-        
-        return;
+      SET_FIELD(service_info->service_name, "FileZilla ftpd");
+      if ((ver = strstr(ftp_banner, "FileZilla Server ")) != NULL)
+        set_version_token(service_info, ver + 17, "");
     }
-    // IMAP detection
-    else if (strstr(banner, "IMAP") != NULL || strncmp(banner, "* OK", 4) == 0)
+    else if (hits[SIG_VSFTPD] >= 0 && strstr(ftp_banner, "vsftpd"))
     {
-        strncpy(service_info->protocol, "IMAP", sizeof(service_info->protocol) - 1);
-        strncpy(service_info->service_name, "imap", sizeof(service_info->service_name) - 1);
-        
-        // Extract server info if available
-        if (strstr(banner, "Dovecot")) {
-            strncpy(service_info->service_name, "Dovecot imapd", sizeof(service_info->service_name) - 1);
-            // Try to extract Dovecot version
-            const char *ver = strstr(banner, "Dovecot ");
-            if (ver) {
-                ver += 8; // Skip "Dovecot "
-                char version[32] = {0};
-                int j = 0;
-                while (ver[j] && !isspace((unsigned char)ver[j]) && ver[j] != ')' && j < 31) {
-                    version[j] = ver[j];
-                    j++;
-                }
-                
-                if (j > 0) {
-                    strncpy(service_info->version, version, sizeof(service_info->version) - 1);
-                }
-            }
-        } else if (strstr(banner, "Cyrus")) {
-            strncpy(service_info->service_name, "Cyrus imapd", sizeof(service_info->service_name) - 1);
-            // Try to extract Cyrus version
-            const char *ver = strstr(banner, "Cyrus IMAP");
-            if (ver) {
-                ver = strchr(ver, 'v');
-                if (ver) {
-                    ver++; // Skip 'v'
-                    char version[32] = {0};
-                    int j = 0;
-                    while (ver[j] && !isspace((unsigned char)ver[j]) && ver[j] != ')' && j < 31) {
-                        version[j] = ver[j];
-                        j++;
-                    }
-                    
-                    if (j > 0) {
-        strncpy(service_info->version, version, sizeof(service_info->version) - 1);
+      SET_FIELD(service_info->service_name, "vsftpd");
+      if ((ver = strstr(ftp_banner, "vsftpd ")) != NULL)
+        set_version_token(service_info, ver + 7, "");
+    }
+    else if (hits[SIG_PROFTPD] >= 0 && strstr(ftp_banner, "ProFTPD"))
+    {
+      SET_FIELD(service_info->service_name, "ProFTPD");
+      if ((ver = strstr(ftp_banner, "ProFTPD ")) != NULL)
+        set_version_token(service_info, ver + 8, "");
+    }
+    else if (hits[SIG_MS_FTP] >= 0 && strstr(ftp_banner, "Microsoft FTP Service"))
+    {
+      SET_FIELD(service_info->service_name, "Microsoft ftpd");
+      // Version is usually not provided directly in the banner
+    }
+    else if (ftp_banner[0])
+    {
+      // Extract the first word as the service name if we couldn't identify it otherwise
+      char extracted_name[64] = {0};
+      sscanf(ftp_banner, "%63s", extracted_name);
+      if (extracted_name[0])
+        SET_FIELD(service_info->service_name, extracted_name);
+    }
+
+    return;
+  }
+
+  // SMTP detection
+  if (hits[SIG_SMTP] >= 0 || strncmp(banner, "220", 3) == 0)
+  {
+    SET_FIELD(service_info->protocol, "SMTP");
+    SET_FIELD(service_info->service_name, "smtp");
+
+    // Check for common mail servers in the banner
+    if (hits[SIG_POSTFIX] >= 0)
+    {
+      SET_FIELD(service_info->service_name, "Postfix smtpd");
+      if (hits[SIG_POSTFIX_VERSION] >= 0)
+        set_version_token(service_info, banner + hits[SIG_POSTFIX_VERSION] + 8, "");
+    }
+    else if (hits[SIG_EXIM] >= 0)
+    {
+      SET_FIELD(service_info->service_name, "Exim smtpd");
+      if (hits[SIG_EXIM_VERSION] >= 0)
+        set_version_token(service_info, banner + hits[SIG_EXIM_VERSION] + 5, "");
+    }
+    else if (hits[SIG_MS_ESMTP] >= 0)
+    {
+      SET_FIELD(service_info->service_name, "Microsoft ESMTP");
+      // Version typically not available in the banner
+    }
+    else if (hits[SIG_SENDMAIL] >= 0)
+    {
+      SET_FIELD(service_info->service_name, "Sendmail");
+      if (hits[SIG_SENDMAIL_VERSION] >= 0)
+        set_version_token(service_info, banner + hits[SIG_SENDMAIL_VERSION] + 9, ";");
+    }
+
+    return;
+  }
+
+  // POP3 detection
+  if (hits[SIG_POP3] >= 0 || strncmp(banner, "+OK", 3) == 0)
+  {
+    SET_FIELD(service_info->protocol, "POP3");
+    SET_FIELD(service_info->service_name, "pop3");
+
+    // Extract server info if available
+    if (hits[SIG_DOVECOT] >= 0)
+    {
+      SET_FIELD(service_info->service_name, "Dovecot pop3d");
+    }
+    else if (hits[SIG_UW] >= 0)
+    {
+      SET_FIELD(service_info->service_name, "UW POP3");
+    }
+    else
+    {
+      // Generic extraction of the banner info
+      const char *banner_start = banner;
+      if (strncmp(banner, "+OK", 3) == 0)
+      {
+        banner_start += 3;
+        while (*banner_start && isspace((unsigned char)*banner_start))
+          banner_start++;
+      }
+
+      // If there's meaningful content, use it as the version (first line only)
+      char extracted_info[64] = {0};
+      int i = 0;
+      while (banner_start[i] && banner_start[i] != '\r' && banner_start[i] != '\n' && i < 63)
+      {
+        extracted_info[i] = banner_start[i];
+        i++;
       }
+      if (i > 0)
+        SET_FIELD(service_info->version, extracted_info);
     }
+
+    return;
   }
-        } else {
-            // Generic extraction of the banner info
-            const char *banner_start = banner;
-            if (strncmp(banner, "* OK", 4) == 0) {
-                banner_start += 4;
-                while (*banner_start && isspace((unsigned char)*banner_start))
-                    banner_start++;
-            }
-            
-            // If there's meaningful content, use it
-            if (banner_start && *banner_start) {
-                char extracted_info[64] = {0};
-                int i = 0;
-                while (banner_start[i] && banner_start[i] != '\r' && banner_start[i] != '\n' && i < 63) {
-                    extracted_info[i] = banner_start[i];
-                    i++;
-                }
-                
-                if (i > 0) {
-                    strncpy(service_info->version, extracted_info, sizeof(service_info->version) - 1);
-                }
-            }
-        }
-        
-        return;
+
+  // IMAP detection
+  if (hits[SIG_IMAP] >= 0 || strncmp(banner, "* OK", 4) == 0)
+  {
+    SET_FIELD(service_info->protocol, "IMAP");
+    SET_FIELD(service_info->service_name, "imap");
+
+    // Extract server info if available
+    if (hits[SIG_DOVECOT] >= 0)
+    {
+      SET_FIELD(service_info->service_name, "Dovecot imapd");
+      if (hits[SIG_DOVECOT_VERSION] >= 0)
+        set_version_token(service_info, banner + hits[SIG_DOVECOT_VERSION] + 8, ")");
     }
-    // Telnet detection
-    else if (strstr(banner, "Telnet") != NULL || strstr(banner, "login:") != NULL || 
-             strstr(banner, "Username:") != NULL || strstr(banner, "Password:") != NULL)
+    else if (hits[SIG_CYRUS] >= 0)
     {
-        strncpy(service_info->protocol, "Telnet", sizeof(service_info->protocol) - 1);
-        strncpy(service_info->service_name, "telnet", sizeof(service_info->service_name) - 1);
-        
-        // Usually telnet doesn't provide version info directly in the banner
-        // But we can try to identify the telnet server type
-        if (strstr(banner, "Linux") || strstr(banner, "Ubuntu") || strstr(banner, "Debian")) {
-            strncpy(service_info->version, "Linux telnetd", sizeof(service_info->version) - 1);
-        } else if (strstr(banner, "Windows")) {
-            strncpy(service_info->version, "Windows telnetd", sizeof(service_info->version) - 1);
-        }
-        
-        return;
+      SET_FIELD(service_info->service_name, "Cyrus imapd");
+      if (hits[SIG_CYRUS_IMAP] >= 0)
+      {
+        // Version follows the first 'v' after "Cyrus IMAP"
+        const char *ver = strchr(banner + hits[SIG_CYRUS_IMAP], 'v');
+        if (ver)
+          set_version_token(service_info, ver + 1, ")");
+      }
     }
-    
-    // If we couldn't identify the service, try to extract some meaningful info from the banner
-    if (banner && banner[0]) {
-        char extracted_info[64] = {0};
-        int i = 0;
-        while (banner[i] && banner[i] != '\r' && banner[i] != '\n' && i < 63) {
-            extracted_info[i] = banner[i];
-            i++;
-        }
-        
-        if (i > 0) {
-            // Check if the banner starts with a service name
-            char service_name[32] = {0};
-            sscanf(extracted_info, "%31s", service_name);
-            
-            if (strlen(service_name) > 0) {
-                strncpy(service_info->service_name, service_name, sizeof(service_info->service_name) - 1);
-                strncpy(service_info->protocol, "tcp", sizeof(service_info->protocol) - 1);
-            }
-        }
+    else
+    {
+      // Generic extraction of the banner info
+      const char *banner_start = banner;
+      if (strncmp(banner, "* OK", 4) == 0)
+      {
+        banner_start += 4;
+        while (*banner_start && isspace((unsigned char)*banner_start))
+          banner_start++;
+      }
+
+      // If there's meaningful content, use it as the version (first line only)
+      char extracted_info[64] = {0};
+      int i = 0;
+      while (banner_start[i] && banner_start[i] != '\r' && banner_start[i] != '\n' && i < 63)
+      {
+        extracted_info[i] = banner_start[i];
+        i++;
+      }
+      if (i > 0)
+        SET_FIELD(service_info->version, extracted_info);
+    }
+
+    return;
+  }
+
+  // Telnet detection
+  if (hits[SIG_TELNET] >= 0 || hits[SIG_LOGIN] >= 0 || hits[SIG_USERNAME] >= 0 ||
+      hits[SIG_PASSWORD] >= 0)
+  {
+    SET_FIELD(service_info->protocol, "Telnet");
+    SET_FIELD(service_info->service_name, "telnet");
+
+    // Usually telnet doesn't provide version info directly in the banner
+    // But we can try to identify the telnet server type
+    if (hits[SIG_LINUX] >= 0 || hits[SIG_UBUNTU] >= 0 || hits[SIG_DEBIAN] >= 0)
+    {
+      SET_FIELD(service_info->version, "Linux telnetd");
+    }
+    else if (hits[SIG_WINDOWS] >= 0)
+    {
+      SET_FIELD(service_info->version, "Windows telnetd");
     }
+
+    return;
+  }
+
+  // If we couldn't identify the service, use the first word of the banner as its name
+  char service_name[32] = {0};
+  if (sscanf(banner, "%31s", service_name) == 1 && service_name[0])
+  {
+    SET_FIELD(service_info->service_name, service_name);
+    SET_FIELD(service_info->protocol, "tcp");
+  }
 }
 
 /**
@@ -1316,18 +1695,13 @@ bool detect_telnet(const char *target, int port, ServiceInfo *service_info)
     // Initialize address structure
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
-    struct hostent *he;
-    
-    // First try to resolve the hostname in case it's not an IP address
-    if ((he = gethostbyname(target)) != NULL) {
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(port);
-        memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
-    } else {
-        // Fall back to treating as IP address if hostname resolution fails
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(port);
-        addr.sin_addr.s_addr = inet_addr(target);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = resolve_probe_target(target, port);
+    if (addr.sin_addr.s_addr == INADDR_NONE)
+    {
+        close(sock);
+        return false;
     }
 
     // Set a timeout for connection
@@ -1376,9 +1750,9 @@ bool detect_telnet(const char *target, int port, ServiceInfo *service_info)
     // Null-terminate the received data
     buffer[bytes_read] = '\0';
     
-    // Copy the banner
-    strncpy(service_info->banner, buffer, sizeof(service_info->banner) - 1);
-    service_info->banner[sizeof(service_info->banner) - 1] = '\0';
+    // Copy the banner; option negotiation may hold NUL bytes, so keep its length
+    memcpy(service_info->banner, buffer, (size_t)bytes_read + 1);
+    service_info->banner_len = (size_t)bytes_read;
     
     // Try to determine version from banner
     if (strstr(buffer, "Linux") || strstr(buffer, "Ubuntu") || strstr(buffer, "Debian"))
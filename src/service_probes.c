@@ -0,0 +1,641 @@
+/**
+ * Neptune Scanner - Service Probe Database
+ * service_probes.c - Loading, selection and matching of service probes
+ */
+
+#include "../include/service_probes.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Loaded probe database
+static service_probe_t probes[MAX_SERVICE_PROBES];
+static int num_probes = 0;
+
+// Built-in probes used when no probe file can be read
+static const char DEFAULT_SERVICE_PROBES[] =
+    "Probe TCP NULL q||\n"
+    "rarity 1\n"
+    "match ssh m|^SSH-*-OpenSSH_%v| p/OpenSSH/\n"
+    "match ssh m|^SSH-|\n"
+    "match ftp m|^220*FTP|i\n"
+    "match smtp m|^220*SMTP|i\n"
+    "match pop3 m|^+OK|\n"
+    "match imap m|^\\* OK|\n"
+    "sslports 465,636,853,990,992-995,5061,6697\n"
+    "Probe TCP GetRequest q|HEAD / HTTP/1.0\\r\\n\\r\\n|\n"
+    "rarity 1\n"
+    "ports 80,443,8000,8008,8080,8443,8888\n"
+    "sslports 443,4443,8443,9443\n"
+    "match http m|^HTTP/1.*\\nServer: nginx/%v|i p/nginx/\n"
+    "match http m|^HTTP/1.*\\nServer: Apache/%v|i p/Apache httpd/\n"
+    "match http m|^HTTP/1.|\n"
+    "Probe TCP GenericLines q|\\r\\n|\n"
+    "rarity 1\n";
+
+// Parse a hexadecimal digit, returning -1 if c is not one
+static int hex_value(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+/**
+ * Decodes one escape sequence starting after the backslash
+ *
+ * @param src Pointer to the character following the backslash; advanced past the sequence
+ * @return Decoded byte
+ */
+static unsigned char decode_escape(const char **src)
+{
+  const char *p = *src;
+  unsigned char value;
+
+  switch (*p)
+  {
+    case 'r':
+      value = '\r';
+      p++;
+      break;
+    case 'n':
+      value = '\n';
+      p++;
+      break;
+    case 't':
+      value = '\t';
+      p++;
+      break;
+    case '0':
+      value = '\0';
+      p++;
+      break;
+    case 'x':
+      if (hex_value(p[1]) >= 0 && hex_value(p[2]) >= 0)
+      {
+        value = (unsigned char)(hex_value(p[1]) * 16 + hex_value(p[2]));
+        p += 3;
+        break;
+      }
+      value = 'x';
+      p++;
+      break;
+    default:
+      // \\, \| and any other escaped delimiter stand for themselves
+      value = (unsigned char)*p;
+      if (*p)
+        p++;
+      break;
+  }
+
+  *src = p;
+  return value;
+}
+
+/**
+ * Finds the end of a delimited field such as q|...| or p/.../
+ *
+ * @param start Pointer to the first character after the opening delimiter
+ * @param delim Delimiter character
+ * @return Pointer to the closing delimiter, or NULL if it is missing
+ */
+static const char *find_delimiter(const char *start, char delim)
+{
+  for (const char *p = start; *p; p++)
+  {
+    if (*p == '\\' && p[1])
+    {
+      p++;
+      continue;
+    }
+    if (*p == delim)
+      return p;
+  }
+  return NULL;
+}
+
+// Parse the "q|...|" payload of a Probe line
+static bool parse_payload(const char *text, service_probe_t *probe)
+{
+  if (text[0] != 'q' || !text[1])
+    return false;
+
+  char delim = text[1];
+  const char *end = find_delimiter(text + 2, delim);
+  if (!end)
+    return false;
+
+  probe->payload_len = 0;
+  for (const char *p = text + 2; p < end && probe->payload_len < MAX_PROBE_PAYLOAD;)
+  {
+    if (*p == '\\')
+    {
+      p++;
+      probe->payload[probe->payload_len++] = decode_escape(&p);
+    }
+    else
+    {
+      probe->payload[probe->payload_len++] = (unsigned char)*p++;
+    }
+  }
+  return true;
+}
+
+int parse_port_ranges(const char *text, probe_port_range_t *ranges, int max_ranges)
+{
+  const char *p = text;
+  int count = 0;
+
+  while (*p && count < max_ranges)
+  {
+    while (*p == ',' || isspace((unsigned char)*p))
+      p++;
+    if (!isdigit((unsigned char)*p))
+      break;
+
+    long low = strtol(p, (char **)&p, 10);
+    long high = low;
+    if (*p == '-')
+    {
+      p++;
+      high = strtol(p, (char **)&p, 10);
+    }
+
+    if (low < 0 || high > 65535 || low > high)
+      continue;
+
+    ranges[count].low = (unsigned short)low;
+    ranges[count].high = (unsigned short)high;
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Compiles a match pattern into tokens
+ *
+ * Pattern syntax: a leading ^ anchors the match at the start of the response, * matches any
+ * run of bytes and %v captures the longest version token that lets the rest match. Escapes (\r, \n, \t, \0, \xHH, \\, \*, \%)
+ * produce literal bytes.
+ */
+static bool compile_pattern(const char *start, const char *end, probe_match_t *match)
+{
+  const char *p = start;
+
+  match->num_tokens = 0;
+  match->anchored = false;
+  if (p < end && *p == '^')
+  {
+    match->anchored = true;
+    p++;
+  }
+
+  while (p < end)
+  {
+    if (match->num_tokens >= MAX_MATCH_PATTERN)
+      return false;
+
+    pattern_token_t *token = &match->tokens[match->num_tokens++];
+    if (*p == '\\')
+    {
+      p++;
+      token->kind = PATTERN_LITERAL;
+      token->byte = decode_escape(&p);
+    }
+    else if (*p == '*')
+    {
+      token->kind = PATTERN_ANY;
+      token->byte = 0;
+      p++;
+    }
+    else if (*p == '%' && p + 1 < end && p[1] == 'v')
+    {
+      token->kind = PATTERN_VERSION;
+      token->byte = 0;
+      p += 2;
+    }
+    else
+    {
+      token->kind = PATTERN_LITERAL;
+      token->byte = (unsigned char)*p++;
+    }
+  }
+
+  return match->num_tokens > 0;
+}
+
+// Parse a "match <service> m|pattern|[i] [p/product/]" line
+static bool parse_match(const char *text, service_probe_t *probe)
+{
+  probe_match_t match;
+  memset(&match, 0, sizeof(match));
+
+  // Service name
+  int name_len = 0;
+  while (text[name_len] && !isspace((unsigned char)text[name_len]))
+    name_len++;
+  if (name_len == 0 || name_len >= (int)sizeof(match.service))
+    return false;
+  memcpy(match.service, text, name_len);
+
+  // Pattern
+  const char *p = text + name_len;
+  while (isspace((unsigned char)*p))
+    p++;
+  if (p[0] != 'm' || !p[1])
+    return false;
+
+  char delim = p[1];
+  const char *pattern_end = find_delimiter(p + 2, delim);
+  if (!pattern_end || !compile_pattern(p + 2, pattern_end, &match))
+    return false;
+
+  // Flags and optional fields
+  p = pattern_end + 1;
+  while (*p && !isspace((unsigned char)*p))
+  {
+    if (*p == 'i')
+      match.nocase = true;
+    p++;
+  }
+
+  while (*p)
+  {
+    while (isspace((unsigned char)*p))
+      p++;
+    if (p[0] == 'p' && p[1])
+    {
+      const char *field_end = find_delimiter(p + 2, p[1]);
+      if (!field_end)
+        break;
+      size_t len = (size_t)(field_end - (p + 2));
+      if (len >= sizeof(match.product))
+        len = sizeof(match.product) - 1;
+      memcpy(match.product, p + 2, len);
+      match.product[len] = '\0';
+      p = field_end + 1;
+    }
+    else
+    {
+      // Skip fields we do not use (e.g., i/.../, o/.../)
+      while (*p && !isspace((unsigned char)*p))
+        p++;
+    }
+  }
+
+  probe_match_t *grown = realloc(probe->matches, (probe->num_matches + 1) * sizeof(probe_match_t));
+  if (!grown)
+    return false;
+  probe->matches = grown;
+  probe->matches[probe->num_matches++] = match;
+  return true;
+}
+
+/**
+ * Parses probe definitions from a buffer
+ *
+ * @param buffer Probe file contents (modified in place)
+ * @return Number of probes loaded
+ */
+static int parse_service_probes(char *buffer)
+{
+  service_probe_t *current = NULL;
+  char *line = buffer;
+
+  while (line && *line)
+  {
+    char *next = strchr(line, '\n');
+    if (next)
+      *next++ = '\0';
+
+    // Strip trailing CR and leading whitespace
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r')
+      line[len - 1] = '\0';
+    while (isspace((unsigned char)*line))
+      line++;
+
+    if (*line == '\0' || *line == '#')
+    {
+      line = next;
+      continue;
+    }
+
+    if (strncmp(line, "Probe ", 6) == 0)
+    {
+      current = NULL;
+
+      // Only TCP probes are used by the connect-based detector
+      char protocol[8] = {0};
+      char name[MAX_PROBE_NAME] = {0};
+      int consumed = 0;
+      if (sscanf(line + 6, "%7s %31s %n", protocol, name, &consumed) >= 2 &&
+          strcmp(protocol, "TCP") == 0 && num_probes < MAX_SERVICE_PROBES)
+      {
+        service_probe_t *probe = &probes[num_probes];
+        memset(probe, 0, sizeof(*probe));
+        strncpy(probe->name, name, sizeof(probe->name) - 1);
+        probe->rarity = 1;
+        if (parse_payload(line + 6 + consumed, probe))
+        {
+          current = probe;
+          num_probes++;
+        }
+      }
+    }
+    else if (current && strncmp(line, "ports ", 6) == 0)
+    {
+      current->num_port_ranges =
+          parse_port_ranges(line + 6, current->ports, MAX_PROBE_PORT_RANGES);
+    }
+    else if (current && strncmp(line, "sslports ", 9) == 0)
+    {
+      current->num_ssl_port_ranges =
+          parse_port_ranges(line + 9, current->ssl_ports, MAX_PROBE_PORT_RANGES);
+    }
+    else if (current && strncmp(line, "rarity ", 7) == 0)
+    {
+      current->rarity = atoi(line + 7);
+    }
+    else if (current && (strncmp(line, "match ", 6) == 0 || strncmp(line, "softmatch ", 10) == 0))
+    {
+      parse_match(strchr(line, ' ') + 1, current);
+    }
+
+    // Other nmap directives (totalwaitms, fallback, ...) are ignored
+    line = next;
+  }
+
+  return num_probes;
+}
+
+bool load_service_probes(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size <= 0)
+  {
+    fclose(file);
+    return false;
+  }
+
+  char *buffer = malloc((size_t)size + 1);
+  if (!buffer)
+  {
+    fclose(file);
+    return false;
+  }
+
+  size_t read = fread(buffer, 1, (size_t)size, file);
+  fclose(file);
+  buffer[read] = '\0';
+
+  free_service_probes();
+  int loaded = parse_service_probes(buffer);
+  free(buffer);
+
+  return loaded > 0;
+}
+
+void load_default_service_probes(void)
+{
+  char buffer[sizeof(DEFAULT_SERVICE_PROBES)];
+  memcpy(buffer, DEFAULT_SERVICE_PROBES, sizeof(buffer));
+
+  free_service_probes();
+  parse_service_probes(buffer);
+}
+
+void free_service_probes(void)
+{
+  for (int i = 0; i < num_probes; i++)
+  {
+    free(probes[i].matches);
+    probes[i].matches = NULL;
+    probes[i].num_matches = 0;
+  }
+  num_probes = 0;
+}
+
+bool ranges_have_port(const probe_port_range_t *ranges, int num_ranges, int port)
+{
+  for (int i = 0; i < num_ranges; i++)
+  {
+    if (port >= ranges[i].low && port <= ranges[i].high)
+      return true;
+  }
+  return false;
+}
+
+// Check whether a probe lists the port as one it usually matches
+static bool probe_has_port(const service_probe_t *probe, int port)
+{
+  return ranges_have_port(probe->ports, probe->num_port_ranges, port);
+}
+
+bool is_ssl_port(int port)
+{
+  for (int i = 0; i < num_probes; i++)
+  {
+    if (ranges_have_port(probes[i].ssl_ports, probes[i].num_ssl_port_ranges, port))
+      return true;
+  }
+  return false;
+}
+
+int select_service_probes(int port, int intensity, const service_probe_t **selected,
+                          int max_selected)
+{
+  int count = 0;
+  bool taken[MAX_SERVICE_PROBES] = {false};
+
+  // The NULL probe costs nothing to send and catches every service that greets first
+  for (int i = 0; i < num_probes && count < max_selected; i++)
+  {
+    if (probes[i].payload_len == 0)
+    {
+      selected[count++] = &probes[i];
+      taken[i] = true;
+    }
+  }
+
+  // Probes known to match this port are tried regardless of rarity
+  for (int i = 0; i < num_probes && count < max_selected; i++)
+  {
+    if (!taken[i] && probe_has_port(&probes[i], port))
+    {
+      selected[count++] = &probes[i];
+      taken[i] = true;
+    }
+  }
+
+  // Remaining probes, least rare first, up to the requested intensity
+  for (int rarity = 1; rarity <= intensity; rarity++)
+  {
+    for (int i = 0; i < num_probes && count < max_selected; i++)
+    {
+      if (!taken[i] && probes[i].rarity == rarity)
+      {
+        selected[count++] = &probes[i];
+        taken[i] = true;
+      }
+    }
+  }
+
+  return count;
+}
+
+// Characters that may appear in a captured version token
+static bool is_version_char(unsigned char c)
+{
+  return isalnum(c) || c == '.' || c == '_' || c == '-' || c == '+' || c == '~' || c == ':';
+}
+
+// Positions known not to lead to a match, per * or %v token
+//
+// A * at pos tries every continuation from pos to the end of the text and a %v at pos every
+// end of the version run it starts, so a token that fails at pos also fails at every later
+// position up to that limit. One interval per token is kept for a whole response, across
+// start offsets, which bounds the search to a pass over the text per wildcard.
+typedef struct
+{
+  size_t first[MAX_MATCH_PATTERN];
+  size_t last[MAX_MATCH_PATTERN];
+} match_memo_t;
+
+static void match_memo_init(match_memo_t *memo, int num_tokens)
+{
+  for (int i = 0; i < num_tokens; i++)
+  {
+    memo->first[i] = 1;
+    memo->last[i] = 0;
+  }
+}
+
+/**
+ * Matches compiled tokens against text starting at a fixed position
+ *
+ * * tries the shortest run first and %v the longest, giving bytes back until the rest of the
+ * pattern matches.
+ *
+ * @return true on a match; the first version capture is copied into version
+ */
+static bool match_tokens(const probe_match_t *match, int token, const unsigned char *text,
+                         size_t len, size_t pos, match_memo_t *memo, char *version,
+                         size_t version_size)
+{
+  while (token < match->num_tokens)
+  {
+    const pattern_token_t *t = &match->tokens[token];
+
+    if (t->kind == PATTERN_ANY || t->kind == PATTERN_VERSION)
+    {
+      if (pos >= memo->first[token] && pos <= memo->last[token])
+        return false;
+
+      // A version run that reaches the failed interval ends where it does
+      bool any = t->kind == PATTERN_ANY;
+      bool known = memo->first[token] <= memo->last[token] && memo->first[token] > pos;
+      size_t limit = len;
+      if (!any)
+      {
+        for (limit = pos; limit < len && is_version_char(text[limit]); limit++)
+        {
+          if (known && limit == memo->first[token])
+          {
+            limit = memo->last[token];
+            break;
+          }
+        }
+        if (limit == pos)
+          return false;
+      }
+
+      // Continuations shared with a later failed position need no second try
+      known = known && memo->last[token] == limit;
+      size_t low = any ? pos : pos + 1;
+      size_t high = known ? memo->first[token] - (any ? 1 : 0) : limit;
+      for (size_t i = 0; i <= high - low; i++)
+      {
+        size_t next = any ? low + i : high - i;
+        if (!match_tokens(match, token + 1, text, len, next, memo, version, version_size))
+          continue;
+
+        // Unwinding reaches the first capture last, so it is the one kept
+        if (!any)
+        {
+          size_t copy = next - pos < version_size ? next - pos : version_size - 1;
+          memcpy(version, text + pos, copy);
+          version[copy] = '\0';
+        }
+        return true;
+      }
+      memo->first[token] = pos;
+      memo->last[token] = limit;
+      return false;
+    }
+
+    if (pos >= len)
+      return false;
+
+    unsigned char c = text[pos];
+    unsigned char expected = t->byte;
+    if (match->nocase ? tolower(c) != tolower(expected) : c != expected)
+      return false;
+
+    pos++;
+    token++;
+  }
+
+  return true;
+}
+
+bool match_service_probe(const service_probe_t *probe, const char *response, size_t response_len,
+                         ServiceInfo *service_info)
+{
+  const unsigned char *text = (const unsigned char *)response;
+
+  for (int i = 0; i < probe->num_matches; i++)
+  {
+    const probe_match_t *match = &probe->matches[i];
+    size_t last_start = match->anchored ? 0 : response_len;
+    char version[sizeof(service_info->version)] = {0};
+    match_memo_t memo;
+    match_memo_init(&memo, match->num_tokens);
+
+    for (size_t start = 0; start <= last_start; start++)
+    {
+      if (!match_tokens(match, 0, text, response_len, start, &memo, version, sizeof(version)))
+        continue;
+
+      // Protocol is the upper-cased service name, matching the rest of the detector
+      size_t j;
+      for (j = 0; match->service[j] && j < sizeof(service_info->protocol) - 1; j++)
+        service_info->protocol[j] = (char)toupper((unsigned char)match->service[j]);
+      service_info->protocol[j] = '\0';
+
+      const char *name = match->product[0] ? match->product : match->service;
+      strncpy(service_info->service_name, name, sizeof(service_info->service_name) - 1);
+      service_info->service_name[sizeof(service_info->service_name) - 1] = '\0';
+
+      if (version[0])
+      {
+        strncpy(service_info->version, version, sizeof(service_info->version) - 1);
+        service_info->version[sizeof(service_info->version) - 1] = '\0';
+      }
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,381 @@
+/**
+ * Neptune Scanner - Service Records
+ * service_records.c - Service record table, string interning, the banner store and the arena
+ */
+
+#include "../include/service_records.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t hash_string(const char *text)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    hash = (hash ^ *c) * 16777619u;
+  return hash;
+}
+
+// 64-bit hash of a banner, eight bytes at a time
+static uint64_t hash_bytes(const char *data, size_t len)
+{
+  const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+  uint64_t hash = len * multiplier;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * multiplier;
+    hash ^= hash >> 29;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, len - i);
+  hash = (hash ^ tail) * multiplier;
+
+  // Finalizer from MurmurHash3, so every input bit reaches the low bits used for slots
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+void service_table_init(service_table_t *table)
+{
+  memset(table, 0, sizeof(*table));
+}
+
+void service_table_free(service_table_t *table)
+{
+  free(table->records);
+  free(table->arena);
+  free(table->strings);
+  free(table->intern_slots);
+  free(table->banners);
+  free(table->banner_slots);
+  memset(table, 0, sizeof(*table));
+}
+
+/**
+ * Copies bytes into the arena, NUL-terminated
+ *
+ * @param table Table
+ * @param data Bytes to store
+ * @param len Number of bytes
+ * @param offset Receives their offset; 0 when len is 0
+ * @return false if memory runs out or the arena would pass 4 GB
+ */
+static bool arena_store(service_table_t *table, const char *data, size_t len, uint32_t *offset)
+{
+  if (table->arena_used == 0)
+  {
+    // Offset 0 is the shared empty string
+    table->arena_capacity = 4096;
+    table->arena = malloc(table->arena_capacity);
+    if (!table->arena)
+      return false;
+    table->arena[0] = '\0';
+    table->arena_used = 1;
+  }
+  if (len == 0)
+  {
+    *offset = 0;
+    return true;
+  }
+
+  if (table->arena_used + len + 1 > table->arena_capacity)
+  {
+    size_t capacity = table->arena_capacity;
+    while (table->arena_used + len + 1 > capacity)
+      capacity *= 2;
+    if (capacity > UINT32_MAX)
+      return false;
+    char *arena = realloc(table->arena, capacity);
+    if (!arena)
+      return false;
+    table->arena = arena;
+    table->arena_capacity = capacity;
+  }
+
+  *offset = (uint32_t)table->arena_used;
+  memcpy(table->arena + table->arena_used, data, len);
+  table->arena[table->arena_used + len] = '\0';
+  table->arena_used += len + 1;
+  return true;
+}
+
+// Resize the intern hash to size slots (a power of two) and reinsert every string
+static bool resize_intern_slots(service_table_t *table, uint32_t size)
+{
+  uint32_t *slots = calloc(size, sizeof(uint32_t));
+  if (!slots)
+    return false;
+  for (uint32_t id = 1; id < table->num_strings; id++)
+  {
+    uint32_t i = hash_string(table->arena + table->strings[id]) & (size - 1);
+    while (slots[i])
+      i = (i + 1) & (size - 1);
+    slots[i] = id;
+  }
+  free(table->intern_slots);
+  table->intern_slots = slots;
+  table->intern_mask = size - 1;
+  return true;
+}
+
+/**
+ * Returns the ID of a string, adding it on first use
+ *
+ * @param table Table
+ * @param text String
+ * @param id Receives the ID; 0 for ""
+ * @return false if memory runs out
+ */
+static bool intern(service_table_t *table, const char *text, uint32_t *id)
+{
+  if (!*text)
+  {
+    *id = 0;
+    return true;
+  }
+
+  // Keep the hash at most half full; ID 0 is reserved for ""
+  if (table->num_strings == 0)
+    table->num_strings = 1;
+  if (2 * (table->num_strings + 1) > table->intern_mask + 1 &&
+      !resize_intern_slots(table, table->intern_mask ? (table->intern_mask + 1) * 2 : 64))
+    return false;
+
+  uint32_t i = hash_string(text) & table->intern_mask;
+  for (; table->intern_slots[i]; i = (i + 1) & table->intern_mask)
+  {
+    uint32_t candidate = table->intern_slots[i];
+    if (strcmp(table->arena + table->strings[candidate], text) == 0)
+    {
+      *id = candidate;
+      return true;
+    }
+  }
+
+  if (table->num_strings >= table->strings_capacity)
+  {
+    uint32_t capacity = table->strings_capacity ? table->strings_capacity * 2 : 32;
+    uint32_t *strings = realloc(table->strings, capacity * sizeof(uint32_t));
+    if (!strings)
+      return false;
+    table->strings = strings;
+    table->strings_capacity = capacity;
+    table->strings[0] = 0;
+  }
+
+  uint32_t offset;
+  if (!arena_store(table, text, strlen(text), &offset))
+    return false;
+  *id = table->num_strings++;
+  table->strings[*id] = offset;
+  table->intern_slots[i] = *id;
+  return true;
+}
+
+// Resize the banner hash to size slots (a power of two) and reinsert every banner
+static bool resize_banner_slots(service_table_t *table, uint32_t size)
+{
+  uint32_t *slots = calloc(size, sizeof(uint32_t));
+  if (!slots)
+    return false;
+  for (uint32_t id = 1; id < table->num_banners; id++)
+  {
+    uint32_t i = (uint32_t)table->banners[id].hash & (size - 1);
+    while (slots[i])
+      i = (i + 1) & (size - 1);
+    slots[i] = id;
+  }
+  free(table->banner_slots);
+  table->banner_slots = slots;
+  table->banner_mask = size - 1;
+  return true;
+}
+
+/**
+ * Returns the ID of a banner, storing it on first sight
+ *
+ * @param table Table
+ * @param data Banner bytes
+ * @param len Number of bytes
+ * @param id Receives the ID; 0 when len is 0
+ * @return false if memory runs out
+ */
+static bool store_banner(service_table_t *table, const char *data, uint32_t len, uint32_t *id)
+{
+  if (len == 0)
+  {
+    *id = 0;
+    return true;
+  }
+
+  // Keep the hash at most half full; ID 0 is reserved for no banner
+  if (table->num_banners == 0)
+    table->num_banners = 1;
+  if (2 * (table->num_banners + 1) > table->banner_mask + 1 &&
+      !resize_banner_slots(table, table->banner_mask ? (table->banner_mask + 1) * 2 : 64))
+    return false;
+
+  // Equal hashes are confirmed against the stored bytes, so a collision costs a compare
+  // rather than a wrong banner
+  uint64_t hash = hash_bytes(data, len);
+  uint32_t i = (uint32_t)hash & table->banner_mask;
+  for (; table->banner_slots[i]; i = (i + 1) & table->banner_mask)
+  {
+    const service_banner_t *candidate = &table->banners[table->banner_slots[i]];
+    if (candidate->hash == hash && candidate->len == len &&
+        memcmp(table->arena + candidate->offset, data, len) == 0)
+    {
+      *id = table->banner_slots[i];
+      return true;
+    }
+  }
+
+  if (table->num_banners >= table->banners_capacity)
+  {
+    uint32_t capacity = table->banners_capacity ? table->banners_capacity * 2 : 32;
+    service_banner_t *banners = realloc(table->banners, capacity * sizeof(service_banner_t));
+    if (!banners)
+      return false;
+    table->banners = banners;
+    table->banners_capacity = capacity;
+    memset(&table->banners[0], 0, sizeof(service_banner_t));
+  }
+
+  uint32_t offset;
+  if (!arena_store(table, data, len, &offset))
+    return false;
+  *id = table->num_banners++;
+  table->banners[*id] = (service_banner_t){hash, offset, len};
+  table->banner_slots[i] = *id;
+  return true;
+}
+
+// Smallest power of two hash size that keeps count entries (plus the reserved ID 0) at most
+// half full
+static uint32_t slots_for(size_t count)
+{
+  uint32_t size = 64;
+  while (size < 2 * (count + 2))
+    size *= 2;
+  return size;
+}
+
+bool service_table_reserve(service_table_t *table, size_t ports, size_t details_max)
+{
+  // Every port may bring two new strings, a banner and its longest text
+  size_t records = table->count + ports;
+  size_t strings = (table->num_strings ? table->num_strings : 1) + 2 * ports;
+  size_t banners = (table->num_banners ? table->num_banners : 1) + ports;
+  const ServiceInfo *info = NULL;
+  size_t text = sizeof(info->protocol) + sizeof(info->service_name) + sizeof(info->version) +
+                sizeof(info->banner) + details_max;
+  size_t arena = (table->arena_used ? table->arena_used : 1) + ports * text;
+  if (strings > UINT32_MAX / 8 || banners > UINT32_MAX / 8 || arena > UINT32_MAX)
+    return false;
+
+  if (records > table->capacity)
+  {
+    service_record_t *grown = realloc(table->records, records * sizeof(service_record_t));
+    if (!grown)
+      return false;
+    table->records = grown;
+    table->capacity = records;
+  }
+  if (strings > table->strings_capacity)
+  {
+    uint32_t *grown = realloc(table->strings, strings * sizeof(uint32_t));
+    if (!grown)
+      return false;
+    table->strings = grown;
+    table->strings_capacity = (uint32_t)strings;
+    table->strings[0] = 0;
+  }
+  if (banners > table->banners_capacity)
+  {
+    service_banner_t *grown = realloc(table->banners, banners * sizeof(service_banner_t));
+    if (!grown)
+      return false;
+    table->banners = grown;
+    table->banners_capacity = (uint32_t)banners;
+    memset(&table->banners[0], 0, sizeof(service_banner_t));
+  }
+  if ((slots_for(strings) > table->intern_mask + 1 &&
+       !resize_intern_slots(table, slots_for(strings))) ||
+      (slots_for(banners) > table->banner_mask + 1 &&
+       !resize_banner_slots(table, slots_for(banners))))
+    return false;
+
+  // The arena is created by its first store; reserving starts it with the empty string
+  if (arena > table->arena_capacity)
+  {
+    char *grown = realloc(table->arena, arena);
+    if (!grown)
+      return false;
+    if (table->arena_used == 0)
+    {
+      grown[0] = '\0';
+      table->arena_used = 1;
+    }
+    table->arena = grown;
+    table->arena_capacity = arena;
+  }
+  return true;
+}
+
+bool service_table_add(service_table_t *table, const ServiceInfo *info, const char *details)
+{
+  if (table->count == table->capacity)
+  {
+    size_t capacity = table->capacity ? table->capacity * 2 : 64;
+    service_record_t *records = realloc(table->records, capacity * sizeof(service_record_t));
+    if (!records)
+      return false;
+    table->records = records;
+    table->capacity = capacity;
+  }
+
+  // Binary banners may hold NULs, so take the received length; callers that fill a banner
+  // without one have a text banner that ends at its first NUL
+  size_t banner_len = info->banner_len;
+  if (banner_len == 0 || banner_len >= sizeof(info->banner))
+    banner_len = strnlen(info->banner, sizeof(info->banner));
+
+  service_record_t record;
+  memset(&record, 0, sizeof(record));
+  record.port = (uint16_t)info->port;
+  if (!intern(table, info->protocol, &record.protocol) ||
+      !intern(table, info->service_name, &record.service) ||
+      !arena_store(table, info->version, strnlen(info->version, sizeof(info->version)),
+                   &record.version) ||
+      !store_banner(table, info->banner, (uint32_t)banner_len, &record.banner) ||
+      !arena_store(table, details ? details : "", details ? strlen(details) : 0,
+                   &record.details))
+    return false;
+
+  table->records[table->count++] = record;
+  return true;
+}
+
+const char *service_table_banner(const service_table_t *table, uint32_t id, uint32_t *len)
+{
+  if (len)
+    *len = id ? table->banners[id].len : 0;
+  return id ? table->arena + table->banners[id].offset : "";
+}
+
+const char *service_table_text(const service_table_t *table, uint32_t offset)
+{
+  return offset ? table->arena + offset : "";
+}
+
+const char *service_table_string(const service_table_t *table, uint32_t id)
+{
+  return id ? table->arena + table->strings[id] : "";
+}
@@ -0,0 +1,268 @@
+/**
+ * Neptune Scanner - Port to Service Lookup
+ * services.c - Compiled-in services table, memory-mapped services database and lookups
+ */
+
+#include "../include/services.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const service_entry_t SERVICES[SERVICE_COUNT] = {
+#define SERVICE(port, name, description, frequency)                                                \
+  [SERVICE_ID_##port] = {port, name, description, frequency},
+#include "../include/services.def"
+#undef SERVICE
+};
+
+// Row number + 1 for every port in the compiled-in table, 0 for ports that are not
+static const uint16_t SERVICE_INDEX[65536] = {
+#define SERVICE(port, name, description, frequency) [port] = SERVICE_ID_##port + 1,
+#include "../include/services.def"
+#undef SERVICE
+};
+
+// The mapped services database, if one is loaded
+static struct
+{
+  const unsigned char *base;            // Start of the mapping
+  size_t size;                          // Size of the mapping
+  const services_db_record_t *records;  // Records, most frequent first
+  uint32_t num_records;                 // Number of records
+  const uint16_t *index[2];             // Per-port record number + 1: [0] TCP, [1] UDP
+  const char *strings;                  // String pool
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#endif
+} services_db;
+
+// Map a whole file read-only; returns NULL on failure
+static const unsigned char *map_file(const char *path, size_t *size)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return NULL;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping)
+  {
+    CloseHandle(file);
+    return NULL;
+  }
+
+  const unsigned char *base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!base)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return NULL;
+  }
+
+  services_db.file = file;
+  services_db.mapping = mapping;
+  *size = (size_t)file_size.QuadPart;
+  return base;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping keeps the file referenced
+  if (base == MAP_FAILED)
+    return NULL;
+
+  *size = (size_t)st.st_size;
+  return base;
+#endif
+}
+
+static void unmap_file(void)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(services_db.base);
+  CloseHandle(services_db.mapping);
+  CloseHandle(services_db.file);
+#else
+  munmap((void *)services_db.base, services_db.size);
+#endif
+}
+
+// Check that every offset in the mapped file stays inside it
+static bool validate_services_db(const unsigned char *base, size_t size)
+{
+  if (size < sizeof(services_db_header_t))
+    return false;
+
+  const services_db_header_t *header = (const services_db_header_t *)base;
+  if (memcmp(header->magic, SERVICES_DB_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SERVICES_DB_VERSION || header->byte_order != SERVICES_DB_BYTE_ORDER ||
+      header->num_records > SERVICES_DB_MAX_RECORDS)
+  {
+    return false;
+  }
+
+  size_t records_end =
+      (size_t)header->records_offset + (size_t)header->num_records * sizeof(services_db_record_t);
+  size_t index_end = (size_t)header->index_offset + 2 * 65536 * sizeof(uint16_t);
+  size_t strings_end = (size_t)header->strings_offset + header->strings_size;
+  if (header->records_offset % 4 != 0 || header->index_offset % 2 != 0 || records_end > size ||
+      index_end > size || strings_end > size || header->strings_size == 0 ||
+      base[strings_end - 1] != '\0')
+  {
+    return false;
+  }
+
+  // Index entries and string offsets are trusted by the lookups, so check them once here
+  const services_db_record_t *records =
+      (const services_db_record_t *)(base + header->records_offset);
+  for (uint32_t i = 0; i < header->num_records; i++)
+  {
+    if (records[i].name >= header->strings_size || records[i].description >= header->strings_size)
+      return false;
+  }
+
+  const uint16_t *index = (const uint16_t *)(base + header->index_offset);
+  for (size_t i = 0; i < 2 * 65536; i++)
+  {
+    if (index[i] > header->num_records)
+      return false;
+  }
+
+  return true;
+}
+
+bool load_services_db(const char *path)
+{
+  unload_services_db();
+
+  size_t size = 0;
+  const unsigned char *base = map_file(path, &size);
+  if (!base)
+    return false;
+
+  services_db.base = base;
+  services_db.size = size;
+  if (!validate_services_db(base, size))
+  {
+    fprintf(stderr, "Warning: %s is not a valid services database\n", path);
+    unload_services_db();
+    return false;
+  }
+
+  const services_db_header_t *header = (const services_db_header_t *)base;
+  services_db.records = (const services_db_record_t *)(base + header->records_offset);
+  services_db.num_records = header->num_records;
+  services_db.index[0] = (const uint16_t *)(base + header->index_offset);
+  services_db.index[1] = services_db.index[0] + 65536;
+  services_db.strings = (const char *)(base + header->strings_offset);
+  return true;
+}
+
+void unload_services_db(void)
+{
+  if (services_db.base)
+    unmap_file();
+  memset(&services_db, 0, sizeof(services_db));
+}
+
+// Fill an entry from a database record
+static void entry_from_record(const services_db_record_t *record, service_entry_t *entry)
+{
+  entry->port = record->port;
+  entry->name = services_db.strings + record->name;
+  entry->description = services_db.strings + record->description;
+  entry->frequency = record->frequency / SERVICES_DB_FREQUENCY_SCALE;
+}
+
+bool lookup_service(int port, service_proto_t protocol, service_entry_t *entry)
+{
+  if (port < 0 || port > 65535)
+    return false;
+
+  if (services_db.base)
+  {
+    uint16_t row = services_db.index[protocol == SERVICE_PROTO_UDP][port];
+    if (row != 0)
+    {
+      entry_from_record(&services_db.records[row - 1], entry);
+
+      // The compiled-in table can supply a missing TCP description
+      if (entry->description[0] == '\0' && protocol == SERVICE_PROTO_TCP && SERVICE_INDEX[port])
+        entry->description = SERVICES[SERVICE_INDEX[port] - 1].description;
+      return true;
+    }
+  }
+
+  if (protocol != SERVICE_PROTO_TCP || SERVICE_INDEX[port] == 0)
+    return false;
+  *entry = SERVICES[SERVICE_INDEX[port] - 1];
+  return true;
+}
+
+const char *get_service_name(int port)
+{
+  service_entry_t entry;
+  return lookup_service(port, SERVICE_PROTO_TCP, &entry) ? entry.name : "Unknown";
+}
+
+const char *get_service_description(int port)
+{
+  service_entry_t entry;
+  if (!lookup_service(port, SERVICE_PROTO_TCP, &entry) || entry.description[0] == '\0')
+    return "Unknown service";
+  return entry.description;
+}
+
+double get_service_frequency(int port)
+{
+  service_entry_t entry;
+  return lookup_service(port, SERVICE_PROTO_TCP, &entry) ? entry.frequency : 0.0;
+}
+
+int get_top_ports(service_proto_t protocol, int count, int *ports)
+{
+  int found = 0;
+
+  // Database records are already sorted by descending frequency
+  if (services_db.base)
+  {
+    for (uint32_t i = 0; i < services_db.num_records && found < count; i++)
+    {
+      if (services_db.records[i].protocol == protocol)
+        ports[found++] = services_db.records[i].port;
+    }
+    return found;
+  }
+
+  if (protocol != SERVICE_PROTO_TCP)
+    return 0;
+  for (int i = 0; i < SERVICE_COUNT && found < count; i++)
+    ports[found++] = SERVICES[i].port;
+  return found;
+}
@@ -0,0 +1,490 @@
+/**
+ * Neptune Scanner - SYN Scan Engine
+ * syn_engine.c - Probe slots, pacing, retransmission, reply matching and job scheduling
+ */
+
+#include "../include/syn_engine.h"
+#include "../include/advanced_scan.h"
+#include "../include/config.h"
+#include "../include/scan_stats.h"
+#include "../include/trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#define REPLY_BATCH 256        // Replies taken from the transport per poll
+#define STRIDE_SCALE (1 << 20) // Pass added per probe is STRIDE_SCALE / weight
+
+// A probe in flight
+typedef struct
+{
+  syn_job_t *job;   // Job the probe belongs to
+  uint32_t addr;    // Target host
+  uint16_t port;    // Target port
+  uint8_t tries;    // Times sent
+  bool in_use;
+  int64_t sent_at;  // Time of the last send
+  int prev;         // Neighbours in send order (-1 = none)
+  int next;
+} probe_slot_t;
+
+struct syn_job
+{
+  uint32_t first_host;   // First host, host byte order
+  uint32_t num_hosts;
+  uint16_t *ports;       // Copy of the caller's ports, or NULL for a bitmap job
+  port_bitmap_t *bitmap; // Copy of the caller's port bitmap, or NULL for a list job
+  int port;              // Bitmap jobs: port of the pairs being probed (-1 before the first)
+  int num_ports;
+  uint64_t total;        // Host and port pairs to probe
+  uint64_t next_target;  // Next pair to probe
+  int weight;
+  uint64_t pass;         // Stride-scheduling virtual time; the lowest pass sends next
+  int in_flight;         // Slots held by the job
+  bool finished;
+  syn_result_fn on_result;
+  void *context;
+  int64_t start;         // Transport time the job was added
+  syn_engine_stats_t stats;
+  syn_job_t *next;       // Next job of the engine
+};
+
+struct syn_engine
+{
+  transport_t *transport;
+  syn_engine_config_t config;
+  probe_slot_t *slots;
+  int *free_slots;   // Stack of unused slot numbers
+  int num_free;
+  int oldest;        // Head of the send-order list (-1 = empty)
+  int newest;        // Tail of the send-order list
+  transport_reply_t *replies;
+  syn_job_t *jobs;
+  uint64_t queued;   // Pairs of all jobs not probed yet
+  uint64_t pass;     // Pass of the job that sent last; new jobs start here
+  int64_t rate_start;    // Start of the current rate-limited stretch
+  uint64_t rate_sent;    // Probes sent since rate_start
+  uint64_t unmatched;
+  int64_t shown_in_flight;  // The engine's share of GAUGE_IN_FLIGHT
+  int64_t shown_queue;      // The engine's share of GAUGE_PROBE_QUEUE
+};
+
+void syn_engine_default_config(syn_engine_config_t *config)
+{
+  config->max_outstanding = SYN_ENGINE_MAX_OUTSTANDING;
+  config->rate = 0;
+  config->retries = SYN_ENGINE_RETRIES;
+  config->timeout_us = (int64_t)SYN_ENGINE_TIMEOUT * 1000;
+  config->base_port = SYN_ENGINE_BASE_PORT;
+}
+
+static void unlink_slot(syn_engine_t *engine, int index)
+{
+  probe_slot_t *slot = &engine->slots[index];
+  if (slot->prev >= 0)
+    engine->slots[slot->prev].next = slot->next;
+  else
+    engine->oldest = slot->next;
+  if (slot->next >= 0)
+    engine->slots[slot->next].prev = slot->prev;
+  else
+    engine->newest = slot->prev;
+}
+
+static void append_slot(syn_engine_t *engine, int index)
+{
+  probe_slot_t *slot = &engine->slots[index];
+  slot->prev = engine->newest;
+  slot->next = -1;
+  if (engine->newest >= 0)
+    engine->slots[engine->newest].next = index;
+  else
+    engine->oldest = index;
+  engine->newest = index;
+}
+
+static void release_slot(syn_engine_t *engine, int index)
+{
+  unlink_slot(engine, index);
+  engine->slots[index].in_use = false;
+  engine->slots[index].job->in_flight--;
+  engine->free_slots[engine->num_free++] = index;
+}
+
+// (Re)send the probe of a slot and move it to the end of the send order
+static void send_slot(syn_engine_t *engine, int index, int64_t now)
+{
+  probe_slot_t *slot = &engine->slots[index];
+  syn_job_t *job = slot->job;
+  if (slot->tries > 0)
+  {
+    unlink_slot(engine, index);
+    job->stats.retransmits++;
+    scan_stats_add(STAT_RETRANSMITS, 1);
+  }
+  slot->tries++;
+  slot->sent_at = now;
+  append_slot(engine, index);
+
+  int64_t trace_start = trace_begin();
+  engine->transport->ops->send_syn(engine->transport, slot->addr, slot->port,
+                                   (uint16_t)(engine->config.base_port + index));
+  trace_end(TRACE_SEND, trace_start, slot->port, NULL);
+  job->stats.sent++;
+  engine->rate_sent++;
+  scan_stats_add(STAT_PROBES_SENT, 1);
+
+  // Retransmissions use the rate budget too, so they count towards the job's share
+  job->pass += STRIDE_SCALE / (uint64_t)job->weight;
+  engine->pass = job->pass;
+}
+
+// Earliest time the rate limit allows the next send
+static int64_t next_send_time(const syn_engine_t *engine)
+{
+  if (engine->config.rate <= 0)
+    return engine->rate_start;
+  return engine->rate_start +
+         (int64_t)(engine->rate_sent * 1000000 / (uint64_t)engine->config.rate);
+}
+
+// Bring the engine's share of the in-flight and queue gauges up to date
+static void publish_gauges(syn_engine_t *engine, int64_t in_flight, int64_t queued)
+{
+  if (in_flight != engine->shown_in_flight)
+    scan_stats_gauge_add(GAUGE_IN_FLIGHT, in_flight - engine->shown_in_flight);
+  if (queued != engine->shown_queue)
+    scan_stats_gauge_add(GAUGE_PROBE_QUEUE, queued - engine->shown_queue);
+  engine->shown_in_flight = in_flight;
+  engine->shown_queue = queued;
+}
+
+// Job with pairs left to probe and the lowest pass (weighted fair sharing), or NULL
+static syn_job_t *next_job(const syn_engine_t *engine)
+{
+  syn_job_t *best = NULL;
+  for (syn_job_t *job = engine->jobs; job; job = job->next)
+  {
+    if (job->next_target < job->total && (!best || job->pass < best->pass))
+      best = job;
+  }
+  return best;
+}
+
+static void report(const probe_slot_t *slot, port_state_t state, const os_response_t *reply)
+{
+  syn_job_t *job = slot->job;
+  if (state == PORT_STATE_OPEN)
+    job->stats.open++;
+  else if (state == PORT_STATE_CLOSED)
+    job->stats.closed++;
+  else
+    job->stats.filtered++;
+  scan_stats_add(state == PORT_STATE_OPEN     ? STAT_OPEN
+                 : state == PORT_STATE_CLOSED ? STAT_CLOSED
+                                              : STAT_FILTERED,
+                 1);
+  if (job->on_result)
+    job->on_result(job->context, slot->addr, slot->port, state, reply);
+}
+
+syn_engine_t *syn_engine_create(transport_t *transport, const syn_engine_config_t *config)
+{
+  if (config->max_outstanding < 1 || config->max_outstanding > SYN_ENGINE_MAX_SLOTS ||
+      config->base_port + config->max_outstanding - 1 > 65535 || config->timeout_us <= 0 ||
+      config->retries < 0 || config->retries > 254)
+  {
+    return NULL;
+  }
+
+  syn_engine_t *engine = calloc(1, sizeof(syn_engine_t));
+  if (!engine)
+    return NULL;
+  engine->transport = transport;
+  engine->config = *config;
+  engine->slots = calloc((size_t)config->max_outstanding, sizeof(probe_slot_t));
+  engine->free_slots = malloc((size_t)config->max_outstanding * sizeof(int));
+  engine->replies = malloc(REPLY_BATCH * sizeof(transport_reply_t));
+  if (!engine->slots || !engine->free_slots || !engine->replies)
+  {
+    syn_engine_destroy(engine);
+    return NULL;
+  }
+
+  // Hand out low slot numbers first so small scans use few local ports
+  for (int i = config->max_outstanding - 1; i >= 0; i--)
+    engine->free_slots[engine->num_free++] = i;
+  engine->oldest = engine->newest = -1;
+  return engine;
+}
+
+void syn_engine_destroy(syn_engine_t *engine)
+{
+  if (!engine)
+    return;
+  while (engine->jobs)
+    syn_engine_remove_job(engine, engine->jobs);
+  publish_gauges(engine, 0, 0);
+  free(engine->slots);
+  free(engine->free_slots);
+  free(engine->replies);
+  free(engine);
+}
+
+// Schedule a job whose ports are already stored
+static syn_job_t *start_job(syn_engine_t *engine, syn_job_t *job, uint32_t first_addr,
+                            uint32_t num_hosts, int num_ports, int weight,
+                            syn_result_fn on_result, void *context)
+{
+  int64_t now = engine->transport->ops->now(engine->transport);
+
+  // An idle engine must not save up rate budget for a burst
+  if (!syn_engine_busy(engine))
+  {
+    engine->rate_start = now;
+    engine->rate_sent = 0;
+  }
+
+  job->first_host = ntohl(first_addr);
+  job->num_hosts = num_hosts;
+  job->num_ports = num_ports;
+  job->total = (uint64_t)num_hosts * (uint64_t)(num_ports > 0 ? num_ports : 0);
+  job->weight = weight > 0 ? weight : 1;
+  job->pass = engine->pass;
+  job->on_result = on_result;
+  job->context = context;
+  job->start = now;
+  job->next = engine->jobs;
+  engine->jobs = job;
+  engine->queued += job->total;
+
+  // Nothing to probe: done already
+  if (job->total == 0)
+    job->finished = true;
+  else
+    scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, (int64_t)num_hosts);
+  return job;
+}
+
+syn_job_t *syn_engine_add_job(syn_engine_t *engine, uint32_t first_addr, uint32_t num_hosts,
+                              const uint16_t *ports, int num_ports, int weight,
+                              syn_result_fn on_result, void *context)
+{
+  syn_job_t *job = calloc(1, sizeof(syn_job_t));
+  if (!job)
+    return NULL;
+  if (num_ports > 0)
+  {
+    job->ports = malloc((size_t)num_ports * sizeof(uint16_t));
+    if (!job->ports)
+    {
+      free(job);
+      return NULL;
+    }
+    memcpy(job->ports, ports, (size_t)num_ports * sizeof(uint16_t));
+  }
+  return start_job(engine, job, first_addr, num_hosts, num_ports, weight, on_result, context);
+}
+
+syn_job_t *syn_engine_add_bitmap_job(syn_engine_t *engine, uint32_t first_addr,
+                                     uint32_t num_hosts, const port_bitmap_t *ports, int weight,
+                                     syn_result_fn on_result, void *context)
+{
+  syn_job_t *job = calloc(1, sizeof(syn_job_t));
+  if (!job)
+    return NULL;
+  job->bitmap = malloc(sizeof(port_bitmap_t));
+  if (!job->bitmap)
+  {
+    free(job);
+    return NULL;
+  }
+  memcpy(job->bitmap, ports, sizeof(port_bitmap_t));
+  job->port = -1;
+  return start_job(engine, job, first_addr, num_hosts, port_bitmap_count(ports), weight,
+                   on_result, context);
+}
+
+bool syn_engine_job_finished(const syn_job_t *job, syn_engine_stats_t *stats)
+{
+  if (stats)
+    *stats = job->stats;
+  return job->finished;
+}
+
+void syn_engine_remove_job(syn_engine_t *engine, syn_job_t *job)
+{
+  // A job removed early gives up its probes in flight without reporting them
+  for (int i = 0; i < engine->config.max_outstanding && job->in_flight > 0; i++)
+  {
+    if (engine->slots[i].in_use && engine->slots[i].job == job)
+      release_slot(engine, i);
+  }
+
+  for (syn_job_t **link = &engine->jobs; *link; link = &(*link)->next)
+  {
+    if (*link == job)
+    {
+      *link = job->next;
+      break;
+    }
+  }
+  engine->queued -= job->total - job->next_target;
+  if (!job->finished)
+    scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, -(int64_t)job->num_hosts);
+  free(job->ports);
+  free(job->bitmap);
+  free(job);
+}
+
+bool syn_engine_busy(const syn_engine_t *engine)
+{
+  for (const syn_job_t *job = engine->jobs; job; job = job->next)
+  {
+    if (!job->finished)
+      return true;
+  }
+  return false;
+}
+
+// Port of a job's next pair; a bitmap job moves to the next set bit as each port begins
+static uint16_t next_port(syn_job_t *job)
+{
+  if (!job->bitmap)
+    return job->ports[job->next_target / job->num_hosts];
+  if (job->next_target % job->num_hosts == 0)
+    job->port = port_bitmap_next(job->bitmap, job->port + 1);
+  return (uint16_t)job->port;
+}
+
+bool syn_engine_step(syn_engine_t *engine, int64_t max_wait_us)
+{
+  transport_t *transport = engine->transport;
+  const syn_engine_config_t *config = &engine->config;
+  int64_t now = transport->ops->now(transport);
+
+  // Retransmit or give up on probes that timed out, oldest first
+  while (engine->oldest >= 0 && engine->slots[engine->oldest].sent_at + config->timeout_us <= now)
+  {
+    int index = engine->oldest;
+    probe_slot_t *slot = &engine->slots[index];
+    if (slot->tries <= config->retries && now >= next_send_time(engine))
+    {
+      scan_stats_add(STAT_TIMEOUTS, 1);
+      send_slot(engine, index, now);
+    }
+    else if (slot->tries > config->retries)
+    {
+      scan_stats_add(STAT_TIMEOUTS, 1);
+      report(slot, PORT_STATE_FILTERED, NULL);
+      release_slot(engine, index);
+    }
+    else
+    {
+      break; // Due for a retransmission the rate limit does not allow yet
+    }
+  }
+
+  // Send new probes while slots and the rate limit allow, each from the job furthest behind
+  syn_job_t *job;
+  while (engine->num_free > 0 && now >= next_send_time(engine) && (job = next_job(engine)))
+  {
+    int index = engine->free_slots[--engine->num_free];
+    probe_slot_t *slot = &engine->slots[index];
+    slot->job = job;
+    slot->addr = htonl(job->first_host + (uint32_t)(job->next_target % job->num_hosts));
+    slot->port = next_port(job);
+    slot->tries = 0;
+    slot->in_use = true;
+    job->next_target++;
+    job->in_flight++;
+    engine->queued--;
+    send_slot(engine, index, now);
+  }
+
+  publish_gauges(engine, config->max_outstanding - engine->num_free, (int64_t)engine->queued);
+
+  // Wait for replies until the oldest probe times out or the next send is due
+  int64_t wake = engine->oldest >= 0 ? engine->slots[engine->oldest].sent_at + config->timeout_us
+                                     : now + config->timeout_us;
+  if (engine->queued > 0 && engine->num_free > 0 && next_send_time(engine) < wake)
+    wake = next_send_time(engine);
+  if (engine->oldest >= 0 && wake <= now &&
+      engine->slots[engine->oldest].tries <= config->retries)
+    wake = next_send_time(engine); // A retransmission waits for the rate limit
+  if (max_wait_us >= 0 && wake > now + max_wait_us)
+    wake = now + max_wait_us;
+  if (wake < now)
+    wake = now;
+
+  int64_t wait_start = trace_begin();
+  int count = transport->ops->poll(transport, engine->replies, REPLY_BATCH, wake - now);
+  trace_end(TRACE_WAIT, wait_start, 0, "poll");
+  if (count < 0)
+    return false;
+
+  int64_t received = count > 0 ? transport->ops->now(transport) : now;
+  for (int i = 0; i < count; i++)
+  {
+    const transport_reply_t *reply = &engine->replies[i];
+    int index = (int)reply->local_port - config->base_port;
+    probe_slot_t *slot = index >= 0 && index < config->max_outstanding ? &engine->slots[index]
+                                                                        : NULL;
+    bool is_syn_ack = (reply->tcp.flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK);
+    bool is_rst = (reply->tcp.flags & TCP_RST) != 0;
+    if (!slot || !slot->in_use || slot->addr != reply->addr || slot->port != reply->port ||
+        (!is_syn_ack && !is_rst))
+    {
+      engine->unmatched++;
+      continue;
+    }
+
+    // Only replies to a probe sent once have an unambiguous RTT (Karn's rule)
+    scan_stats_add(STAT_RESPONSES, 1);
+    if (slot->tries == 1)
+      scan_stats_record_rtt(received - slot->sent_at);
+    trace_instant(TRACE_RESPONSE, slot->port, (uint32_t)(received - slot->sent_at));
+    report(slot, is_syn_ack ? PORT_STATE_OPEN : PORT_STATE_CLOSED, &reply->tcp);
+    release_slot(engine, index);
+  }
+
+  // Jobs with every pair probed and nothing in flight are done
+  int64_t end = 0;
+  for (job = engine->jobs; job; job = job->next)
+  {
+    if (job->finished || job->next_target < job->total || job->in_flight > 0)
+      continue;
+    if (end == 0)
+      end = transport->ops->now(transport);
+    job->finished = true;
+    job->stats.elapsed_us = end - job->start;
+    job->stats.unmatched = engine->unmatched;
+    scan_stats_gauge_add(GAUGE_ACTIVE_HOSTS, -(int64_t)job->num_hosts);
+  }
+  return true;
+}
+
+bool syn_engine_run(transport_t *transport, const syn_engine_config_t *config, uint32_t first_addr,
+                    uint32_t num_hosts, const uint16_t *ports, int num_ports,
+                    syn_result_fn on_result, void *context, syn_engine_stats_t *stats)
+{
+  syn_engine_t *engine = syn_engine_create(transport, config);
+  if (!engine)
+    return false;
+
+  syn_job_t *job = syn_engine_add_job(engine, first_addr, num_hosts, ports, num_ports, 1,
+                                      on_result, context);
+  bool ok = job != NULL;
+  while (ok && !syn_engine_job_finished(job, stats))
+    ok = syn_engine_step(engine, -1);
+  if (job && stats)
+    syn_engine_job_finished(job, stats);
+
+  syn_engine_destroy(engine);
+  return ok;
+}
@@ -0,0 +1,533 @@
+/**
+ * Neptune Scanner - Target Specifications
+ * target_spec.c - Target parsing and the streaming target producer
+ */
+
+#include "../include/target_spec.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define TARGET_MAX_LEN 255                   // Longest target in a list file
+#define RELEASE_BYTES (16 * 1024 * 1024)     // List bytes parsed between page releases
+#define BATCH_BLOCKS 64                      // Blocks the producer queues under one lock
+
+struct target_stream
+{
+  char target[TARGET_MAX_LEN + 1]; // Command-line target ("" = none)
+  const exclude_list_t *exclude;   // Addresses left out (NULL = none)
+
+  // The mapped list file (NULL = none)
+  const char *list;
+  size_t list_size;
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#endif
+
+  // Producer thread only: blocks not queued yet, the last one still growing
+  target_block_t batch[BATCH_BLOCKS];
+  int batch_count;
+  uint64_t batch_excluded;    // Addresses cut out since the last flush
+
+  pthread_t producer;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;   // Signalled when an empty queue gets a block or the producer ends
+  pthread_cond_t not_full;    // Signalled when a full queue drains to half or the stream closes
+
+  // Under lock
+  target_block_t queue[TARGET_QUEUE_BLOCKS];
+  int head;                   // Next block to take
+  int count;                  // Blocks queued
+  bool finished;              // The producer has queued its last block
+  bool stopping;              // The stream is closing; the producer gives up
+  uint64_t invalid;
+  uint64_t excluded;
+};
+
+// Parse a number 0-255 at *p, advancing past it
+static bool parse_octet(const char **p, long *value)
+{
+  char *end;
+  if (!isdigit((unsigned char)**p))
+    return false;
+  *value = strtol(*p, &end, 10);
+  *p = end;
+  return *value <= 255;
+}
+
+bool target_range_parse(const char *text, target_range_t *range)
+{
+  const char *p = text;
+  bool plain = true; // Every octet a single number, so a CIDR suffix may follow
+  for (int i = 0; i < 4; i++)
+  {
+    long low, high;
+    if (*p == '*')
+    {
+      low = 0;
+      high = 255;
+      plain = false;
+      p++;
+    }
+    else
+    {
+      if (!parse_octet(&p, &low))
+        return false;
+      high = low;
+      if (*p == '-')
+      {
+        p++;
+        plain = false;
+        if (!parse_octet(&p, &high) || high < low)
+          return false;
+      }
+    }
+    range->low[i] = (uint8_t)low;
+    range->high[i] = (uint8_t)high;
+    if (i < 3 && *p++ != '.')
+      return false;
+  }
+
+  if (*p == '/' && plain)
+  {
+    p++;
+    long bits;
+    char *end;
+    if (!isdigit((unsigned char)*p))
+      return false;
+    bits = strtol(p, &end, 10);
+    if (bits > 32 || *end != '\0')
+      return false;
+
+    // A prefix splits into whole octets and one aligned range, so it is octet ranges too
+    uint32_t addr = (uint32_t)range->low[0] << 24 | (uint32_t)range->low[1] << 16 |
+                    (uint32_t)range->low[2] << 8 | range->low[3];
+    uint32_t mask = bits == 0 ? 0 : ~0u << (32 - bits);
+    uint32_t first = addr & mask;
+    uint32_t last = first | ~mask;
+    for (int i = 0; i < 4; i++)
+    {
+      range->low[i] = (uint8_t)(first >> (24 - 8 * i));
+      range->high[i] = (uint8_t)(last >> (24 - 8 * i));
+    }
+    return true;
+  }
+  return *p == '\0';
+}
+
+uint64_t target_range_count(const target_range_t *range)
+{
+  uint64_t count = 1;
+  for (int i = 0; i < 4; i++)
+    count *= (uint64_t)(range->high[i] - range->low[i] + 1);
+  return count;
+}
+
+// Queue the batch, waiting for room; false once the stream is closing
+static bool flush_batch(target_stream_t *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+  for (int i = 0; i < stream->batch_count && !stream->stopping; i++)
+  {
+    while (stream->count == TARGET_QUEUE_BLOCKS && !stream->stopping)
+      pthread_cond_wait(&stream->not_full, &stream->lock);
+    if (stream->stopping)
+      break;
+    int tail = (stream->head + stream->count) % TARGET_QUEUE_BLOCKS;
+    stream->queue[tail] = stream->batch[i];
+
+    // Only a consumer waiting on an empty queue needs waking
+    if (stream->count++ == 0)
+      pthread_cond_signal(&stream->not_empty);
+  }
+  bool ok = !stream->stopping;
+  stream->excluded += stream->batch_excluded;
+  pthread_mutex_unlock(&stream->lock);
+  stream->batch_count = 0;
+  stream->batch_excluded = 0;
+  return ok;
+}
+
+// Add consecutive addresses to the batch, extending the last block when they continue it;
+// false once the stream is closing
+static bool batch_addresses(target_stream_t *stream, uint32_t first, uint32_t last)
+{
+  if (stream->batch_count > 0)
+  {
+    target_block_t *tail = &stream->batch[stream->batch_count - 1];
+    if (tail->last != UINT32_MAX && first == tail->last + 1 &&
+        (uint64_t)last - tail->first < TARGET_BLOCK_MAX_HOSTS)
+    {
+      tail->last = last;
+      return true;
+    }
+  }
+
+  // Split long runs into blocks of at most TARGET_BLOCK_MAX_HOSTS
+  for (;;)
+  {
+    if (stream->batch_count == BATCH_BLOCKS && !flush_batch(stream))
+      return false;
+    uint32_t end = last - first >= TARGET_BLOCK_MAX_HOSTS ? first + TARGET_BLOCK_MAX_HOSTS - 1
+                                                          : last;
+    stream->batch[stream->batch_count++] = (target_block_t){first, end};
+    if (end == last)
+      return true;
+    first = end + 1;
+  }
+}
+
+// Add consecutive addresses less the excluded ones, which cost one lookup per gap rather than
+// any work per address; false once the stream is closing
+static bool push_addresses(target_stream_t *stream, uint32_t first, uint32_t last)
+{
+  if (!stream->exclude)
+    return batch_addresses(stream, first, last);
+
+  uint64_t kept = 0;
+  uint64_t total = (uint64_t)(last - first) + 1;
+  uint32_t run_last;
+  bool ok = true;
+  while (ok && exclude_list_next_run(stream->exclude, &first, last, &run_last))
+  {
+    ok = batch_addresses(stream, first, run_last);
+    kept += (uint64_t)(run_last - first) + 1;
+    if (run_last == last)
+      break;
+    first = run_last + 1;
+  }
+  stream->batch_excluded += total - kept;
+  return ok;
+}
+
+bool target_range_each(const target_range_t *range, target_run_fn visit, void *context)
+{
+  // The octets down to the last partial one are stepped through value by value, and
+  // everything below them is one run of consecutive addresses
+  int split = 3;
+  while (split > 0 && range->low[split] == 0 && range->high[split] == 255)
+    split--;
+  int shift = 24 - 8 * split;
+  uint32_t below = shift == 0 ? 0 : (1u << shift) - 1;
+
+  uint8_t octet[4];
+  memcpy(octet, range->low, sizeof(octet));
+  for (;;)
+  {
+    uint32_t prefix = 0;
+    for (int i = 0; i < split; i++)
+      prefix |= (uint32_t)octet[i] << (24 - 8 * i);
+    uint32_t first = prefix | (uint32_t)range->low[split] << shift;
+    uint32_t last = prefix | (uint32_t)range->high[split] << shift | below;
+    if (!visit(context, first, last))
+      return false;
+
+    // Next prefix, odometer style
+    int i = split - 1;
+    while (i >= 0 && octet[i] == range->high[i])
+    {
+      octet[i] = range->low[i];
+      i--;
+    }
+    if (i < 0)
+      return true;
+    octet[i]++;
+  }
+}
+
+static bool push_run(void *context, uint32_t first, uint32_t last)
+{
+  return push_addresses(context, first, last);
+}
+
+static void count_invalid(target_stream_t *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+  stream->invalid++;
+  pthread_mutex_unlock(&stream->lock);
+}
+
+// Queue one target; false once the stream is closing
+static bool push_target(target_stream_t *stream, const char *target)
+{
+  target_range_t range;
+  if (target_range_parse(target, &range))
+    return target_range_each(&range, push_run, stream);
+
+  // A host name is resolved on the producer thread, so slow lookups never stall the scan;
+  // what is batched goes out first
+  if (!flush_batch(stream))
+    return false;
+  struct addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(target, NULL, &hints, &result) != 0)
+  {
+    count_invalid(stream);
+    return true;
+  }
+  uint32_t addr = ntohl(((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr);
+  freeaddrinfo(result);
+  return push_addresses(stream, addr, addr);
+}
+
+// Give parsed list pages back to the system, so the mapping's resident size stays bounded
+static void release_list(target_stream_t *stream, size_t parsed)
+{
+#ifdef _WIN32
+  (void)stream;
+  (void)parsed;
+#else
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t len = parsed / page * page;
+  if (len > 0)
+    madvise((void *)stream->list, len, MADV_DONTNEED);
+#endif
+}
+
+// Queue every target of the list file, a whitespace-separated token at a time
+static bool push_list(target_stream_t *stream)
+{
+  const char *p = stream->list;
+  const char *end = stream->list + stream->list_size;
+  size_t released = 0;
+  while (p < end)
+  {
+    if (*p == '#')
+    {
+      while (p < end && *p != '\n')
+        p++;
+      continue;
+    }
+    if (isspace((unsigned char)*p))
+    {
+      p++;
+      continue;
+    }
+
+    const char *token = p;
+    while (p < end && !isspace((unsigned char)*p) && *p != '#')
+      p++;
+    size_t len = (size_t)(p - token);
+    if (len > TARGET_MAX_LEN)
+    {
+      count_invalid(stream);
+      continue;
+    }
+    char target[TARGET_MAX_LEN + 1];
+    memcpy(target, token, len);
+    target[len] = '\0';
+    if (!push_target(stream, target))
+      return false;
+
+    size_t parsed = (size_t)(p - stream->list);
+    if (parsed - released >= RELEASE_BYTES)
+    {
+      release_list(stream, parsed);
+      released = parsed;
+    }
+  }
+  return true;
+}
+
+static void *produce_targets(void *arg)
+{
+  target_stream_t *stream = arg;
+  bool ok = !stream->target[0] || push_target(stream, stream->target);
+  if (ok && stream->list)
+    ok = push_list(stream);
+  if (ok)
+    flush_batch(stream);
+
+  pthread_mutex_lock(&stream->lock);
+  stream->finished = true;
+  pthread_cond_broadcast(&stream->not_empty);
+  pthread_mutex_unlock(&stream->lock);
+  return NULL;
+}
+
+// Map the list file read-only; an empty file maps to no targets
+static bool map_list(target_stream_t *stream, const char *path)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size))
+  {
+    CloseHandle(file);
+    return false;
+  }
+  if (file_size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return true;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  const char *base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!base)
+  {
+    if (mapping)
+      CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  stream->file = file;
+  stream->mapping = mapping;
+  stream->list = base;
+  stream->list_size = (size_t)file_size.QuadPart;
+  return true;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return false;
+  }
+  if (st.st_size == 0)
+  {
+    close(fd);
+    return true;
+  }
+
+  void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping keeps the file referenced
+  if (base == MAP_FAILED)
+    return false;
+  madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+  stream->list = base;
+  stream->list_size = (size_t)st.st_size;
+  return true;
+#endif
+}
+
+static void unmap_list(target_stream_t *stream)
+{
+  if (!stream->list)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(stream->list);
+  CloseHandle(stream->mapping);
+  CloseHandle(stream->file);
+#else
+  munmap((void *)stream->list, stream->list_size);
+#endif
+}
+
+target_stream_t *target_stream_open(const char *target, const char *list_file,
+                                    const exclude_list_t *exclude, char *error, size_t error_size)
+{
+  target_stream_t *stream = calloc(1, sizeof(target_stream_t));
+  if (!stream)
+  {
+    snprintf(error, error_size, "out of memory");
+    return NULL;
+  }
+  if (target)
+    snprintf(stream->target, sizeof(stream->target), "%s", target);
+  stream->exclude = exclude;
+  if (list_file && list_file[0] && !map_list(stream, list_file))
+  {
+    snprintf(error, error_size, "cannot read target list %s", list_file);
+    free(stream);
+    return NULL;
+  }
+
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->not_empty, NULL);
+  pthread_cond_init(&stream->not_full, NULL);
+  if (pthread_create(&stream->producer, NULL, produce_targets, stream) != 0)
+  {
+    snprintf(error, error_size, "cannot start the target producer");
+    pthread_cond_destroy(&stream->not_full);
+    pthread_cond_destroy(&stream->not_empty);
+    pthread_mutex_destroy(&stream->lock);
+    unmap_list(stream);
+    free(stream);
+    return NULL;
+  }
+  return stream;
+}
+
+bool target_stream_next(target_stream_t *stream, target_block_t *block, bool wait)
+{
+  pthread_mutex_lock(&stream->lock);
+  while (wait && stream->count == 0 && !stream->finished)
+    pthread_cond_wait(&stream->not_empty, &stream->lock);
+  bool ok = stream->count > 0;
+  if (ok)
+  {
+    *block = stream->queue[stream->head];
+    stream->head = (stream->head + 1) % TARGET_QUEUE_BLOCKS;
+    // The producer waits on a full queue, and refills it once half is gone
+    if (--stream->count == TARGET_QUEUE_BLOCKS / 2)
+      pthread_cond_signal(&stream->not_full);
+  }
+  pthread_mutex_unlock(&stream->lock);
+  return ok;
+}
+
+bool target_stream_done(target_stream_t *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+  bool done = stream->finished && stream->count == 0;
+  pthread_mutex_unlock(&stream->lock);
+  return done;
+}
+
+uint64_t target_stream_invalid(target_stream_t *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+  uint64_t invalid = stream->invalid;
+  pthread_mutex_unlock(&stream->lock);
+  return invalid;
+}
+
+uint64_t target_stream_excluded(target_stream_t *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+  uint64_t excluded = stream->excluded;
+  pthread_mutex_unlock(&stream->lock);
+  return excluded;
+}
+
+void target_stream_close(target_stream_t *stream)
+{
+  if (!stream)
+    return;
+  pthread_mutex_lock(&stream->lock);
+  stream->stopping = true;
+  pthread_cond_broadcast(&stream->not_full);
+  pthread_mutex_unlock(&stream->lock);
+  pthread_join(stream->producer, NULL);
+
+  pthread_cond_destroy(&stream->not_full);
+  pthread_cond_destroy(&stream->not_empty);
+  pthread_mutex_destroy(&stream->lock);
+  unmap_list(stream);
+  free(stream);
+}
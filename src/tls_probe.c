@@ -0,0 +1,574 @@
+/**
+ * Neptune Scanner - TLS Fingerprinting
+ * tls_probe.c - ClientHello builder and incremental ServerHello/Certificate parser
+ */
+
+#include "../include/tls_probe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Record content types
+#define TLS_RECORD_CHANGE_CIPHER_SPEC 20
+#define TLS_RECORD_ALERT 21
+#define TLS_RECORD_HANDSHAKE 22
+#define TLS_RECORD_APPLICATION_DATA 23
+
+// Handshake message types
+#define TLS_HANDSHAKE_CLIENT_HELLO 1
+#define TLS_HANDSHAKE_SERVER_HELLO 2
+#define TLS_HANDSHAKE_CERTIFICATE 11
+#define TLS_HANDSHAKE_SERVER_HELLO_DONE 14
+
+#define TLS_MAX_RECORD_BODY (16384 + 2048) // Largest record body allowed (RFC 5246 6.2.3)
+
+// Cipher suites offered, most preferred first
+static const struct
+{
+  uint16_t id;
+  const char *name;
+} TLS_CIPHERS[] = {
+    {0xC02F, "TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256"},
+    {0xC02B, "TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256"},
+    {0xC030, "TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384"},
+    {0xC02C, "TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384"},
+    {0xCCA8, "TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256"},
+    {0xCCA9, "TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256"},
+    {0xC013, "TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA"},
+    {0xC009, "TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA"},
+    {0xC014, "TLS_ECDHE_RSA_WITH_AES_256_CBC_SHA"},
+    {0xC00A, "TLS_ECDHE_ECDSA_WITH_AES_256_CBC_SHA"},
+    {0x009E, "TLS_DHE_RSA_WITH_AES_128_GCM_SHA256"},
+    {0x009F, "TLS_DHE_RSA_WITH_AES_256_GCM_SHA384"},
+    {0x0033, "TLS_DHE_RSA_WITH_AES_128_CBC_SHA"},
+    {0x0039, "TLS_DHE_RSA_WITH_AES_256_CBC_SHA"},
+    {0x009C, "TLS_RSA_WITH_AES_128_GCM_SHA256"},
+    {0x009D, "TLS_RSA_WITH_AES_256_GCM_SHA384"},
+    {0x003C, "TLS_RSA_WITH_AES_128_CBC_SHA256"},
+    {0x002F, "TLS_RSA_WITH_AES_128_CBC_SHA"},
+    {0x0035, "TLS_RSA_WITH_AES_256_CBC_SHA"},
+    {0x000A, "TLS_RSA_WITH_3DES_EDE_CBC_SHA"},
+    {0x0005, "TLS_RSA_WITH_RC4_128_SHA"},
+    {0x00FF, "TLS_EMPTY_RENEGOTIATION_INFO_SCSV"},
+};
+
+#define TLS_NUM_CIPHERS (sizeof(TLS_CIPHERS) / sizeof(TLS_CIPHERS[0]))
+
+// Append helpers for the ClientHello builder
+static unsigned char *put_u8(unsigned char *out, unsigned value)
+{
+  *out++ = (unsigned char)value;
+  return out;
+}
+
+static unsigned char *put_u16(unsigned char *out, unsigned value)
+{
+  *out++ = (unsigned char)(value >> 8);
+  *out++ = (unsigned char)value;
+  return out;
+}
+
+static void patch_u16(unsigned char *at, size_t value)
+{
+  at[0] = (unsigned char)(value >> 8);
+  at[1] = (unsigned char)value;
+}
+
+static void patch_u24(unsigned char *at, size_t value)
+{
+  at[0] = (unsigned char)(value >> 16);
+  at[1] = (unsigned char)(value >> 8);
+  at[2] = (unsigned char)value;
+}
+
+size_t tls_build_client_hello(const char *server_name, unsigned char *buffer, size_t buffer_size)
+{
+  size_t name_len = server_name ? strlen(server_name) : 0;
+  if (name_len > 255 || buffer_size < TLS_MAX_CLIENT_HELLO)
+    return 0;
+
+  unsigned char *out = buffer;
+
+  // Record header (length patched at the end); version 1.0 for compatibility with old servers
+  out = put_u8(out, TLS_RECORD_HANDSHAKE);
+  out = put_u16(out, 0x0301);
+  unsigned char *record_len = out;
+  out += 2;
+
+  // Handshake header (length patched at the end)
+  unsigned char *handshake = out;
+  out = put_u8(out, TLS_HANDSHAKE_CLIENT_HELLO);
+  out += 3;
+
+  out = put_u16(out, 0x0303); // Highest version offered: TLS 1.2
+
+  // Random; only has to look random, the handshake is never completed
+  unsigned seed = (unsigned)time(NULL) ^ (unsigned)(uintptr_t)buffer;
+  for (int i = 0; i < 32; i++)
+  {
+    seed = seed * 1103515245u + 12345u;
+    out = put_u8(out, seed >> 16);
+  }
+
+  out = put_u8(out, 0); // No session ID
+
+  out = put_u16(out, TLS_NUM_CIPHERS * 2);
+  for (size_t i = 0; i < TLS_NUM_CIPHERS; i++)
+    out = put_u16(out, TLS_CIPHERS[i].id);
+
+  out = put_u8(out, 1); // Compression methods: null only
+  out = put_u8(out, 0);
+
+  unsigned char *extensions_len = out;
+  out += 2;
+
+  // server_name
+  if (name_len > 0)
+  {
+    out = put_u16(out, 0x0000);
+    out = put_u16(out, name_len + 5);
+    out = put_u16(out, name_len + 3);
+    out = put_u8(out, 0); // host_name
+    out = put_u16(out, name_len);
+    memcpy(out, server_name, name_len);
+    out += name_len;
+  }
+
+  // supported_groups: x25519, secp256r1, secp384r1, secp521r1
+  static const uint16_t groups[] = {0x001D, 0x0017, 0x0018, 0x0019};
+  out = put_u16(out, 0x000A);
+  out = put_u16(out, sizeof(groups) + 2);
+  out = put_u16(out, sizeof(groups));
+  for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++)
+    out = put_u16(out, groups[i]);
+
+  // ec_point_formats: uncompressed
+  out = put_u16(out, 0x000B);
+  out = put_u16(out, 2);
+  out = put_u8(out, 1);
+  out = put_u8(out, 0);
+
+  // signature_algorithms
+  static const uint16_t signatures[] = {0x0403, 0x0503, 0x0603, 0x0804, 0x0805,
+                                        0x0806, 0x0401, 0x0501, 0x0601, 0x0201};
+  out = put_u16(out, 0x000D);
+  out = put_u16(out, sizeof(signatures) + 2);
+  out = put_u16(out, sizeof(signatures));
+  for (size_t i = 0; i < sizeof(signatures) / sizeof(signatures[0]); i++)
+    out = put_u16(out, signatures[i]);
+
+  patch_u16(extensions_len, (size_t)(out - extensions_len - 2));
+  patch_u24(handshake + 1, (size_t)(out - handshake - 4));
+  patch_u16(record_len, (size_t)(out - record_len - 2));
+  return (size_t)(out - buffer);
+}
+
+void tls_parser_init(tls_parser_t *parser)
+{
+  parser->record_header_len = 0;
+  parser->record_remaining = 0;
+  parser->record_type = 0;
+  parser->handshake_len = 0;
+}
+
+const char *tls_version_name(uint16_t version)
+{
+  switch (version)
+  {
+  case 0x0300:
+    return "SSLv3";
+  case 0x0301:
+    return "TLSv1.0";
+  case 0x0302:
+    return "TLSv1.1";
+  case 0x0303:
+    return "TLSv1.2";
+  case 0x0304:
+    return "TLSv1.3";
+  default:
+    return NULL;
+  }
+}
+
+const char *tls_cipher_name(uint16_t cipher)
+{
+  for (size_t i = 0; i < TLS_NUM_CIPHERS; i++)
+  {
+    if (TLS_CIPHERS[i].id == cipher)
+      return TLS_CIPHERS[i].name;
+  }
+  return NULL;
+}
+
+// A DER value: the bytes between the header of a TLV and its end
+typedef struct
+{
+  const unsigned char *data;
+  size_t len;
+} der_t;
+
+// Read the next TLV from 'in' into tag/value and advance past it
+static bool der_next(der_t *in, unsigned char *tag, der_t *value)
+{
+  if (in->len < 2)
+    return false;
+
+  *tag = in->data[0];
+  size_t len = in->data[1];
+  size_t header = 2;
+  if (len & 0x80)
+  {
+    size_t bytes = len & 0x7F;
+    if (bytes == 0 || bytes > 3 || in->len < 2 + bytes)
+      return false;
+    len = 0;
+    for (size_t i = 0; i < bytes; i++)
+      len = (len << 8) | in->data[2 + i];
+    header += bytes;
+  }
+
+  if (len > in->len - header)
+    return false;
+
+  value->data = in->data + header;
+  value->len = len;
+  in->data += header + len;
+  in->len -= header + len;
+  return true;
+}
+
+// Read the next TLV and require a specific tag
+static bool der_expect(der_t *in, unsigned char tag, der_t *value)
+{
+  unsigned char found;
+  return der_next(in, &found, value) && found == tag;
+}
+
+// Copy a string value, replacing anything unprintable
+static void copy_printable(char *out, size_t out_size, const unsigned char *data, size_t len)
+{
+  size_t n = len < out_size - 1 ? len : out_size - 1;
+  for (size_t i = 0; i < n; i++)
+    out[i] = (data[i] >= 0x20 && data[i] < 0x7F) ? (char)data[i] : '?';
+  out[n] = '\0';
+}
+
+// Find an attribute (by the last byte of its 2.5.4.x OID) in a Name
+static bool name_attribute(der_t name, unsigned char attribute, char *out, size_t out_size)
+{
+  der_t rdn;
+  while (der_expect(&name, 0x31, &rdn))
+  {
+    der_t pair;
+    while (der_expect(&rdn, 0x30, &pair))
+    {
+      der_t oid;
+      der_t value;
+      unsigned char tag;
+      if (!der_expect(&pair, 0x06, &oid) || !der_next(&pair, &tag, &value))
+        return false;
+      if (oid.len == 3 && oid.data[0] == 0x55 && oid.data[1] == 0x04 && oid.data[2] == attribute)
+      {
+        copy_printable(out, out_size, value.data, value.len);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Common name, or the organization if the name has no CN
+static void name_summary(der_t name, char *out, size_t out_size)
+{
+  if (!name_attribute(name, 0x03, out, out_size) && !name_attribute(name, 0x0A, out, out_size))
+    out[0] = '\0';
+}
+
+// Format a UTCTime or GeneralizedTime as "YYYY-MM-DD HH:MM:SS"
+static void format_time(unsigned char tag, der_t value, char *out, size_t out_size)
+{
+  char digits[15] = {0};
+  if (tag == 0x17 && value.len >= 12)
+  {
+    int year = (value.data[0] - '0') * 10 + (value.data[1] - '0');
+    snprintf(digits, sizeof(digits), "%s", year < 50 ? "20" : "19");
+    memcpy(digits + 2, value.data, 12);
+  }
+  else if (tag == 0x18 && value.len >= 14)
+  {
+    memcpy(digits, value.data, 14);
+  }
+  else
+  {
+    out[0] = '\0';
+    return;
+  }
+
+  for (int i = 0; i < 14; i++)
+  {
+    if (digits[i] < '0' || digits[i] > '9')
+    {
+      out[0] = '\0';
+      return;
+    }
+  }
+
+  snprintf(out, out_size, "%.4s-%.2s-%.2s %.2s:%.2s:%.2s", digits, digits + 4, digits + 6,
+           digits + 8, digits + 10, digits + 12);
+}
+
+// Append one subject alternative name to the comma-separated list
+static void append_san(char *out, size_t out_size, const char *name)
+{
+  size_t used = strlen(out);
+  if (used + (used ? 2 : 0) + strlen(name) >= out_size)
+    return; // Keep whole names only
+  snprintf(out + used, out_size - used, "%s%s", used ? ", " : "", name);
+}
+
+// Collect dNSName and iPAddress entries from a subjectAltName extension value
+static void parse_san(der_t value, char *out, size_t out_size)
+{
+  der_t names;
+  if (!der_expect(&value, 0x30, &names))
+    return;
+
+  unsigned char tag;
+  der_t name;
+  while (der_next(&names, &tag, &name))
+  {
+    char text[128];
+    if (tag == 0x82)
+    {
+      copy_printable(text, sizeof(text), name.data, name.len);
+      append_san(out, out_size, text);
+    }
+    else if (tag == 0x87 && name.len == 4)
+    {
+      snprintf(text, sizeof(text), "%u.%u.%u.%u", name.data[0], name.data[1], name.data[2],
+               name.data[3]);
+      append_san(out, out_size, text);
+    }
+  }
+}
+
+// Pull the fields of interest out of a DER-encoded X.509 certificate
+static bool parse_certificate(const unsigned char *data, size_t len, tls_info_t *info)
+{
+  der_t in = {data, len};
+  der_t certificate;
+  der_t tbs;
+  if (!der_expect(&in, 0x30, &certificate) || !der_expect(&certificate, 0x30, &tbs))
+    return false;
+
+  unsigned char tag;
+  der_t field;
+  if (!der_next(&tbs, &tag, &field))
+    return false;
+  if (tag == 0xA0 && !der_next(&tbs, &tag, &field)) // Skip the explicit version
+    return false;
+  // 'field' is now the serial number
+
+  der_t issuer;
+  der_t validity;
+  der_t subject;
+  if (!der_expect(&tbs, 0x30, &field) ||    // signature algorithm
+      !der_expect(&tbs, 0x30, &issuer) || !der_expect(&tbs, 0x30, &validity) ||
+      !der_expect(&tbs, 0x30, &subject) || !der_expect(&tbs, 0x30, &field)) // public key
+  {
+    return false;
+  }
+
+  name_summary(issuer, info->issuer, sizeof(info->issuer));
+  name_summary(subject, info->subject, sizeof(info->subject));
+
+  der_t time_value;
+  if (der_next(&validity, &tag, &time_value))
+    format_time(tag, time_value, info->not_before, sizeof(info->not_before));
+  if (der_next(&validity, &tag, &time_value))
+    format_time(tag, time_value, info->not_after, sizeof(info->not_after));
+
+  // Optional unique IDs, then [3] extensions
+  while (der_next(&tbs, &tag, &field))
+  {
+    if (tag != 0xA3)
+      continue;
+
+    der_t extensions;
+    der_t extension;
+    if (!der_expect(&field, 0x30, &extensions))
+      break;
+    while (der_expect(&extensions, 0x30, &extension))
+    {
+      der_t oid;
+      der_t value;
+      if (!der_expect(&extension, 0x06, &oid) || !der_next(&extension, &tag, &value))
+        continue;
+      if (tag == 0x01 && !der_next(&extension, &tag, &value)) // Skip the critical flag
+        continue;
+      if (tag == 0x04 && oid.len == 3 && oid.data[0] == 0x55 && oid.data[1] == 0x1D &&
+          oid.data[2] == 0x11)
+      {
+        parse_san(value, info->san, sizeof(info->san));
+      }
+    }
+    break;
+  }
+
+  info->certificate = true;
+  return true;
+}
+
+// Parse a ServerHello body
+static bool parse_server_hello(const unsigned char *body, size_t len, tls_info_t *info)
+{
+  // version(2) random(32) session_id_len(1)
+  if (len < 35)
+    return false;
+  size_t pos = 34;
+  size_t session_id_len = body[pos++];
+  if (len < pos + session_id_len + 3)
+    return false;
+  pos += session_id_len;
+
+  info->version = (uint16_t)(body[0] << 8 | body[1]);
+  info->cipher = (uint16_t)(body[pos] << 8 | body[pos + 1]);
+  pos += 3; // cipher + compression
+
+  // supported_versions overrides the legacy version field
+  if (len >= pos + 2)
+  {
+    size_t end = pos + 2 + (size_t)(body[pos] << 8 | body[pos + 1]);
+    pos += 2;
+    while (end <= len && pos + 4 <= end)
+    {
+      unsigned type = body[pos] << 8 | body[pos + 1];
+      size_t ext_len = (size_t)(body[pos + 2] << 8 | body[pos + 3]);
+      pos += 4;
+      if (pos + ext_len > end)
+        break;
+      if (type == 0x002B && ext_len == 2)
+        info->version = (uint16_t)(body[pos] << 8 | body[pos + 1]);
+      pos += ext_len;
+    }
+  }
+
+  info->server_hello = true;
+  return true;
+}
+
+// Consume complete handshake messages from the buffer
+static tls_parse_status_t parse_handshake(tls_parser_t *parser, tls_info_t *info)
+{
+  while (parser->handshake_len >= 4)
+  {
+    const unsigned char *message = parser->handshake;
+    unsigned type = message[0];
+    size_t len = (size_t)message[1] << 16 | (size_t)message[2] << 8 | message[3];
+
+    if (type == TLS_HANDSHAKE_CERTIFICATE)
+    {
+      // The leaf certificate is first in the list; stop as soon as it is complete
+      if (parser->handshake_len < 4 + 3 + 3)
+        return TLS_PARSE_MORE;
+      const unsigned char *leaf = message + 7;
+      size_t leaf_len = (size_t)leaf[0] << 16 | (size_t)leaf[1] << 8 | leaf[2];
+      if (leaf_len == 0 || 10 + leaf_len > 4 + len)
+        return TLS_PARSE_ERROR;
+      if (parser->handshake_len < 10 + leaf_len)
+        return 10 + leaf_len > TLS_MAX_HANDSHAKE ? TLS_PARSE_ERROR : TLS_PARSE_MORE;
+      return parse_certificate(leaf + 3, leaf_len, info) ? TLS_PARSE_DONE : TLS_PARSE_ERROR;
+    }
+
+    if (4 + len > TLS_MAX_HANDSHAKE)
+      return TLS_PARSE_ERROR;
+    if (parser->handshake_len < 4 + len)
+      return TLS_PARSE_MORE;
+
+    if (type == TLS_HANDSHAKE_SERVER_HELLO)
+    {
+      if (!parse_server_hello(message + 4, len, info))
+        return TLS_PARSE_ERROR;
+    }
+    else if (type == TLS_HANDSHAKE_SERVER_HELLO_DONE)
+    {
+      return TLS_PARSE_DONE; // Anonymous or PSK suite: no certificate is coming
+    }
+    else if (!info->server_hello)
+    {
+      return TLS_PARSE_ERROR; // Anything before ServerHello means this is not a TLS server
+    }
+
+    parser->handshake_len -= 4 + len;
+    memmove(parser->handshake, parser->handshake + 4 + len, parser->handshake_len);
+  }
+  return TLS_PARSE_MORE;
+}
+
+tls_parse_status_t tls_parser_feed(tls_parser_t *parser, const unsigned char *data, size_t len,
+                                   tls_info_t *info)
+{
+  while (len > 0)
+  {
+    // Record header
+    if (parser->record_header_len < 5)
+    {
+      size_t n = 5 - parser->record_header_len;
+      if (n > len)
+        n = len;
+      memcpy(parser->record + parser->record_header_len, data, n);
+      parser->record_header_len += n;
+      data += n;
+      len -= n;
+      if (parser->record_header_len < 5)
+        return TLS_PARSE_MORE;
+
+      parser->record_type = parser->record[0];
+      parser->record_remaining = (size_t)parser->record[3] << 8 | parser->record[4];
+      if (parser->record[1] != 0x03 || parser->record_type < TLS_RECORD_CHANGE_CIPHER_SPEC ||
+          parser->record_type > TLS_RECORD_APPLICATION_DATA ||
+          parser->record_remaining > TLS_MAX_RECORD_BODY)
+      {
+        return TLS_PARSE_ERROR;
+      }
+    }
+
+    size_t n = parser->record_remaining < len ? parser->record_remaining : len;
+    switch (parser->record_type)
+    {
+    case TLS_RECORD_HANDSHAKE:
+    {
+      size_t room = TLS_MAX_HANDSHAKE - parser->handshake_len;
+      size_t copy = n < room ? n : room;
+      memcpy(parser->handshake + parser->handshake_len, data, copy);
+      parser->handshake_len += copy;
+
+      tls_parse_status_t status = parse_handshake(parser, info);
+      if (status != TLS_PARSE_MORE)
+        return status;
+      if (copy < n)
+        return TLS_PARSE_ERROR;
+      break;
+    }
+    case TLS_RECORD_ALERT:
+      // Alerts are two bytes: level, description
+      if (parser->record_remaining >= 2 && n >= 2)
+      {
+        info->alert = data[1];
+        return TLS_PARSE_ALERT;
+      }
+      return n == parser->record_remaining ? TLS_PARSE_ERROR : TLS_PARSE_MORE;
+    default:
+      // Encrypted traffic: nothing more can be read in the clear
+      return info->server_hello ? TLS_PARSE_DONE : TLS_PARSE_ERROR;
+    }
+
+    data += n;
+    len -= n;
+    parser->record_remaining -= n;
+    if (parser->record_remaining == 0)
+      parser->record_header_len = 0;
+  }
+  return TLS_PARSE_MORE;
+}
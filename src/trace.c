@@ -0,0 +1,211 @@
+/**
+ * Neptune Scanner - Event Tracing
+ * trace.c - Trace rings and the Chrome trace-event writer
+ */
+
+#include "../include/trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INSTANT UINT32_MAX // Duration of an instant event
+
+// One recorded span or instant (32 bytes)
+typedef struct
+{
+  int64_t start_us;
+  const char *detail;
+  uint32_t duration_us; // INSTANT for an instant
+  uint32_t thread;      // Id of the recording thread
+  uint32_t value;
+  uint16_t port;
+  uint8_t event;
+} trace_entry_t;
+
+// A thread's ring; only its owner writes, trace_write reads after the scan threads are done
+typedef struct trace_ring
+{
+  trace_entry_t entries[TRACE_RING_EVENTS];
+  uint64_t head;            // Events ever written; the ring holds the last TRACE_RING_EVENTS
+  atomic_bool in_use;       // Owned by a live thread
+  struct trace_ring *next;  // Next ring in the list (never removed)
+} trace_ring_t;
+
+static const char *const event_names[TRACE_EVENT_COUNT] = {
+    "resolve", "send", "response", "connect", "wait", "service", "write"};
+
+bool trace_enabled = false;
+
+static _Atomic(trace_ring_t *) ring_list;
+static atomic_int num_rings;
+static atomic_uint next_thread_id;
+static atomic_uint_fast64_t dropped_events; // Recorded by threads that found no ring
+static int64_t trace_origin;                // Time trace_start was called
+
+static _Thread_local trace_ring_t *local_ring;
+static _Thread_local uint32_t local_thread_id;
+static _Thread_local bool no_ring;          // This thread was refused a ring
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+// Thread exit: hand the ring to the next thread that needs one
+static void release_ring(void *ring)
+{
+  atomic_store(&((trace_ring_t *)ring)->in_use, false);
+}
+
+static void create_ring_key(void)
+{
+  pthread_key_create(&ring_key, release_ring);
+}
+
+// Create a ring and add it to the list, already claimed by the caller
+static trace_ring_t *new_ring(void)
+{
+  if (atomic_fetch_add(&num_rings, 1) >= TRACE_MAX_RINGS)
+    return NULL;
+
+  // Pages of the ring are only touched as events are written to them
+  trace_ring_t *ring = calloc(1, sizeof(*ring));
+  if (!ring)
+    return NULL;
+  atomic_store(&ring->in_use, true);
+  ring->next = atomic_load(&ring_list);
+  while (!atomic_compare_exchange_weak(&ring_list, &ring->next, ring))
+    ;
+  return ring;
+}
+
+// The calling thread's ring, claiming a free one or creating one on first use
+static trace_ring_t *thread_ring(void)
+{
+  if (local_ring || no_ring)
+    return local_ring;
+
+  pthread_once(&ring_key_once, create_ring_key);
+  local_thread_id = atomic_fetch_add(&next_thread_id, 1) + 1;
+
+  trace_ring_t *ring = NULL;
+  for (trace_ring_t *r = atomic_load(&ring_list); r && !ring; r = r->next)
+  {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&r->in_use, &expected, true))
+      ring = r;
+  }
+  if (!ring)
+    ring = new_ring();
+
+  if (!ring)
+  {
+    no_ring = true;
+    return NULL;
+  }
+  pthread_setspecific(ring_key, ring);
+  local_ring = ring;
+  return ring;
+}
+
+bool trace_start(void)
+{
+  pthread_once(&ring_key_once, create_ring_key);
+  trace_origin = scan_stats_now_us();
+
+  // The main thread's ring is made up front so that a failure shows before the scan
+  if (!thread_ring())
+    return false;
+  trace_enabled = true;
+  return true;
+}
+
+void trace_record(trace_event_t event, int64_t start_us, int64_t duration_us, int port,
+                  uint32_t value, const char *detail)
+{
+  trace_ring_t *ring = thread_ring();
+  if (!ring)
+  {
+    atomic_fetch_add_explicit(&dropped_events, 1, memory_order_relaxed);
+    return;
+  }
+
+  trace_entry_t *entry = &ring->entries[ring->head & (TRACE_RING_EVENTS - 1)];
+  entry->start_us = start_us;
+  entry->duration_us = duration_us < 0             ? INSTANT
+                      : duration_us >= INSTANT ? INSTANT - 1
+                                               : (uint32_t)duration_us;
+  entry->detail = detail;
+  entry->thread = local_thread_id;
+  entry->value = value;
+  entry->port = (uint16_t)port;
+  entry->event = (uint8_t)event;
+  ring->head++;
+}
+
+// Write a string as a JSON string literal
+static void write_json_string(FILE *file, const char *text)
+{
+  fputc('"', file);
+  for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+  {
+    if (*c == '"' || *c == '\\')
+      fprintf(file, "\\%c", *c);
+    else if (*c < 0x20)
+      fprintf(file, "\\u%04x", *c);
+    else
+      fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+bool trace_write(const char *path, uint64_t *events, uint64_t *dropped)
+{
+  trace_enabled = false;
+
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return false;
+
+  uint64_t written = 0;
+  uint64_t lost = atomic_load(&dropped_events);
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n{\"name\":\"process_name\","
+                "\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"neptunescan\"}}");
+
+  for (trace_ring_t *ring = atomic_load(&ring_list); ring; ring = ring->next)
+  {
+    uint64_t first = ring->head > TRACE_RING_EVENTS ? ring->head - TRACE_RING_EVENTS : 0;
+    lost += first;
+    for (uint64_t i = first; i < ring->head; i++)
+    {
+      const trace_entry_t *entry = &ring->entries[i & (TRACE_RING_EVENTS - 1)];
+      fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"scan\",\"pid\":1,\"tid\":%u,\"ts\":%lld",
+              event_names[entry->event], entry->thread,
+              (long long)(entry->start_us - trace_origin));
+      if (entry->duration_us != INSTANT)
+        fprintf(file, ",\"ph\":\"X\",\"dur\":%u", entry->duration_us);
+      else
+        fprintf(file, ",\"ph\":\"i\",\"s\":\"t\"");
+
+      fprintf(file, ",\"args\":{\"port\":%u", entry->port);
+      if (entry->event == TRACE_RESPONSE)
+        fprintf(file, ",\"rtt_us\":%u", entry->value);
+      if (entry->detail)
+      {
+        fprintf(file, ",\"detail\":");
+        write_json_string(file, entry->detail);
+      }
+      fprintf(file, "}}");
+      written++;
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  bool ok = !ferror(file);
+  if (fclose(file) != 0)
+    ok = false;
+
+  if (events)
+    *events = written;
+  if (dropped)
+    *dropped = lost;
+  return ok;
+}
@@ -0,0 +1,148 @@
+/**
+ * Neptune Scanner - Packet Transport
+ * transport_raw.c - Transport over a raw TCP socket
+ */
+
+#include "../include/transport.h"
+#include "../include/advanced_scan.h"
+#include "../include/scan_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct
+{
+  transport_t base;
+  int sock;              // Raw IPPROTO_TCP socket, used for sending and receiving
+  uint32_t last_target;  // Target of the cached source address
+  uint32_t source;       // Local address used to reach last_target
+  uint64_t rng;          // Sequence numbers of the SYNs
+} raw_transport_t;
+
+static int64_t raw_now(transport_t *transport)
+{
+  (void)transport;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool raw_send_syn(transport_t *transport, uint32_t addr, uint16_t port, uint16_t local_port)
+{
+  raw_transport_t *raw = (raw_transport_t *)transport;
+
+  // Scans walk many ports of one host or hosts of one subnet, so one cached route goes far
+  if (addr != raw->last_target || raw->source == 0)
+  {
+    raw->source = os_source_address(addr);
+    raw->last_target = addr;
+  }
+
+  unsigned char segment[OS_MAX_PROBE_LEN];
+  size_t len = os_build_tcp_probe(segment, raw->source, addr, local_port, port, TCP_SYN, true,
+                                  &raw->rng);
+
+  struct sockaddr_in dest;
+  memset(&dest, 0, sizeof(dest));
+  dest.sin_family = AF_INET;
+  dest.sin_addr.s_addr = addr;
+  if (sendto(raw->sock, segment, len, 0, (struct sockaddr *)&dest, sizeof(dest)) != (ssize_t)len)
+    return false;
+  scan_stats_add(STAT_BYTES_SENT, len + 20); // The kernel adds the IP header
+  return true;
+}
+
+static int raw_poll(transport_t *transport, transport_reply_t *replies, int max, int64_t timeout_us)
+{
+  raw_transport_t *raw = (raw_transport_t *)transport;
+  int count = 0;
+
+  while (count < max)
+  {
+    // Block only for the first reply, then drain whatever is already queued
+    struct timeval tv = {0, 0};
+    if (count == 0 && timeout_us > 0)
+    {
+      tv.tv_sec = (time_t)(timeout_us / 1000000);
+      tv.tv_usec = (suseconds_t)(timeout_us % 1000000);
+    }
+
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(raw->sock, &readfds);
+    int ready = select(raw->sock + 1, &readfds, NULL, NULL, &tv);
+    if (ready < 0)
+      return count > 0 ? count : -1;
+    if (ready == 0)
+      break;
+
+    unsigned char packet[1500];
+    ssize_t bytes = recv(raw->sock, packet, sizeof(packet), 0);
+    if (bytes < 20)
+      continue;
+    scan_stats_add(STAT_BYTES_RECEIVED, (uint64_t)bytes);
+
+    size_t ihl = (size_t)(packet[0] & 0x0F) * 4;
+    if ((size_t)bytes < ihl + 20 || packet[9] != IPPROTO_TCP)
+      continue;
+
+    transport_reply_t *reply = &replies[count];
+    const unsigned char *tcp = packet + ihl;
+    memcpy(&reply->addr, packet + 12, 4);
+    reply->port = (uint16_t)(tcp[0] << 8 | tcp[1]);
+    reply->local_port = (uint16_t)(tcp[2] << 8 | tcp[3]);
+    if (os_parse_tcp_response(packet, (size_t)bytes, &reply->tcp))
+      count++;
+  }
+
+  return count;
+}
+
+static void raw_close(transport_t *transport)
+{
+  raw_transport_t *raw = (raw_transport_t *)transport;
+  close(raw->sock);
+  free(raw);
+}
+
+static const transport_ops_t RAW_OPS = {raw_now, raw_send_syn, raw_poll, raw_close};
+
+transport_t *transport_raw_open(void)
+{
+  raw_transport_t *raw = calloc(1, sizeof(raw_transport_t));
+  if (!raw)
+    return NULL;
+
+  // Without IP_HDRINCL the kernel adds the IP header, and the socket also receives the replies
+  raw->sock = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+  if (raw->sock < 0)
+  {
+    free(raw);
+    return NULL;
+  }
+
+  // Replies to a fast scan arrive in bursts; a larger buffer keeps them from being dropped
+  int buffer_size = 4 * 1024 * 1024;
+  setsockopt(raw->sock, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+  os_random_seed(&raw->rng);
+  raw->base.ops = &RAW_OPS;
+  return &raw->base;
+}
+
+#else
+
+transport_t *transport_raw_open(void)
+{
+  // Windows does not send TCP over raw sockets
+  return NULL;
+}
+
+#endif
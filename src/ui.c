@@ -14,6 +14,7 @@
 #include "../include/utils.h"
 #include "../include/scanner.h"
 #include "../include/service_detection.h"
+#include "../include/services.h"
 
 // Color codes for terminal output
 #define COLOR_RED "\x1b[31m"
@@ -32,7 +33,7 @@ void print_header(void)
 }
 
 // Function to print scan results
-void print_results(const char *target, int *open_ports, int num_ports)
+void print_results(const char *target, const int *open_ports, int num_ports)
 {
   printf("\n%sScan Results for %s%s\n", COLOR_GREEN, target, COLOR_RESET);
   printf("========================\n\n");
@@ -184,7 +185,7 @@ void show_scanning_header(const char *target, int start_port, int end_port)
 
   if (use_common_ports)
   {
-    printf("Scanning %d common ports\n", COMMON_PORTS_COUNT);
+    printf("Scanning %d common ports\n", SERVICE_COUNT);
   }
   else
   {
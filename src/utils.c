@@ -30,9 +30,12 @@ struct hostent* gethostbyname(const char* name) { return NULL; }
 #endif
 
 #ifdef _WIN32
+#include <winsock2.h>
 #include <windows.h>
 #else
 #include <sys/time.h>
+#include <netdb.h>
+#include <arpa/inet.h>
 #endif
 #include "../include/utils.h"
 
@@ -0,0 +1,119 @@
+/**
+ * Neptune Scanner - Banner Read Test
+ * test_banner_reads.c - Multi-line greetings must be read to their last line
+ *
+ * Usage: test_banner_reads
+ *
+ * Starts a server on a loopback port that sends an FTP/SMTP style multi-line greeting a line at a
+ * time: a "220-" opening line, continuation lines (some of them free text, as RFC 959 allows)
+ * and the closing "220 " line. grab_banner must return the whole greeting rather than stop at
+ * the first line that does not start with "220-". The exit status is non-zero on any mismatch.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/service_detection.h"
+#include "../include/service_probes.h"
+
+#define LINE_GAP_US 50000 // Between the lines of a greeting, so each arrives in its own read
+
+typedef struct
+{
+  const char *name;
+  const char *lines[6]; // Greeting, a line per send, NULL after the last
+} greeting_t;
+
+static const greeting_t greetings[] = {
+    {"continuation lines with the code",
+     {"220-mail.example.com ESMTP\r\n", "220-No UCE\r\n", "220 Ready\r\n", NULL}},
+    {"free-text continuation lines",
+     {"220-Welcome to the example FTP service\r\n", "  Uploads go to /incoming.\r\n",
+      "Be nice.\r\n", "220 Ready\r\n", NULL}},
+    {"a closing line of another code first",
+     {"220-Welcome\r\n", "230 is not the end\r\n", "220 Ready\r\n", NULL}},
+};
+
+#define NUM_GREETINGS (int)(sizeof(greetings) / sizeof(greetings[0]))
+
+typedef struct
+{
+  int listener;
+  const greeting_t *greeting;
+} test_server_t;
+
+// Accepts connections and sends the current greeting a line at a time until it is closed
+static void *greeting_server(void *arg)
+{
+  test_server_t *server = arg;
+  int client;
+  while ((client = accept(server->listener, NULL, NULL)) >= 0)
+  {
+    for (int i = 0; server->greeting->lines[i]; i++)
+    {
+      const char *line = server->greeting->lines[i];
+      ssize_t sent = send(client, line, strlen(line), 0);
+      (void)sent;
+      usleep(LINE_GAP_US);
+    }
+    close(client);
+  }
+  return NULL;
+}
+
+// The whole greeting as one string
+static void join_lines(const greeting_t *greeting, char *out, size_t size)
+{
+  out[0] = '\0';
+  for (int i = 0; greeting->lines[i]; i++)
+    strncat(out, greeting->lines[i], size - strlen(out) - 1);
+}
+
+int main(void)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  test_server_t server = {socket(AF_INET, SOCK_STREAM, 0), &greetings[0]};
+  if (server.listener < 0 || bind(server.listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(server.listener, 8) < 0 ||
+      getsockname(server.listener, (struct sockaddr *)&addr, &len) < 0)
+  {
+    fprintf(stderr, "Error: Cannot start the greeting server\n");
+    return 1;
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, greeting_server, &server) != 0)
+  {
+    fprintf(stderr, "Error: Cannot start the greeting server\n");
+    return 1;
+  }
+  load_default_service_probes();
+
+  int failures = 0;
+  for (int i = 0; i < NUM_GREETINGS; i++)
+  {
+    char expected[512], banner[1024];
+    server.greeting = &greetings[i];
+    join_lines(&greetings[i], expected, sizeof(expected));
+    if (!grab_banner("127.0.0.1", ntohs(addr.sin_port), banner, sizeof(banner)) ||
+        strcmp(banner, expected) != 0)
+    {
+      fprintf(stderr, "FAIL: %s: got \"%s\"\n", greetings[i].name, banner);
+      failures++;
+    }
+  }
+
+  shutdown(server.listener, SHUT_RDWR);
+  close(server.listener);
+  pthread_join(thread, NULL);
+  free_service_probes();
+  printf("%d multi-line greetings: %s\n", NUM_GREETINGS, failures ? "FAIL" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * Neptune Scanner - Concurrent Scan Test
+ * test_concurrent_scans.c - Two library scans with service detection running at once
+ *
+ * Usage: test_concurrent_scans
+ *
+ * Starts an SSH and an FTP server on loopback ports, then runs two scans of both ports at the
+ * same time, one of "localhost" and one of "127.0.0.1", several rounds over. Service detection
+ * of the two scans overlaps, so each scan must identify both services on the address it
+ * scanned, independently of the other. The exit status is non-zero on any mismatch.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/neptunescan.h"
+
+#define ROUNDS 5
+#define NUM_SERVERS 2
+
+typedef struct
+{
+  const char *banner;
+  const char *protocol; // Expected protocol of the service
+  int listener;
+  uint16_t port;
+  pthread_t thread;
+} test_server_t;
+
+typedef struct
+{
+  const char *target;
+  const test_server_t *servers;
+  int identified[NUM_SERVERS];
+  int wrong;
+  bool done;
+} scan_check_t;
+
+static test_server_t servers[NUM_SERVERS] = {
+    {"SSH-2.0-OpenSSH_9.6p1 Ubuntu-3ubuntu13\r\n", "SSH", -1, 0, 0},
+    {"220 (vsFTPd 3.0.5)\r\n", "FTP", -1, 0, 0},
+};
+
+// Accepts connections and greets each with the server's banner until the listener is closed
+static void *banner_server(void *arg)
+{
+  test_server_t *server = arg;
+  int client;
+  while ((client = accept(server->listener, NULL, NULL)) >= 0)
+  {
+    ssize_t sent = send(client, server->banner, strlen(server->banner), 0);
+    (void)sent;
+    usleep(20000);
+    close(client);
+  }
+  return NULL;
+}
+
+static bool start_server(test_server_t *server)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  server->listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (server->listener < 0 || bind(server->listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(server->listener, 64) < 0 ||
+      getsockname(server->listener, (struct sockaddr *)&addr, &len) < 0)
+    return false;
+  server->port = ntohs(addr.sin_port);
+  return pthread_create(&server->thread, NULL, banner_server, server) == 0;
+}
+
+static void stop_server(test_server_t *server)
+{
+  shutdown(server->listener, SHUT_RDWR);
+  close(server->listener);
+  pthread_join(server->thread, NULL);
+}
+
+static void check_result(void *user, const neptune_result_t *result)
+{
+  scan_check_t *check = user;
+  if (result->event == NEPTUNE_EVENT_DONE)
+  {
+    check->done = true;
+    return;
+  }
+  if (result->event != NEPTUNE_EVENT_SERVICE)
+    return;
+
+  for (int i = 0; i < NUM_SERVERS; i++)
+  {
+    if (result->port != check->servers[i].port)
+      continue;
+    if (result->addr == htonl(INADDR_LOOPBACK) &&
+        strcmp(result->protocol, check->servers[i].protocol) == 0)
+    {
+      check->identified[i]++;
+      return;
+    }
+    break;
+  }
+  fprintf(stderr, "%s: unexpected service %s (%s) on %u\n", check->target, result->service,
+          result->protocol, result->port);
+  check->wrong++;
+}
+
+static neptune_scan_ctx *start_scan(scan_check_t *check, const char *ports)
+{
+  neptune_scan_options_t options;
+  neptune_scan_options_init(&options);
+  options.detect_services = true;
+  neptune_scan_ctx *scan = neptune_scan_create(&options, check_result, check);
+  if (!scan || !neptune_scan_add_target(scan, check->target) ||
+      !neptune_scan_add_ports(scan, ports) || !neptune_scan_start(scan))
+  {
+    fprintf(stderr, "Error: Cannot start the scan of %s\n", check->target);
+    exit(1);
+  }
+  return scan;
+}
+
+// Whether the scan identified each service exactly once and nothing else
+static bool scan_passed(const scan_check_t *check, int round)
+{
+  bool passed = check->done && check->wrong == 0;
+  for (int i = 0; i < NUM_SERVERS; i++)
+    passed = passed && check->identified[i] == 1;
+  if (!passed)
+  {
+    fprintf(stderr, "FAIL: round %d, %s: SSH %d, FTP %d, wrong %d\n", round, check->target,
+            check->identified[0], check->identified[1], check->wrong);
+  }
+  return passed;
+}
+
+int main(void)
+{
+  for (int i = 0; i < NUM_SERVERS; i++)
+  {
+    if (!start_server(&servers[i]))
+    {
+      fprintf(stderr, "Error: Cannot start the %s server\n", servers[i].protocol);
+      return 1;
+    }
+  }
+  char ports[32];
+  snprintf(ports, sizeof(ports), "%u,%u", servers[0].port, servers[1].port);
+  neptune_init(NULL, NULL);
+
+  int failures = 0;
+  for (int round = 1; round <= ROUNDS; round++)
+  {
+    scan_check_t checks[2] = {{.target = "localhost", .servers = servers},
+                              {.target = "127.0.0.1", .servers = servers}};
+    neptune_scan_ctx *scans[2];
+    for (int i = 0; i < 2; i++)
+      scans[i] = start_scan(&checks[i], ports);
+    for (int i = 0; i < 2; i++)
+    {
+      neptune_scan_wait(scans[i]);
+      neptune_scan_destroy(scans[i]);
+      failures += !scan_passed(&checks[i], round);
+    }
+  }
+
+  neptune_cleanup();
+  for (int i = 0; i < NUM_SERVERS; i++)
+    stop_server(&servers[i]);
+  printf("%d rounds of two concurrent scans: %s\n", ROUNDS, failures ? "FAIL" : "ok");
+  return failures ? 1 : 0;
+}
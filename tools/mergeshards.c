@@ -0,0 +1,217 @@
+/**
+ * Neptune Scanner - Shard Merger
+ * mergeshards.c - Merges the results files of a sharded scan into one sorted file
+ *
+ * Usage: mergeshards <output|-> <shard file>...
+ *
+ * Every input must be a results file (include/results_file.h), and so already sorted. The
+ * merge streams: it holds one line per input in a min-heap keyed on address and port and
+ * always writes the smallest, so memory stays constant however large the shards are. A port
+ * found by more than one input is written once. When the inputs carry shard headers, shards
+ * missing from a complete i/n set are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/results_file.h"
+
+// An input and its current line
+typedef struct
+{
+  const char *path;
+  FILE *file;
+  char line[RESULTS_FILE_MAX_LINE];
+  uint64_t key;
+  bool has_key;               // key holds the previous line's key
+  unsigned long line_number;
+} shard_input_t;
+
+static shard_input_t *inputs;
+static int *heap; // Indexes into inputs, ordered by key
+static int heap_size;
+
+// Shard headers seen: shard_seen[i] for "# shard i/shard_total"
+static char *shard_seen;
+static int shard_total;
+static bool shard_mismatch;
+
+static void note_shard_header(const shard_input_t *input)
+{
+  int index, count;
+  if (sscanf(input->line, "# shard %d/%d", &index, &count) != 2 || index < 1 || index > count)
+    return;
+  if (!shard_seen)
+  {
+    shard_seen = calloc((size_t)count + 1, 1);
+    shard_total = count;
+  }
+  if (!shard_seen || count != shard_total)
+  {
+    shard_mismatch = true;
+    return;
+  }
+  shard_seen[index] = 1;
+}
+
+// Read the next result line of an input; false at its end. Exits on malformed or unsorted input.
+static bool advance(shard_input_t *input)
+{
+  uint64_t previous = input->key;
+
+  while (fgets(input->line, sizeof(input->line), input->file))
+  {
+    input->line_number++;
+    size_t len = strlen(input->line);
+    if (len == sizeof(input->line) - 1 && input->line[len - 1] != '\n')
+    {
+      fprintf(stderr, "Error: %s:%lu: line too long\n", input->path, input->line_number);
+      exit(1);
+    }
+    if (input->line[0] == '#')
+    {
+      note_shard_header(input);
+      continue;
+    }
+    if (input->line[0] == '\n' || input->line[0] == '\r')
+      continue;
+    if (!results_file_key(input->line, &input->key))
+    {
+      fprintf(stderr, "Error: %s:%lu: not a result line\n", input->path, input->line_number);
+      exit(1);
+    }
+    if (input->has_key && input->key < previous)
+    {
+      fprintf(stderr, "Error: %s:%lu: results are not sorted\n", input->path,
+              input->line_number);
+      exit(1);
+    }
+    if (input->line[len - 1] != '\n')
+      strcpy(input->line + len, "\n");
+    input->has_key = true;
+    return true;
+  }
+  input->key = UINT64_MAX;
+  return false;
+}
+
+static bool heap_less(int a, int b)
+{
+  return inputs[heap[a]].key < inputs[heap[b]].key ||
+         (inputs[heap[a]].key == inputs[heap[b]].key && heap[a] < heap[b]);
+}
+
+static void sift_down(int i)
+{
+  for (;;)
+  {
+    int smallest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < heap_size && heap_less(left, smallest))
+      smallest = left;
+    if (right < heap_size && heap_less(right, smallest))
+      smallest = right;
+    if (smallest == i)
+      return;
+    int swap = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = swap;
+    i = smallest;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: %s <output|-> <shard file>...\n", argv[0]);
+    return 1;
+  }
+
+  int num_inputs = argc - 2;
+  inputs = calloc((size_t)num_inputs, sizeof(shard_input_t));
+  heap = malloc((size_t)num_inputs * sizeof(int));
+  if (!inputs || !heap)
+  {
+    fprintf(stderr, "Error: Out of memory\n");
+    return 1;
+  }
+
+  for (int i = 0; i < num_inputs; i++)
+  {
+    inputs[i].path = argv[i + 2];
+    inputs[i].file = fopen(inputs[i].path, "r");
+    if (!inputs[i].file)
+    {
+      fprintf(stderr, "Error: Cannot open %s\n", inputs[i].path);
+      return 1;
+    }
+    if (!fgets(inputs[i].line, sizeof(inputs[i].line), inputs[i].file) ||
+        strncmp(inputs[i].line, RESULTS_FILE_FORMAT, strlen(RESULTS_FILE_FORMAT)) != 0)
+    {
+      fprintf(stderr, "Error: %s is not a results file\n", inputs[i].path);
+      return 1;
+    }
+    inputs[i].line_number = 1;
+    if (advance(&inputs[i]))
+      heap[heap_size++] = i;
+  }
+  for (int i = heap_size / 2 - 1; i >= 0; i--)
+    sift_down(i);
+
+  FILE *out = strcmp(argv[1], "-") == 0 ? stdout : fopen(argv[1], "w");
+  if (!out)
+  {
+    fprintf(stderr, "Error: Cannot create %s\n", argv[1]);
+    return 1;
+  }
+
+  fprintf(out, "%s\n", RESULTS_FILE_FORMAT);
+  unsigned long written = 0, duplicates = 0;
+  uint64_t last_key = UINT64_MAX;
+  while (heap_size > 0)
+  {
+    shard_input_t *input = &inputs[heap[0]];
+    if (input->key == last_key)
+    {
+      duplicates++;
+    }
+    else
+    {
+      fputs(input->line, out);
+      last_key = input->key;
+      written++;
+    }
+
+    if (!advance(input))
+      heap[0] = heap[--heap_size];
+    sift_down(0);
+  }
+
+  bool ok = !ferror(out);
+  if (out != stdout && fclose(out) != 0)
+    ok = false;
+  if (!ok)
+  {
+    fprintf(stderr, "Error: Cannot write %s\n", argv[1]);
+    return 1;
+  }
+
+  fprintf(stderr, "Merged %d files: %lu results, %lu duplicates dropped\n", num_inputs, written,
+          duplicates);
+  if (shard_mismatch)
+    fprintf(stderr, "Warning: inputs come from scans with different shard counts\n");
+  for (int i = 1; shard_seen && !shard_mismatch && i <= shard_total; i++)
+  {
+    if (!shard_seen[i])
+      fprintf(stderr, "Warning: shard %d/%d is missing\n", i, shard_total);
+  }
+
+  for (int i = 0; i < num_inputs; i++)
+    fclose(inputs[i].file);
+  free(inputs);
+  free(heap);
+  free(shard_seen);
+  return 0;
+}
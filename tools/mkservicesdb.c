@@ -0,0 +1,254 @@
+/**
+ * Neptune Scanner - Services Database Builder
+ * mkservicesdb.c - Converts an nmap-services style text file into the binary services database
+ *
+ * Usage: mkservicesdb <input> <output>
+ *
+ * Each input line is "name port/protocol [frequency] [# description]". Lines in /etc/services
+ * format (aliases instead of a frequency) are accepted with a frequency of 0. Only tcp and udp
+ * entries are kept; when a port is listed twice for the same protocol the more frequent entry
+ * wins. The output layout is described in include/services.h.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/services.h"
+
+#define MAX_LINE 1024
+
+typedef struct
+{
+  char *name;
+  char *description;
+  uint16_t port;
+  uint8_t protocol;
+  uint32_t frequency; // Parts per million
+  size_t line;        // Input line, keeps the sort stable
+} service_t;
+
+static service_t *services = NULL;
+static size_t num_services = 0;
+static size_t services_capacity = 0;
+
+static char *copy_string(const char *text, size_t len)
+{
+  char *copy = malloc(len + 1);
+  if (!copy)
+  {
+    fprintf(stderr, "Error: Out of memory\n");
+    exit(1);
+  }
+  memcpy(copy, text, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+// Parse one input line; returns false for comments, blank lines and unsupported protocols
+static bool parse_line(char *line, size_t line_number, service_t *service)
+{
+  char *comment = strchr(line, '#');
+  if (comment)
+    *comment++ = '\0';
+
+  char *name = strtok(line, " \t\r\n");
+  char *port_proto = strtok(NULL, " \t\r\n");
+  char *frequency = strtok(NULL, " \t\r\n");
+  if (!name || !port_proto)
+    return false;
+
+  char *slash = strchr(port_proto, '/');
+  if (!slash)
+    return false;
+  *slash = '\0';
+
+  char *end;
+  long port = strtol(port_proto, &end, 10);
+  if (*end != '\0' || port < 0 || port > 65535)
+    return false;
+
+  if (strcmp(slash + 1, "tcp") == 0)
+    service->protocol = SERVICE_PROTO_TCP;
+  else if (strcmp(slash + 1, "udp") == 0)
+    service->protocol = SERVICE_PROTO_UDP;
+  else
+    return false;
+
+  // A frequency is a number in [0, 1]; anything else is an /etc/services alias
+  double value = 0.0;
+  if (frequency)
+  {
+    value = strtod(frequency, &end);
+    if (*end != '\0' || value < 0.0 || value > 1.0)
+      value = 0.0;
+  }
+
+  // The description is the comment without surrounding whitespace
+  const char *description = "";
+  size_t description_len = 0;
+  if (comment)
+  {
+    while (isspace((unsigned char)*comment))
+      comment++;
+    description_len = strlen(comment);
+    while (description_len > 0 && isspace((unsigned char)comment[description_len - 1]))
+      description_len--;
+    description = comment;
+  }
+
+  service->name = copy_string(name, strlen(name));
+  service->description = copy_string(description, description_len);
+  service->port = (uint16_t)port;
+  service->frequency = (uint32_t)(value * SERVICES_DB_FREQUENCY_SCALE + 0.5);
+  service->line = line_number;
+  return true;
+}
+
+// Most frequent first; ties keep input order
+static int compare_services(const void *a, const void *b)
+{
+  const service_t *left = a;
+  const service_t *right = b;
+  if (left->frequency != right->frequency)
+    return left->frequency > right->frequency ? -1 : 1;
+  return left->line < right->line ? -1 : (left->line > right->line);
+}
+
+static void put_u16(unsigned char *out, uint16_t value)
+{
+  out[0] = (unsigned char)value;
+  out[1] = (unsigned char)(value >> 8);
+}
+
+static void put_u32(unsigned char *out, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    out[i] = (unsigned char)(value >> (8 * i));
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 3)
+  {
+    fprintf(stderr, "Usage: %s <input> <output>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *input = fopen(argv[1], "r");
+  if (!input)
+  {
+    fprintf(stderr, "Error: Could not open %s\n", argv[1]);
+    return 1;
+  }
+
+  char line[MAX_LINE];
+  size_t line_number = 0;
+  while (fgets(line, sizeof(line), input))
+  {
+    line_number++;
+    service_t service;
+    if (!parse_line(line, line_number, &service))
+      continue;
+
+    if (num_services == services_capacity)
+    {
+      services_capacity = services_capacity ? services_capacity * 2 : 1024;
+      services = realloc(services, services_capacity * sizeof(service_t));
+      if (!services)
+      {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+      }
+    }
+    services[num_services++] = service;
+  }
+  fclose(input);
+
+  qsort(services, num_services, sizeof(service_t), compare_services);
+
+  // Keep the first (most frequent) entry for each port and protocol
+  static uint8_t seen[2][65536];
+  size_t kept = 0;
+  for (size_t i = 0; i < num_services; i++)
+  {
+    uint8_t *slot = &seen[services[i].protocol == SERVICE_PROTO_UDP][services[i].port];
+    if (*slot)
+      continue;
+    *slot = 1;
+    services[kept++] = services[i];
+  }
+
+  if (kept == 0 || kept > SERVICES_DB_MAX_RECORDS)
+  {
+    fprintf(stderr, "Error: %s has %zu services (must be 1 to %d)\n", argv[1], kept,
+            SERVICES_DB_MAX_RECORDS);
+    return 1;
+  }
+
+  // String pool: offset 0 is the empty string shared by entries without a description
+  size_t strings_size = 1;
+  for (size_t i = 0; i < kept; i++)
+  {
+    strings_size += strlen(services[i].name) + 1;
+    if (services[i].description[0])
+      strings_size += strlen(services[i].description) + 1;
+  }
+
+  size_t records_offset = sizeof(services_db_header_t);
+  size_t index_offset = records_offset + kept * sizeof(services_db_record_t);
+  size_t strings_offset = index_offset + 2 * 65536 * sizeof(uint16_t);
+  size_t file_size = strings_offset + strings_size;
+
+  unsigned char *out = calloc(1, file_size);
+  if (!out)
+  {
+    fprintf(stderr, "Error: Out of memory\n");
+    return 1;
+  }
+
+  memcpy(out, SERVICES_DB_MAGIC, 8);
+  put_u32(out + 8, SERVICES_DB_VERSION);
+  put_u32(out + 12, SERVICES_DB_BYTE_ORDER);
+  put_u32(out + 16, (uint32_t)kept);
+  put_u32(out + 20, (uint32_t)records_offset);
+  put_u32(out + 24, (uint32_t)index_offset);
+  put_u32(out + 28, (uint32_t)strings_offset);
+  put_u32(out + 32, (uint32_t)strings_size);
+
+  size_t string_pos = 1;
+  for (size_t i = 0; i < kept; i++)
+  {
+    unsigned char *record = out + records_offset + i * sizeof(services_db_record_t);
+    put_u16(record, services[i].port);
+    record[2] = services[i].protocol;
+    put_u32(record + 4, services[i].frequency);
+
+    size_t len = strlen(services[i].name) + 1;
+    memcpy(out + strings_offset + string_pos, services[i].name, len);
+    put_u32(record + 8, (uint32_t)string_pos);
+    string_pos += len;
+
+    if (services[i].description[0])
+    {
+      len = strlen(services[i].description) + 1;
+      memcpy(out + strings_offset + string_pos, services[i].description, len);
+      put_u32(record + 12, (uint32_t)string_pos);
+      string_pos += len;
+    }
+
+    size_t table = services[i].protocol == SERVICE_PROTO_UDP ? 65536 : 0;
+    put_u16(out + index_offset + (table + services[i].port) * sizeof(uint16_t), (uint16_t)(i + 1));
+  }
+
+  FILE *output = fopen(argv[2], "wb");
+  if (!output || fwrite(out, 1, file_size, output) != file_size || fclose(output) != 0)
+  {
+    fprintf(stderr, "Error: Could not write %s\n", argv[2]);
+    return 1;
+  }
+
+  printf("Wrote %zu services (%zu duplicates dropped) to %s\n", kept, num_services - kept, argv[2]);
+  free(out);
+  return 0;
+}